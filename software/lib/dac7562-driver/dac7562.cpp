@@ -46,7 +46,7 @@ void DAC7562::begin() {
 }
 
 void DAC7562::send(uint8_t cmd, uint8_t addr, uint16_t data) {
-    uint32_t frame = (uint32_t(cmd) << 19) | (uint32_t(addr) << 16) | (data << 4);
+    uint32_t frame = DAC7562::frame(cmd, addr, data);
 
     uint8_t tx[3] = {
         uint8_t(frame >> 16),
@@ -87,6 +87,16 @@ void DAC7562::setBoth(float normalized) {
     setB(voltage);
 }
 
+void DAC7562::setCodeA(uint16_t code) {
+    if (code > 4095) code = 4095;
+    send(DAC_CMD_WRITE_UPDATE_N, DAC_ADDR_A, code);
+}
+
+void DAC7562::setCodeB(uint16_t code) {
+    if (code > 4095) code = 4095;
+    send(DAC_CMD_WRITE_UPDATE_N, DAC_ADDR_B, code);
+}
+
 void DAC7562::clear() {
     gpio_put(clr_pin_, 0);
     sleep_us(100);
@@ -30,9 +30,23 @@ public:
     void setA(float normalized);
     void setB(float normalized);
     void setBoth(float normalized);
+    // Raw 12-bit codes (0-4095), written and updated at once
+    void setCodeA(uint16_t code);
+    void setCodeB(uint16_t code);
     void clear();
     void update();
 
+    // 24-bit input shift register word, right aligned, as send() clocks it out
+    static uint32_t frame(uint8_t cmd, uint8_t addr, uint16_t data) {
+        return (uint32_t(cmd) << 19) | (uint32_t(addr) << 16) | (uint32_t(data & 0x0FFF) << 4);
+    }
+
+    // For DAC7562Stream, which takes these pins over while streaming
+    spi_inst_t* get_spi() const { return spi_; }
+    uint get_cs_pin() const { return cs_pin_; }
+    uint get_sck_pin() const { return sck_pin_; }
+    uint get_mosi_pin() const { return mosi_pin_; }
+
 private:
     void send(uint8_t cmd, uint8_t addr, uint16_t data);
 
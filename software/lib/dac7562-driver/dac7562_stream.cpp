@@ -0,0 +1,166 @@
+#include "dac7562_stream.h"
+#include "dac7562_stream.pio.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/pwm.h"
+#include "pico/stdlib.h"
+
+#define DAC_STREAM_COUNT_BITS 0x0FFFFFFFu   // TRANS_COUNT field; the mode sits above it
+
+DAC7562Stream::DAC7562Stream(DAC7562& dac, uint pace_pwm_slice)
+    : dac(dac), pace_slice(pace_pwm_slice), frames{}, frame_count(0), frames_per_sample(0),
+      restart_address(frames), pio(nullptr), sm(0), offset(0), dma_data(-1), dma_control(-1),
+      rate_hz(0), looping(false), started(false) {
+}
+
+DAC7562Stream::~DAC7562Stream() {
+    stop();
+}
+
+bool DAC7562Stream::load(const uint16_t* codes, uint32_t samples, DacStreamChannels channels) {
+    uint8_t per_sample = channels == DacStreamChannels::BOTH ? 2 : 1;
+    if (started || samples == 0 || samples > DAC_STREAM_MAX_FRAMES / per_sample ||
+        (channels != DacStreamChannels::A && channels != DacStreamChannels::B &&
+         channels != DacStreamChannels::BOTH)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < samples * per_sample; i++) {
+        if (codes[i] > 4095) {
+            return false;
+        }
+    }
+
+    // Left aligned for the PIO's MSB-first shift
+    for (uint32_t i = 0; i < samples; i++) {
+        if (channels == DacStreamChannels::BOTH) {
+            frames[2 * i] = DAC7562::frame(DAC_CMD_WRITE_INPUT_REG, DAC_ADDR_A, codes[2 * i]) << 8;
+            frames[2 * i + 1] = DAC7562::frame(DAC_CMD_WRITE_UPDATE_ALL, DAC_ADDR_B, codes[2 * i + 1]) << 8;
+        } else {
+            uint8_t addr = channels == DacStreamChannels::A ? DAC_ADDR_A : DAC_ADDR_B;
+            frames[i] = DAC7562::frame(DAC_CMD_WRITE_UPDATE_N, addr, codes[i]) << 8;
+        }
+    }
+    frame_count = samples * per_sample;
+    frames_per_sample = per_sample;
+    return true;
+}
+
+bool DAC7562Stream::start(uint32_t sample_rate_hz, bool loop) {
+    if (started || frame_count == 0 || sample_rate_hz == 0 ||
+        sample_rate_hz > DAC_STREAM_MAX_FRAME_RATE / frames_per_sample) {
+        return false;
+    }
+
+    // One DREQ per PWM wrap: period = div * (wrap + 1) system clocks, div 1-255
+    uint32_t sys_hz = clock_get_hz(clk_sys);
+    uint32_t frame_rate = sample_rate_hz * frames_per_sample;
+    uint32_t cycles = (sys_hz + frame_rate / 2) / frame_rate;
+    uint32_t div = (cycles + 65535) / 65536;
+    if (div == 0 || div > 255) {
+        return false;
+    }
+    uint32_t top = (cycles + div / 2) / div;
+
+    dma_data = dma_claim_unused_channel(false);
+    dma_control = dma_claim_unused_channel(false);
+    uint gpio_low = MIN(dac.get_mosi_pin(), MIN(dac.get_sck_pin(), dac.get_cs_pin()));
+    uint gpio_high = MAX(dac.get_mosi_pin(), MAX(dac.get_sck_pin(), dac.get_cs_pin()));
+    if (dma_data < 0 || dma_control < 0 ||
+        !pio_claim_free_sm_and_add_program_for_gpio_range(&dac7562_stream_program, &pio, &sm, &offset,
+                                                          gpio_low, gpio_high - gpio_low + 1, true)) {
+        pio = nullptr;
+        release();
+        return false;
+    }
+
+    // A setter's last frame has already left the SPI (spi_write_blocking waits for it)
+    float clkdiv = (float)sys_hz / (2.0f * DAC_STREAM_SCLK_HZ);
+    dac7562_stream_program_init(pio, sm, offset, dac.get_mosi_pin(), dac.get_sck_pin(), dac.get_cs_pin(),
+                                clkdiv < 1.0f ? 1.0f : clkdiv);
+
+    pwm_config pace = pwm_get_default_config();
+    pwm_config_set_clkdiv_int(&pace, div);
+    pwm_config_set_wrap(&pace, top - 1);
+    pwm_init(pace_slice, &pace, false);
+
+    dma_channel_config config = dma_channel_get_default_config(dma_data);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, pwm_get_dreq(pace_slice));
+    channel_config_set_chain_to(&config, loop ? dma_control : dma_data);  // Itself: no chaining
+    dma_channel_configure(dma_data, &config, &pio->txf[sm], frames, frame_count, false);
+
+    // Rewrites the data channel's read address through its trigger alias; the
+    // transfer count reloads from the value configured above
+    config = dma_channel_get_default_config(dma_control);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, false);
+    restart_address = frames;
+    dma_channel_configure(dma_control, &config, &dma_hw->ch[dma_data].al3_read_addr_trig,
+                          &restart_address, 1, false);
+
+    rate_hz = sys_hz / (div * top * frames_per_sample);
+    looping = loop;
+    started = true;
+    dma_channel_start(dma_data);
+    pwm_set_enabled(pace_slice, true);
+    return true;
+}
+
+void DAC7562Stream::stop() {
+    if (!started) {
+        return;
+    }
+    pwm_set_enabled(pace_slice, false);
+    // The control channel first, so a pass ending meanwhile cannot restart the data channel
+    dma_channel_abort(dma_control);
+    dma_channel_abort(dma_data);
+    dma_channel_abort(dma_control);
+
+    // Let the frames already in the FIFO finish, so SYNC ends high
+    uint32_t stall = 1u << (PIO_FDEBUG_TXSTALL_LSB + sm);
+    pio->fdebug = stall;
+    while (!(pio->fdebug & stall)) {
+        tight_loop_contents();
+    }
+    pio_sm_set_enabled(pio, sm, false);
+
+    // Back to begin()'s setup; SYNC is the SIO output, still driven high
+    gpio_set_function(dac.get_sck_pin(), GPIO_FUNC_SPI);
+    gpio_set_function(dac.get_mosi_pin(), GPIO_FUNC_SPI);
+    gpio_set_function(dac.get_cs_pin(), GPIO_FUNC_SIO);
+
+    release();
+    rate_hz = 0;
+    started = false;
+}
+
+void DAC7562Stream::release() {
+    if (pio != nullptr) {
+        pio_remove_program_and_unclaim_sm(&dac7562_stream_program, pio, sm, offset);
+        pio = nullptr;
+    }
+    int* channels[] = {&dma_data, &dma_control};
+    for (int* channel : channels) {
+        if (*channel >= 0) {
+            dma_channel_unclaim(*channel);
+            *channel = -1;
+        }
+    }
+}
+
+bool DAC7562Stream::is_running() const {
+    // A looping data channel is briefly idle while the control channel restarts it
+    return started && (looping || dma_channel_is_busy(dma_data));
+}
+
+uint32_t DAC7562Stream::get_position() const {
+    if (!started) {
+        return 0;
+    }
+    uint32_t remaining = dma_channel_hw_addr(dma_data)->transfer_count & DAC_STREAM_COUNT_BITS;
+    return (frame_count - remaining) / frames_per_sample;
+}
@@ -0,0 +1,72 @@
+#ifndef PICO_PLC_DAC7562_STREAM_H
+#define PICO_PLC_DAC7562_STREAM_H
+
+#include "dac7562.h"
+#include "hardware/pio.h"
+
+// Buffered DAC7562 output with no CPU per sample. load() formats the codes into 24-bit
+// frames once; start() hands SCLK, DIN and SYNC (CS) to a PIO state machine that clocks
+// out one frame per TX FIFO word with SYNC framed in hardware, and a DMA channel feeds
+// it the frames, paced by the wrap DREQ of a spare PWM slice (its pins stay free).
+// Looping restarts the buffer from a second, chained DMA channel.
+//
+// With both channels each sample is two frames: A to its input register, then B with
+// "write and update all", so both outputs change together on the second frame.
+//
+// Between start() and stop() the pins belong to the PIO: nothing may call the DAC7562
+// setters (ScanEngine, IoMap, ControlEngine). stop() hands them back to the SPI and the
+// outputs hold the last sample sent.
+#define DAC_STREAM_MAX_FRAMES 8192          // Frame buffer, 4 bytes each
+#define DAC_STREAM_SCLK_HZ 25000000         // PIO serial clock; the DAC7562 takes up to 50 MHz
+#define DAC_STREAM_MAX_FRAME_RATE 400000    // A frame takes about 1.2 us at 25 MHz
+
+enum class DacStreamChannels : uint8_t {
+    A = 1,
+    B = 2,
+    BOTH = 3            // A and B updated together
+};
+
+class DAC7562Stream {
+private:
+    DAC7562& dac;
+    uint pace_slice;
+
+    uint32_t frames[DAC_STREAM_MAX_FRAMES];
+    uint32_t frame_count;
+    uint8_t frames_per_sample;
+    const uint32_t* restart_address;    // Read by the control channel into the data channel
+
+    PIO pio;
+    uint sm;
+    uint offset;
+    int dma_data;
+    int dma_control;
+    uint32_t rate_hz;
+    bool looping;
+    bool started;
+
+    void release();
+
+public:
+    // pace_pwm_slice: a PWM slice not used for outputs, for its wrap DREQ
+    DAC7562Stream(DAC7562& dac, uint pace_pwm_slice);
+    ~DAC7562Stream();
+
+    // 12-bit codes, one per sample, or A, B pairs with BOTH; not while started
+    bool load(const uint16_t* codes, uint32_t samples, DacStreamChannels channels);
+    // Samples per second, from about 10 Hz up to DAC_STREAM_MAX_FRAME_RATE frames;
+    // one pass stops on the last sample, holding it until stop()
+    bool start(uint32_t sample_rate_hz, bool loop);
+    void stop();
+
+    bool is_started() const { return started; }
+    // False once a single pass has been sent
+    bool is_running() const;
+    // Sample being sent in the current pass
+    uint32_t get_position() const;
+    uint32_t get_samples() const { return frames_per_sample ? frame_count / frames_per_sample : 0; }
+    // Actual rate after the PWM divider rounding, 0 when stopped
+    uint32_t get_rate_hz() const { return rate_hz; }
+};
+
+#endif //PICO_PLC_DAC7562_STREAM_H
@@ -9,15 +9,20 @@ ModbusBase::ModbusBase(uart_inst_t* uart, uint baudrate, int de_pin, int re_pin,
 
     // UART handler class with RS485 transceiver control
     stream = std::make_unique<ModbusStream>(uart, baudrate, de_pin, re_pin, parity);
+    stream->set_diagnostics(&diagnostics);
     
     // callback for received frames (called from IRQ!)
     stream->on_frame_received([this](const modbus_frame_t& frame) {
+        this->diagnostics.count_function(frame.function_code);
+        if ((frame.function_code & 0x80) && frame.data_length >= 1) {
+            this->diagnostics.count_exception(frame.data[0]);  // Exception response from a slave
+        }
         this->handle_received_frame(frame);
     });
     
     // error callback for CRC failures
     stream->on_error_received([this](const modbus_frame_t& frame) {
-        this->diagnostic_counters.BUS_COMMUNICATION_ERROR_COUNT++;
+        this->diagnostics.increment(ModbusCounter::BUS_COMMUNICATION_ERROR);
     });
 }
 
@@ -53,8 +58,8 @@ void ModbusBase::process_tx_queue() {
 
         // Send the frame
         stream->write(&frame);
-        diagnostic_counters.BUS_MESSAGE_COUNT++;
-        MODBUS_DEBUG_PRINT("[DIAG] BUS_MESSAGE_COUNT incremented to %u\n", diagnostic_counters.BUS_MESSAGE_COUNT);
+        diagnostics.increment(ModbusCounter::BUS_MESSAGE);
+        MODBUS_DEBUG_PRINT("[DIAG] BUS_MESSAGE_COUNT incremented to %lu\n", (unsigned long)get_bus_message_count());
 
         if (frame.data) {
             free(frame.data);
@@ -62,6 +67,24 @@ void ModbusBase::process_tx_queue() {
     } else {
         mutex_exit(&tx_queue_mutex);
     }
+    
+    process_background();
+}
+
+void ModbusBase::send_frame(ModbusFrameWriter& writer) {
+    stream->write_prepared(writer.finish());
+    diagnostics.increment(ModbusCounter::BUS_MESSAGE);
+}
+
+void ModbusBase::send_frame_async(ModbusFrameWriter& writer) {
+    stream->write_prepared_async(writer.finish());
+    diagnostics.increment(ModbusCounter::BUS_MESSAGE);
+}
+
+void ModbusBase::enable_irq_framing() {
+    stream->enable_irq_framing([this](const modbus_frame_t& frame) {
+        return this->handle_received_frame_irq(frame);
+    });
 }
 
 void ModbusBase::on_debug(const std::function<void( const modbus_frame_t&)>& callback) {
@@ -8,14 +8,19 @@
 
 #include "md_stream.h"
 #include "md_common.h"
+#include "md_diagnostics.h"
 
 // Request context for matching responses
 struct pending_request_t {
     uint8_t address;
     uint8_t function_code;
     std::function<void(const modbus_frame_t&)> callback;
+    std::function<void()> timeout_callback;
     uint64_t timestamp_us;
     uint32_t timeout_ms;
+    uint64_t tx_start_us;
+    uint64_t tx_end_us;
+    uint16_t tx_length;
 };
 
 class ModbusBase {
@@ -35,19 +40,23 @@ private:
 
 protected:
     // Diagnostic counters accessible by derived classes
-    struct {
-        uint16_t BUS_MESSAGE_COUNT = 0;
-        uint16_t BUS_COMMUNICATION_ERROR_COUNT = 0;
-        uint16_t SLAVE_EXCEPTION_ERROR_COUNT = 0;
-        uint16_t SLAVE_MESSAGE_COUNT = 0;
-        uint16_t SLAVE_NO_RESPONSE_COUNT = 0;
-        uint16_t SLAVE_NAK_COUNT = 0;
-        uint16_t SLAVE_BUSY_COUNT = 0;
-        uint16_t BUS_CHARACTER_OVERRUN_COUNT = 0;
-    } diagnostic_counters;
+    ModbusDiagnostics diagnostics;
     
     std::unique_ptr<ModbusStream>& get_stream() { return stream; }
     
+    // Zero-copy TX: serialize straight into the stream's TX buffer, then send it
+    ModbusFrameWriter begin_frame(uint8_t address, uint8_t function_code) {
+        stream->wait_tx_idle();  // An IRQ reply may still be draining from the buffer
+        return ModbusFrameWriter(stream->get_tx_buffer(), address, function_code);
+    }
+    void send_frame(ModbusFrameWriter& writer);
+    // Returns after the first byte, for replies sent from interrupt context
+    void send_frame_async(ModbusFrameWriter& writer);
+    
+    // Detect frame ends in timer IRQ context and offer them to handle_received_frame_irq()
+    void enable_irq_framing();
+    bool is_frame_answered() const { return stream->is_frame_answered(); }
+    
     // Helper to invoke callbacks from derived classes
     void invoke_message_callback(const modbus_frame_t& frame) {
         if (message_callback) {
@@ -69,6 +78,14 @@ protected:
     
     // Virtual method for derived classes to handle received frames
     virtual void handle_received_frame(const modbus_frame_t& frame) = 0;
+    
+    // Called in timer IRQ context when IRQ framing is enabled. Return true if the
+    // frame needs no further processing; handle_received_frame() still sees it
+    // afterwards with is_frame_answered() set.
+    virtual bool handle_received_frame_irq(const modbus_frame_t& frame) { return false; }
+    
+    // Low-priority work, run at the end of every process_tx_queue()
+    virtual void process_background() {}
 
 public:
     ModbusBase(uart_inst_t* uart, uint baudrate, int de_pin = -1, int re_pin = -1, ModbusParity parity = ModbusParity::EVEN);
@@ -85,14 +102,16 @@ public:
     void on_message(const std::function<void(const modbus_frame_t &)> &callback);;
     
     // Diagnostic counter access
-    uint16_t get_bus_message_count() const { return diagnostic_counters.BUS_MESSAGE_COUNT; }
-    uint16_t get_bus_communication_error_count() const { return diagnostic_counters.BUS_COMMUNICATION_ERROR_COUNT; }
-    uint16_t get_slave_exception_error_count() const { return diagnostic_counters.SLAVE_EXCEPTION_ERROR_COUNT; }
-    uint16_t get_slave_message_count() const { return diagnostic_counters.SLAVE_MESSAGE_COUNT; }
-    uint16_t get_slave_no_response_count() const { return diagnostic_counters.SLAVE_NO_RESPONSE_COUNT; }
-    uint16_t get_slave_nak_count() const { return diagnostic_counters.SLAVE_NAK_COUNT; }
-    uint16_t get_slave_busy_count() const { return diagnostic_counters.SLAVE_BUSY_COUNT; }
-    uint16_t get_bus_character_overrun_count() const { return diagnostic_counters.BUS_CHARACTER_OVERRUN_COUNT; }
+    uint32_t get_bus_message_count() const { return diagnostics.get(ModbusCounter::BUS_MESSAGE); }
+    uint32_t get_bus_communication_error_count() const { return diagnostics.get(ModbusCounter::BUS_COMMUNICATION_ERROR); }
+    uint32_t get_slave_exception_error_count() const { return diagnostics.get(ModbusCounter::SLAVE_EXCEPTION_ERROR); }
+    uint32_t get_slave_message_count() const { return diagnostics.get(ModbusCounter::SLAVE_MESSAGE); }
+    uint32_t get_slave_no_response_count() const { return diagnostics.get(ModbusCounter::SLAVE_NO_RESPONSE); }
+    uint32_t get_slave_nak_count() const { return diagnostics.get(ModbusCounter::SLAVE_NAK); }
+    uint32_t get_slave_busy_count() const { return diagnostics.get(ModbusCounter::SLAVE_BUSY); }
+    uint32_t get_bus_character_overrun_count() const { return diagnostics.get(ModbusCounter::BUS_CHARACTER_OVERRUN); }
+    const ModbusDiagnostics& get_diagnostics() const { return diagnostics; }
+    void clear_diagnostics() { diagnostics.clear(); }
 };
 
 #endif //PICO_PLC_MD_BASE_H
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include "md_bitstore.h"
+#include <cstring>
+
+ModbusBitStore::ModbusBitStore() : values(nullptr), exists_mask(nullptr), size(0), word_count(0) {
+}
+
+void ModbusBitStore::init(uint32_t count) {
+    size = count;
+    // One spare word so extract()/deposit() never need a bounds check
+    word_count = (size + 31) / 32;
+    values = std::make_unique<uint32_t[]>(word_count + 1);
+    std::memset(values.get(), 0, (word_count + 1) * sizeof(uint32_t));
+    exists_mask.reset();
+}
+
+void ModbusBitStore::init(const std::map<uint16_t, bool>& initial) {
+    // std::map is ordered, so the last key is the highest address
+    init(initial.empty() ? 0 : (uint32_t)initial.rbegin()->first + 1);
+
+    // Only keep an exists mask when there are holes in the address range
+    if (initial.size() != size) {
+        exists_mask = std::make_unique<uint32_t[]>(word_count + 1);
+        std::memset(exists_mask.get(), 0, (word_count + 1) * sizeof(uint32_t));
+    }
+
+    for (const auto& pair : initial) {
+        if (exists_mask) {
+            exists_mask[pair.first >> 5] |= 1u << (pair.first & 31);
+        }
+        set(pair.first, pair.second);
+    }
+}
+
+uint32_t ModbusBitStore::extract(const uint32_t* words, uint32_t bit) {
+    uint32_t word = bit >> 5;
+    uint32_t shift = bit & 31;
+    uint32_t result = words[word] >> shift;
+    if (shift) {
+        result |= words[word + 1] << (32 - shift);
+    }
+    return result;
+}
+
+void ModbusBitStore::deposit(uint32_t* words, uint32_t bit, uint32_t bits, uint32_t value) {
+    uint32_t word = bit >> 5;
+    uint32_t shift = bit & 31;
+    uint32_t mask = low_mask(bits);
+    value &= mask;
+
+    words[word] = (words[word] & ~(mask << shift)) | (value << shift);
+    if (shift && shift + bits > 32) {
+        uint32_t spill = 32 - shift;
+        words[word + 1] = (words[word + 1] & ~(mask >> spill)) | (value >> spill);
+    }
+}
+
+bool ModbusBitStore::exists(uint16_t address) const {
+    if (address >= size) return false;
+    if (!exists_mask) return true;
+    return (exists_mask[address >> 5] >> (address & 31)) & 1u;
+}
+
+bool ModbusBitStore::exists_range(uint16_t start, uint16_t count) const {
+    if ((uint32_t)start + count > size) return false;
+    if (!exists_mask) return true;
+
+    // Compare the mask 32 addresses at a time
+    for (uint32_t done = 0; done < count; done += 32) {
+        uint32_t bits = count - done;
+        if (bits > 32) bits = 32;
+        uint32_t wanted = low_mask(bits);
+        if ((extract(exists_mask.get(), start + done) & wanted) != wanted) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ModbusBitStore::set(uint16_t address, bool value) {
+    uint32_t bit = 1u << (address & 31);
+    if (value) {
+        values[address >> 5] |= bit;
+    } else {
+        values[address >> 5] &= ~bit;
+    }
+}
+
+void ModbusBitStore::read_packed(uint16_t start, uint16_t count, uint8_t* out) const {
+    uint16_t byte_count = (count + 7) / 8;
+    uint16_t byte_index = 0;
+
+    for (uint32_t done = 0; done < count; done += 32) {
+        uint32_t chunk = extract(values.get(), start + done);
+        uint32_t bits = count - done;
+        if (bits < 32) {
+            chunk &= low_mask(bits);
+        }
+        // Little-endian byte order matches Modbus bit order
+        for (uint8_t b = 0; b < 4 && byte_index < byte_count; b++) {
+            out[byte_index++] = (chunk >> (b * 8)) & 0xFF;
+        }
+    }
+}
+
+void ModbusBitStore::write_packed(uint16_t start, uint16_t count, const uint8_t* in) {
+    uint16_t byte_count = (count + 7) / 8;
+    uint16_t byte_index = 0;
+
+    for (uint32_t done = 0; done < count; done += 32) {
+        uint32_t chunk = 0;
+        for (uint8_t b = 0; b < 4 && byte_index < byte_count; b++) {
+            chunk |= (uint32_t)in[byte_index++] << (b * 8);
+        }
+        uint32_t bits = count - done;
+        if (bits > 32) bits = 32;
+        deposit(values.get(), start + done, bits, chunk);
+    }
+}
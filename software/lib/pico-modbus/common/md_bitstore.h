@@ -0,0 +1,52 @@
+#ifndef PICO_PLC_MD_BITSTORE_H
+#define PICO_PLC_MD_BITSTORE_H
+
+#include "pico/stdlib.h"
+#include <memory>
+#include <map>
+
+// Dense bit storage for coils and discrete inputs.
+// Values are packed 32 per word; an optional "exists" mask marks which
+// addresses are valid when the address space is sparse.
+class ModbusBitStore {
+private:
+    std::unique_ptr<uint32_t[]> values;
+    std::unique_ptr<uint32_t[]> exists_mask;  // nullptr = every address below size exists
+    uint32_t size;
+    uint32_t word_count;
+
+    static uint32_t low_mask(uint32_t bits) { return bits >= 32 ? 0xFFFFFFFFu : ((1u << bits) - 1); }
+    // Read 32 bits starting at an arbitrary bit offset
+    static uint32_t extract(const uint32_t* words, uint32_t bit);
+    // Write the low "bits" bits of value at an arbitrary bit offset
+    static void deposit(uint32_t* words, uint32_t bit, uint32_t bits, uint32_t value);
+
+public:
+    ModbusBitStore();
+
+    // Dense store for addresses 0..count-1, all cleared
+    void init(uint32_t count);
+    // Sparse store built from address -> value pairs
+    void init(const std::map<uint16_t, bool>& initial);
+
+    uint32_t get_size() const { return size; }
+    bool is_sparse() const { return exists_mask != nullptr; }
+
+    bool exists(uint16_t address) const;
+    bool exists_range(uint16_t start, uint16_t count) const;
+
+    // Single-bit access, address must exist
+    bool get(uint16_t address) const { return (values[address >> 5] >> (address & 31)) & 1u; }
+    void set(uint16_t address, bool value);
+
+    // Modbus bit packing (LSB of first byte = start address), range must exist
+    void read_packed(uint16_t start, uint16_t count, uint8_t* out) const;
+    void write_packed(uint16_t start, uint16_t count, const uint8_t* in);
+
+    // Raw word access (bit n of word w = address w * 32 + n)
+    const uint32_t* get_words() const { return values.get(); }
+    uint32_t* get_words() { return values.get(); }
+    uint32_t get_word_count() const { return word_count; }
+};
+
+#endif //PICO_PLC_MD_BITSTORE_H
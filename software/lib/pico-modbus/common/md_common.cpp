@@ -2,18 +2,27 @@
 
 #include "md_stream.h"
 
+// CRC-16 lookup table, generated at compile time
+static constexpr std::array<uint16_t, 256> make_crc_table() {
+    std::array<uint16_t, 256> table = {};
+    for (uint16_t i = 0; i < 256; i++) {
+        uint16_t crc = i;
+        for (int j = 0; j < 8; j++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+// Kept in RAM so the per-byte lookup never waits on XIP flash
+const std::array<uint16_t, 256> __not_in_flash("modbus") modbus_crc_table = make_crc_table();
+
 /* calculate Modbus CRC-16 (polynomial 0xA001) */
 uint16_t calculate_crc(const uint8_t* data, const size_t length) {
     uint16_t crc = 0xFFFF;
     for (size_t i = 0; i < length; i++) {
-        crc ^= data[i];
-        for (int j = 0; j < 8; j++) {
-            if (crc & 1) {
-                crc = (crc >> 1) ^ 0xA001;
-            } else {
-                crc = crc >> 1;
-            }
-        }
+        crc = crc_update(crc, data[i]);
     }
     return crc;
 }
@@ -141,6 +150,17 @@ modbus_frame_t write_multiple_registers_request(uint8_t slave_addr, uint16_t sta
     return build_frame(slave_addr, enum_value(ModbusFunctionCode::WRITE_MULTIPLE_REGISTERS), data, 5 + byte_count);
 }
 
+modbus_frame_t mask_write_register_request(uint8_t slave_addr, uint16_t reg_addr, uint16_t and_mask, uint16_t or_mask) {
+    uint8_t* data = new uint8_t[6];
+    data[0] = (reg_addr >> 8) & 0xFF;
+    data[1] = reg_addr & 0xFF;
+    data[2] = (and_mask >> 8) & 0xFF;
+    data[3] = and_mask & 0xFF;
+    data[4] = (or_mask >> 8) & 0xFF;
+    data[5] = or_mask & 0xFF;
+    return build_frame(slave_addr, enum_value(ModbusFunctionCode::MASK_WRITE_REGISTER), data, 6);
+}
+
 // ===== RESPONSE BUILDERS (Slave -> Master) =====
 
 modbus_frame_t read_coils_response(uint8_t slave_addr, uint16_t count, const uint8_t* coil_bytes) {
@@ -212,6 +232,18 @@ modbus_frame_t write_multiple_registers_response(uint8_t slave_addr, uint16_t st
     return build_frame(slave_addr, enum_value(ModbusFunctionCode::WRITE_MULTIPLE_REGISTERS), data, 4);
 }
 
+modbus_frame_t mask_write_register_response(uint8_t slave_addr, uint16_t reg_addr, uint16_t and_mask, uint16_t or_mask) {
+    // Echo back the request
+    uint8_t* data = new uint8_t[6];
+    data[0] = (reg_addr >> 8) & 0xFF;
+    data[1] = reg_addr & 0xFF;
+    data[2] = (and_mask >> 8) & 0xFF;
+    data[3] = and_mask & 0xFF;
+    data[4] = (or_mask >> 8) & 0xFF;
+    data[5] = or_mask & 0xFF;
+    return build_frame(slave_addr, enum_value(ModbusFunctionCode::MASK_WRITE_REGISTER), data, 6);
+}
+
 // ===== EXCEPTION RESPONSE =====
 
 modbus_frame_t exception_response(uint8_t slave_addr, uint8_t function_code, ModbusExceptionCode exception_code) {
@@ -3,6 +3,7 @@
 
 #include "pico/stdlib.h"
 #include <type_traits>
+#include <array>
 
 // Uncomment the line below to enable debug messages globally
 // #define MODBUS_DEBUG
@@ -49,7 +50,8 @@ enum class ModbusFunctionCode : uint8_t {
     WRITE_SINGLE_REGISTER = 0x06,
     READ_DIAGNOSTICS = 0x08,
     WRITE_MULTIPLE_COILS = 0x0F,
-    WRITE_MULTIPLE_REGISTERS = 0x10
+    WRITE_MULTIPLE_REGISTERS = 0x10,
+    MASK_WRITE_REGISTER = 0x16
 };
 
 /* Exception codes */
@@ -60,6 +62,7 @@ enum class ModbusExceptionCode : uint8_t {
     SLAVE_DEVICE_FAILURE = 0x04,
     ACKNOWLEDGE = 0x05,
     SLAVE_DEVICE_BUSY = 0x06,
+    NEGATIVE_ACKNOWLEDGE = 0x07,
     MEMORY_PARITY_ERROR = 0x08,
     GATEWAY_PATH_UNAVAILABLE = 0x0A,
     GATEWAY_TARGET_RESPOND_FAILED = 0x0B
@@ -92,6 +95,64 @@ constexpr auto enum_value(T value){
 uint16_t calculate_crc(const uint8_t* data, size_t length);
 bool check_crc(const modbus_frame_t* frame);
 
+// Table-driven CRC-16 (polynomial 0xA001), one lookup per byte
+extern const std::array<uint16_t, 256> modbus_crc_table;
+
+inline uint16_t crc_update(uint16_t crc, uint8_t byte) {
+    return (crc >> 8) ^ modbus_crc_table[(crc ^ byte) & 0xFF];
+}
+
+// Serializes an RTU frame straight into a caller-owned buffer,
+// updating the CRC as each byte is written (no intermediate copies)
+class ModbusFrameWriter {
+private:
+    uint8_t* buffer;
+    uint16_t length;
+    uint16_t crc;
+
+public:
+    ModbusFrameWriter(uint8_t* buffer, uint8_t address, uint8_t function_code)
+        : buffer(buffer), length(0), crc(0xFFFF) {
+        put(address);
+        put(function_code);
+    }
+
+    void put(uint8_t byte) {
+        buffer[length++] = byte;
+        crc = crc_update(crc, byte);
+    }
+
+    // Big-endian, as used for all Modbus 16-bit fields
+    void put16(uint16_t value) {
+        put((value >> 8) & 0xFF);
+        put(value & 0xFF);
+    }
+
+    void put_bytes(const uint8_t* data, uint16_t count) {
+        for (uint16_t i = 0; i < count; i++) {
+            put(data[i]);
+        }
+    }
+
+    // In-place writes: fill tail() directly, then advance() over the bytes written
+    uint8_t* tail() { return &buffer[length]; }
+    void advance(uint16_t count) {
+        for (uint16_t i = 0; i < count; i++) {
+            crc = crc_update(crc, buffer[length++]);
+        }
+    }
+
+    // Appends the CRC (low byte first) and returns the total frame length
+    uint16_t finish() {
+        uint16_t final_crc = crc;
+        buffer[length++] = final_crc & 0xFF;
+        buffer[length++] = (final_crc >> 8) & 0xFF;
+        return length;
+    }
+
+    uint16_t get_length() const { return length; }
+};
+
 // Request builders (Master -> Slave)
 modbus_frame_t read_coils_request(uint8_t slave_addr, uint16_t start_addr, uint16_t count);
 modbus_frame_t read_discrete_inputs_request(uint8_t slave_addr, uint16_t start_addr, uint16_t count);
@@ -101,6 +162,7 @@ modbus_frame_t write_single_coil_request(uint8_t slave_addr, uint16_t coil_addr,
 modbus_frame_t write_single_register_request(uint8_t slave_addr, uint16_t reg_addr, uint16_t value);
 modbus_frame_t write_multiple_coils_request(uint8_t slave_addr, uint16_t start_addr, uint16_t count, const uint8_t* values);
 modbus_frame_t write_multiple_registers_request(uint8_t slave_addr, uint16_t start_addr, uint16_t count, const uint16_t* values);
+modbus_frame_t mask_write_register_request(uint8_t slave_addr, uint16_t reg_addr, uint16_t and_mask, uint16_t or_mask);
 
 // Response builders (Slave -> Master)
 modbus_frame_t read_coils_response(uint8_t slave_addr, uint16_t count, const uint8_t* coil_bytes);
@@ -110,6 +172,7 @@ modbus_frame_t write_single_coil_response(uint8_t slave_addr, uint16_t coil_addr
 modbus_frame_t write_single_register_response(uint8_t slave_addr, uint16_t reg_addr, uint16_t value);
 modbus_frame_t write_multiple_coils_response(uint8_t slave_addr, uint16_t start_addr, uint16_t count);
 modbus_frame_t write_multiple_registers_response(uint8_t slave_addr, uint16_t start_addr, uint16_t count);
+modbus_frame_t mask_write_register_response(uint8_t slave_addr, uint16_t reg_addr, uint16_t and_mask, uint16_t or_mask);
 
 // Exception response builder
 modbus_frame_t exception_response(uint8_t slave_addr, uint8_t function_code, ModbusExceptionCode exception_code);
@@ -0,0 +1,51 @@
+#include "md_diagnostics.h"
+
+ModbusDiagnostics::ModbusDiagnostics() {
+    clear();
+}
+
+uint32_t ModbusDiagnostics::get_flat(uint16_t index) const {
+    if (index < FUNCTION_BASE) {
+        return counters[index].load(std::memory_order_relaxed);
+    }
+    if (index < EXCEPTION_BASE) {
+        return function_codes[index - FUNCTION_BASE].load(std::memory_order_relaxed);
+    }
+    if (index < FLAT_COUNT) {
+        return exception_codes[index - EXCEPTION_BASE].load(std::memory_order_relaxed);
+    }
+    return 0;
+}
+
+bool ModbusDiagnostics::from_diagnostic_code(uint16_t sub_function, ModbusCounter& counter) {
+    if (sub_function < enum_value(ModbusDiagnosticCode::BUS_MESSAGE_COUNT) ||
+        sub_function > enum_value(ModbusDiagnosticCode::BUS_CHARACTER_OVERRUN_COUNT)) {
+        return false;
+    }
+    counter = static_cast<ModbusCounter>(sub_function - enum_value(ModbusDiagnosticCode::BUS_MESSAGE_COUNT));
+    return true;
+}
+
+bool ModbusDiagnostics::read_registers(uint16_t offset, uint16_t count, uint16_t* values) const {
+    if ((uint32_t)offset + count > REGISTER_COUNT) {
+        return false;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t reg = offset + i;
+        uint32_t value = get_flat(reg / 2);
+        values[i] = (reg & 1) ? (value & 0xFFFF) : (value >> 16);
+    }
+    return true;
+}
+
+void ModbusDiagnostics::clear() {
+    for (auto& counter : counters) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    for (auto& counter : function_codes) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    for (auto& counter : exception_codes) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+}
\ No newline at end of file
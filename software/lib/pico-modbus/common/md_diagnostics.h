@@ -0,0 +1,90 @@
+#ifndef PICO_PLC_MD_DIAGNOSTICS_H
+#define PICO_PLC_MD_DIAGNOSTICS_H
+
+#include "md_common.h"
+#include <atomic>
+
+// Event counters. Indices 0x0B-0x12 of FC08 map onto the first entries.
+enum class ModbusCounter : uint8_t {
+    BUS_MESSAGE = 0,          // FC08 0x0B
+    BUS_COMMUNICATION_ERROR,  // FC08 0x0C: CRC errors and short frames
+    SLAVE_EXCEPTION_ERROR,    // FC08 0x0D
+    SLAVE_MESSAGE,            // FC08 0x0E
+    SLAVE_NO_RESPONSE,        // FC08 0x0F
+    SLAVE_NAK,                // FC08 0x10
+    SLAVE_BUSY,               // FC08 0x11
+    BUS_CHARACTER_OVERRUN,    // FC08 0x12: UART overrun or frame longer than the RX buffer
+    UART_PARITY_ERROR,
+    UART_FRAMING_ERROR,
+    UART_BREAK,
+    CRC_ERROR,
+    SHORT_FRAME,
+    INTER_CHARACTER_TIMEOUT,  // T1.5 gap inside a frame
+    RX_FRAME_DROPPED,         // Completed frame lost, main loop too slow
+    COUNT
+};
+
+// Frames seen per function code (exception bit masked off) and per exception code
+#define MODBUS_DIAG_FUNCTION_CODES 128
+#define MODBUS_DIAG_EXCEPTION_CODES 16
+
+// Vendor FC08 sub-functions returning a full 32-bit counter (high word first):
+// base | ModbusCounter, base | function code, base | exception code
+#define MODBUS_DIAG_SUB_COUNTER 0x0100
+#define MODBUS_DIAG_SUB_FUNCTION 0x0200
+#define MODBUS_DIAG_SUB_EXCEPTION 0x0300
+
+// 32-bit counters updated with relaxed atomic increments, so the UART IRQ,
+// the frame alarm and the main loop on either core can count concurrently.
+//
+// All counters also form one flat list (counters, then function codes, then
+// exception codes) that read_registers() serializes as two registers per
+// counter, high word first.
+class ModbusDiagnostics {
+private:
+    std::atomic<uint32_t> counters[enum_value(ModbusCounter::COUNT)];
+    std::atomic<uint32_t> function_codes[MODBUS_DIAG_FUNCTION_CODES];
+    std::atomic<uint32_t> exception_codes[MODBUS_DIAG_EXCEPTION_CODES];
+
+public:
+    static constexpr uint16_t FUNCTION_BASE = enum_value(ModbusCounter::COUNT);
+    static constexpr uint16_t EXCEPTION_BASE = FUNCTION_BASE + MODBUS_DIAG_FUNCTION_CODES;
+    static constexpr uint16_t FLAT_COUNT = EXCEPTION_BASE + MODBUS_DIAG_EXCEPTION_CODES;
+    static constexpr uint16_t REGISTER_COUNT = FLAT_COUNT * 2;
+
+    ModbusDiagnostics();
+
+    void increment(ModbusCounter counter) {
+        counters[enum_value(counter)].fetch_add(1, std::memory_order_relaxed);
+    }
+    void count_function(uint8_t function_code) {
+        function_codes[function_code & 0x7F].fetch_add(1, std::memory_order_relaxed);
+    }
+    void count_exception(uint8_t exception_code) {
+        if (exception_code < MODBUS_DIAG_EXCEPTION_CODES) {
+            exception_codes[exception_code].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    uint32_t get(ModbusCounter counter) const {
+        return counters[enum_value(counter)].load(std::memory_order_relaxed);
+    }
+    uint32_t get_function_count(uint8_t function_code) const {
+        return function_codes[function_code & 0x7F].load(std::memory_order_relaxed);
+    }
+    uint32_t get_exception_count(uint8_t exception_code) const {
+        return exception_code < MODBUS_DIAG_EXCEPTION_CODES ? exception_codes[exception_code].load(std::memory_order_relaxed) : 0;
+    }
+    uint32_t get_flat(uint16_t index) const;
+
+    // FC08 sub-function 0x0B-0x12 -> counter, false for other codes
+    static bool from_diagnostic_code(uint16_t sub_function, ModbusCounter& counter);
+
+    // Registers [offset, offset + count) of the flat list
+    bool read_registers(uint16_t offset, uint16_t count, uint16_t* values) const;
+
+    void clear();
+    void clear(ModbusCounter counter) { counters[enum_value(counter)].store(0, std::memory_order_relaxed); }
+};
+
+#endif //PICO_PLC_MD_DIAGNOSTICS_H
\ No newline at end of file
@@ -0,0 +1,290 @@
+#include "md_gateway.h"
+#include <cstring>
+
+ModbusTcpGateway::ModbusTcpGateway(ModbusGatewayLink& link, const clock_function_t& clock, uint32_t timeout_ms)
+    : ModbusTcpServer(), link(link), clock(clock), timeout_ms(timeout_ms),
+      transactions{}, in_flight(nullptr), next_sequence(0), next_tag(0), next_client(0), gateway_stats{} {
+    for (int unit_id = 0; unit_id < 256; unit_id++) {
+        routes[unit_id] = (unit_id >= 1 && unit_id <= 247) ? unit_id : MODBUS_GATEWAY_NO_ROUTE;
+    }
+}
+
+bool ModbusTcpGateway::map_unit(uint8_t unit_id, uint8_t rtu_address) {
+    // RTU broadcast is not routed, it has no reply to return
+    if (rtu_address < 1 || rtu_address > 247) {
+        return false;
+    }
+    routes[unit_id] = rtu_address;
+    return true;
+}
+
+bool ModbusTcpGateway::is_read(uint8_t function_code) {
+    return function_code >= 0x01 && function_code <= 0x04;
+}
+
+bool ModbusTcpGateway::waits_on(int client, const transaction_t& transaction) const {
+    for (uint8_t i = 0; transaction.used && i < transaction.waiter_count; i++) {
+        if (transaction.waiters[i].client == client) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// A read may only join a transaction that runs no earlier than the client's newest
+// pending request: joining an older one would answer it ahead of, and with data from
+// before, a write or read the client sent first
+ModbusTcpGateway::transaction_t* ModbusTcpGateway::find_duplicate(int client, uint8_t address,
+                                                                  const uint8_t* pdu, uint16_t length) {
+    const transaction_t* newest = nullptr;
+    for (const transaction_t& t : transactions) {
+        if (waits_on(client, t) && (newest == nullptr || (int32_t)(t.sequence - newest->sequence) > 0)) {
+            newest = &t;
+        }
+    }
+    for (transaction_t& t : transactions) {
+        if (t.used && t.address == address && t.pdu_length == length &&
+            t.waiter_count < MODBUS_GATEWAY_MAX_WAITERS && memcmp(t.pdu, pdu, length) == 0 &&
+            (newest == nullptr || (int32_t)(t.sequence - newest->sequence) >= 0)) {
+            return &t;
+        }
+    }
+    return nullptr;
+}
+
+// True while one of the transaction's requesters still waits on an earlier transaction,
+// which keeps every client's requests on the bus in the order it sent them
+bool ModbusTcpGateway::waits_on_earlier(const transaction_t& transaction) const {
+    for (const transaction_t& t : transactions) {
+        if (!t.used || &t == &transaction || (int32_t)(t.sequence - transaction.sequence) >= 0) {
+            continue;
+        }
+        for (uint8_t i = 0; i < transaction.waiter_count; i++) {
+            if (waits_on(transaction.waiters[i].client, t)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+ModbusTcpGateway::transaction_t* ModbusTcpGateway::allocate() {
+    for (transaction_t& t : transactions) {
+        if (!t.used) {
+            return &t;
+        }
+    }
+    return nullptr;
+}
+
+uint8_t ModbusTcpGateway::queued_count(int client) const {
+    uint8_t count = 0;
+    for (const transaction_t& t : transactions) {
+        if (t.used && !t.in_flight && t.owner == client) {
+            count++;
+        }
+    }
+    return count;
+}
+
+uint8_t ModbusTcpGateway::owed_count(int client) const {
+    uint8_t count = 0;
+    for (const transaction_t& t : transactions) {
+        for (uint8_t i = 0; t.used && i < t.waiter_count; i++) {
+            if (t.waiters[i].client == client) {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+uint8_t ModbusTcpGateway::get_pending_count() const {
+    uint8_t count = 0;
+    for (const transaction_t& t : transactions) {
+        if (t.used) {
+            count++;
+        }
+    }
+    return count;
+}
+
+bool ModbusTcpGateway::can_accept(int client) {
+    // Every reply owed to the client keeps a full ADU of its send space, so a queued
+    // or coalesced request is never answered into a full buffer
+    if (get_send_space(client) < (owed_count(client) + 1) * MODBUS_TCP_MAX_ADU_SIZE) {
+        return false;
+    }
+    // A full queue holds requests back in the client's TCP window instead of refusing them
+    for (const transaction_t& t : transactions) {
+        if (!t.used) {
+            return queued_count(client) < MODBUS_GATEWAY_CLIENT_SHARE;
+        }
+    }
+    return false;
+}
+
+void ModbusTcpGateway::send_exception(int client, uint16_t transaction_id, uint8_t unit_id,
+                                      uint8_t function_code, uint8_t exception_code) {
+    uint8_t reply[3] = { unit_id, (uint8_t)(function_code | 0x80), exception_code };
+    send_response(client, transaction_id, reply, sizeof(reply));
+}
+
+bool ModbusTcpGateway::handle_request(int client, uint16_t transaction_id, uint8_t unit_id,
+                                      const uint8_t* pdu, uint16_t length) {
+    uint8_t address = routes[unit_id];
+    if (address == MODBUS_GATEWAY_NO_ROUTE) {
+        gateway_stats.unrouted++;
+        send_exception(client, transaction_id, unit_id, pdu[0], EXCEPTION_PATH_UNAVAILABLE);
+        return true;
+    }
+
+    waiter_t waiter = { (uint8_t)client, unit_id, transaction_id, clock() };
+
+    // Identical reads already queued or on the bus share its reply; writes always run
+    if (is_read(pdu[0])) {
+        transaction_t* duplicate = find_duplicate(client, address, pdu, length);
+        if (duplicate != nullptr) {
+            duplicate->waiters[duplicate->waiter_count++] = waiter;
+            gateway_stats.deduplicated++;
+            return true;
+        }
+    }
+
+    transaction_t* t = allocate();
+    if (t == nullptr) {
+        send_exception(client, transaction_id, unit_id, pdu[0], EXCEPTION_DEVICE_BUSY);
+        return true;
+    }
+    t->used = true;
+    t->in_flight = false;
+    t->owner = client;
+    t->address = address;
+    t->sequence = next_sequence++;
+    t->pdu_length = length;
+    memcpy(t->pdu, pdu, length);
+    t->waiters[0] = waiter;
+    t->waiter_count = 1;
+
+    start_next();
+    return true;
+}
+
+void ModbusTcpGateway::start_next() {
+    if (in_flight != nullptr) {
+        return;
+    }
+
+    // Round-robin over clients, oldest request first within each client. The globally
+    // oldest transaction never waits on an earlier one, so the queue always drains.
+    for (uint8_t i = 0; i < MODBUS_TCP_MAX_CLIENTS; i++) {
+        uint8_t client = (next_client + i) % MODBUS_TCP_MAX_CLIENTS;
+        transaction_t* oldest = nullptr;
+        for (transaction_t& t : transactions) {
+            if (t.used && !t.in_flight && t.owner == client &&
+                (oldest == nullptr || (int32_t)(t.sequence - oldest->sequence) < 0)) {
+                oldest = &t;
+            }
+        }
+        if (oldest == nullptr || waits_on_earlier(*oldest)) {
+            continue;
+        }
+
+        oldest->tag = ++next_tag;
+        if (!link.forward(oldest->tag, oldest->address, oldest->pdu, oldest->pdu_length, timeout_ms)) {
+            return;  // Bus busy, retried from process()
+        }
+        oldest->in_flight = true;
+        oldest->started_us = clock();
+        in_flight = oldest;
+        next_client = (client + 1) % MODBUS_TCP_MAX_CLIENTS;
+        gateway_stats.forwarded++;
+        return;
+    }
+}
+
+void ModbusTcpGateway::reply_all(transaction_t& transaction, const uint8_t* pdu, uint16_t length) {
+    uint8_t reply[MODBUS_TCP_MAX_PDU_SIZE + 1];
+    if (length > MODBUS_TCP_MAX_PDU_SIZE) {
+        length = MODBUS_TCP_MAX_PDU_SIZE;
+    }
+    memcpy(&reply[1], pdu, length);
+
+    uint64_t now = clock();
+    uint32_t failed = 0;  // Client mask
+    for (uint8_t i = 0; i < transaction.waiter_count; i++) {
+        const waiter_t& waiter = transaction.waiters[i];
+        reply[0] = waiter.unit_id;  // Each requester gets its own unit ID back
+        if (send_response(waiter.client, waiter.transaction_id, reply, length + 1)) {
+            gateway_stats.latency.add((uint32_t)(now - waiter.received_us));
+        } else {
+            gateway_stats.dropped++;
+            failed |= 1u << waiter.client;
+        }
+    }
+
+    transaction.used = false;
+    transaction.in_flight = false;
+    transaction.waiter_count = 0;
+    if (in_flight == &transaction) {
+        in_flight = nullptr;
+    }
+
+    // Send space is reserved, so this is a transport failure. A client missing a reply
+    // is dropped, so it retries at once instead of waiting out its own timeout.
+    for (int client = 0; client < MODBUS_TCP_MAX_CLIENTS; client++) {
+        if (failed & (1u << client)) {
+            drop_client(client);
+        }
+    }
+}
+
+void ModbusTcpGateway::complete(uint32_t tag, const uint8_t* pdu, uint16_t length) {
+    // A late reply for a transaction the watchdog already ended is dropped
+    if (in_flight == nullptr || in_flight->tag != tag || length < 1) {
+        return;
+    }
+    // The next transaction is started from process(): the link may still be busy with this one
+    reply_all(*in_flight, pdu, length);
+}
+
+void ModbusTcpGateway::fail(uint32_t tag, uint8_t exception_code) {
+    if (in_flight == nullptr || in_flight->tag != tag) {
+        return;
+    }
+    uint8_t pdu[2] = { (uint8_t)(in_flight->pdu[0] | 0x80), exception_code };
+    if (exception_code == EXCEPTION_TARGET_FAILED) {
+        gateway_stats.timeouts++;
+    }
+    reply_all(*in_flight, pdu, sizeof(pdu));
+}
+
+void ModbusTcpGateway::process() {
+    // Watchdog at twice the bus timeout, in case the link never reports back
+    if (in_flight != nullptr && clock() - in_flight->started_us > (uint64_t)timeout_ms * 2000) {
+        fail(in_flight->tag, EXCEPTION_TARGET_FAILED);
+    }
+    start_next();
+}
+
+void ModbusTcpGateway::close_client(int client) {
+    // Forget the client's requests; queued transactions nobody waits for are dropped
+    for (transaction_t& t : transactions) {
+        if (!t.used) {
+            continue;
+        }
+        uint8_t kept = 0;
+        for (uint8_t i = 0; i < t.waiter_count; i++) {
+            if (t.waiters[i].client != client) {
+                t.waiters[kept++] = t.waiters[i];
+            }
+        }
+        t.waiter_count = kept;
+        if (kept == 0 && !t.in_flight) {
+            t.used = false;
+        } else if (t.owner == client && kept > 0) {
+            t.owner = t.waiters[0].client;
+        }
+    }
+    ModbusTcpServer::close_client(client);
+}
@@ -0,0 +1,117 @@
+#ifndef PICO_PLC_MD_GATEWAY_H
+#define PICO_PLC_MD_GATEWAY_H
+
+#include "md_tcp.h"
+#include "md_histogram.h"
+
+// Modbus TCP -> RTU gateway core: queues requests from all TCP clients, runs them
+// one at a time on the downstream bus and routes each reply back. Like md_tcp it is
+// free of Pico SDK headers; the bus is a ModbusGatewayLink (md_gateway_link.h for
+// ModbusMaster, or a simulated bus on a host).
+
+#define MODBUS_GATEWAY_MAX_PENDING 16       // Queued + in-flight bus transactions
+#define MODBUS_GATEWAY_MAX_WAITERS 8        // TCP requests answered by one transaction
+#define MODBUS_GATEWAY_CLIENT_SHARE 4       // Queued transactions per client before backpressure
+#define MODBUS_GATEWAY_TIMEOUT_MS 1000
+#define MODBUS_GATEWAY_NO_ROUTE 0           // Route table entry for "no RTU address"
+
+// Downstream bus, one transaction at a time
+class ModbusGatewayLink {
+public:
+    virtual ~ModbusGatewayLink() = default;
+
+    // Start a transaction; report its end with ModbusTcpGateway::complete() or fail()
+    // and the same tag. False if the bus cannot take it yet (retried by process()).
+    virtual bool forward(uint32_t tag, uint8_t address, const uint8_t* pdu, uint16_t length, uint32_t timeout_ms) = 0;
+};
+
+struct modbus_gateway_stats_t {
+    uint32_t forwarded;             // Bus transactions started
+    uint32_t deduplicated;          // Reads answered by another request's transaction
+    uint32_t timeouts;              // Transactions ended by the watchdog or the link
+    uint32_t unrouted;              // Unit IDs without an RTU address
+    uint32_t dropped;               // Replies that could not be sent, client dropped
+    latency_histogram_t latency;    // TCP request -> reply sent
+};
+
+class ModbusTcpGateway : public ModbusTcpServer {
+public:
+    typedef std::function<uint64_t()> clock_function_t;  // Microseconds
+
+private:
+    struct waiter_t {
+        uint8_t client;
+        uint8_t unit_id;
+        uint16_t transaction_id;
+        uint64_t received_us;
+    };
+
+    struct transaction_t {
+        bool used;
+        bool in_flight;
+        uint8_t owner;           // Client whose queue it is on (fairness)
+        uint8_t address;
+        uint8_t waiter_count;
+        uint16_t pdu_length;
+        uint32_t sequence;       // Arrival order, across all clients
+        uint32_t tag;
+        uint64_t started_us;
+        waiter_t waiters[MODBUS_GATEWAY_MAX_WAITERS];
+        uint8_t pdu[MODBUS_TCP_MAX_PDU_SIZE];
+    };
+
+    ModbusGatewayLink& link;
+    clock_function_t clock;
+    uint32_t timeout_ms;
+
+    uint8_t routes[256];                 // TCP unit ID -> RTU address
+    transaction_t transactions[MODBUS_GATEWAY_MAX_PENDING];
+    transaction_t* in_flight;
+    uint32_t next_sequence;
+    uint32_t next_tag;
+    uint8_t next_client;                 // Round-robin position
+    modbus_gateway_stats_t gateway_stats;
+
+    // Exception codes the gateway answers with itself
+    static constexpr uint8_t EXCEPTION_DEVICE_BUSY = 0x06;
+    static constexpr uint8_t EXCEPTION_PATH_UNAVAILABLE = 0x0A;
+    static constexpr uint8_t EXCEPTION_TARGET_FAILED = 0x0B;
+
+    static bool is_read(uint8_t function_code);
+    bool waits_on(int client, const transaction_t& transaction) const;
+    transaction_t* find_duplicate(int client, uint8_t address, const uint8_t* pdu, uint16_t length);
+    bool waits_on_earlier(const transaction_t& transaction) const;
+    transaction_t* allocate();
+    uint8_t queued_count(int client) const;
+    uint8_t owed_count(int client) const;
+    void start_next();
+    void reply_all(transaction_t& transaction, const uint8_t* pdu, uint16_t length);
+    void send_exception(int client, uint16_t transaction_id, uint8_t unit_id, uint8_t function_code, uint8_t exception_code);
+
+protected:
+    bool handle_request(int client, uint16_t transaction_id, uint8_t unit_id,
+                        const uint8_t* pdu, uint16_t length) override;
+    bool can_accept(int client) override;
+
+public:
+    ModbusTcpGateway(ModbusGatewayLink& link, const clock_function_t& clock, uint32_t timeout_ms = MODBUS_GATEWAY_TIMEOUT_MS);
+
+    // Unit IDs 1-247 map to the same RTU address by default, 0 and 248-255 to nothing
+    bool map_unit(uint8_t unit_id, uint8_t rtu_address);
+    void unmap_unit(uint8_t unit_id) { routes[unit_id] = MODBUS_GATEWAY_NO_ROUTE; }
+
+    // Bus transaction finished: response PDU (function code first), or an exception code
+    void complete(uint32_t tag, const uint8_t* pdu, uint16_t length);
+    void fail(uint32_t tag, uint8_t exception_code);
+
+    // Watchdog and queue service; call from the main loop
+    void process();
+
+    void close_client(int client) override;
+
+    uint8_t get_pending_count() const;
+    const modbus_gateway_stats_t& get_gateway_stats() const { return gateway_stats; }
+    void reset_gateway_stats() { gateway_stats = {}; }
+};
+
+#endif //PICO_PLC_MD_GATEWAY_H
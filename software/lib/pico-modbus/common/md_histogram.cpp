@@ -0,0 +1,40 @@
+#include "md_histogram.h"
+#include <cstdio>
+#include <cstring>
+
+void latency_histogram_t::add(uint32_t us) {
+    uint8_t bucket = 0;
+    while (bucket < MODBUS_HIST_BUCKETS - 1 && us >= bucket_limit_us(bucket)) {
+        bucket++;
+    }
+    buckets[bucket]++;
+
+    if (count == 0 || us < min_us) min_us = us;
+    if (us > max_us) max_us = us;
+    count++;
+    sum_us += us;
+}
+
+void latency_histogram_t::clear() {
+    memset(this, 0, sizeof(*this));
+}
+
+uint32_t latency_histogram_t::percentile_us(uint8_t percent) const {
+    if (count == 0) return 0;
+
+    uint64_t target = ((uint64_t)count * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (uint8_t i = 0; i < MODBUS_HIST_BUCKETS - 1; i++) {
+        seen += buckets[i];
+        if (seen >= target) {
+            return bucket_limit_us(i);
+        }
+    }
+    return max_us;
+}
+
+void latency_histogram_t::print(const char* name) const {
+    printf("  %-10s n=%lu min=%lu avg=%lu p50<%lu p99<%lu max=%lu us\n", name,
+           (unsigned long)count, (unsigned long)min_us, (unsigned long)average_us(),
+           (unsigned long)percentile_us(50), (unsigned long)percentile_us(99), (unsigned long)max_us);
+}
@@ -0,0 +1,28 @@
+#ifndef PICO_PLC_MD_HISTOGRAM_H
+#define PICO_PLC_MD_HISTOGRAM_H
+
+#include <cstdint>
+
+// Histogram layout: bucket i counts samples below (MODBUS_HIST_BASE_US << i),
+// the last bucket collects everything above that
+#define MODBUS_HIST_BUCKETS 16
+#define MODBUS_HIST_BASE_US 64
+
+struct latency_histogram_t {
+    uint32_t buckets[MODBUS_HIST_BUCKETS];
+    uint32_t count;
+    uint64_t sum_us;
+    uint32_t min_us;
+    uint32_t max_us;
+
+    void add(uint32_t us);
+    void clear();
+    uint32_t average_us() const { return count ? (uint32_t)(sum_us / count) : 0; }
+    // Upper bound of the bucket that holds the given percentile (0-100)
+    uint32_t percentile_us(uint8_t percent) const;
+    static uint32_t bucket_limit_us(uint8_t bucket) { return MODBUS_HIST_BASE_US << bucket; }
+    // One summary line on stdout, for the dump functions
+    void print(const char* name) const;
+};
+
+#endif //PICO_PLC_MD_HISTOGRAM_H
\ No newline at end of file
@@ -0,0 +1,41 @@
+#include "md_image.h"
+#include <cstring>
+
+ModbusProcessImage::ModbusProcessImage()
+    : buffers(nullptr), size(0), writer_index(0), reader_index(1), middle(2) {
+}
+
+uint32_t ModbusProcessImage::allocate(uint32_t count) {
+    uint32_t offset = size;
+    uint32_t new_size = size + count;
+
+    // Grow all three copies, keeping the current contents of each
+    std::unique_ptr<uint16_t[]> grown = std::make_unique<uint16_t[]>(3 * new_size);
+    std::memset(grown.get(), 0, 3 * new_size * sizeof(uint16_t));
+    for (uint8_t i = 0; i < 3; i++) {
+        if (size > 0) {
+            std::memcpy(&grown[i * new_size], &buffers[i * size], size * sizeof(uint16_t));
+        }
+    }
+
+    buffers = std::move(grown);
+    size = new_size;
+    return offset;
+}
+
+void ModbusProcessImage::commit() {
+    uint8_t published = writer_index;
+
+    // Hand the finished copy over and take back whichever buffer is free
+    writer_index = middle.exchange(published | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+
+    // Continue the next scan from the values just published. The reader may be
+    // looking at "published" too, but only reads it, so copying from it is safe.
+    std::memcpy(&buffers[writer_index * size], &buffers[published * size], size * sizeof(uint16_t));
+}
+
+void ModbusProcessImage::acquire() {
+    if (middle.load(std::memory_order_relaxed) & FRESH) {
+        reader_index = middle.exchange(reader_index, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+}
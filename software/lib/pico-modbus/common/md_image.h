@@ -0,0 +1,46 @@
+#ifndef PICO_PLC_MD_IMAGE_H
+#define PICO_PLC_MD_IMAGE_H
+
+#include "pico/stdlib.h"
+#include <atomic>
+#include <memory>
+
+// Triple-buffered process image shared by the application and Modbus.
+//
+// The application (writer) updates its private copy freely and publishes the
+// whole scan with commit(). Modbus (reader) calls acquire() once per request
+// and then sees one consistent, committed snapshot until the next acquire().
+// Both sides only ever swap buffer indices with a single atomic exchange, so
+// neither can block the other, even when they run on different cores.
+class ModbusProcessImage {
+private:
+    static constexpr uint8_t INDEX_MASK = 0x03;
+    static constexpr uint8_t FRESH = 0x04;  // Set when the middle buffer holds an unread commit
+
+    std::unique_ptr<uint16_t[]> buffers;  // 3 copies of "size" words
+    uint32_t size;
+
+    uint8_t writer_index;
+    uint8_t reader_index;
+    std::atomic<uint8_t> middle;
+
+public:
+    ModbusProcessImage();
+
+    // Reserve "count" words and return their offset. Setup only: must not be
+    // called once the reader and writer are running.
+    uint32_t allocate(uint32_t count);
+
+    uint32_t get_size() const { return size; }
+    bool empty() const { return size == 0; }
+
+    // Writer side: private working copy, published by commit()
+    uint16_t* write_view() { return &buffers[writer_index * size]; }
+    void commit();
+
+    // Reader side: pick up the latest commit (if any), then read read_view()
+    void acquire();
+    const uint16_t* read_view() const { return &buffers[reader_index * size]; }
+};
+
+#endif //PICO_PLC_MD_IMAGE_H
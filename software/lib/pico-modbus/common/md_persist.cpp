@@ -0,0 +1,315 @@
+#include "md_persist.h"
+#include "md_common.h"
+#include "pico-utils/flash_utils.h"
+#include <cstddef>
+#include <cstring>
+
+ModbusPersistentStore::ModbusPersistentStore()
+    : register_count(0), flash_offset(0), sector_count(0), active_sector(-1), active_sequence(0),
+      write_slot(1), dirty_pending(false), first_dirty_us(0), last_dirty_us(0), flush_delay_us(0),
+      records_written(0), sectors_erased(0), write_errors(0) {
+}
+
+bool ModbusPersistentStore::init(uint32_t offset, uint8_t count, uint32_t flush_delay_ms) {
+    if (offset % FLASH_SECTOR_SIZE != 0 || count < 2 ||
+        offset + (uint32_t)count * FLASH_SECTOR_SIZE > PICO_FLASH_SIZE_BYTES) {
+        return false;
+    }
+    flash_offset = offset;
+    sector_count = count;
+    flush_delay_us = flush_delay_ms * 1000;
+    find_active_sector();
+    return true;
+}
+
+const uint8_t* ModbusPersistentStore::sector_data(uint8_t sector) const {
+    return reinterpret_cast<const uint8_t*>(XIP_BASE + sector_offset(sector));
+}
+
+bool ModbusPersistentStore::is_erased(const uint8_t* slot) {
+    uint32_t words[2];
+    memcpy(words, slot, sizeof(words));
+    return words[0] == 0xFFFFFFFF && words[1] == 0xFFFFFFFF;
+}
+
+ModbusPersistentStore::record_t ModbusPersistentStore::make_record(uint8_t unit, uint16_t address, uint16_t value) {
+    record_t record;
+    record.address = address;
+    record.value = value;
+    record.unit = unit;
+    record.reserved = 0;
+    record.crc = calculate_crc(reinterpret_cast<const uint8_t*>(&record), offsetof(record_t, crc));
+    return record;
+}
+
+bool ModbusPersistentStore::record_valid(const record_t& record) {
+    return record.reserved == 0 &&
+           record.crc == calculate_crc(reinterpret_cast<const uint8_t*>(&record), offsetof(record_t, crc));
+}
+
+void ModbusPersistentStore::find_active_sector() {
+    // Newest sector whose copy was completed
+    active_sector = -1;
+    for (uint8_t sector = 0; sector < sector_count; sector++) {
+        sector_header_t header;
+        memcpy(&header, sector_data(sector), sizeof(header));
+        if (header.magic != MAGIC || header.state != STATE_COMMITTED) {
+            continue;
+        }
+        if (active_sector < 0 || is_newer(header.sequence, active_sequence)) {
+            active_sector = sector;
+            active_sequence = header.sequence;
+        }
+    }
+
+    // Append after the last used slot
+    write_slot = 1;
+    if (active_sector >= 0) {
+        const uint8_t* data = sector_data(active_sector);
+        for (uint32_t slot = SLOTS_PER_SECTOR - 1; slot > 0; slot--) {
+            if (!is_erased(data + slot * SLOT_SIZE)) {
+                write_slot = slot + 1;
+                break;
+            }
+        }
+    }
+}
+
+bool ModbusPersistentStore::add_range(uint8_t unit, uint16_t start, uint16_t count, uint16_t* values) {
+    // Leave room so a full copy always fits in a fresh sector with space to append
+    if (count == 0 || values == nullptr || register_count + count > (SLOTS_PER_SECTOR - 1) / 2) {
+        return false;
+    }
+    uint32_t end = (uint32_t)start + count;
+    for (const range_t& range : ranges) {
+        if (range.unit == unit && start < range.start + range.count && range.start < end) {
+            return false;
+        }
+    }
+
+    range_t range;
+    range.unit = unit;
+    range.start = start;
+    range.count = count;
+    range.values = values;
+    range.stored = std::make_unique<uint16_t[]>(count);
+    memcpy(range.stored.get(), values, count * sizeof(uint16_t));
+    ranges.push_back(std::move(range));
+    register_count += count;
+    snapshot.resize(register_count);  // flush() allocates nothing
+    return true;
+}
+
+ModbusPersistentStore::range_t* ModbusPersistentStore::find_range(uint8_t unit, uint16_t address) {
+    for (range_t& range : ranges) {
+        if (range.unit == unit && address >= range.start && address < range.start + range.count) {
+            return &range;
+        }
+    }
+    return nullptr;
+}
+
+uint32_t ModbusPersistentStore::restore() {
+    if (active_sector < 0) {
+        return 0;
+    }
+
+    // Records are in write order, so later ones simply overwrite earlier ones
+    uint32_t applied = 0;
+    const uint8_t* data = sector_data(active_sector);
+    for (uint32_t slot = 1; slot < write_slot; slot++) {
+        record_t record;
+        memcpy(&record, data + slot * SLOT_SIZE, sizeof(record));
+        if (!record_valid(record)) {
+            continue;  // Torn write
+        }
+        range_t* range = find_range(record.unit, record.address);
+        if (range == nullptr) {
+            continue;  // No longer persistent
+        }
+        uint16_t index = record.address - range->start;
+        range->values[index] = record.value;
+        range->stored[index] = record.value;
+        applied++;
+    }
+    return applied;
+}
+
+void ModbusPersistentStore::mark_dirty(uint8_t unit, uint16_t start, uint16_t count, uint64_t now_us) {
+    uint32_t end = (uint32_t)start + count;
+    for (const range_t& range : ranges) {
+        if (range.unit == unit && start < range.start + range.count && range.start < end) {
+            if (!dirty_pending) {
+                dirty_pending = true;
+                first_dirty_us = now_us;
+            }
+            last_dirty_us = now_us;
+            return;
+        }
+    }
+}
+
+bool ModbusPersistentStore::service(uint64_t now_us) {
+    if (!dirty_pending || !is_enabled()) {
+        return false;
+    }
+    if (now_us - last_dirty_us < flush_delay_us &&
+        now_us - first_dirty_us < (uint64_t)flush_delay_us * MAX_DELAY_FACTOR) {
+        return false;
+    }
+    if (!flush()) {
+        // Retry after another delay
+        first_dirty_us = now_us;
+        last_dirty_us = now_us;
+        return false;
+    }
+    return true;
+}
+
+bool ModbusPersistentStore::flush() {
+    if (!is_enabled()) {
+        return false;
+    }
+
+    // Cleared first: a write that lands during the flush marks the store again
+    dirty_pending = false;
+    uint32_t changed = take_snapshot();
+    bool ok = true;
+    if (changed > 0) {
+        if (active_sector < 0 || write_slot + changed > SLOTS_PER_SECTOR) {
+            ok = rotate();
+        } else {
+            ok = append();
+        }
+    }
+    if (!ok) {
+        dirty_pending = true;
+    }
+    return ok;
+}
+
+uint32_t ModbusPersistentStore::take_snapshot() {
+    uint32_t changed = 0;
+    size_t n = 0;
+    for (range_t& range : ranges) {
+        for (uint16_t i = 0; i < range.count; i++) {
+            uint16_t value = range.values[i];  // Read once, the live value may move on
+            snapshot_t& entry = snapshot[n++];
+            entry.record = make_record(range.unit, range.start + i, value);
+            entry.stored = &range.stored[i];
+            entry.changed = value != range.stored[i];
+            if (entry.changed) {
+                changed++;
+            }
+        }
+    }
+    return changed;
+}
+
+bool ModbusPersistentStore::program_snapshot(uint8_t sector, uint32_t slot, bool changed_only) {
+    // A page worth of records at a time
+    record_t batch[RECORDS_PER_PAGE];
+    uint32_t n = 0;
+    for (size_t i = 0; i < snapshot.size(); i++) {
+        if (changed_only && !snapshot[i].changed) {
+            continue;
+        }
+        batch[n++] = snapshot[i].record;
+        if (n == RECORDS_PER_PAGE) {
+            if (!program(sector, slot, reinterpret_cast<const uint8_t*>(batch), n * SLOT_SIZE)) {
+                return false;
+            }
+            slot += n;
+            n = 0;
+        }
+    }
+    if (n > 0 && !program(sector, slot, reinterpret_cast<const uint8_t*>(batch), n * SLOT_SIZE)) {
+        return false;
+    }
+    return true;
+}
+
+bool ModbusPersistentStore::append() {
+    uint32_t changed = 0;
+    for (const snapshot_t& entry : snapshot) {
+        if (entry.changed) {
+            changed++;
+        }
+    }
+    if (!program_snapshot(active_sector, write_slot, true)) {
+        return false;
+    }
+    for (snapshot_t& entry : snapshot) {
+        if (entry.changed) {
+            *entry.stored = entry.record.value;
+        }
+    }
+    write_slot += changed;
+    records_written += changed;
+    return true;
+}
+
+bool ModbusPersistentStore::program(uint8_t sector, uint32_t slot, const uint8_t* data, uint32_t length) {
+    // Bytes outside the new data are programmed as 0xFF, which leaves flash unchanged
+    uint8_t page[FLASH_PAGE_SIZE];
+    uint32_t offset = slot * SLOT_SIZE;
+    uint32_t end = offset + length;
+    while (offset < end) {
+        uint32_t page_start = offset & ~(FLASH_PAGE_SIZE - 1);
+        uint32_t chunk = ((end < page_start + FLASH_PAGE_SIZE) ? end : page_start + FLASH_PAGE_SIZE) - offset;
+
+        memset(page, 0xFF, sizeof(page));
+        memcpy(&page[offset - page_start], data, chunk);
+
+        if (!flash_safe_program_page(sector_offset(sector) + page_start, page, MODBUS_PERSIST_FLASH_TIMEOUT_MS)) {
+            write_errors++;
+            return false;
+        }
+        data += chunk;
+        offset += chunk;
+    }
+    return true;
+}
+
+bool ModbusPersistentStore::erase(uint8_t sector) {
+    if (!flash_safe_erase_sector(sector_offset(sector), MODBUS_PERSIST_FLASH_TIMEOUT_MS)) {
+        write_errors++;
+        return false;
+    }
+    sectors_erased++;
+    return true;
+}
+
+bool ModbusPersistentStore::rotate() {
+    uint8_t sector = (active_sector < 0) ? 0 : (active_sector + 1) % sector_count;
+    uint16_t sequence = active_sequence + 1;
+
+    if (!erase(sector)) {
+        return false;
+    }
+
+    sector_header_t header = { MAGIC, sequence, STATE_OPEN };
+    if (!program(sector, 0, reinterpret_cast<const uint8_t*>(&header), sizeof(header))) {
+        return false;
+    }
+
+    // Copy of every persistent value
+    if (!program_snapshot(sector, 1, false)) {
+        return false;
+    }
+
+    // Only now does the new sector replace the old one
+    header.state = STATE_COMMITTED;
+    if (!program(sector, 0, reinterpret_cast<const uint8_t*>(&header), sizeof(header))) {
+        return false;
+    }
+
+    for (snapshot_t& entry : snapshot) {
+        *entry.stored = entry.record.value;
+    }
+    active_sector = sector;
+    active_sequence = sequence;
+    write_slot = 1 + snapshot.size();
+    records_written += snapshot.size();
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+#ifndef PICO_PLC_MD_PERSIST_H
+#define PICO_PLC_MD_PERSIST_H
+
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include <memory>
+#include <vector>
+
+// Timeout for the other core to reach a flash-safe state
+#define MODBUS_PERSIST_FLASH_TIMEOUT_MS 100
+
+// Log-structured store for holding registers in a reserved flash area.
+//
+// The area is a ring of erase sectors. Each sector starts with a header
+// (magic, sequence number, commit flag) followed by 8-byte records
+// {register, value, unit, CRC}. Changes are appended to the newest sector;
+// when it is full the next sector in the ring is erased, receives a copy of
+// all persistent values and becomes the newest. Every sector is erased once
+// per trip around the ring, and restoring only replays the newest sector.
+//
+// Flash is programmed through flash_safe_execute(), so a second core must be
+// set up for it (multicore_lockout_victim_init() or flash_safe_execute_core_init()).
+// The area is FLASH_PERSIST_OFFSET / FLASH_PERSIST_SECTORS of pico-utils/flash_layout.h.
+class ModbusPersistentStore {
+private:
+    struct record_t {
+        uint16_t address;
+        uint16_t value;
+        uint8_t unit;
+        uint8_t reserved;  // Always 0 so a record is never all 0xFF (erased)
+        uint16_t crc;      // Modbus CRC of the first 6 bytes
+    };
+
+    struct sector_header_t {
+        uint32_t magic;
+        uint16_t sequence;
+        uint16_t state;    // STATE_OPEN while the copy is written, STATE_COMMITTED after
+    };
+
+    static constexpr uint32_t MAGIC = 0x5350424D;  // "MBPS"
+    static constexpr uint16_t STATE_OPEN = 0xFFFF;
+    static constexpr uint16_t STATE_COMMITTED = 0x0000;
+    static constexpr uint32_t SLOT_SIZE = sizeof(record_t);
+    static constexpr uint32_t SLOTS_PER_SECTOR = FLASH_SECTOR_SIZE / SLOT_SIZE;  // Slot 0 is the header
+    static constexpr uint32_t RECORDS_PER_PAGE = FLASH_PAGE_SIZE / SLOT_SIZE;
+
+    struct range_t {
+        uint8_t unit;
+        uint16_t start;
+        uint16_t count;
+        uint16_t* values;                    // Live registers (RAM region storage)
+        std::unique_ptr<uint16_t[]> stored;  // Value last written to flash
+    };
+    std::vector<range_t> ranges;
+    uint32_t register_count;
+
+    // Every persistent value as flush() read it, in one pass: registers written from an
+    // IRQ (scan programs) while flash is programmed go out with the next flush
+    struct snapshot_t {
+        record_t record;
+        uint16_t* stored;                    // Updated once the record is in flash
+        bool changed;
+    };
+    std::vector<snapshot_t> snapshot;
+
+    uint32_t flash_offset;
+    uint8_t sector_count;
+    int active_sector;        // -1 until the first sector is written
+    uint16_t active_sequence;
+    uint32_t write_slot;      // Next free slot in the active sector
+
+    // Batching: flush once writes have been quiet for flush_delay_us,
+    // or at the latest MAX_DELAY_FACTOR times that after the first change
+    static constexpr uint32_t MAX_DELAY_FACTOR = 10;
+    bool dirty_pending;
+    uint64_t first_dirty_us;
+    uint64_t last_dirty_us;
+    uint32_t flush_delay_us;
+
+    uint32_t records_written;
+    uint32_t sectors_erased;
+    uint32_t write_errors;
+
+    const uint8_t* sector_data(uint8_t sector) const;
+    uint32_t sector_offset(uint8_t sector) const { return flash_offset + sector * FLASH_SECTOR_SIZE; }
+    static bool is_erased(const uint8_t* slot);
+    static bool is_newer(uint16_t a, uint16_t b) { return (int16_t)(a - b) > 0; }
+    static record_t make_record(uint8_t unit, uint16_t address, uint16_t value);
+    static bool record_valid(const record_t& record);
+
+    range_t* find_range(uint8_t unit, uint16_t address);
+    void find_active_sector();
+
+    // Program "length" bytes at a slot boundary of a sector, page by page
+    bool program(uint8_t sector, uint32_t slot, const uint8_t* data, uint32_t length);
+    bool erase(uint8_t sector);
+    // Fill the snapshot, returns the number of values that differ from flash
+    uint32_t take_snapshot();
+    // Program the snapshot entries (all, or only the changed ones) from "slot" on
+    bool program_snapshot(uint8_t sector, uint32_t slot, bool changed_only);
+    // Append the changed snapshot values to the active sector
+    bool append();
+    // Erase the next sector, copy the whole snapshot into it and make it the active one
+    bool rotate();
+
+public:
+    ModbusPersistentStore();
+
+    // Use "count" sectors at "offset" (sector aligned, outside the program image)
+    bool init(uint32_t offset, uint8_t count, uint32_t flush_delay_ms);
+    bool is_enabled() const { return sector_count != 0; }
+
+    // Registers start..start+count-1 of a unit, backed by "values" in RAM.
+    // At most half a sector of records may be persistent in total.
+    bool add_range(uint8_t unit, uint16_t start, uint16_t count, uint16_t* values);
+
+    // Replay the newest sector into the ranges, returns the number of records applied
+    uint32_t restore();
+
+    // Note a change, written by a later service() or flush()
+    void mark_dirty(uint8_t unit, uint16_t start, uint16_t count, uint64_t now_us);
+
+    // Flush when the batching delay has passed; call from the main loop
+    bool service(uint64_t now_us);
+    bool flush();
+
+    bool has_pending() const { return dirty_pending; }
+    uint32_t get_records_written() const { return records_written; }
+    uint32_t get_sectors_erased() const { return sectors_erased; }
+    uint32_t get_write_errors() const { return write_errors; }
+};
+
+#endif //PICO_PLC_MD_PERSIST_H
\ No newline at end of file
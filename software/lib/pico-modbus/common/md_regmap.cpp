@@ -0,0 +1,234 @@
+#include "md_regmap.h"
+#include <algorithm>
+#include <cstring>
+
+bool ModbusRegisterMap::can_insert(uint16_t start, uint32_t count) const {
+    if (count == 0 || (uint32_t)start + count > 0x10000) {
+        return false;
+    }
+
+    auto it = std::upper_bound(regions.begin(), regions.end(), start,
+                               [](uint16_t address, const register_region_t& r) { return address < r.start; });
+
+    // Reject overlaps with the neighbours on either side
+    if (it != regions.end() && (uint32_t)start + count > it->start) {
+        return false;
+    }
+    if (it != regions.begin() && std::prev(it)->end() > start) {
+        return false;
+    }
+    return true;
+}
+
+bool ModbusRegisterMap::insert(register_region_t&& region) {
+    if (!can_insert(region.start, region.count)) {
+        return false;
+    }
+
+    auto it = std::upper_bound(regions.begin(), regions.end(), region.start,
+                               [](uint16_t address, const register_region_t& r) { return address < r.start; });
+    regions.insert(it, std::move(region));
+    return true;
+}
+
+bool ModbusRegisterMap::add_ram_region(uint16_t start, uint32_t count) {
+    register_region_t region;
+    region.start = start;
+    region.count = count;
+    region.storage = std::make_unique<uint16_t[]>(count);
+    std::memset(region.storage.get(), 0, count * sizeof(uint16_t));
+    return insert(std::move(region));
+}
+
+bool ModbusRegisterMap::add_snapshot_region(uint16_t start, uint32_t count, ModbusProcessImage& image) {
+    register_region_t region;
+    region.start = start;
+    region.count = count;
+    region.image = &image;
+    // Check first so a rejected region doesn't take space in the image
+    if (!can_insert(start, count)) {
+        return false;
+    }
+    region.image_offset = image.allocate(count);
+    return insert(std::move(region));
+}
+
+bool ModbusRegisterMap::add_callback_region(uint16_t start, uint32_t count,
+                                            const register_read_callback_t& on_read,
+                                            const register_write_callback_t& on_write) {
+    if (!on_read) {
+        return false;
+    }
+    register_region_t region;
+    region.start = start;
+    region.count = count;
+    region.on_read = on_read;
+    region.on_write = on_write;
+    return insert(std::move(region));
+}
+
+const register_region_t* ModbusRegisterMap::find(uint16_t address) const {
+    auto it = std::upper_bound(regions.begin(), regions.end(), address,
+                               [](uint16_t a, const register_region_t& r) { return a < r.start; });
+    if (it == regions.begin()) {
+        return nullptr;
+    }
+    --it;
+    return (address < it->end()) ? &(*it) : nullptr;
+}
+
+register_region_t* ModbusRegisterMap::find(uint16_t address) {
+    return const_cast<register_region_t*>(static_cast<const ModbusRegisterMap*>(this)->find(address));
+}
+
+bool ModbusRegisterMap::contains(uint16_t start, uint16_t count) const {
+    uint32_t address = start;
+    uint32_t end = (uint32_t)start + count;
+    if (end > 0x10000) {
+        return false;
+    }
+
+    const register_region_t* region = find(start);
+    while (region != nullptr) {
+        address = region->end();
+        if (address >= end) {
+            return true;
+        }
+        // Continue only into an immediately adjacent region
+        region = (region + 1 < regions.data() + regions.size() && (region + 1)->start == address) ? region + 1 : nullptr;
+    }
+    return false;
+}
+
+bool ModbusRegisterMap::writable(uint16_t start, uint16_t count) const {
+    if (!contains(start, count)) {
+        return false;
+    }
+
+    uint32_t address = start;
+    uint32_t end = (uint32_t)start + count;
+    for (const register_region_t* region = find(start); address < end; region++) {
+        if (region->is_snapshot() || (!region->is_ram() && !region->on_write)) {
+            return false;
+        }
+        address = region->end();
+    }
+    return true;
+}
+
+bool ModbusRegisterMap::has_callbacks(uint16_t start, uint16_t count) const {
+    uint32_t end = (uint32_t)start + count;
+    for (const register_region_t& region : regions) {
+        if (region.start >= end) {
+            break;
+        }
+        if (region.end() > start && !region.is_ram() && !region.is_snapshot()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint16_t* ModbusRegisterMap::ram_pointer(uint16_t address) {
+    register_region_t* region = find(address);
+    if (region == nullptr) {
+        return nullptr;
+    }
+    if (region->is_snapshot()) {
+        return region->image->write_view() + region->image_offset + (address - region->start);
+    }
+    if (!region->is_ram()) {
+        return nullptr;
+    }
+    return &region->storage[address - region->start];
+}
+
+bool ModbusRegisterMap::read(uint16_t start, uint16_t count, uint16_t* values) const {
+    if (!contains(start, count)) {
+        return false;
+    }
+
+    uint32_t address = start;
+    uint32_t end = (uint32_t)start + count;
+    const register_region_t* region = find(start);
+    while (address < end) {
+        uint32_t chunk = std::min(end, region->end()) - address;
+        uint16_t* out = values + (address - start);
+
+        if (region->is_ram()) {
+            std::memcpy(out, &region->storage[address - region->start], chunk * sizeof(uint16_t));
+        } else if (region->is_snapshot()) {
+            const uint16_t* values = region->image->write_view() + region->image_offset + (address - region->start);
+            std::memcpy(out, values, chunk * sizeof(uint16_t));
+        } else if (!region->on_read((uint16_t)address, (uint16_t)chunk, out)) {
+            return false;
+        }
+
+        address += chunk;
+        region++;
+    }
+    return true;
+}
+
+bool ModbusRegisterMap::write(uint16_t start, uint16_t count, const uint16_t* values) {
+    // Refuse the whole write if any part is missing or read-only
+    if (!writable(start, count)) {
+        return false;
+    }
+
+    uint32_t address = start;
+    uint32_t end = (uint32_t)start + count;
+    register_region_t* region = find(start);
+    while (address < end) {
+        uint32_t chunk = std::min(end, region->end()) - address;
+        const uint16_t* in = values + (address - start);
+
+        if (region->is_ram()) {
+            std::memcpy(&region->storage[address - region->start], in, chunk * sizeof(uint16_t));
+        } else if (!region->on_write((uint16_t)address, (uint16_t)chunk, in)) {
+            return false;
+        }
+
+        address += chunk;
+        region++;
+    }
+    return true;
+}
+
+bool ModbusRegisterMap::read_into(uint16_t start, uint16_t count, ModbusFrameWriter& writer) const {
+    if (!contains(start, count)) {
+        return false;
+    }
+
+    uint32_t address = start;
+    uint32_t end = (uint32_t)start + count;
+    const register_region_t* region = find(start);
+    while (address < end) {
+        uint32_t chunk = std::min(end, region->end()) - address;
+
+        if (region->is_ram() || region->is_snapshot()) {
+            const uint16_t* values = region->is_ram()
+                ? &region->storage[address - region->start]
+                : region->image->read_view() + region->image_offset + (address - region->start);
+            for (uint32_t i = 0; i < chunk; i++) {
+                writer.put16(values[i]);
+            }
+        } else {
+            // A frame holds at most 125 registers, so one callback call per region
+            uint16_t values[125];
+            for (uint32_t done = 0; done < chunk; done += 125) {
+                uint16_t part = (uint16_t)std::min<uint32_t>(chunk - done, 125);
+                if (!region->on_read((uint16_t)(address + done), part, values)) {
+                    return false;
+                }
+                for (uint16_t i = 0; i < part; i++) {
+                    writer.put16(values[i]);
+                }
+            }
+        }
+
+        address += chunk;
+        region++;
+    }
+    return true;
+}
@@ -0,0 +1,78 @@
+#ifndef PICO_PLC_MD_REGMAP_H
+#define PICO_PLC_MD_REGMAP_H
+
+#include "md_common.h"
+#include "md_image.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Callbacks for registers that are computed on demand instead of stored.
+// Both receive the absolute start address and must fill/consume "count" values.
+typedef std::function<bool(uint16_t start, uint16_t count, uint16_t* values)> register_read_callback_t;
+typedef std::function<bool(uint16_t start, uint16_t count, const uint16_t* values)> register_write_callback_t;
+
+// One contiguous block of register addresses
+struct register_region_t {
+    uint16_t start = 0;
+    uint32_t count = 0;
+    std::unique_ptr<uint16_t[]> storage;     // RAM-backed when non-null
+    ModbusProcessImage* image = nullptr;     // Snapshot-backed when non-null
+    uint32_t image_offset = 0;
+    register_read_callback_t on_read;        // Callback-backed otherwise
+    register_write_callback_t on_write;      // Optional, read-only if unset
+
+    uint32_t end() const { return (uint32_t)start + count; }
+    bool is_ram() const { return storage != nullptr; }
+    bool is_snapshot() const { return image != nullptr; }
+};
+
+// Register address space made of multiple non-overlapping regions,
+// kept sorted by start address for O(log n) lookup
+class ModbusRegisterMap {
+private:
+    std::vector<register_region_t> regions;
+
+    bool can_insert(uint16_t start, uint32_t count) const;
+    bool insert(register_region_t&& region);
+
+public:
+    // Zero-initialized RAM region
+    bool add_ram_region(uint16_t start, uint32_t count);
+    // Published by the application through a process image, read-only for the master
+    bool add_snapshot_region(uint16_t start, uint32_t count, ModbusProcessImage& image);
+    // Values produced lazily, only for the range a request reads
+    bool add_callback_region(uint16_t start, uint32_t count,
+                             const register_read_callback_t& on_read,
+                             const register_write_callback_t& on_write = nullptr);
+    void clear() { regions.clear(); }
+
+    bool empty() const { return regions.empty(); }
+    size_t get_region_count() const { return regions.size(); }
+
+    // Region containing the address, or nullptr
+    const register_region_t* find(uint16_t address) const;
+    register_region_t* find(uint16_t address);
+
+    // True when every address in the range is covered (regions may be adjacent)
+    bool contains(uint16_t start, uint16_t count) const;
+    // True when the range is covered and no part of it is read-only
+    bool writable(uint16_t start, uint16_t count) const;
+    // True when any part of the range is callback-backed (such reads may not run in IRQ context)
+    bool has_callbacks(uint16_t start, uint16_t count) const;
+
+    // Direct pointer into RAM storage (nullptr for callback regions / holes).
+    // For snapshot regions this is the application's unpublished working copy.
+    uint16_t* ram_pointer(uint16_t address);
+
+    // Range access across adjacent regions, fails without side effects on holes.
+    // Application view: snapshot regions read the working copy, and are not writable.
+    bool read(uint16_t start, uint16_t count, uint16_t* values) const;
+    bool write(uint16_t start, uint16_t count, const uint16_t* values);
+    
+    // Serialize the range big-endian straight into a frame (RAM regions are not copied first).
+    // Modbus view: snapshot regions read the snapshot taken by the last acquire().
+    bool read_into(uint16_t start, uint16_t count, ModbusFrameWriter& writer) const;
+};
+
+#endif //PICO_PLC_MD_REGMAP_H
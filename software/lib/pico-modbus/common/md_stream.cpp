@@ -4,6 +4,7 @@
 #include <cstdlib>
 #include <cstring>
 
+#include "hardware/sync.h"
 #include "pico-utils/common_utils.h"
 
 // Static member initialization
@@ -11,7 +12,11 @@ ModbusStream* ModbusStream::instance = nullptr;
 
 ModbusStream::ModbusStream(uart_inst_t* uart, uint baudrate, int de_pin, int re_pin, ModbusParity parity) 
     : uart(uart), baudrate(baudrate), de_pin(de_pin), re_pin(re_pin),
-      rx_index(0), frame_ready(false), last_rx_time_us(0), tx_in_progress(false) {
+      rx_index(0), frame_ready(false), last_rx_time_us(0), tx_in_progress(false), rx_frame_start_us(0),
+      last_frame_start_us(0), last_frame_end_us(0), last_tx_start_us(0), last_tx_end_us(0), last_tx_length(0),
+      last_bus_activity_us(0), diagnostics(nullptr), irq_framing(false), frame_alarm_pending(false),
+      rx_queue_head(0), rx_queue_tail(0), rx_deferred(0), current_frame_answered(false),
+      tx_async_active(false), tx_async_index(0), tx_async_length(0) {
 
     instance = this;
     
@@ -38,7 +43,7 @@ ModbusStream::ModbusStream(uart_inst_t* uart, uint baudrate, int de_pin, int re_
     // calculation of character time in microseconds
     // Modbus RTU character: 1 start bit + 8 data bits + parity + 1 stop bit = 11 bits
     // If parity is NONE, 2 stop bits are used, so still 11 bits (1 start + 8 data + 2 stop)
-    uint32_t char_time_us = (11 * 1000000) / baudrate;
+    char_time_us = (11 * 1000000) / baudrate;
 
     t1_5_us = (char_time_us * 3) / 2;  // 1.5 character times
     t3_5_us = (char_time_us * 7) / 2;  // 3.5 character times
@@ -103,7 +108,11 @@ ModbusStream::~ModbusStream() {
 
 void ModbusStream::uart_irq_handler() {
     if (instance) {
-        instance->handle_uart_rx();
+        if (instance->tx_async_active) {
+            instance->handle_uart_tx();
+        } else {
+            instance->handle_uart_rx();
+        }
     }
 }
 
@@ -128,6 +137,7 @@ void ModbusStream::handle_uart_rx() {
                 // T1.5 violation detected - discard partial frame
                 // The current byte will be treated as the start of a new frame
                 rx_index = 0;
+                count(ModbusCounter::INTER_CHARACTER_TIMEOUT);
             }
         }
 
@@ -137,6 +147,19 @@ void ModbusStream::handle_uart_rx() {
         
         if (dr & 0xF00) {
             // Hardware error detected (Parity, Framing, Overrun, Break)
+            if (dr & UART_UARTDR_OE_BITS) {
+                count(ModbusCounter::BUS_CHARACTER_OVERRUN);
+            }
+            if (dr & UART_UARTDR_BE_BITS) {
+                count(ModbusCounter::UART_BREAK);
+            }
+            if (dr & UART_UARTDR_PE_BITS) {
+                count(ModbusCounter::UART_PARITY_ERROR);
+            }
+            if (dr & UART_UARTDR_FE_BITS) {
+                count(ModbusCounter::UART_FRAMING_ERROR);
+            }
+            
             // Modbus spec requires ignoring the frame if a parity/framing error occurs.
             // We reset the buffer to discard the current frame.
             reset_rx_buffer();
@@ -144,24 +167,72 @@ void ModbusStream::handle_uart_rx() {
             // We continue to read to clear the FIFO, but we don't store the data
             // Update timestamp to prevent T3.5 from triggering immediately on next byte
             last_rx_time_us = time_us_64();
+            last_bus_activity_us = last_rx_time_us;
             continue;
         }
 
         uint8_t byte = dr & 0xFF;
+        uint64_t now = time_us_64();
+        if (rx_index == 0) {
+            rx_frame_start_us = now;
+        }
         rx_buffer[rx_index++] = byte;
         // NOTE: No printf in IRQ handler - it blocks subsequent byte reception!
         
         // update timestamp
-        last_rx_time_us = time_us_64();
+        last_rx_time_us = now;
+        last_bus_activity_us = now;
+        
+        // One alarm per frame, it re-arms itself while bytes keep arriving
+        if (irq_framing && !frame_alarm_pending) {
+            frame_alarm_pending = true;
+            if (add_alarm_in_us(t3_5_us, frame_alarm_callback, this, true) < 0) {
+                frame_alarm_pending = false;  // No free alarm, process_if_ready() takes over
+            }
+        }
     }
     
     // check for buffer overflow
     if (rx_index >= MODBUS_MAX_FRAME_SIZE) {
+        count(ModbusCounter::BUS_CHARACTER_OVERRUN);
         reset_rx_buffer();
     }
 }
 
 void ModbusStream::process_if_ready() {
+    if (irq_framing) {
+        // Frames completed by the alarm, in arrival order
+        while (rx_queue_tail != rx_queue_head) {
+            rx_slot_t& slot = rx_queue[rx_queue_tail];
+            current_frame_answered = slot.answered;
+            if (frame_callback) {
+                frame_callback(slot.frame);
+            }
+            current_frame_answered = false;
+            
+            uint32_t irq_state = save_and_disable_interrupts();
+            if (!slot.answered) {
+                rx_deferred--;
+            }
+            rx_queue_tail = (rx_queue_tail + 1) % MODBUS_RX_QUEUE_DEPTH;
+            restore_interrupts(irq_state);
+        }
+        
+        // Fallback when no alarm could be scheduled
+        if (frame_alarm_pending || rx_index == 0 || last_rx_time_us == 0 ||
+            time_us_64() - last_rx_time_us < t3_5_us) {
+            return;
+        }
+        frame_alarm_pending = true;
+        int64_t delay_us = complete_frame_irq();
+        // A byte arrived after the silence check: wait out the rest of T3.5 on an alarm,
+        // or keep polling here. A flag left set would stop framing for good.
+        if (delay_us > 0 && add_alarm_in_us(delay_us, frame_alarm_callback, this, true) < 0) {
+            frame_alarm_pending = false;
+        }
+        return;
+    }
+    
     // Check if we have data and if T3.5 silence has elapsed
     if (rx_index > 0 && last_rx_time_us > 0) {
         uint64_t elapsed = time_us_64() - last_rx_time_us;
@@ -181,7 +252,7 @@ void ModbusStream::reset_rx_buffer() {
     memset(rx_buffer, 0, MODBUS_MAX_FRAME_SIZE);
 }
 
-void ModbusStream::process_received_frame() {
+ModbusStream::FrameStatus ModbusStream::decode_frame(modbus_frame_t& frame, uint8_t* data) {
     MODBUS_DEBUG_PRINT("[FRAME] Processing %d bytes\n", rx_index);
     
     // filter out obvious noise (all zeros = floating RS485 line)
@@ -196,56 +267,128 @@ void ModbusStream::process_received_frame() {
     if (all_zeros) {
         MODBUS_DEBUG_PRINT("[FRAME] All zeros (floating line noise), discarding\n");
         reset_rx_buffer();
-        return;
+        return FrameStatus::NOISE;
     }
 
     // minimum frame: address + function + CRC (2 bytes) = 4 bytes
     // Per spec: frames < 3 bytes also count as communication errors
     if (rx_index < 4) {
         MODBUS_DEBUG_PRINT("[FRAME] Too short, discarding\n");
-        if (error_callback) {
-            // Create dummy frame for error reporting
-            modbus_frame_t error_frame = {0};
-            error_callback(error_frame);
-        }
+        frame = {0};
         reset_rx_buffer();
-        return;
+        count(ModbusCounter::SHORT_FRAME);
+        return FrameStatus::TOO_SHORT;
     }
 
-    modbus_frame_t frame;
     frame.address = rx_buffer[0];
     frame.function_code = rx_buffer[1];
     frame.data_length = rx_index - 4; // Minus address, function, and CRC
 
+    // Payload is copied out of rx_buffer so the IRQ can start receiving the next frame
     if (frame.data_length > 0) {
-        frame.data = (uint8_t*)malloc(frame.data_length);
-        if (frame.data) {
-            memcpy(frame.data, &rx_buffer[2], frame.data_length);
-        }
+        memcpy(data, &rx_buffer[2], frame.data_length);
+        frame.data = data;
     } else {
         frame.data = nullptr;
     }
 
     frame.crc = rx_buffer[rx_index - 2] | (rx_buffer[rx_index - 1] << 8);
+    
+    last_frame_start_us = rx_frame_start_us;
+    last_frame_end_us = last_rx_time_us;
 
-    bool crc_valid = check_crc(&frame);
+    bool crc_valid = (calculate_crc(rx_buffer, rx_index - 2) == frame.crc);
     MODBUS_DEBUG_PRINT("[FRAME] Addr=%d Func=0x%02X CRC=%s\n", 
            frame.address, frame.function_code, crc_valid ? "OK" : "FAIL");
 
     reset_rx_buffer();
+    if (!crc_valid) {
+        count(ModbusCounter::CRC_ERROR);
+        return FrameStatus::CRC_ERROR;
+    }
+    return FrameStatus::OK;
+}
+
+void ModbusStream::report_frame_error(FrameStatus status, const modbus_frame_t& frame) {
+    if (!error_callback) {
+        return;
+    }
+    if (status == FrameStatus::TOO_SHORT) {
+        error_callback(frame);
+    } else if (status == FrameStatus::CRC_ERROR && frame_callback) {
+        // without a frame callback there is nothing we can do...... Viva La Napoleon!
+        error_callback(frame);
+    }
+}
+
+void ModbusStream::process_received_frame() {
+    modbus_frame_t frame;
+    FrameStatus status = decode_frame(frame, frame_data);
     
     // received a frame, invoke callback
-    if (crc_valid && frame_callback) {
-        frame_callback(frame);
-    } else if (!frame_callback) {
-        // there is nothing we can do...... Viva La Napoleon!
-    } else if (!crc_valid && error_callback) {
-        error_callback(frame);
+    if (status == FrameStatus::OK) {
+        if (frame_callback) {
+            frame_callback(frame);
+        }
+    } else {
+        report_frame_error(status, frame);
     }
+}
 
-    if (frame.data) {
-        free(frame.data);
+int64_t ModbusStream::frame_alarm_callback(alarm_id_t id, void* user_data) {
+    return static_cast<ModbusStream*>(user_data)->complete_frame_irq();
+}
+
+int64_t ModbusStream::complete_frame_irq() {
+    uint32_t irq_state = save_and_disable_interrupts();
+    
+    if (rx_index == 0 || tx_in_progress) {
+        // Frame was discarded (error, overflow or our own TX)
+        frame_alarm_pending = false;
+        restore_interrupts(irq_state);
+        return 0;
+    }
+    
+    uint64_t elapsed = time_us_64() - last_rx_time_us;
+    if (elapsed < t3_5_us) {
+        // More bytes arrived since the alarm was set, wait for the rest of the silence
+        restore_interrupts(irq_state);
+        return t3_5_us - elapsed;
+    }
+    frame_alarm_pending = false;
+    
+    uint8_t next = (rx_queue_head + 1) % MODBUS_RX_QUEUE_DEPTH;
+    if (next == rx_queue_tail) {
+        // Main loop is behind, drop the frame (the master will retry)
+        reset_rx_buffer();
+        count(ModbusCounter::RX_FRAME_DROPPED);
+        restore_interrupts(irq_state);
+        return 0;
+    }
+    
+    // Decode with the UART IRQ masked so the next frame cannot overwrite this one
+    rx_slot_t& slot = rx_queue[rx_queue_head];
+    FrameStatus status = decode_frame(slot.frame, slot.data);
+    restore_interrupts(irq_state);
+    
+    if (status != FrameStatus::OK) {
+        report_frame_error(status, slot.frame);
+        return 0;
     }
+    
+    // Answer here only if that cannot overtake a frame still waiting for the main loop
+    slot.answered = false;
+    if (fast_callback && rx_deferred == 0 && !tx_async_active) {
+        slot.answered = fast_callback(slot.frame);
+    }
+    
+    irq_state = save_and_disable_interrupts();
+    if (!slot.answered) {
+        rx_deferred++;
+    }
+    rx_queue_head = next;
+    restore_interrupts(irq_state);
+    return 0;
 }
 
 void ModbusStream::on_frame_received(const std::function<void(const modbus_frame_t&)>& callback) {
@@ -256,31 +399,16 @@ void ModbusStream::on_error_received(const std::function<void(const modbus_frame
     error_callback = callback;
 }
 
+void ModbusStream::enable_irq_framing(const std::function<bool(const modbus_frame_t&)>& callback) {
+    fast_callback = callback;
+    irq_framing = true;
+}
+
 void ModbusStream::write(const modbus_frame_t* frame) {
-    // led_gpio_set(1);
-    
-    // Disable RX IRQ immediately to prevent echo during TX
-    uart_set_irq_enables(uart, false, false);
-    
-    // Set flag to ignore RX during TX
-    tx_in_progress = true;
-    
-    // Reset RX buffer to discard any partial data
-    rx_index = 0;
-    // DO NOT clear last_rx_time_us - let IRQ handler update it when response arrives
-    
-    // Flush UART FIFO
-    while (uart_is_readable(uart)) {
-        uart_getc(uart);
-    }
-    
     MODBUS_DEBUG_PRINT("[TX] Sending frame: Addr=%d Func=0x%02X DataLen=%d\n",
            frame->address, frame->function_code, frame->data_length);
-    
-    // wait for T3.5 silence before transmitting (bus idle)
-    sleep_us(t3_5_us);
 
-    uint8_t tx_buffer[MODBUS_MAX_FRAME_SIZE];
+    wait_tx_idle();  // An IRQ reply may still be draining from tx_buffer
     uint16_t tx_length = 0;
     
     tx_buffer[tx_length++] = frame->address;
@@ -297,14 +425,59 @@ void ModbusStream::write(const modbus_frame_t* frame) {
     
     MODBUS_DEBUG_PRINT("[TX] Total %d bytes, CRC=0x%04X\n", tx_length, crc);
     
+    write_prepared(tx_length);
+}
+
+void ModbusStream::wait_bus_idle() {
+    // T3.5 silence since the last byte on the bus; usually already elapsed for a reply.
+    // Busy wait: also runs in IRQ context for write_prepared_async()
+    uint64_t idle_at_us = last_bus_activity_us + t3_5_us;
+    uint64_t now = time_us_64();
+    if (now < idle_at_us) {
+        busy_wait_us(idle_at_us - now);
+    }
+}
+
+void ModbusStream::wait_tx_idle() {
+    while (tx_async_active) {
+        tight_loop_contents();
+    }
+}
+
+void ModbusStream::write_prepared(uint16_t tx_length) {
+    // led_gpio_set(1);
+    wait_tx_idle();
+    
+    // Disable RX IRQ immediately to prevent echo during TX
+    uart_set_irq_enables(uart, false, false);
+    
+    // Set flag to ignore RX during TX
+    tx_in_progress = true;
+    
+    // Reset RX buffer to discard any partial data
+    rx_index = 0;
+    // DO NOT clear last_rx_time_us - let IRQ handler update it when response arrives
+    
+    // Flush UART FIFO
+    while (uart_is_readable(uart)) {
+        uart_getc(uart);
+    }
+    
+    // wait for T3.5 silence before transmitting (bus idle)
+    wait_bus_idle();
+    
     // Switch RS485 transceiver to TX mode (SN65HVD75DGKR: DE=1, RE=1)
     set_transceiver_mode_tx();
     
     // transmit frame
+    last_tx_start_us = time_us_64();
     uart_write_blocking(uart, tx_buffer, tx_length);
     
     // Wait for transmission to complete
     uart_tx_wait_blocking(uart);
+    last_tx_end_us = time_us_64();
+    last_tx_length = tx_length;
+    last_bus_activity_us = last_tx_end_us;
     
     // Switch RS485 transceiver back to RX mode (SN65HVD75DGKR: DE=0, RE=0)
     set_transceiver_mode_rx();
@@ -319,6 +492,67 @@ void ModbusStream::write(const modbus_frame_t* frame) {
     // led_gpio_set(0);
 }
 
+void ModbusStream::write_prepared_async(uint16_t tx_length) {
+    // Same preparation as write_prepared()
+    uart_set_irq_enables(uart, false, false);
+    tx_in_progress = true;
+    rx_index = 0;
+    while (uart_is_readable(uart)) {
+        uart_getc(uart);
+    }
+    wait_bus_idle();
+    set_transceiver_mode_tx();
+    
+    last_tx_start_us = time_us_64();
+    last_tx_length = tx_length;
+    tx_async_length = tx_length;
+    tx_async_index = 0;
+    tx_async_active = true;
+    
+    // Prime the transmitter, the TX interrupt feeds the rest
+    handle_uart_tx();
+    if (tx_async_active) {
+        uart_set_irq_enables(uart, false, true);
+    }
+}
+
+void ModbusStream::handle_uart_tx() {
+    while (tx_async_index < tx_async_length && uart_is_writable(uart)) {
+        uart_putc_raw(uart, tx_buffer[tx_async_index++]);
+    }
+    if (tx_async_index < tx_async_length) {
+        return;
+    }
+    
+    // Last byte handed over, wait for the shift register to drain before releasing the bus
+    uart_set_irq_enables(uart, false, false);
+    if (add_alarm_in_us(char_time_us, tx_done_alarm_callback, this, true) < 0) {
+        uart_tx_wait_blocking(uart);
+        finish_tx();
+    }
+}
+
+int64_t ModbusStream::tx_done_alarm_callback(alarm_id_t id, void* user_data) {
+    return static_cast<ModbusStream*>(user_data)->complete_tx_irq();
+}
+
+int64_t ModbusStream::complete_tx_irq() {
+    if (uart_get_hw(uart)->fr & UART_UARTFR_BUSY_BITS) {
+        return (char_time_us / 4) + 1;
+    }
+    finish_tx();
+    return 0;
+}
+
+void ModbusStream::finish_tx() {
+    last_tx_end_us = time_us_64();
+    last_bus_activity_us = last_tx_end_us;
+    set_transceiver_mode_rx();
+    tx_in_progress = false;
+    tx_async_active = false;
+    uart_set_irq_enables(uart, true, false);
+}
+
 void ModbusStream::set_transceiver_mode_tx() {
     // SN65HVD75DGKR: DE=1 (Driver Enable), RE=1 (Receiver Disable)
     if (de_pin >= 0) {
@@ -327,8 +561,9 @@ void ModbusStream::set_transceiver_mode_tx() {
     if (re_pin >= 0) {
         gpio_put(re_pin, 1);
     }
-    // Small delay for transceiver to switch modes (typically ~100ns, but we add margin)
-    sleep_us(1);
+    // Small delay for transceiver to switch modes (typically ~100ns, but we add margin).
+    // Busy wait, IRQ safe: async replies switch from the RX IRQ and the TX-done alarm
+    busy_wait_us(1);
 }
 
 void ModbusStream::set_transceiver_mode_rx() {
@@ -340,5 +575,5 @@ void ModbusStream::set_transceiver_mode_rx() {
         gpio_put(re_pin, 0);
     }
     // Small delay for transceiver to switch modes
-    sleep_us(1);
+    busy_wait_us(1);
 }
\ No newline at end of file
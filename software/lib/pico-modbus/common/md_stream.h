@@ -2,14 +2,19 @@
 #define PICO_PLC_MD_STREAM_H
 
 #include "md_common.h"
+#include "md_diagnostics.h"
 #include "hardware/uart.h"
 #include "hardware/timer.h"
 #include "hardware/irq.h"
 #include "hardware/gpio.h"
+#include "pico/time.h"
 #include <functional>
 
 #define MODBUS_MAX_FRAME_SIZE 256
 
+// Frames completed in timer context and waiting for the main loop
+#define MODBUS_RX_QUEUE_DEPTH 4
+
 class ModbusStream {
 private:
     uart_inst_t* uart;
@@ -20,6 +25,7 @@ private:
     int re_pin;  // Receiver Enable (active LOW)
     
     // timing parameters (in microseconds)
+    uint32_t char_time_us;
     uint32_t t1_5_us;  // 1.5 character times
     uint32_t t3_5_us;  // 3.5 character times (frame boundary)
     
@@ -30,17 +36,75 @@ private:
     volatile uint64_t last_rx_time_us; // Time of last received byte
     volatile bool tx_in_progress; // Flag to ignore RX during TX
     
+    // Payload of the frame handed to frame_callback (valid during the callback)
+    uint8_t frame_data[MODBUS_MAX_FRAME_SIZE];
+    
+    // Complete outgoing frame including CRC
+    uint8_t tx_buffer[MODBUS_MAX_FRAME_SIZE];
+    volatile uint64_t rx_frame_start_us; // Time of first byte of the current frame
+    
+    // Timing of the last completed RX frame and TX frame (for telemetry)
+    uint64_t last_frame_start_us;
+    uint64_t last_frame_end_us;
+    uint64_t last_tx_start_us;
+    uint64_t last_tx_end_us;
+    uint16_t last_tx_length;
+    
+    // Last byte seen on the bus in either direction (T3.5 before TX is measured from here)
+    volatile uint64_t last_bus_activity_us;
+    
+    // Frame-complete detection from a timer alarm instead of process_if_ready() polling
+    bool irq_framing;
+    volatile bool frame_alarm_pending;
+    
+    struct rx_slot_t {
+        modbus_frame_t frame;
+        uint8_t data[MODBUS_MAX_FRAME_SIZE];
+        bool answered;  // Already handled by fast_callback
+    };
+    rx_slot_t rx_queue[MODBUS_RX_QUEUE_DEPTH];
+    volatile uint8_t rx_queue_head;    // Written by the alarm
+    volatile uint8_t rx_queue_tail;    // Written by the main loop
+    volatile uint8_t rx_deferred;      // Queued frames not answered yet
+    bool current_frame_answered;
+    
+    // Interrupt-driven TX state (write_prepared_async)
+    volatile bool tx_async_active;
+    volatile uint16_t tx_async_index;
+    uint16_t tx_async_length;
+    
+    // Counters of the owner (nullptr = not counted)
+    ModbusDiagnostics* diagnostics;
+    void count(ModbusCounter counter) {
+        if (diagnostics != nullptr) {
+            diagnostics->increment(counter);
+        }
+    }
+    
     // callbacks for frame and error handling
     std::function<void(const modbus_frame_t&)> frame_callback;
     std::function<void(const modbus_frame_t&)> error_callback;
+    std::function<bool(const modbus_frame_t&)> fast_callback;
     
     // IRQ handler (must be static for C callback)
     static void uart_irq_handler();
     static ModbusStream* instance;
     
+    static int64_t frame_alarm_callback(alarm_id_t id, void* user_data);
+    static int64_t tx_done_alarm_callback(alarm_id_t id, void* user_data);
+    
+    enum class FrameStatus : uint8_t { OK, NOISE, TOO_SHORT, CRC_ERROR };
+    
     void handle_uart_rx();
+    void handle_uart_tx();
     void reset_rx_buffer();
+    FrameStatus decode_frame(modbus_frame_t& frame, uint8_t* data);
+    void report_frame_error(FrameStatus status, const modbus_frame_t& frame);
     void process_received_frame();
+    int64_t complete_frame_irq();
+    int64_t complete_tx_irq();
+    void finish_tx();
+    void wait_bus_idle();
     
     // RS485 transceiver control
     void set_transceiver_mode_tx();
@@ -51,16 +115,42 @@ public:
     ~ModbusStream();
 
     void write(const modbus_frame_t* frame);
+    
+    // Zero-copy TX: wait_tx_idle(), fill get_tx_buffer() with a complete frame (CRC
+    // included), then send the first tx_length bytes
+    uint8_t* get_tx_buffer() { return tx_buffer; }
+    void write_prepared(uint16_t tx_length);
+    // Same, but returns once the first byte is out; the rest is sent from the UART IRQ.
+    // Safe to call from interrupt context.
+    void write_prepared_async(uint16_t tx_length);
+    bool is_tx_busy() const { return tx_async_active; }
+    void wait_tx_idle();
+    
+    // Detect T3.5 with a timer alarm. Completed frames are first offered to "callback"
+    // in timer IRQ context (return true if answered there), then passed to
+    // on_frame_received() from process_if_ready() in their arrival order.
+    // Frames are offered only while no unanswered frame is waiting for the main loop.
+    void enable_irq_framing(const std::function<bool(const modbus_frame_t&)>& callback);
+    bool is_irq_framing() const { return irq_framing; }
+    // Valid during the frame callback: the frame was answered in IRQ context
+    bool is_frame_answered() const { return current_frame_answered; }
 
     void process_if_ready();
 
     // callbacks for received frames
     void on_frame_received(const std::function<void(const modbus_frame_t&)>& callback);
     void on_error_received(const std::function<void(const modbus_frame_t&)>& callback);
+    void set_diagnostics(ModbusDiagnostics* counters) { diagnostics = counters; }
     
     uint32_t get_t1_5_us() const { return t1_5_us; }
     uint32_t get_t3_5_us() const { return t3_5_us; }
     
+    uint64_t get_last_frame_start_us() const { return last_frame_start_us; }
+    uint64_t get_last_frame_end_us() const { return last_frame_end_us; }
+    uint64_t get_last_tx_start_us() const { return last_tx_start_us; }
+    uint64_t get_last_tx_end_us() const { return last_tx_end_us; }
+    uint16_t get_last_tx_length() const { return last_tx_length; }
+    
     // Get time since last RX byte (in microseconds) - useful for timeout logic
     uint64_t get_time_since_last_rx() const {
         if (last_rx_time_us == 0) return UINT64_MAX;
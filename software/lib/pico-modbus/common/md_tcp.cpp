@@ -0,0 +1,216 @@
+#include "md_tcp.h"
+#include <cstring>
+
+ModbusTcpServer::ModbusTcpServer(ModbusPduHandler& handler)
+    : handler(&handler), clients{}, stats{}, tx_buffer{} {
+}
+
+ModbusTcpServer::ModbusTcpServer()
+    : handler(nullptr), clients{}, stats{}, tx_buffer{} {
+}
+
+void ModbusTcpServer::set_transport(const send_space_function_t& space, const send_function_t& send_fn,
+                                    const drop_function_t& drop_fn) {
+    send_space = space;
+    send = send_fn;
+    drop = drop_fn;
+}
+
+uint16_t ModbusTcpServer::get_send_space(int client) const {
+    return send_space ? send_space(client) : UINT16_MAX;
+}
+
+int ModbusTcpServer::open_client() {
+    for (int i = 0; i < MODBUS_TCP_MAX_CLIENTS; i++) {
+        if (!clients[i].open) {
+            clients[i].open = true;
+            clients[i].dropped = false;
+            clients[i].rx_length = 0;
+            stats.connections++;
+            return i;
+        }
+    }
+    stats.rejected++;
+    return -1;
+}
+
+void ModbusTcpServer::close_client(int client) {
+    if (client < 0 || client >= MODBUS_TCP_MAX_CLIENTS) {
+        return;
+    }
+    clients[client].open = false;
+    clients[client].dropped = false;
+    clients[client].rx_length = 0;
+}
+
+void ModbusTcpServer::drop_client(int client) {
+    if (!is_client_open(client) || clients[client].dropped) {
+        return;
+    }
+    clients[client].dropped = true;
+    stats.dropped++;
+    if (drop) {
+        drop(client);  // The transport ends with close_client()
+    } else {
+        close_client(client);
+    }
+}
+
+bool ModbusTcpServer::is_client_open(int client) const {
+    return client >= 0 && client < MODBUS_TCP_MAX_CLIENTS && clients[client].open;
+}
+
+uint16_t ModbusTcpServer::adu_length(const uint8_t* header) {
+    uint16_t protocol_id = (header[2] << 8) | header[3];
+    uint16_t length = (header[4] << 8) | header[5];  // Unit ID + PDU
+
+    if (protocol_id != 0 || length < 2 || length > MODBUS_TCP_MAX_PDU_SIZE + 1) {
+        return 0;
+    }
+    return MODBUS_MBAP_HEADER_SIZE - 1 + length;
+}
+
+bool ModbusTcpServer::serve(int client, const uint8_t* adu, uint16_t length) {
+    // Nothing more is executed for a dropped client, whether or not the transport has closed it yet
+    if (!is_client_open(client) || clients[client].dropped) {
+        return false;
+    }
+    // Only start a request whose largest possible reply fits, so nothing is executed twice
+    if (!can_accept(client) || (send_space && send_space(client) < MODBUS_TCP_MAX_ADU_SIZE)) {
+        return false;
+    }
+
+    uint16_t transaction_id = (adu[0] << 8) | adu[1];
+    if (handle_request(client, transaction_id, adu[6], &adu[MODBUS_MBAP_HEADER_SIZE], length - MODBUS_MBAP_HEADER_SIZE)) {
+        stats.requests++;
+    } else if (is_client_open(client) && !clients[client].dropped) {
+        stats.no_reply++;  // Not a reply lost with a dropped client
+    }
+    return true;
+}
+
+bool ModbusTcpServer::handle_request(int client, uint16_t transaction_id, uint8_t unit_id,
+                                     const uint8_t* pdu, uint16_t length) {
+    if (handler == nullptr) {
+        return false;
+    }
+
+    // The handler writes unit ID + PDU right behind the MBAP header fields
+    uint8_t* reply = &tx_buffer[MODBUS_MBAP_HEADER_SIZE - 1];
+    uint16_t reply_length = handler->process_pdu(unit_id, pdu, length, reply);
+    if (reply_length == 0) {
+        return false;
+    }
+    // The request has run (a write is applied): a client that never sees the reply would
+    // resend it after its timeout, so it is dropped and reconnects at once instead
+    if (!send_response(client, transaction_id, reply, reply_length)) {
+        drop_client(client);
+        return false;
+    }
+    return true;
+}
+
+bool ModbusTcpServer::send_response(int client, uint16_t transaction_id, const uint8_t* reply, uint16_t length) {
+    if (!is_client_open(client) || !send || length < 2 || length > MODBUS_TCP_MAX_PDU_SIZE + 1) {
+        return false;
+    }
+
+    uint8_t* body = &tx_buffer[MODBUS_MBAP_HEADER_SIZE - 1];
+    if (reply != body) {
+        memmove(body, reply, length);
+    }
+    tx_buffer[0] = (transaction_id >> 8) & 0xFF;
+    tx_buffer[1] = transaction_id & 0xFF;
+    tx_buffer[2] = 0;  // Protocol ID: Modbus
+    tx_buffer[3] = 0;
+    tx_buffer[4] = (length >> 8) & 0xFF;
+    tx_buffer[5] = length & 0xFF;
+
+    return send(client, tx_buffer, MODBUS_MBAP_HEADER_SIZE - 1 + length);
+}
+
+bool ModbusTcpServer::resume(int client) {
+    if (!is_client_open(client)) {
+        return false;
+    }
+    client_t& c = clients[client];
+
+    // A complete ADU left in the buffer is one that waited for send space
+    if (c.rx_length < MODBUS_MBAP_HEADER_SIZE || c.rx_length != adu_length(c.rx_buffer)) {
+        return true;
+    }
+    if (!serve(client, c.rx_buffer, c.rx_length)) {
+        return false;
+    }
+    c.rx_length = 0;
+    return true;
+}
+
+int ModbusTcpServer::receive(int client, const uint8_t* data, uint16_t length) {
+    if (!is_client_open(client) || clients[client].dropped) {
+        return -1;
+    }
+    if (!resume(client)) {
+        return 0;
+    }
+
+    client_t& c = clients[client];
+    uint16_t consumed = 0;
+    uint32_t answered = 0;
+
+    while (consumed < length) {
+        const uint8_t* next = &data[consumed];
+        uint16_t available = length - consumed;
+
+        // Zero-copy: whole ADUs are served from the segment itself
+        if (c.rx_length == 0 && available >= MODBUS_MBAP_HEADER_SIZE) {
+            uint16_t adu = adu_length(next);
+            if (adu == 0) {
+                stats.protocol_errors++;
+                return -1;
+            }
+            if (available >= adu) {
+                if (!serve(client, next, adu)) {
+                    break;
+                }
+                consumed += adu;
+                answered++;
+                continue;
+            }
+        }
+
+        // ADU split across segments: collect the header, then the rest
+        uint16_t wanted = MODBUS_MBAP_HEADER_SIZE;
+        if (c.rx_length >= MODBUS_MBAP_HEADER_SIZE) {
+            wanted = adu_length(c.rx_buffer);
+        }
+        uint16_t chunk = wanted - c.rx_length;
+        if (chunk > available) {
+            chunk = available;
+        }
+        memcpy(&c.rx_buffer[c.rx_length], next, chunk);
+        c.rx_length += chunk;
+        consumed += chunk;
+
+        if (c.rx_length == MODBUS_MBAP_HEADER_SIZE && wanted == MODBUS_MBAP_HEADER_SIZE) {
+            if (adu_length(c.rx_buffer) == 0) {
+                c.rx_length = 0;  // Never parsed again, even if the transport keeps the client
+                stats.protocol_errors++;
+                return -1;
+            }
+            continue;
+        }
+        if (c.rx_length == wanted) {
+            if (!serve(client, c.rx_buffer, c.rx_length)) {
+                break;  // Consumed but held, resume() answers it
+            }
+            c.rx_length = 0;
+            answered++;
+        }
+    }
+
+    if (answered > stats.max_pipelined) {
+        stats.max_pipelined = answered;
+    }
+    return consumed;
+}
@@ -0,0 +1,112 @@
+#ifndef PICO_PLC_MD_TCP_H
+#define PICO_PLC_MD_TCP_H
+
+#include <cstdint>
+#include <functional>
+
+// Modbus TCP (MBAP) protocol core. Transport independent and free of Pico SDK
+// headers: the lwIP listener (md_tcp_server.h) or a host socket loop feeds it bytes.
+
+#define MODBUS_TCP_PORT 502
+#define MODBUS_TCP_MAX_CLIENTS 4
+#define MODBUS_MBAP_HEADER_SIZE 7                // Transaction, protocol, length, unit ID
+#define MODBUS_TCP_MAX_PDU_SIZE 253
+#define MODBUS_TCP_MAX_ADU_SIZE (MODBUS_MBAP_HEADER_SIZE + MODBUS_TCP_MAX_PDU_SIZE)
+#define MODBUS_TCP_UNIT_ID 0xFF                  // "This server" when not behind a gateway
+
+// Serves request PDUs for a transport that carries its own addressing
+class ModbusPduHandler {
+public:
+    virtual ~ModbusPduHandler() = default;
+
+    // "reply" receives the unit ID followed by the response PDU, laid out like an RTU
+    // frame (two spare bytes at the end, for the CRC the RTU writer appends anyway).
+    // Returns the bytes written, 0 = no reply.
+    virtual uint16_t process_pdu(uint8_t unit_id, const uint8_t* pdu, uint16_t length, uint8_t* reply) = 0;
+};
+
+struct modbus_tcp_stats_t {
+    uint32_t connections;       // Accepted since start
+    uint32_t rejected;          // Refused, all client slots in use
+    uint32_t requests;          // ADUs answered
+    uint32_t no_reply;          // ADUs the handler left unanswered
+    uint32_t dropped;           // Clients given up on (e.g. a reply that could not be sent)
+    uint32_t protocol_errors;   // Bad MBAP header, connection dropped
+    uint32_t max_pipelined;     // Most ADUs answered from one receive()
+};
+
+class ModbusTcpServer {
+public:
+    // Free send buffer space of a client, and the send itself (must accept up to that space)
+    typedef std::function<uint16_t(int client)> send_space_function_t;
+    typedef std::function<bool(int client, const uint8_t* data, uint16_t length)> send_function_t;
+    // Close a client's connection from outside the transport's callbacks
+    typedef std::function<void(int client)> drop_function_t;
+
+private:
+    struct client_t {
+        bool open;
+        bool dropped;                                 // Waiting for the transport to close it
+        uint16_t rx_length;                           // Partial ADU split across segments
+        uint8_t rx_buffer[MODBUS_TCP_MAX_ADU_SIZE];
+    };
+
+    ModbusPduHandler* handler;
+    send_space_function_t send_space;
+    send_function_t send;
+    drop_function_t drop;
+    client_t clients[MODBUS_TCP_MAX_CLIENTS];
+    modbus_tcp_stats_t stats;
+
+    // Response ADU: MBAP header, then unit ID + PDU written in place by the handler
+    uint8_t tx_buffer[MODBUS_TCP_MAX_ADU_SIZE + 2];
+
+    // ADU length from a complete header, 0 if the header is not Modbus
+    static uint16_t adu_length(const uint8_t* header);
+    bool serve(int client, const uint8_t* adu, uint16_t length);
+
+protected:
+    // For servers that answer through handle_request() alone
+    ModbusTcpServer();
+
+    // Answer one request; the default passes the PDU to the handler and replies at once.
+    // Returns false if the request gets no reply.
+    virtual bool handle_request(int client, uint16_t transaction_id, uint8_t unit_id,
+                                const uint8_t* pdu, uint16_t length);
+    // False holds the client's next request back (TCP backpressure) until resume()
+    virtual bool can_accept([[maybe_unused]] int client) { return true; }
+    // Free send buffer space of a client (unlimited without a transport space function)
+    uint16_t get_send_space(int client) const;
+
+public:
+    explicit ModbusTcpServer(ModbusPduHandler& handler);
+    virtual ~ModbusTcpServer() = default;
+
+    void set_transport(const send_space_function_t& space, const send_function_t& send_fn,
+                       const drop_function_t& drop_fn = nullptr);
+
+    // Client slot for a new connection, -1 if all are in use
+    int open_client();
+    virtual void close_client(int client);
+    bool is_client_open(int client) const;
+    // Give up on a client (e.g. a reply that could not be sent): no further request of
+    // it is served, and the transport closes the connection, so the client reconnects
+    // and retries instead of timing out
+    void drop_client(int client);
+
+    // Stream bytes from a client. Every complete ADU is answered in order (pipelined
+    // requests included); whole ADUs are served straight from "data". Returns the bytes
+    // consumed, less than "length" when the send buffer is full (offer the rest again
+    // after resume()), or -1 on a protocol error (close the connection).
+    int receive(int client, const uint8_t* data, uint16_t length);
+    // Send space freed: answer a request held back for lack of it
+    bool resume(int client);
+
+    // Send a response ADU: "reply" is the unit ID + PDU
+    bool send_response(int client, uint16_t transaction_id, const uint8_t* reply, uint16_t length);
+
+    const modbus_tcp_stats_t& get_stats() const { return stats; }
+    void reset_stats() { stats = {}; }
+};
+
+#endif //PICO_PLC_MD_TCP_H
@@ -0,0 +1,177 @@
+#include "md_telemetry.h"
+#include <cstdio>
+#include <cstring>
+
+// ===== TELEMETRY =====
+
+ModbusTelemetry::ModbusTelemetry() {
+    reset();
+}
+
+void ModbusTelemetry::reset() {
+    memset(per_key, 0, sizeof(per_key));
+    memset(overall, 0, sizeof(overall));
+    memset(window_busy_us, 0, sizeof(window_busy_us));
+    tx_bytes = 0;
+    rx_bytes = 0;
+    completed = 0;
+    timeouts = 0;
+    untracked = 0;
+    window_slot_start_us = time_us_64();
+    window_slot = 0;
+}
+
+transaction_stats_t* ModbusTelemetry::find_or_create(uint8_t address, uint8_t function_code) {
+    // Exception responses are accounted under the request's function code
+    function_code &= 0x7F;
+
+    for (auto& stats : per_key) {
+        if (!stats.used) {
+            stats.used = true;
+            stats.address = address;
+            stats.function_code = function_code;
+            return &stats;
+        }
+        if (stats.address == address && stats.function_code == function_code) {
+            return &stats;
+        }
+    }
+    untracked++;
+    return nullptr;
+}
+
+const transaction_stats_t* ModbusTelemetry::get_stats(uint8_t address, uint8_t function_code) const {
+    for (const auto& stats : per_key) {
+        if (!stats.used) break;
+        if (stats.address == address && stats.function_code == function_code) {
+            return &stats;
+        }
+    }
+    return nullptr;
+}
+
+void ModbusTelemetry::advance_window(uint64_t now_us) {
+    uint64_t elapsed = now_us - window_slot_start_us;
+    if (elapsed < MODBUS_TELEMETRY_SLOT_US) return;
+
+    uint64_t slots = elapsed / MODBUS_TELEMETRY_SLOT_US;
+    if (slots > MODBUS_TELEMETRY_WINDOW_SLOTS) {
+        slots = MODBUS_TELEMETRY_WINDOW_SLOTS;
+    }
+    for (uint64_t i = 0; i < slots; i++) {
+        window_slot = (window_slot + 1) % MODBUS_TELEMETRY_WINDOW_SLOTS;
+        window_busy_us[window_slot] = 0;
+    }
+    window_slot_start_us = now_us - (elapsed % MODBUS_TELEMETRY_SLOT_US);
+}
+
+void ModbusTelemetry::add_busy(uint64_t start_us, uint64_t end_us) {
+    if (start_us == 0 || end_us <= start_us) return;
+    advance_window(end_us);
+    window_busy_us[window_slot] += (uint32_t)(end_us - start_us);
+}
+
+void ModbusTelemetry::record_transaction(uint8_t address, uint8_t function_code, const transaction_timestamps_t& ts,
+                                         uint16_t tx_length, uint16_t rx_length, bool exception) {
+    uint32_t phase_us[enum_value(ModbusPhase::COUNT)];
+    phase_us[enum_value(ModbusPhase::QUEUE_WAIT)] = (uint32_t)(ts.tx_start_us - ts.queued_us);
+    phase_us[enum_value(ModbusPhase::TX)] = (uint32_t)(ts.tx_end_us - ts.tx_start_us);
+    phase_us[enum_value(ModbusPhase::TURNAROUND)] = (uint32_t)(ts.rx_start_us - ts.tx_end_us);
+    phase_us[enum_value(ModbusPhase::RX)] = (uint32_t)(ts.rx_end_us - ts.rx_start_us);
+    phase_us[enum_value(ModbusPhase::TOTAL)] = (uint32_t)(ts.rx_end_us - ts.queued_us);
+
+    transaction_stats_t* stats = find_or_create(address, function_code);
+    for (uint8_t i = 0; i < enum_value(ModbusPhase::COUNT); i++) {
+        overall[i].add(phase_us[i]);
+        if (stats) stats->phases[i].add(phase_us[i]);
+    }
+    if (stats) {
+        stats->completed++;
+        if (exception) stats->exceptions++;
+    }
+
+    completed++;
+    tx_bytes += tx_length;
+    rx_bytes += rx_length;
+    add_busy(ts.tx_start_us, ts.tx_end_us);
+    add_busy(ts.rx_start_us, ts.rx_end_us);
+}
+
+void ModbusTelemetry::record_timeout(uint8_t address, uint8_t function_code, const transaction_timestamps_t& ts,
+                                     uint16_t tx_length) {
+    transaction_stats_t* stats = find_or_create(address, function_code);
+    if (stats) stats->timeouts++;
+
+    timeouts++;
+    tx_bytes += tx_length;
+    add_busy(ts.tx_start_us, ts.tx_end_us);
+}
+
+uint8_t ModbusTelemetry::get_bus_busy_percent(uint64_t now_us) {
+    advance_window(now_us);
+
+    uint64_t busy_us = 0;
+    for (uint32_t slot_busy : window_busy_us) {
+        busy_us += slot_busy;
+    }
+    // Current slot is only partially elapsed
+    uint64_t window_us = (uint64_t)(MODBUS_TELEMETRY_WINDOW_SLOTS - 1) * MODBUS_TELEMETRY_SLOT_US
+                         + (now_us - window_slot_start_us);
+    if (window_us == 0) return 0;
+
+    uint64_t percent = (busy_us * 100) / window_us;
+    return percent > 100 ? 100 : (uint8_t)percent;
+}
+
+static const char* phase_name(uint8_t phase) {
+    switch (phase) {
+        case enum_value(ModbusPhase::QUEUE_WAIT): return "queue";
+        case enum_value(ModbusPhase::TX):         return "tx";
+        case enum_value(ModbusPhase::TURNAROUND): return "turnaround";
+        case enum_value(ModbusPhase::RX):         return "rx";
+        case enum_value(ModbusPhase::TOTAL):      return "total";
+        default:                                  return "?";
+    }
+}
+
+void ModbusTelemetry::dump() {
+    printf("=== Modbus telemetry ===\n");
+    printf("Transactions: %lu, timeouts: %lu, untracked: %lu\n",
+           (unsigned long)completed, (unsigned long)timeouts, (unsigned long)untracked);
+    printf("Bytes TX: %llu, RX: %llu, bus busy: %u%%\n",
+           (unsigned long long)tx_bytes, (unsigned long long)rx_bytes, get_bus_busy_percent(time_us_64()));
+
+    printf("All slaves:\n");
+    for (uint8_t i = 0; i < enum_value(ModbusPhase::COUNT); i++) {
+        overall[i].print(phase_name(i));
+    }
+
+    for (const auto& stats : per_key) {
+        if (!stats.used) break;
+        printf("Slave %u func 0x%02X: ok=%lu exc=%lu timeout=%lu\n", stats.address, stats.function_code,
+               (unsigned long)stats.completed, (unsigned long)stats.exceptions, (unsigned long)stats.timeouts);
+        for (uint8_t i = 0; i < enum_value(ModbusPhase::COUNT); i++) {
+            stats.phases[i].print(phase_name(i));
+        }
+    }
+}
+
+void turnaround_stats_t::record(uint32_t us, bool from_irq) {
+    (from_irq ? irq : deferred).add(us);
+    if (budget_us != 0 && us > budget_us) {
+        over_budget++;
+    }
+}
+
+void turnaround_stats_t::clear() {
+    irq.clear();
+    deferred.clear();
+    over_budget = 0;
+}
+
+void turnaround_stats_t::dump() const {
+    printf("=== Modbus slave turnaround ===\n");
+    printf("Budget: %lu us, over budget: %lu\n", (unsigned long)budget_us, (unsigned long)over_budget);
+    irq.print("irq");
+    deferred.print("deferred");
+}
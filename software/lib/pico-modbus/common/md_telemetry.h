@@ -0,0 +1,102 @@
+#ifndef PICO_PLC_MD_TELEMETRY_H
+#define PICO_PLC_MD_TELEMETRY_H
+
+#include "md_common.h"
+#include "md_histogram.h"
+
+// Number of (slave, function code) pairs tracked individually
+#define MODBUS_TELEMETRY_MAX_KEYS 16
+
+// Bus utilization sliding window (10 x 100 ms = 1 s)
+#define MODBUS_TELEMETRY_WINDOW_SLOTS 10
+#define MODBUS_TELEMETRY_SLOT_US 100000
+
+// Phases of a master transaction
+enum class ModbusPhase : uint8_t {
+    QUEUE_WAIT = 0,  // send_request() -> first byte on the wire
+    TX,              // first byte -> last byte transmitted
+    TURNAROUND,      // last TX byte -> first response byte
+    RX,              // first -> last response byte
+    TOTAL,           // send_request() -> last response byte
+    COUNT
+};
+
+// Timestamps collected for one transaction (time_us_64() values)
+struct transaction_timestamps_t {
+    uint64_t queued_us;
+    uint64_t tx_start_us;
+    uint64_t tx_end_us;
+    uint64_t rx_start_us;
+    uint64_t rx_end_us;
+};
+
+// Slave reply timing: last request byte -> first reply byte
+struct turnaround_stats_t {
+    latency_histogram_t irq;       // Replies sent from the frame-complete interrupt
+    latency_histogram_t deferred;  // Replies sent from the main loop
+    uint32_t budget_us;            // 0 = no budget
+    uint32_t over_budget;
+
+    void record(uint32_t us, bool from_irq);
+    void clear();  // Keeps the budget
+    void dump() const;
+};
+
+struct transaction_stats_t {
+    uint8_t address;
+    uint8_t function_code;
+    bool used;
+    uint32_t completed;
+    uint32_t exceptions;
+    uint32_t timeouts;
+    latency_histogram_t phases[enum_value(ModbusPhase::COUNT)];
+};
+
+class ModbusTelemetry {
+private:
+    transaction_stats_t per_key[MODBUS_TELEMETRY_MAX_KEYS];
+    latency_histogram_t overall[enum_value(ModbusPhase::COUNT)];
+
+    uint64_t tx_bytes;
+    uint64_t rx_bytes;
+    uint32_t completed;
+    uint32_t timeouts;
+    uint32_t untracked;  // transactions that did not fit in per_key
+
+    // Sliding window of bus-busy time
+    uint32_t window_busy_us[MODBUS_TELEMETRY_WINDOW_SLOTS];
+    uint64_t window_slot_start_us;
+    uint8_t window_slot;
+
+    transaction_stats_t* find_or_create(uint8_t address, uint8_t function_code);
+    void advance_window(uint64_t now_us);
+    void add_busy(uint64_t start_us, uint64_t end_us);
+
+public:
+    ModbusTelemetry();
+
+    // Completed transaction (normal or exception response)
+    void record_transaction(uint8_t address, uint8_t function_code, const transaction_timestamps_t& ts,
+                            uint16_t tx_length, uint16_t rx_length, bool exception);
+    // Request sent but no response arrived
+    void record_timeout(uint8_t address, uint8_t function_code, const transaction_timestamps_t& ts,
+                        uint16_t tx_length);
+
+    const transaction_stats_t* get_stats(uint8_t address, uint8_t function_code) const;
+    const latency_histogram_t& get_overall(ModbusPhase phase) const { return overall[enum_value(phase)]; }
+
+    uint64_t get_tx_bytes() const { return tx_bytes; }
+    uint64_t get_rx_bytes() const { return rx_bytes; }
+    uint32_t get_completed_count() const { return completed; }
+    uint32_t get_timeout_count() const { return timeouts; }
+
+    // Percentage (0-100) of the last window the bus was carrying data
+    uint8_t get_bus_busy_percent(uint64_t now_us);
+
+    void reset();
+
+    // Print all statistics to stdio (USB CDC on the PLC builds)
+    void dump();
+};
+
+#endif //PICO_PLC_MD_TELEMETRY_H
@@ -0,0 +1,30 @@
+#include "md_gateway_link.h"
+#include <cstring>
+
+bool ModbusMasterLink::forward(uint32_t tag, uint8_t address, const uint8_t* pdu, uint16_t length, uint32_t timeout_ms) {
+    if (gateway == nullptr || length < 1 || length > MODBUS_TCP_MAX_PDU_SIZE || master.is_request_pending()) {
+        return false;
+    }
+
+    modbus_frame_t request;
+    request.address = address;
+    request.function_code = pdu[0];
+    request.data = const_cast<uint8_t*>(&pdu[1]);
+    request.data_length = length - 1;
+    request.crc = 0;
+
+    ModbusTcpGateway* target = gateway;
+    master.send_request(request,
+        [target, tag](const modbus_frame_t& response) {
+            // Back to PDU form, exception responses included
+            uint8_t reply[MODBUS_TCP_MAX_PDU_SIZE];
+            reply[0] = response.function_code;
+            memcpy(&reply[1], response.data, response.data_length);
+            target->complete(tag, reply, response.data_length + 1);
+        },
+        timeout_ms,
+        [target, tag]() {
+            target->fail(tag, enum_value(ModbusExceptionCode::GATEWAY_TARGET_RESPOND_FAILED));
+        });
+    return true;
+}
@@ -0,0 +1,26 @@
+#ifndef PICO_PLC_GATEWAY_LINK_H
+#define PICO_PLC_GATEWAY_LINK_H
+
+#include "md_master.h"
+#include "common/md_gateway.h"
+
+// Runs gateway transactions on an RTU bus through a ModbusMaster, e.g.
+//     ModbusMasterLink link(master);
+//     ModbusTcpGateway gateway(link, time_us_64);
+//     link.attach(gateway);
+//     ModbusTcpListener listener(gateway);
+// and in the main loop: master.process_tx_queue(), gateway.process(), listener.process()
+class ModbusMasterLink : public ModbusGatewayLink {
+private:
+    ModbusMaster& master;
+    ModbusTcpGateway* gateway;
+
+public:
+    explicit ModbusMasterLink(ModbusMaster& master) : master(master), gateway(nullptr) {}
+
+    void attach(ModbusTcpGateway& target) { gateway = &target; }
+
+    bool forward(uint32_t tag, uint8_t address, const uint8_t* pdu, uint16_t length, uint32_t timeout_ms) override;
+};
+
+#endif //PICO_PLC_GATEWAY_LINK_H
@@ -26,6 +26,17 @@ void ModbusMaster::handle_received_frame(const modbus_frame_t& frame) {
         bool is_exception_response = (frame.function_code == (pending_request->function_code | 0x80));
 
         if (pending_request->address == frame.address && (is_normal_response || is_exception_response)) {
+            transaction_timestamps_t ts = {
+                pending_request->timestamp_us,
+                pending_request->tx_start_us,
+                pending_request->tx_end_us,
+                get_stream()->get_last_frame_start_us(),
+                get_stream()->get_last_frame_end_us()
+            };
+            telemetry.record_transaction(frame.address, pending_request->function_code, ts,
+                                         pending_request->tx_length, frame.data_length + 4,
+                                         is_exception_response);
+            
             // Call the specific callback for this request
             if (pending_request->callback) {
                 pending_request->callback(frame);
@@ -41,7 +52,8 @@ void ModbusMaster::handle_received_frame(const modbus_frame_t& frame) {
 
 void ModbusMaster::send_request(const modbus_frame_t& frame, 
                                 const std::function<void(const modbus_frame_t&)>& callback,
-                                uint32_t timeout_ms) {
+                                uint32_t timeout_ms,
+                                const std::function<void()>& timeout_callback) {
     // Queue the frame for sending
     queue_write(frame);
     
@@ -57,8 +69,12 @@ void ModbusMaster::send_request(const modbus_frame_t& frame,
     pending_request->address = frame.address;
     pending_request->function_code = frame.function_code;
     pending_request->callback = callback;
+    pending_request->timeout_callback = timeout_callback;
     pending_request->timestamp_us = time_us_64();
     pending_request->timeout_ms = timeout_ms;
+    pending_request->tx_start_us = 0;
+    pending_request->tx_end_us = 0;
+    pending_request->tx_length = 0;
     request_sent = false; // Mark as not sent yet
     
     mutex_exit(&request_mutex);
@@ -68,6 +84,7 @@ void ModbusMaster::check_request_timeouts() {
     mutex_enter_blocking(&request_mutex);
     
     bool timed_out = false;
+    std::function<void()> timeout_callback;
     if (pending_request != nullptr && request_sent) {
         uint64_t elapsed_us = time_us_64() - pending_request->timestamp_us;
         uint64_t timeout_us = (uint64_t)pending_request->timeout_ms * 1000ULL;
@@ -85,7 +102,18 @@ void ModbusMaster::check_request_timeouts() {
             MODBUS_DEBUG_PRINT("[Master] Request TIMEOUT (addr=%d, func=0x%02X)\n", 
                    pending_request->address, pending_request->function_code);
             
+            transaction_timestamps_t ts = {
+                pending_request->timestamp_us,
+                pending_request->tx_start_us,
+                pending_request->tx_end_us,
+                0,
+                0
+            };
+            telemetry.record_timeout(pending_request->address, pending_request->function_code, ts,
+                                     pending_request->tx_length);
+            
             // Timeout - remove request
+            timeout_callback = pending_request->timeout_callback;
             delete pending_request;
             pending_request = nullptr;
             request_sent = false;
@@ -97,7 +125,10 @@ void ModbusMaster::check_request_timeouts() {
     
     // Increment no response counter after releasing mutex
     if (timed_out) {
-        diagnostic_counters.SLAVE_NO_RESPONSE_COUNT++;
+        diagnostics.increment(ModbusCounter::SLAVE_NO_RESPONSE);
+        if (timeout_callback) {
+            timeout_callback();
+        }
     }
 }
 
@@ -120,6 +151,14 @@ void ModbusMaster::process_tx_queue() {
         mutex_enter_blocking(&request_mutex);
         if (pending_request != nullptr) {
             request_sent = true;
+            
+            // Capture TX timing if the frame went out after the request was queued
+            const auto& stream = get_stream();
+            if (pending_request->tx_start_us == 0 && stream->get_last_tx_start_us() >= pending_request->timestamp_us) {
+                pending_request->tx_start_us = stream->get_last_tx_start_us();
+                pending_request->tx_end_us = stream->get_last_tx_end_us();
+                pending_request->tx_length = stream->get_last_tx_length();
+            }
         }
         mutex_exit(&request_mutex);
     }
@@ -224,6 +263,14 @@ void ModbusMaster::send_write_multiple_registers_request(uint8_t slave_addr, uin
     free_frame(request);
 }
 
+void ModbusMaster::send_mask_write_register_request(uint8_t slave_addr, uint16_t reg_addr, uint16_t and_mask, uint16_t or_mask,
+                                                    const std::function<void(const modbus_frame_t&)>& callback,
+                                                    uint32_t timeout_ms) {
+    modbus_frame_t request = mask_write_register_request(slave_addr, reg_addr, and_mask, or_mask);
+    send_request(request, callback, timeout_ms);
+    free_frame(request);
+}
+
 bool ModbusMaster::is_request_pending() {
     mutex_enter_blocking(&request_mutex);
     bool pending = (pending_request != nullptr);
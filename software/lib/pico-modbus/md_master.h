@@ -2,6 +2,7 @@
 #define PICO_PLC_MASTER_H
 
 #include "common/md_base.h"
+#include "common/md_telemetry.h"
 
 class ModbusMaster : public ModbusBase {
 private:
@@ -9,6 +10,9 @@ private:
     mutex_t request_mutex;
     bool request_sent;
     
+    // Per-phase latency histograms and bus utilization
+    ModbusTelemetry telemetry;
+    
     void check_request_timeouts();
     
 protected:
@@ -18,10 +22,11 @@ public:
     ModbusMaster(uart_inst_t* uart, uint baudrate, int de_pin = -1, int re_pin = -1, ModbusParity parity = ModbusParity::EVEN);  // Master has no address
     ~ModbusMaster();
     
-    // Send request with callback for response
+    // Send request with callback for response; timeout_callback runs if none arrives
     void send_request(const modbus_frame_t& frame, 
                       const std::function<void(const modbus_frame_t&)>& callback,
-                      uint32_t timeout_ms = 5000);
+                      uint32_t timeout_ms = 5000,
+                      const std::function<void()>& timeout_callback = nullptr);
 
     void send_diagnostic_request(uint8_t slave_addr, uint16_t sub_function, uint16_t data,
                                  const std::function<void(const modbus_frame_t&)>& callback,
@@ -75,9 +80,20 @@ public:
                                                const std::function<void(const modbus_frame_t&)>& callback,
                                                uint32_t timeout_ms = 5000);
 
+    // Atomically modifies one holding register on the slave:
+    // result = (current & and_mask) | (or_mask & ~and_mask)
+    void send_mask_write_register_request(uint8_t slave_addr, uint16_t reg_addr, uint16_t and_mask, uint16_t or_mask,
+                                          const std::function<void(const modbus_frame_t&)>& callback,
+                                          uint32_t timeout_ms = 5000);
+
     void process_tx_queue();
 
     bool is_request_pending();
+    
+    // Transaction latency and bus-utilization telemetry
+    ModbusTelemetry& get_telemetry() { return telemetry; }
+    void dump_telemetry() { telemetry.dump(); }
+    void reset_telemetry() { telemetry.reset(); }
 };
 
 
@@ -0,0 +1,142 @@
+#include "md_passthrough.h"
+#include "common/md_common.h"
+#include "pico/stdio.h"
+#include <cstring>
+
+ModbusPassthrough::ModbusPassthrough(uart_inst_t* uart, uint baudrate, int de_pin, int re_pin, ModbusParity parity)
+    : ModbusBase(uart, baudrate, de_pin, re_pin, parity),
+      batch_length(0), host_index(0), host_length(0),
+      reported_crc_errors(0), reported_short_frames(0), reported_dropped(0),
+      host_resyncs(0), batch_overflows(0) {
+}
+
+static void put_u16(uint8_t* p, uint16_t value) {
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+}
+
+static void put_u32(uint8_t* p, uint32_t value) {
+    put_u16(p, value & 0xFFFF);
+    put_u16(p + 2, value >> 16);
+}
+
+void ModbusPassthrough::append_record(PassthroughRecord type, uint64_t start_us, uint64_t end_us,
+                                      const uint8_t* payload, uint16_t length, const uint8_t* tail, uint16_t tail_length) {
+    uint16_t total = RECORD_HEADER_SIZE + length + tail_length;
+    if (batch_length + total > sizeof(batch)) {
+        flush_batch();
+        if (total > sizeof(batch)) {
+            batch_overflows++;
+            return;
+        }
+    }
+
+    uint8_t* record = &batch[batch_length];
+    record[0] = MODBUS_PASSTHROUGH_SYNC;
+    record[1] = enum_value(type);
+    put_u16(&record[2], length + tail_length);
+    put_u32(&record[4], (uint32_t)start_us);
+    put_u32(&record[8], (uint32_t)end_us);
+    memcpy(&record[RECORD_HEADER_SIZE], payload, length);
+    if (tail_length > 0) {
+        memcpy(&record[RECORD_HEADER_SIZE + length], tail, tail_length);
+    }
+    batch_length += total;
+}
+
+void ModbusPassthrough::handle_received_frame(const modbus_frame_t& frame) {
+    // Rebuild the wire bytes: address, function code, data, CRC low byte first
+    uint8_t head[2] = { frame.address, frame.function_code };
+    uint8_t wire[MODBUS_MAX_FRAME_SIZE];
+    memcpy(wire, frame.data, frame.data_length);
+    wire[frame.data_length] = frame.crc & 0xFF;
+    wire[frame.data_length + 1] = (frame.crc >> 8) & 0xFF;
+
+    const auto& stream = get_stream();
+    append_record(PassthroughRecord::RX_FRAME, stream->get_last_frame_start_us(), stream->get_last_frame_end_us(),
+                  head, sizeof(head), wire, frame.data_length + 2);
+}
+
+void ModbusPassthrough::read_host() {
+    uint8_t buffer[64];
+    int count = stdio_get_until(reinterpret_cast<char*>(buffer), sizeof(buffer), get_absolute_time());
+    for (int i = 0; i < count; i++) {
+        host_byte(buffer[i]);
+    }
+}
+
+void ModbusPassthrough::host_byte(uint8_t byte) {
+    if (host_index < HOST_HEADER_SIZE) {
+        if (host_index == 0 && byte != MODBUS_PASSTHROUGH_SYNC) {
+            host_resyncs++;
+            return;
+        }
+        host_header[host_index++] = byte;
+        if (host_index == HOST_HEADER_SIZE) {
+            host_length = host_header[2] | (host_header[3] << 8);
+            if (host_header[1] != enum_value(PassthroughRecord::TX_FRAME) ||
+                host_length < 4 || host_length > MODBUS_MAX_FRAME_SIZE) {
+                // Not a record start after all, look for the next sync byte
+                host_resyncs++;
+                host_index = 0;
+            }
+        }
+        return;
+    }
+
+    host_frame[host_index++ - HOST_HEADER_SIZE] = byte;
+    if (host_index - HOST_HEADER_SIZE == host_length) {
+        send_host_frame();
+        host_index = 0;
+    }
+}
+
+void ModbusPassthrough::send_host_frame() {
+    // Sent as is: the host owns the CRC, a bad one is the host's test case
+    const auto& stream = get_stream();
+    stream->wait_tx_idle();
+    memcpy(stream->get_tx_buffer(), host_frame, host_length);
+    stream->write_prepared(host_length);
+    diagnostics.increment(ModbusCounter::BUS_MESSAGE);
+
+    uint8_t sent[2];
+    put_u16(sent, host_length);
+    append_record(PassthroughRecord::TX_DONE, stream->get_last_tx_start_us(), stream->get_last_tx_end_us(),
+                  sent, sizeof(sent));
+}
+
+void ModbusPassthrough::report_errors() {
+    uint32_t crc_errors = diagnostics.get(ModbusCounter::CRC_ERROR);
+    uint32_t short_frames = diagnostics.get(ModbusCounter::SHORT_FRAME);
+    uint32_t dropped = diagnostics.get(ModbusCounter::RX_FRAME_DROPPED);
+    if (crc_errors == reported_crc_errors && short_frames == reported_short_frames && dropped == reported_dropped) {
+        return;
+    }
+    reported_crc_errors = crc_errors;
+    reported_short_frames = short_frames;
+    reported_dropped = dropped;
+
+    uint8_t counters[12];
+    put_u32(&counters[0], crc_errors);
+    put_u32(&counters[4], short_frames);
+    put_u32(&counters[8], dropped);
+    uint64_t now = time_us_64();
+    append_record(PassthroughRecord::BUS_ERRORS, now, now, counters, sizeof(counters));
+}
+
+void ModbusPassthrough::flush_batch() {
+    if (batch_length == 0) {
+        return;
+    }
+    // One write for the whole batch: TinyUSB packs it into full-size packets
+    stdio_put_string(reinterpret_cast<const char*>(batch), batch_length, false, false);
+    stdio_flush();
+    batch_length = 0;
+}
+
+void ModbusPassthrough::process() {
+    get_stream()->process_if_ready();
+    read_host();
+    report_errors();
+    flush_batch();
+}
@@ -0,0 +1,69 @@
+#ifndef PICO_PLC_PASSTHROUGH_H
+#define PICO_PLC_PASSTHROUGH_H
+
+#include "common/md_base.h"
+
+// USB CDC <-> RS-485 bridge for host tools. Framing (T1.5/T3.5) is done here, so the
+// host exchanges whole frames in records, all fields little-endian:
+//
+//   host -> device:  0xA5, type, length (u16), payload
+//   device -> host:  0xA5, type, length (u16), start_us (u32), end_us (u32), payload
+//
+// Records from the device are batched: everything completed since the last
+// process() goes to USB in one write, filling whole packets.
+#define MODBUS_PASSTHROUGH_SYNC 0xA5
+#define MODBUS_PASSTHROUGH_BATCH_SIZE 1024
+
+enum class PassthroughRecord : uint8_t {
+    RX_FRAME = 0x01,    // Device: frame from the bus, CRC included, timed first -> last byte
+    TX_DONE = 0x02,     // Device: host frame sent, payload = bytes sent (u16)
+    BUS_ERRORS = 0x03,  // Device: counters changed, payload = CRC errors, short frames, dropped (u32 each)
+    TX_FRAME = 0x10     // Host: frame to send as is, CRC included
+};
+
+class ModbusPassthrough : public ModbusBase {
+private:
+    static constexpr uint8_t RECORD_HEADER_SIZE = 12;
+    static constexpr uint8_t HOST_HEADER_SIZE = 4;
+
+    // Records waiting for the next USB write
+    uint8_t batch[MODBUS_PASSTHROUGH_BATCH_SIZE];
+    uint16_t batch_length;
+
+    // Host record being received
+    uint8_t host_header[HOST_HEADER_SIZE];
+    uint8_t host_frame[MODBUS_MAX_FRAME_SIZE];
+    uint16_t host_index;
+    uint16_t host_length;
+
+    // Last reported error counters
+    uint32_t reported_crc_errors;
+    uint32_t reported_short_frames;
+    uint32_t reported_dropped;
+
+    uint32_t host_resyncs;     // Bytes skipped looking for a record start
+    uint32_t batch_overflows;  // Records lost, USB not drained fast enough
+
+    void append_record(PassthroughRecord type, uint64_t start_us, uint64_t end_us,
+                       const uint8_t* payload, uint16_t length, const uint8_t* tail = nullptr, uint16_t tail_length = 0);
+    void read_host();
+    void host_byte(uint8_t byte);
+    void send_host_frame();
+    void report_errors();
+    void flush_batch();
+
+protected:
+    void handle_received_frame(const modbus_frame_t& frame) override;
+
+public:
+    ModbusPassthrough(uart_inst_t* uart, uint baudrate, int de_pin = -1, int re_pin = -1, ModbusParity parity = ModbusParity::EVEN);
+
+    // Move frames both ways and push the batch to USB; call in a tight loop,
+    // with nothing else writing to stdio
+    void process();
+
+    uint32_t get_host_resync_count() const { return host_resyncs; }
+    uint32_t get_batch_overflow_count() const { return batch_overflows; }
+};
+
+#endif //PICO_PLC_PASSTHROUGH_H
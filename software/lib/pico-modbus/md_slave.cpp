@@ -6,285 +6,385 @@
 
 ModbusSlave::ModbusSlave(uint8_t address, uart_inst_t* uart, uint baudrate, int de_pin, int re_pin, ModbusParity parity)
     : ModbusBase(uart, baudrate, de_pin, re_pin, parity),
-      device_address(address),
+      ModbusSlaveUnit(address),
       is_broadcast_request(false),
-      holding_registers_enabled(false),
-      input_registers_enabled(false),
-      coils_enabled(false),
-      discrete_inputs_enabled(false),
-      auto_sync_gpio(false),
-      holding_registers(nullptr),
-      holding_registers_size(0),
-      input_registers(nullptr),
-      input_registers_size(0) {
-    // Slave must have address 1-247 (0=broadcast)
-    assert(address >= 1 && address <= 247 && "Slave address must be 1-247");
+      unit_table{},
+      current_unit(this),
+      fast_response_enabled(false),
+      irq_reply_active(false),
+      pdu_reply(nullptr),
+      pdu_reply_length(0),
+      turnaround{} {
+    unit_table[address] = this;
+    units.push_back(this);
+    memset(custom_index, NO_CUSTOM_FUNCTION, sizeof(custom_index));
 }
 
-void ModbusSlave::handle_received_frame(const modbus_frame_t& frame) {
-    // Call debug callback if set
-    invoke_debug_callback(frame);
-    
-    // Only process frames addressed to us or broadcast (address 0)
-    if (frame.address != get_address() && frame.address != 0) {
-        return;  // Not for us
+void ModbusSlave::enable_fast_response(uint32_t turnaround_budget_us) {
+    turnaround.budget_us = turnaround_budget_us;
+    if (!fast_response_enabled) {
+        fast_response_enabled = true;
+        enable_irq_framing();
+    }
+}
+
+ModbusSlaveUnit* ModbusSlave::add_unit(uint8_t address) {
+    if (address < 1 || address > MAX_UNIT_ADDRESS || unit_table[address] != nullptr) {
+        return nullptr;
+    }
+    extra_units.push_back(std::make_unique<ModbusSlaveUnit>(address));
+    ModbusSlaveUnit* unit = extra_units.back().get();
+    unit->persistent_store = persistence.is_enabled() ? &persistence : nullptr;
+    unit_table[address] = unit;
+    units.push_back(unit);
+    return unit;
+}
+
+ModbusSlaveUnit* ModbusSlave::get_unit(uint8_t address) const {
+    if (address > MAX_UNIT_ADDRESS) {
+        return nullptr;
+    }
+    return unit_table[address];
+}
+
+bool ModbusSlave::enable_persistence(uint32_t flash_offset, uint8_t sector_count, uint32_t flush_delay_ms) {
+    if (!persistence.init(flash_offset, sector_count, flush_delay_ms)) {
+        return false;
+    }
+    for (ModbusSlaveUnit* unit : units) {
+        unit->persistent_store = &persistence;
+    }
+    return true;
+}
+
+bool ModbusSlave::persist_holding_registers(uint16_t start, uint16_t count, uint8_t unit_address) {
+    ModbusSlaveUnit* unit = (unit_address == 0) ? this : get_unit(unit_address);
+    if (unit == nullptr || !persistence.is_enabled() || count == 0) {
+        return false;
     }
     
-    is_broadcast_request = (frame.address == 0);
-    uint8_t func = frame.function_code;
-    
-    // Parse request fields
-    uint16_t start_addr = 0;
-    uint16_t count = 0;
-    if (frame.data_length >= 4) {
-        start_addr = (frame.data[0] << 8) | frame.data[1];
-        count = (frame.data[2] << 8) | frame.data[3];
+    // Must be one RAM region: flash records are applied straight to its storage
+    const register_region_t* region = unit->holding_registers.find(start);
+    if (region == nullptr || !region->is_ram() || (uint32_t)start + count > region->end()) {
+        return false;
+    }
+    return persistence.add_range(unit->get_address(), start, count, unit->holding_registers.ram_pointer(start));
+}
+
+uint32_t ModbusSlave::restore_persistent_registers() {
+    return persistence.restore();
+}
+
+bool ModbusSlave::flush_persistent_registers() {
+    return persistence.flush();
+}
+
+void ModbusSlave::process_background() {
+    // Flash programming stalls this core, so only start it between frames
+    if (persistence.has_pending() && !get_stream()->is_tx_busy() &&
+        get_stream()->get_time_since_last_rx() >= get_stream()->get_t3_5_us()) {
+        persistence.service(time_us_64());
     }
+}
+
+bool ModbusSlave::enable_diagnostic_registers(uint16_t base) {
+    return add_input_register_callback(base, ModbusDiagnostics::REGISTER_COUNT,
+                                       [this, base](uint16_t start, uint16_t count, uint16_t* values) {
+        return diagnostics.read_registers(start - base, count, values);
+    });
+}
+
+bool ModbusSlave::is_fast_path_request(const ModbusSlaveUnit& unit, const modbus_frame_t& frame) const {
+    if (frame.data_length < 4) {
+        return false;
+    }
+    uint16_t start_addr = (frame.data[0] << 8) | frame.data[1];
+    uint16_t count = (frame.data[2] << 8) | frame.data[3];
     
-    // Handle function codes
-    switch (func) {
+    // Bit stores are always RAM; register reads must not reach application callbacks
+    switch (frame.function_code) {
         case enum_value(ModbusFunctionCode::READ_COILS):
-            handle_read_coils(frame, start_addr, count);
-            break;
-            
         case enum_value(ModbusFunctionCode::READ_DISCRETE_INPUTS):
-            handle_read_discrete_inputs(frame, start_addr, count);
-            break;
-            
+            return true;
         case enum_value(ModbusFunctionCode::READ_HOLDING_REGISTERS):
-            handle_read_holding_registers(frame, start_addr, count);
-            break;
-            
+            return !unit.holding_registers.has_callbacks(start_addr, count);
         case enum_value(ModbusFunctionCode::READ_INPUT_REGISTERS):
-            handle_read_input_registers(frame, start_addr, count);
-            break;
-            
-        case enum_value(ModbusFunctionCode::WRITE_SINGLE_COIL):
-            handle_write_single_coil(frame, start_addr);
-            break;
-            
-        case enum_value(ModbusFunctionCode::WRITE_SINGLE_REGISTER):
-            handle_write_single_register(frame, start_addr);
-            break;
-            
-        case enum_value(ModbusFunctionCode::WRITE_MULTIPLE_COILS):
-            handle_write_multiple_coils(frame, start_addr, count);
-            break;
-            
-        case enum_value(ModbusFunctionCode::WRITE_MULTIPLE_REGISTERS):
-            handle_write_multiple_registers(frame, start_addr, count);
-            break;
-            
-        case enum_value(ModbusFunctionCode::READ_DIAGNOSTICS):
-            handle_read_diagnostics(frame);
-            break;
-            
+            return !unit.input_registers.has_callbacks(start_addr, count);
         default:
-            // Unsupported function code
-            if (!is_broadcast_request) {
-                send_exception(func, ModbusExceptionCode::ILLEGAL_FUNCTION);
-            } else {
-                // Broadcast - no response, but count as no-response
-                diagnostic_counters.SLAVE_NO_RESPONSE_COUNT++;
-            }
-            break;
+            return false;
     }
-    
-    // Increment message counter after successful processing (per spec)
-    diagnostic_counters.SLAVE_MESSAGE_COUNT++;
-    
-    // Call application message callback
-    invoke_message_callback(frame);
 }
 
-void ModbusSlave::send_reply(const modbus_frame_t& frame) {
-    // Don't send replies to broadcast messages (address 0)
-    if (is_broadcast_request) {
-        diagnostic_counters.SLAVE_NO_RESPONSE_COUNT++;
-        return;
+bool ModbusSlave::handle_received_frame_irq(const modbus_frame_t& frame) {
+    if (frame.address == 0 || pdu_reply != nullptr) {
+        return false;  // Broadcasts are writes; a TCP request owns the handlers right now
     }
-    queue_write(frame);
-    process_tx_queue();
+    ModbusSlaveUnit* unit = get_unit(frame.address);
+    if (unit == nullptr) {
+        return true;  // Not for us, nothing to do
+    }
+    if (!is_fast_path_request(*unit, frame)) {
+        return false;
+    }
+    
+    is_broadcast_request = false;
+    irq_reply_active = true;
+    dispatch(*unit, frame);
+    irq_reply_active = false;
+    return true;
 }
 
-void ModbusSlave::send_exception(uint8_t function_code, ModbusExceptionCode exception_code) {
-    diagnostic_counters.SLAVE_EXCEPTION_ERROR_COUNT++;
-    send_reply(exception_response(get_address(), function_code, exception_code));
-}
-
-// Enable register types
-void ModbusSlave::enable_holding_registers(uint16_t size) {
-    holding_registers = std::make_unique<uint16_t[]>(size);
-    holding_registers_size = size;
-    holding_registers_enabled = true;
-    std::memset(holding_registers.get(), 0, size * sizeof(uint16_t));
-}
-
-void ModbusSlave::enable_input_registers(uint16_t size) {
-    input_registers = std::make_unique<uint16_t[]>(size);
-    input_registers_size = size;
-    input_registers_enabled = true;
-    std::memset(input_registers.get(), 0, size * sizeof(uint16_t));
-}
-
-void ModbusSlave::enable_coils(const std::map<uint16_t, bool>& initial_coils, bool auto_gpio) {
-    coils = initial_coils;
-    coils_enabled = true;
-    auto_sync_gpio = auto_gpio;
-    
-    // Initialize GPIO pins if auto-sync enabled
-    if (auto_sync_gpio) {
-        for (const auto& pair : coils) {
-            uint16_t gpio_num = pair.first;
-            if (gpio_num < 30) {  // Valid GPIO range for RP2040/RP2350
-                gpio_init(gpio_num);
-                gpio_set_dir(gpio_num, GPIO_OUT);
-                gpio_put(gpio_num, pair.second ? 1 : 0);
-            }
+void ModbusSlave::handle_received_frame(const modbus_frame_t& frame) {
+    // Call debug callback if set
+    invoke_debug_callback(frame);
+    
+    if (is_frame_answered()) {
+        // Already replied from the frame-complete interrupt, only the bookkeeping is left
+        if (get_unit(frame.address) != nullptr) {
+            diagnostics.increment(ModbusCounter::SLAVE_MESSAGE);
+            invoke_message_callback(frame);
         }
+        return;
     }
-}
-
-void ModbusSlave::sync_gpio_outputs() {
-    if (!auto_sync_gpio || !coils_enabled) return;
     
-    for (const auto& pair : coils) {
-        uint16_t gpio_num = pair.first;
-        bool state = pair.second;
-        if (gpio_num < 30) {  // Valid GPIO range
-            gpio_put(gpio_num, state ? 1 : 0);
+    is_broadcast_request = (frame.address == 0);
+    
+    if (is_broadcast_request) {
+        // Broadcast reaches every hosted unit, none of them replies
+        for (ModbusSlaveUnit* unit : units) {
+            dispatch(*unit, frame);
         }
+    } else {
+        // Only process frames addressed to one of our units
+        ModbusSlaveUnit* unit = get_unit(frame.address);
+        if (unit == nullptr) {
+            return;  // Not for us
+        }
+        dispatch(*unit, frame);
     }
+    
+    // Increment message counter after successful processing (per spec)
+    diagnostics.increment(ModbusCounter::SLAVE_MESSAGE);
+    
+    // Call application message callback
+    invoke_message_callback(frame);
 }
 
-void ModbusSlave::update_gpio_outputs() {
-    sync_gpio_outputs();
+// Handler per function code, resolved at compile time from the enabled feature set.
+// Every entry is valid: codes without a built-in handler go to the custom function
+// handlers, exception-flagged codes (0x80+) are always illegal. Kept in RAM so
+// dispatch does not wait on XIP flash.
+constexpr std::array<ModbusSlave::handler_t, 256> ModbusSlave::build_handler_table() {
+    std::array<handler_t, 256> table{};
+    for (size_t fc = 0; fc < table.size(); fc++) {
+        table[fc] = (fc < 0x80) ? &ModbusSlave::handle_custom_function : &ModbusSlave::handle_illegal_function;
+    }
+    
+#if MODBUS_SLAVE_COILS
+    table[enum_value(ModbusFunctionCode::READ_COILS)] = &ModbusSlave::handle_read_coils;
+    table[enum_value(ModbusFunctionCode::WRITE_SINGLE_COIL)] = &ModbusSlave::handle_write_single_coil;
+    table[enum_value(ModbusFunctionCode::WRITE_MULTIPLE_COILS)] = &ModbusSlave::handle_write_multiple_coils;
+#endif
+#if MODBUS_SLAVE_DISCRETE_INPUTS
+    table[enum_value(ModbusFunctionCode::READ_DISCRETE_INPUTS)] = &ModbusSlave::handle_read_discrete_inputs;
+#endif
+#if MODBUS_SLAVE_HOLDING_REGISTERS
+    table[enum_value(ModbusFunctionCode::READ_HOLDING_REGISTERS)] = &ModbusSlave::handle_read_holding_registers;
+    table[enum_value(ModbusFunctionCode::WRITE_SINGLE_REGISTER)] = &ModbusSlave::handle_write_single_register;
+    table[enum_value(ModbusFunctionCode::WRITE_MULTIPLE_REGISTERS)] = &ModbusSlave::handle_write_multiple_registers;
+    table[enum_value(ModbusFunctionCode::MASK_WRITE_REGISTER)] = &ModbusSlave::handle_mask_write_register;
+#endif
+#if MODBUS_SLAVE_INPUT_REGISTERS
+    table[enum_value(ModbusFunctionCode::READ_INPUT_REGISTERS)] = &ModbusSlave::handle_read_input_registers;
+#endif
+#if MODBUS_SLAVE_DIAGNOSTICS
+    table[enum_value(ModbusFunctionCode::READ_DIAGNOSTICS)] = &ModbusSlave::handle_read_diagnostics;
+#endif
+    return table;
 }
 
-void ModbusSlave::enable_discrete_inputs(const std::map<uint16_t, bool>& initial_inputs) {
-    discrete_inputs = initial_inputs;
-    discrete_inputs_enabled = true;
-}
+const std::array<ModbusSlave::handler_t, 256> __not_in_flash("modbus") ModbusSlave::handler_table =
+    ModbusSlave::build_handler_table();
 
-// Holding register access
-bool ModbusSlave::check_hregister_exist(uint16_t address, uint16_t count) {
-    // Check if address range is valid (address + count must not overflow)
-    if (address > holding_registers_size || count > holding_registers_size) {
-        return false;
-    }
-    // Check if the range fits within the allocated size
-    if (address + count > holding_registers_size) {
-        return false;
+uint16_t ModbusSlave::request_word(const modbus_frame_t& frame, uint8_t offset) {
+    if (frame.data_length < offset + 2) {
+        return 0;
     }
-    return true;
+    return (frame.data[offset] << 8) | frame.data[offset + 1];
 }
 
-bool ModbusSlave::set_holding_register(uint16_t address, uint16_t value) {
-    if (!holding_registers_enabled || address >= holding_registers_size) {
-        return false;
+void ModbusSlave::dispatch(ModbusSlaveUnit& unit, const modbus_frame_t& frame) {
+    current_unit = &unit;
+    
+    // Take the latest committed snapshot; the whole request is served from it
+    if (!unit.process_image.empty()) {
+        unit.process_image.acquire();
     }
-    holding_registers[address] = value;
-    return true;
+    
+    (this->*handler_table[frame.function_code])(unit, frame);
+    
+    unit.unit_counters.SLAVE_MESSAGE_COUNT++;
 }
 
-bool ModbusSlave::get_holding_register(uint16_t address, uint16_t& value) const {
-    if (!holding_registers_enabled || address >= holding_registers_size) {
+bool ModbusSlave::register_function(uint8_t function_code, const modbus_function_handler_t& handler) {
+    // Only codes without a built-in handler
+    if (function_code == 0 || function_code >= 0x80 ||
+        handler_table[function_code] != &ModbusSlave::handle_custom_function || !handler) {
         return false;
     }
-    value = holding_registers[address];
-    return true;
-}
-
-// Input register access
-bool ModbusSlave::check_iregister_exist(uint16_t address, uint16_t count) {
-    // Check if address range is valid
-    if (address > input_registers_size || count > input_registers_size) {
-        return false;
+    
+    if (custom_index[function_code] != NO_CUSTOM_FUNCTION) {
+        custom_functions[custom_index[function_code]] = handler;  // Replace
+        return true;
     }
-    // Check if the range fits within the allocated size
-    if (address + count > input_registers_size) {
+    if (custom_functions.size() >= NO_CUSTOM_FUNCTION) {
         return false;
     }
+    custom_index[function_code] = custom_functions.size();
+    custom_functions.push_back(handler);
     return true;
 }
 
-bool ModbusSlave::set_input_register(uint16_t address, uint16_t value) {
-    if (address >= input_registers_size) {
-        return false;
+uint16_t ModbusSlave::process_pdu(uint8_t unit_id, const uint8_t* pdu, uint16_t length, uint8_t* reply) {
+    if (length < 1 || length > MODBUS_MAX_FRAME_SIZE - 3) {
+        return 0;
     }
-    input_registers[address] = value;
-    return true;
+    
+    ModbusSlaveUnit* unit = (unit_id == 0 || unit_id == MODBUS_TCP_UNIT_ID) ? this : get_unit(unit_id);
+    if (unit == nullptr) {
+        // Not hosted here: answer like a gateway with no path to the unit
+        reply[0] = unit_id;
+        reply[1] = pdu[0] | 0x80;
+        reply[2] = enum_value(ModbusExceptionCode::GATEWAY_PATH_UNAVAILABLE);
+        return 3;
+    }
+    
+    modbus_frame_t frame;
+    frame.address = unit_id;
+    frame.function_code = pdu[0];
+    frame.data = const_cast<uint8_t*>(&pdu[1]);
+    frame.data_length = length - 1;
+    frame.crc = 0;
+    
+    is_broadcast_request = false;
+    pdu_reply_length = 0;
+    pdu_reply = reply;
+    dispatch(*unit, frame);
+    pdu_reply = nullptr;
+    
+    invoke_message_callback(frame);
+    
+    if (pdu_reply_length == 0) {
+        return 0;
+    }
+    reply[0] = unit_id;  // Echo the requested unit ID, also for the MODBUS_TCP_UNIT_ID alias
+    return pdu_reply_length;
 }
 
-bool ModbusSlave::get_input_register(uint16_t address, uint16_t& value) const {
-    if (!input_registers_enabled || address >= input_registers_size) {
-        return false;
+void ModbusSlave::handle_illegal_function(ModbusSlaveUnit& unit, const modbus_frame_t& frame) {
+    // Unsupported function code
+    if (!is_broadcast_request) {
+        send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_FUNCTION);
+    } else {
+        // Broadcast - no response, but count as no-response
+        diagnostics.increment(ModbusCounter::SLAVE_NO_RESPONSE);
+        unit.unit_counters.SLAVE_NO_RESPONSE_COUNT++;
     }
-    value = input_registers[address];
-    return true;
 }
 
-// Coil access
-bool ModbusSlave::check_coils_exist(uint16_t starting_address, uint16_t count) const {
-    // Check if all coil addresses in the range exist in the map
-    for (uint16_t i = 0; i < count; i++) {
-        if (coils.find(starting_address + i) == coils.end()) {
-            return false;
-        }
+void ModbusSlave::handle_custom_function(ModbusSlaveUnit& unit, const modbus_frame_t& frame) {
+    uint8_t index = custom_index[frame.function_code];
+    if (index == NO_CUSTOM_FUNCTION) {
+        handle_illegal_function(unit, frame);
+        return;
     }
-    return true;
+    
+    // The handler writes its response payload straight into the TX buffer
+    ModbusFrameWriter writer = begin_reply(frame.function_code);
+    int length = custom_functions[index](unit, frame.data, frame.data_length, writer.tail(),
+                                         MODBUS_SLAVE_REPLY_CAPACITY);
+    if (length < 0) {
+        send_exception(frame.function_code, static_cast<ModbusExceptionCode>(-length));
+        return;
+    }
+    if (length > MODBUS_SLAVE_REPLY_CAPACITY) {
+        // A handler breaking its contract; the frame end is not sent
+        send_exception(frame.function_code, ModbusExceptionCode::SLAVE_DEVICE_FAILURE);
+        return;
+    }
+    writer.advance(length);
+    send_reply(writer);
 }
 
-bool ModbusSlave::set_coil(uint16_t address, bool value) {
-    if (!coils_enabled || coils.find(address) == coils.end()) {
-        return false;
+void ModbusSlave::send_reply(const modbus_frame_t& frame) {
+    // Don't send replies to broadcast messages (address 0)
+    if (is_broadcast_request) {
+        diagnostics.increment(ModbusCounter::SLAVE_NO_RESPONSE);
+        current_unit->unit_counters.SLAVE_NO_RESPONSE_COUNT++;
+        return;
     }
-    coils[address] = value;
-    return true;
+    queue_write(frame);
+    process_tx_queue();
 }
 
-bool ModbusSlave::get_coil(uint16_t address, bool& value) const {
-    auto it = coils.find(address);
-    if (!coils_enabled || it == coils.end()) {
-        return false;
+ModbusFrameWriter ModbusSlave::begin_reply(uint8_t function_code) {
+    if (pdu_reply != nullptr) {
+        return ModbusFrameWriter(pdu_reply, current_unit->get_address(), function_code);
     }
-    value = it->second;
-    return true;
+    return begin_frame(current_unit->get_address(), function_code);
 }
 
-// Discrete input access
-bool ModbusSlave::check_discrete_exist(uint16_t address, uint16_t count) {
-    // Check if all discrete input addresses in the range exist in the map
-    for (uint16_t i = 0; i < count; i++) {
-        if (discrete_inputs.find(address + i) == discrete_inputs.end()) {
-            return false;
-        }
+void ModbusSlave::send_reply(ModbusFrameWriter& writer) {
+    if (pdu_reply != nullptr) {
+        pdu_reply_length = writer.get_length();  // Already in the caller's buffer
+        return;
     }
-    return true;
+    
+    // Don't send replies to broadcast messages (address 0)
+    if (is_broadcast_request) {
+        diagnostics.increment(ModbusCounter::SLAVE_NO_RESPONSE);
+        current_unit->unit_counters.SLAVE_NO_RESPONSE_COUNT++;
+        return;
+    }
+    
+    if (irq_reply_active) {
+        send_frame_async(writer);
+    } else {
+        send_frame(writer);
+    }
+    
+    const auto& stream = get_stream();
+    turnaround.record((uint32_t)(stream->get_last_tx_start_us() - stream->get_last_frame_end_us()), irq_reply_active);
 }
 
-bool ModbusSlave::set_discrete_input(uint16_t address, bool value) {
-    if (discrete_inputs.find(address) == discrete_inputs.end()) {
-        return false;
-    }
-    discrete_inputs[address] = value;
-    return true;
+void ModbusSlave::send_echo_reply(const modbus_frame_t& frame, uint8_t length) {
+    ModbusFrameWriter writer = begin_reply(frame.function_code);
+    writer.put_bytes(frame.data, length);
+    send_reply(writer);
 }
 
-bool ModbusSlave::get_discrete_input(uint16_t address, bool& value) const {
-    auto it = discrete_inputs.find(address);
-    if (!discrete_inputs_enabled || it == discrete_inputs.end()) {
-        return false;
-    }
-    value = it->second;
-    return true;
+void ModbusSlave::send_exception(uint8_t function_code, ModbusExceptionCode exception_code) {
+    diagnostics.increment(ModbusCounter::SLAVE_EXCEPTION_ERROR);
+    diagnostics.count_exception(enum_value(exception_code));
+    if (exception_code == ModbusExceptionCode::SLAVE_DEVICE_BUSY) {
+        diagnostics.increment(ModbusCounter::SLAVE_BUSY);
+    } else if (exception_code == ModbusExceptionCode::NEGATIVE_ACKNOWLEDGE) {
+        diagnostics.increment(ModbusCounter::SLAVE_NAK);
+    }
+    current_unit->unit_counters.SLAVE_EXCEPTION_ERROR_COUNT++;
+    ModbusFrameWriter writer = begin_reply(function_code | 0x80);
+    writer.put(enum_value(exception_code));
+    send_reply(writer);
 }
 
 // ===== FUNCTION CODE HANDLERS =====
 
-void ModbusSlave::handle_read_coils(const modbus_frame_t& frame, uint16_t start_addr, uint16_t count) {
+#if MODBUS_SLAVE_COILS
+void ModbusSlave::handle_read_coils(ModbusSlaveUnit& unit, const modbus_frame_t& frame) {
+    uint16_t start_addr = request_word(frame, 0);
+    uint16_t count = request_word(frame, 2);
     // Check if function is supported
-    if (!is_coils_enabled()) {
+    if (!unit.is_coils_enabled()) {
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_FUNCTION);
         return;
     }
@@ -296,31 +396,26 @@ void ModbusSlave::handle_read_coils(const modbus_frame_t& frame, uint16_t start_
     }
     
     // Check if addresses exist
-    if (!check_coils_exist(start_addr, count)) {
+    if (!unit.check_coils_exist(start_addr, count)) {
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_DATA_ADDRESS);
         return;
     }
     
-    // Build response
+    // Build response (packed 32 coils at a time, straight into the TX buffer)
     uint8_t byte_count = (count + 7) / 8;
-    uint8_t* coil_bytes = new uint8_t[byte_count];
-    memset(coil_bytes, 0, byte_count);
-    
-    for (uint16_t i = 0; i < count; i++) {
-        bool value;
-        if (get_coil(start_addr + i, value) && value) {
-            coil_bytes[i / 8] |= (1 << (i % 8));
-        }
-    }
-    
-    modbus_frame_t response = read_coils_response(get_address(), count, coil_bytes);
-    send_reply(response);
-    free_frame(response);
-    delete[] coil_bytes;
+    ModbusFrameWriter writer = begin_reply(frame.function_code);
+    writer.put(byte_count);
+    unit.coils.read_packed(start_addr, count, writer.tail());
+    writer.advance(byte_count);
+    send_reply(writer);
 }
+#endif
 
-void ModbusSlave::handle_read_discrete_inputs(const modbus_frame_t& frame, uint16_t start_addr, uint16_t count) {
-    if (!is_discrete_inputs_enabled()) {
+#if MODBUS_SLAVE_DISCRETE_INPUTS
+void ModbusSlave::handle_read_discrete_inputs(ModbusSlaveUnit& unit, const modbus_frame_t& frame) {
+    uint16_t start_addr = request_word(frame, 0);
+    uint16_t count = request_word(frame, 2);
+    if (!unit.is_discrete_inputs_enabled()) {
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_FUNCTION);
         return;
     }
@@ -330,30 +425,25 @@ void ModbusSlave::handle_read_discrete_inputs(const modbus_frame_t& frame, uint1
         return;
     }
     
-    if (!check_discrete_exist(start_addr, count)) {
+    if (!unit.check_discrete_exist(start_addr, count)) {
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_DATA_ADDRESS);
         return;
     }
     
     uint8_t byte_count = (count + 7) / 8;
-    uint8_t* input_bytes = new uint8_t[byte_count];
-    memset(input_bytes, 0, byte_count);
-    
-    for (uint16_t i = 0; i < count; i++) {
-        bool value;
-        if (get_discrete_input(start_addr + i, value) && value) {
-            input_bytes[i / 8] |= (1 << (i % 8));
-        }
-    }
-    
-    modbus_frame_t response = read_discrete_inputs_response(get_address(), count, input_bytes);
-    send_reply(response);
-    free_frame(response);
-    delete[] input_bytes;
+    ModbusFrameWriter writer = begin_reply(frame.function_code);
+    writer.put(byte_count);
+    unit.discrete_inputs.read_packed(start_addr, count, writer.tail());
+    writer.advance(byte_count);
+    send_reply(writer);
 }
+#endif
 
-void ModbusSlave::handle_read_holding_registers(const modbus_frame_t& frame, uint16_t start_addr, uint16_t count) {
-    if (!is_holding_registers_enabled()) {
+#if MODBUS_SLAVE_HOLDING_REGISTERS
+void ModbusSlave::handle_read_holding_registers(ModbusSlaveUnit& unit, const modbus_frame_t& frame) {
+    uint16_t start_addr = request_word(frame, 0);
+    uint16_t count = request_word(frame, 2);
+    if (!unit.is_holding_registers_enabled()) {
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_FUNCTION);
         return;
     }
@@ -363,24 +453,28 @@ void ModbusSlave::handle_read_holding_registers(const modbus_frame_t& frame, uin
         return;
     }
     
-    if (!check_hregister_exist(start_addr, count)) {
+    if (!unit.check_hregister_exist(start_addr, count)) {
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_DATA_ADDRESS);
         return;
     }
     
-    uint16_t* values = new uint16_t[count];
-    for (uint16_t i = 0; i < count; i++) {
-        get_holding_register(start_addr + i, values[i]);
+    // Serialize big-endian straight from register storage into the TX buffer;
+    // callback-backed regions compute only the requested range here
+    ModbusFrameWriter writer = begin_reply(frame.function_code);
+    writer.put(count * 2);
+    if (!unit.holding_registers.read_into(start_addr, count, writer)) {
+        send_exception(frame.function_code, ModbusExceptionCode::SLAVE_DEVICE_FAILURE);
+        return;
     }
-    
-    modbus_frame_t response = read_registers_response(get_address(), 0x03, count, values);
-    send_reply(response);
-    free_frame(response);
-    delete[] values;
+    send_reply(writer);
 }
+#endif
 
-void ModbusSlave::handle_read_input_registers(const modbus_frame_t& frame, uint16_t start_addr, uint16_t count) {
-    if (!is_input_registers_enabled()) {
+#if MODBUS_SLAVE_INPUT_REGISTERS
+void ModbusSlave::handle_read_input_registers(ModbusSlaveUnit& unit, const modbus_frame_t& frame) {
+    uint16_t start_addr = request_word(frame, 0);
+    uint16_t count = request_word(frame, 2);
+    if (!unit.is_input_registers_enabled()) {
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_FUNCTION);
         return;
     }
@@ -390,30 +484,38 @@ void ModbusSlave::handle_read_input_registers(const modbus_frame_t& frame, uint1
         return;
     }
     
-    if (!check_iregister_exist(start_addr, count)) {
+    if (!unit.check_iregister_exist(start_addr, count)) {
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_DATA_ADDRESS);
         return;
     }
     
-    uint16_t* values = new uint16_t[count];
-    for (uint16_t i = 0; i < count; i++) {
-        get_input_register(start_addr + i, values[i]);
+    // Serialize big-endian straight from register storage into the TX buffer;
+    // callback-backed regions compute only the requested range here
+    ModbusFrameWriter writer = begin_reply(frame.function_code);
+    writer.put(count * 2);
+    if (!unit.input_registers.read_into(start_addr, count, writer)) {
+        send_exception(frame.function_code, ModbusExceptionCode::SLAVE_DEVICE_FAILURE);
+        return;
     }
-    
-    modbus_frame_t response = read_registers_response(get_address(), 0x04, count, values);
-    send_reply(response);
-    free_frame(response);
-    delete[] values;
+    send_reply(writer);
 }
+#endif
 
-void ModbusSlave::handle_write_single_coil(const modbus_frame_t& frame, uint16_t coil_addr) {
-    if (!is_coils_enabled()) {
+#if MODBUS_SLAVE_COILS
+void ModbusSlave::handle_write_single_coil(ModbusSlaveUnit& unit, const modbus_frame_t& frame) {
+    uint16_t coil_addr = request_word(frame, 0);
+    if (!unit.is_coils_enabled()) {
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_FUNCTION);
         return;
     }
     
+    if (frame.data_length < 4) {
+        send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_DATA_VALUE);
+        return;
+    }
+    
     // Parse value (must be 0xFF00 or 0x0000)
-    uint16_t value_word = (frame.data[2] << 8) | frame.data[3];
+    uint16_t value_word = request_word(frame, 2);
     if (value_word != 0xFF00 && value_word != 0x0000) {
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_DATA_VALUE);
         return;
@@ -421,46 +523,56 @@ void ModbusSlave::handle_write_single_coil(const modbus_frame_t& frame, uint16_t
     
     bool value = (value_word == 0xFF00);
     
-    if (!set_coil(coil_addr, value)) {
+    if (!unit.set_coil(coil_addr, value)) {
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_DATA_ADDRESS);
         return;
     }
     
     // Sync GPIO if auto-sync enabled
-    sync_gpio_outputs();
+    unit.sync_gpio_outputs();
     
     // Echo back request
-    modbus_frame_t response = write_single_coil_response(get_address(), coil_addr, value);
-    send_reply(response);
-    free_frame(response);
+    send_echo_reply(frame, 4);
 }
+#endif
 
-void ModbusSlave::handle_write_single_register(const modbus_frame_t& frame, uint16_t reg_addr) {
-    if (!is_holding_registers_enabled()) {
+#if MODBUS_SLAVE_HOLDING_REGISTERS
+void ModbusSlave::handle_write_single_register(ModbusSlaveUnit& unit, const modbus_frame_t& frame) {
+    uint16_t reg_addr = request_word(frame, 0);
+    if (!unit.is_holding_registers_enabled()) {
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_FUNCTION);
         return;
     }
     
-    uint16_t value = (frame.data[2] << 8) | frame.data[3];
+    if (frame.data_length < 4) {
+        send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_DATA_VALUE);
+        return;
+    }
     
-    if (!set_holding_register(reg_addr, value)) {
+    uint16_t value = request_word(frame, 2);
+    
+    // Snapshot registers belong to the application and are rejected here
+    if (!unit.holding_registers.write(reg_addr, 1, &value)) {
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_DATA_ADDRESS);
         return;
     }
+    unit.mark_persistent_dirty(reg_addr, 1);
     
     // Echo back request
-    modbus_frame_t response = write_single_register_response(get_address(), reg_addr, value);
-    send_reply(response);
-    free_frame(response);
+    send_echo_reply(frame, 4);
 }
+#endif
 
-void ModbusSlave::handle_write_multiple_coils(const modbus_frame_t& frame, uint16_t start_addr, uint16_t count) {
-    if (!is_coils_enabled()) {
+#if MODBUS_SLAVE_COILS
+void ModbusSlave::handle_write_multiple_coils(ModbusSlaveUnit& unit, const modbus_frame_t& frame) {
+    uint16_t start_addr = request_word(frame, 0);
+    uint16_t count = request_word(frame, 2);
+    if (!unit.is_coils_enabled()) {
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_FUNCTION);
         return;
     }
     
-    if (count == 0 || count > 1968) {
+    if (frame.data_length < 5 || count == 0 || count > 1968) {
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_DATA_VALUE);
         return;
     }
@@ -472,32 +584,33 @@ void ModbusSlave::handle_write_multiple_coils(const modbus_frame_t& frame, uint1
         return;
     }
     
-    if (!check_coils_exist(start_addr, count)) {
+    if (!unit.check_coils_exist(start_addr, count)) {
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_DATA_ADDRESS);
         return;
     }
     
-    // Write coils
-    for (uint16_t i = 0; i < count; i++) {
-        bool value = (frame.data[5 + i / 8] >> (i % 8)) & 0x01;
-        set_coil(start_addr + i, value);
-    }
+    // Write coils (unpacked 32 coils at a time)
+    unit.coils.write_packed(start_addr, count, &frame.data[5]);
+    unit.mark_coils_dirty(start_addr, count);
     
     // Sync GPIO if auto-sync enabled
-    sync_gpio_outputs();
+    unit.sync_gpio_outputs();
     
-    modbus_frame_t response = write_multiple_coils_response(get_address(), start_addr, count);
-    send_reply(response);
-    free_frame(response);
+    // Reply with start address and quantity
+    send_echo_reply(frame, 4);
 }
+#endif
 
-void ModbusSlave::handle_write_multiple_registers(const modbus_frame_t& frame, uint16_t start_addr, uint16_t count) {
-    if (!is_holding_registers_enabled()) {
+#if MODBUS_SLAVE_HOLDING_REGISTERS
+void ModbusSlave::handle_write_multiple_registers(ModbusSlaveUnit& unit, const modbus_frame_t& frame) {
+    uint16_t start_addr = request_word(frame, 0);
+    uint16_t count = request_word(frame, 2);
+    if (!unit.is_holding_registers_enabled()) {
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_FUNCTION);
         return;
     }
     
-    if (count == 0 || count > 123) {
+    if (frame.data_length < 5 || count == 0 || count > 123) {
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_DATA_VALUE);
         return;
     }
@@ -508,25 +621,77 @@ void ModbusSlave::handle_write_multiple_registers(const modbus_frame_t& frame, u
         return;
     }
     
-    if (!check_hregister_exist(start_addr, count)) {
+    if (!unit.holding_registers.writable(start_addr, count)) {
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_DATA_ADDRESS);
         return;
     }
     
     // Write registers
+    uint16_t values[123];
     for (uint16_t i = 0; i < count; i++) {
-        uint16_t value = (frame.data[5 + i * 2] << 8) | frame.data[6 + i * 2];
-        set_holding_register(start_addr + i, value);
+        values[i] = (frame.data[5 + i * 2] << 8) | frame.data[6 + i * 2];
+    }
+    if (!unit.holding_registers.write(start_addr, count, values)) {
+        send_exception(frame.function_code, ModbusExceptionCode::SLAVE_DEVICE_FAILURE);
+        return;
+    }
+    unit.mark_persistent_dirty(start_addr, count);
+    
+    // Reply with start address and quantity
+    send_echo_reply(frame, 4);
+}
+#endif
+
+#if MODBUS_SLAVE_HOLDING_REGISTERS
+void ModbusSlave::handle_mask_write_register(ModbusSlaveUnit& unit, const modbus_frame_t& frame) {
+    uint16_t reg_addr = request_word(frame, 0);
+    if (!unit.is_holding_registers_enabled()) {
+        send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_FUNCTION);
+        return;
+    }
+    
+    if (frame.data_length < 6) {
+        send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_DATA_VALUE);
+        return;
+    }
+    
+    uint16_t and_mask = request_word(frame, 2);
+    uint16_t or_mask = request_word(frame, 4);
+    
+    if (!unit.holding_registers.writable(reg_addr, 1)) {
+        send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_DATA_ADDRESS);
+        return;
+    }
+    
+    uint16_t* reg = unit.holding_registers.ram_pointer(reg_addr);
+    if (reg != nullptr) {
+        // Read-modify-write in one step so no other writer can interleave
+        uint32_t irq_state = save_and_disable_interrupts();
+        *reg = (*reg & and_mask) | (or_mask & ~and_mask);
+        restore_interrupts(irq_state);
+    } else {
+        // Callback-backed register: the callbacks own the consistency
+        uint16_t current = 0;
+        if (!unit.holding_registers.read(reg_addr, 1, &current)) {
+            send_exception(frame.function_code, ModbusExceptionCode::SLAVE_DEVICE_FAILURE);
+            return;
+        }
+        current = (current & and_mask) | (or_mask & ~and_mask);
+        if (!unit.holding_registers.write(reg_addr, 1, &current)) {
+            send_exception(frame.function_code, ModbusExceptionCode::SLAVE_DEVICE_FAILURE);
+            return;
+        }
     }
+    unit.mark_persistent_dirty(reg_addr, 1);
     
-    modbus_frame_t response = write_multiple_registers_response(get_address(), start_addr, count);
-    send_reply(response);
-    free_frame(response);
+    // Echo back request
+    send_echo_reply(frame, 6);
 }
+#endif
 
-void ModbusSlave::handle_read_diagnostics(const modbus_frame_t& frame) {
+#if MODBUS_SLAVE_DIAGNOSTICS
+void ModbusSlave::handle_read_diagnostics(ModbusSlaveUnit& unit, const modbus_frame_t& frame) {
     if (frame.data_length < 4) {
-        diagnostic_counters.SLAVE_EXCEPTION_ERROR_COUNT++;
         send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_DATA_VALUE);
         return;
     }
@@ -534,7 +699,39 @@ void ModbusSlave::handle_read_diagnostics(const modbus_frame_t& frame) {
     uint16_t sub_function = (frame.data[0] << 8) | frame.data[1];
     uint16_t data_field = (frame.data[2] << 8) | frame.data[3];
     
+    // Vendor sub-functions: any counter as a full 32-bit value
+    uint8_t index = sub_function & 0xFF;
+    bool wide = true;
+    uint32_t wide_data = 0;
+    switch (sub_function & 0xFF00) {
+        case MODBUS_DIAG_SUB_COUNTER:
+            wide = index < enum_value(ModbusCounter::COUNT);
+            wide_data = wide ? diagnostics.get(static_cast<ModbusCounter>(index)) : 0;
+            break;
+        case MODBUS_DIAG_SUB_FUNCTION:
+            wide = index < MODBUS_DIAG_FUNCTION_CODES;
+            wide_data = diagnostics.get_function_count(index);
+            break;
+        case MODBUS_DIAG_SUB_EXCEPTION:
+            wide = index < MODBUS_DIAG_EXCEPTION_CODES;
+            wide_data = diagnostics.get_exception_count(index);
+            break;
+        default:
+            wide = false;
+            break;
+    }
+    if (wide) {
+        ModbusFrameWriter writer = begin_reply(frame.function_code);
+        writer.put16(sub_function);
+        writer.put16(wide_data >> 16);
+        writer.put16(wide_data & 0xFFFF);
+        send_reply(writer);
+        return;
+    }
+    
+    // Standard counters are 16-bit on the wire: low word of the 32-bit counter
     uint16_t response_data = 0;
+    ModbusCounter counter;
     
     // Handle diagnostic sub-functions
     switch (sub_function) {
@@ -542,49 +739,47 @@ void ModbusSlave::handle_read_diagnostics(const modbus_frame_t& frame) {
             response_data = data_field;
             break;
             
-        case enum_value(ModbusDiagnosticCode::BUS_MESSAGE_COUNT):
-            response_data = get_bus_message_count();
-            MODBUS_DEBUG_PRINT("[DIAG READ] BUS_MESSAGE_COUNT = %u (direct: %u)\n", response_data, diagnostic_counters.BUS_MESSAGE_COUNT);
-            break;
+        case enum_value(ModbusDiagnosticCode::CLEAR_COUNTERS_AND_DIAGNOSTIC_REGISTER):
+            diagnostics.clear();
+            for (ModbusSlaveUnit* hosted : units) {
+                hosted->unit_counters.clear();
+            }
+            send_echo_reply(frame, 4);
+            return;
             
-        case enum_value(ModbusDiagnosticCode::BUS_COMMUNICATION_ERROR_COUNT):
-            response_data = get_bus_communication_error_count();
-            break;
+        case enum_value(ModbusDiagnosticCode::CLEAR_OVERRUN_COUNTER_AND_FLAG):
+            diagnostics.clear(ModbusCounter::BUS_CHARACTER_OVERRUN);
+            send_echo_reply(frame, 4);
+            return;
             
+        // Per unit, the bus-wide totals are available through the vendor sub-functions
         case enum_value(ModbusDiagnosticCode::SLAVE_EXCEPTION_ERROR_COUNT):
-            response_data = get_slave_exception_error_count();
+            response_data = (uint16_t)unit.unit_counters.SLAVE_EXCEPTION_ERROR_COUNT;
             break;
             
         case enum_value(ModbusDiagnosticCode::SLAVE_MESSAGE_COUNT):
-            response_data = get_slave_message_count();
+            response_data = (uint16_t)unit.unit_counters.SLAVE_MESSAGE_COUNT;
             break;
             
         case enum_value(ModbusDiagnosticCode::SLAVE_NO_RESPONSE_COUNT):
-            response_data = get_slave_no_response_count();
-            break;
-            
-        case enum_value(ModbusDiagnosticCode::SLAVE_NAK_COUNT):
-            response_data = get_slave_nak_count();
-            break;
-            
-        case enum_value(ModbusDiagnosticCode::SLAVE_BUSY_COUNT):
-            response_data = get_slave_busy_count();
-            break;
-            
-        case enum_value(ModbusDiagnosticCode::BUS_CHARACTER_OVERRUN_COUNT):
-            response_data = get_bus_character_overrun_count();
+            response_data = (uint16_t)unit.unit_counters.SLAVE_NO_RESPONSE_COUNT;
             break;
             
         default:
-            // Unsupported sub-function
-            diagnostic_counters.SLAVE_EXCEPTION_ERROR_COUNT++;
-            send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_FUNCTION);
-            return;
+            if (!ModbusDiagnostics::from_diagnostic_code(sub_function, counter)) {
+                // Unsupported sub-function
+                send_exception(frame.function_code, ModbusExceptionCode::ILLEGAL_FUNCTION);
+                return;
+            }
+            response_data = (uint16_t)diagnostics.get(counter);
+            break;
     }
     
-    modbus_frame_t response = read_diagnostics_response(get_address(), sub_function, response_data);
     MODBUS_DEBUG_PRINT("[DIAG RESPONSE] Sending: sub_func=0x%04X, data=0x%04X (%u)\n", sub_function, response_data, response_data);
-    send_reply(response);
-    free_frame(response);
+    ModbusFrameWriter writer = begin_reply(frame.function_code);
+    writer.put16(sub_function);
+    writer.put16(response_data);
+    send_reply(writer);
 }
+#endif
 
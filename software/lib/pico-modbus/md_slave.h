@@ -2,99 +2,169 @@
 #define PICO_PLC_SLAVE_H
 
 #include "common/md_base.h"
+#include "common/md_telemetry.h"
+#include "common/md_tcp.h"
+#include "md_slave_unit.h"
+#include "pico-utils/flash_layout.h"
+#include <array>
+#include <functional>
 #include <memory>
 #include <map>
+#include <vector>
 
-class ModbusSlave : public ModbusBase {
+// Built-in function code groups; set to 0 to compile the handlers out.
+// Disabled codes answer ILLEGAL_FUNCTION unless claimed by register_function().
+#ifndef MODBUS_SLAVE_COILS
+#define MODBUS_SLAVE_COILS 1                // FC01, FC05, FC15
+#endif
+#ifndef MODBUS_SLAVE_DISCRETE_INPUTS
+#define MODBUS_SLAVE_DISCRETE_INPUTS 1      // FC02
+#endif
+#ifndef MODBUS_SLAVE_HOLDING_REGISTERS
+#define MODBUS_SLAVE_HOLDING_REGISTERS 1    // FC03, FC06, FC16, FC22
+#endif
+#ifndef MODBUS_SLAVE_INPUT_REGISTERS
+#define MODBUS_SLAVE_INPUT_REGISTERS 1      // FC04
+#endif
+#ifndef MODBUS_SLAVE_DIAGNOSTICS
+#define MODBUS_SLAVE_DIAGNOSTICS 1          // FC08
+#endif
+
+// User function code handler. "request" is the PDU payload after the function code;
+// the response payload (after the function code) goes to "response", which has room for
+// "capacity" bytes (MODBUS_SLAVE_REPLY_CAPACITY: the frame less address, FC and CRC).
+// A handler must not write past it: reply with an exception instead. Return the
+// response length, or -ModbusExceptionCode to reply with an exception.
+#define MODBUS_SLAVE_REPLY_CAPACITY (MODBUS_MAX_FRAME_SIZE - 4)
+typedef std::function<int(ModbusSlaveUnit& unit, const uint8_t* request, uint8_t length,
+                          uint8_t* response, uint8_t capacity)> modbus_function_handler_t;
+
+// Modbus RTU slave. The slave itself is the unit at its primary address;
+// add_unit() hosts further unit IDs (virtual devices) on the same port.
+// As a ModbusPduHandler the same units are served over Modbus TCP.
+class ModbusSlave : public ModbusBase, public ModbusSlaveUnit, public ModbusPduHandler {
 private:
-    uint8_t device_address;
+    static constexpr uint8_t MAX_UNIT_ADDRESS = 247;
+    
     bool is_broadcast_request; // Flag to track if current request is broadcast
     
-    // Register type enable flags
-    bool coils_enabled;
-    bool discrete_inputs_enabled;
-    bool input_registers_enabled;
-    bool holding_registers_enabled;
+    // O(1) dispatch: unit ID -> unit (nullptr = not hosted here)
+    ModbusSlaveUnit* unit_table[MAX_UNIT_ADDRESS + 1];
+    std::vector<ModbusSlaveUnit*> units;                       // All hosted units, primary first
+    std::vector<std::unique_ptr<ModbusSlaveUnit>> extra_units; // Ownership of add_unit() units
+    
+    // Unit handling the current request (replies carry its address)
+    ModbusSlaveUnit* current_unit;
     
-    // Auto-sync GPIO for coils (when enabled)
-    bool auto_sync_gpio;
+    // Fast response mode: reads answered from the frame-complete interrupt
+    bool fast_response_enabled;
+    bool irq_reply_active;  // Current request is being served in IRQ context
+    turnaround_stats_t turnaround;
     
-    // Holding Registers (R/W, 16-bit) - contiguous array
-    std::unique_ptr<uint16_t[]> holding_registers;
-    uint16_t holding_registers_size;
+    // Set while process_pdu() runs: replies go here instead of the UART
+    uint8_t* volatile pdu_reply;
+    uint16_t pdu_reply_length;
     
-    // Input Registers (R, 16-bit) - contiguous array
-    std::unique_ptr<uint16_t[]> input_registers;
-    uint16_t input_registers_size;
+    // Flash copy of selected holding registers, shared by all units
+    ModbusPersistentStore persistence;
     
-    // Coils (R/W, 1-bit) - sparse map of address -> value
-    std::map<uint16_t, bool> coils;
+    bool is_fast_path_request(const ModbusSlaveUnit& unit, const modbus_frame_t& frame) const;
     
-    // Discrete Inputs (R, 1-bit) - sparse map of address -> value
-    std::map<uint16_t, bool> discrete_inputs;
+    void dispatch(ModbusSlaveUnit& unit, const modbus_frame_t& frame);
     
-    // Sync GPIO outputs with coil states
-    void sync_gpio_outputs();
+    // One handler per function code, built at compile time (see build_handler_table)
+    typedef void (ModbusSlave::*handler_t)(ModbusSlaveUnit& unit, const modbus_frame_t& frame);
+    static const std::array<handler_t, 256> handler_table;
+    static constexpr std::array<handler_t, 256> build_handler_table();
+    
+    // User function codes: custom_index maps FC -> custom_functions slot
+    static constexpr uint8_t NO_CUSTOM_FUNCTION = 0xFF;
+    uint8_t custom_index[0x80];
+    std::vector<modbus_function_handler_t> custom_functions;
+    
+    // Big-endian word at "offset" in the request payload (0 if the frame is too short)
+    static uint16_t request_word(const modbus_frame_t& frame, uint8_t offset);
     
     // Handler methods for each function code
-    void handle_read_coils(const modbus_frame_t& frame, uint16_t start_addr, uint16_t count);
-    void handle_read_discrete_inputs(const modbus_frame_t& frame, uint16_t start_addr, uint16_t count);
-    void handle_read_holding_registers(const modbus_frame_t& frame, uint16_t start_addr, uint16_t count);
-    void handle_read_input_registers(const modbus_frame_t& frame, uint16_t start_addr, uint16_t count);
-    void handle_write_single_coil(const modbus_frame_t& frame, uint16_t coil_addr);
-    void handle_write_single_register(const modbus_frame_t& frame, uint16_t reg_addr);
-    void handle_write_multiple_coils(const modbus_frame_t& frame, uint16_t start_addr, uint16_t count);
-    void handle_write_multiple_registers(const modbus_frame_t& frame, uint16_t start_addr, uint16_t count);
-    void handle_read_diagnostics(const modbus_frame_t& frame);
+    void handle_illegal_function(ModbusSlaveUnit& unit, const modbus_frame_t& frame);
+    void handle_custom_function(ModbusSlaveUnit& unit, const modbus_frame_t& frame);
+#if MODBUS_SLAVE_COILS
+    void handle_read_coils(ModbusSlaveUnit& unit, const modbus_frame_t& frame);
+    void handle_write_single_coil(ModbusSlaveUnit& unit, const modbus_frame_t& frame);
+    void handle_write_multiple_coils(ModbusSlaveUnit& unit, const modbus_frame_t& frame);
+#endif
+#if MODBUS_SLAVE_DISCRETE_INPUTS
+    void handle_read_discrete_inputs(ModbusSlaveUnit& unit, const modbus_frame_t& frame);
+#endif
+#if MODBUS_SLAVE_HOLDING_REGISTERS
+    void handle_read_holding_registers(ModbusSlaveUnit& unit, const modbus_frame_t& frame);
+    void handle_write_single_register(ModbusSlaveUnit& unit, const modbus_frame_t& frame);
+    void handle_write_multiple_registers(ModbusSlaveUnit& unit, const modbus_frame_t& frame);
+    void handle_mask_write_register(ModbusSlaveUnit& unit, const modbus_frame_t& frame);
+#endif
+#if MODBUS_SLAVE_INPUT_REGISTERS
+    void handle_read_input_registers(ModbusSlaveUnit& unit, const modbus_frame_t& frame);
+#endif
+#if MODBUS_SLAVE_DIAGNOSTICS
+    void handle_read_diagnostics(ModbusSlaveUnit& unit, const modbus_frame_t& frame);
+#endif
+    
+    // Reply frame for the current unit, on the UART or in the process_pdu() buffer
+    ModbusFrameWriter begin_reply(uint8_t function_code);
+    
+    // Reply with the first "length" bytes of the request payload
+    void send_echo_reply(const modbus_frame_t& frame, uint8_t length);
 
 protected:
     void handle_received_frame(const modbus_frame_t& frame) override;
+    bool handle_received_frame_irq(const modbus_frame_t& frame) override;
+    void process_background() override;
     
 public:
     ModbusSlave(uint8_t address, uart_inst_t* uart, uint baudrate, int de_pin = -1, int re_pin = -1, ModbusParity parity = ModbusParity::EVEN);
     
-    // Enable register types
-    void enable_holding_registers(uint16_t size);
-    void enable_input_registers(uint16_t size);
-    void enable_coils(const std::map<uint16_t, bool>& initial_coils, bool auto_gpio = true);
-    void enable_discrete_inputs(const std::map<uint16_t, bool>& initial_inputs);
-
-    void update_gpio_outputs();
-
-    uint16_t* get_holding_registers() { return holding_registers.get(); }
-    uint16_t* get_input_registers() { return input_registers.get(); }
-    std::map<uint16_t, bool>* get_coils() { return &coils; }
-    std::map<uint16_t, bool>* get_discrete_inputs() { return &discrete_inputs; }
-
-    bool is_holding_registers_enabled() const { return holding_registers_enabled; }
-    bool is_input_registers_enabled() const { return input_registers_enabled; }
-    bool is_coils_enabled() const { return coils_enabled; }
-    bool is_discrete_inputs_enabled() const { return discrete_inputs_enabled; }
-    
-    // Holding register access (R/W by Modbus)
-    bool check_hregister_exist(uint16_t address, uint16_t count);
-    bool set_holding_register(uint16_t address, uint16_t value);
-    bool get_holding_register(uint16_t address, uint16_t& value) const;
-    
-    // Input register access (R by Modbus, W by application)
-    bool check_iregister_exist(uint16_t address, uint16_t count);
-    bool set_input_register(uint16_t address, uint16_t value);  // Application updates
-    bool get_input_register(uint16_t address, uint16_t& value) const;
-    
-    // Coil access (R/W by Modbus)
-    bool check_coils_exist(uint16_t starting_address, uint16_t count) const;
-    bool set_coil(uint16_t address, bool value);
-    bool get_coil(uint16_t address, bool& value) const;
-    
-    // Discrete input access (R by Modbus, W by application)
-    bool check_discrete_exist(uint16_t address, uint16_t count);
-    bool set_discrete_input(uint16_t address, bool value);  // Application updates
-    bool get_discrete_input(uint16_t address, bool& value) const;
-    
-    uint8_t get_address() const { return device_address; }
+    // Host another unit ID on this port; nullptr if the address is invalid or taken
+    ModbusSlaveUnit* add_unit(uint8_t address);
+    ModbusSlaveUnit* get_unit(uint8_t address) const;
+    size_t get_unit_count() const { return units.size(); }
+    
+    // Serve a function code (1-127) that has no built-in handler, on all units.
+    // Registering the same code again replaces the handler. Runs from process_tx_queue().
+    bool register_function(uint8_t function_code, const modbus_function_handler_t& handler);
+    
+    // Serve a request PDU from another transport (Modbus TCP) with the RTU handlers.
+    // Unit ID 0 and MODBUS_TCP_UNIT_ID address this slave. Call from the same context
+    // as process_tx_queue(); the IRQ fast path stands aside while it runs.
+    uint16_t process_pdu(uint8_t unit_id, const uint8_t* pdu, uint16_t length, uint8_t* reply) override;
+    
+    // Answer FC01-FC04 reads of RAM and snapshot data directly from the frame-complete
+    // timer interrupt; writes and callback-backed reads still go through process_tx_queue().
+    // Configure all units and regions before enabling. Budget 0 = no budget check.
+    void enable_fast_response(uint32_t turnaround_budget_us = 0);
+    const turnaround_stats_t& get_turnaround_stats() const { return turnaround; }
+    void reset_turnaround_stats() { turnaround.clear(); }
+    void dump_turnaround_stats() const { turnaround.dump(); }
+    
+    // Keep selected holding registers in flash across resets. Uses "sector_count"
+    // sectors at "flash_offset" (FLASH_PERSIST_OFFSET of pico-utils/flash_layout.h); changes
+    // are written in batches once writes have been quiet for flush_delay_ms.
+    bool enable_persistence(uint32_t flash_offset, uint8_t sector_count = FLASH_PERSIST_SECTORS,
+                            uint32_t flush_delay_ms = 1000);
+    // Range of one RAM region, after the region is set up. unit_address 0 = this slave
+    bool persist_holding_registers(uint16_t start, uint16_t count, uint8_t unit_address = 0);
+    // Load the last stored values (once at boot, after all persist_holding_registers())
+    uint32_t restore_persistent_registers();
+    bool flush_persistent_registers();
+    const ModbusPersistentStore& get_persistent_store() const { return persistence; }
+    
+    // Expose all diagnostic counters as input registers base..base+REGISTER_COUNT-1:
+    // ModbusCounter entries, then per function code, then per exception code,
+    // two registers per 32-bit counter (high word first)
+    bool enable_diagnostic_registers(uint16_t base);
     
     void send_reply(const modbus_frame_t& frame);
+    void send_reply(ModbusFrameWriter& writer);  // Zero-copy, frame built with begin_frame()
     void send_exception(uint8_t function_code, ModbusExceptionCode exception_code);
 };
 
-#endif //PICO_PLC_SLAVE_H
\ No newline at end of file
+#endif //PICO_PLC_SLAVE_H
@@ -0,0 +1,280 @@
+#include "md_slave_unit.h"
+#include <cassert>
+#include <cstring>
+
+ModbusSlaveUnit::ModbusSlaveUnit(uint8_t address)
+    : unit_address(address),
+      coils_enabled(false),
+      discrete_inputs_enabled(false),
+      input_registers_enabled(false),
+      holding_registers_enabled(false),
+      auto_sync_gpio(false),
+      coil_gpio_mask(0),
+      gpio_dirty_mask(0),
+      persistent_store(nullptr) {
+    // Unit must have address 1-247 (0=broadcast)
+    assert(address >= 1 && address <= 247 && "Slave address must be 1-247");
+}
+
+// Enable register types
+void ModbusSlaveUnit::enable_holding_registers(uint16_t size) {
+    holding_registers.clear();
+    holding_registers.add_ram_region(0, size);
+    holding_registers_enabled = true;
+}
+
+void ModbusSlaveUnit::enable_input_registers(uint16_t size) {
+    input_registers.clear();
+    input_registers.add_ram_region(0, size);
+    input_registers_enabled = true;
+}
+
+bool ModbusSlaveUnit::add_holding_register_region(uint16_t start, uint32_t count) {
+    if (!holding_registers.add_ram_region(start, count)) {
+        return false;
+    }
+    holding_registers_enabled = true;
+    return true;
+}
+
+bool ModbusSlaveUnit::add_holding_register_callback(uint16_t start, uint32_t count,
+                                                const register_read_callback_t& on_read,
+                                                const register_write_callback_t& on_write) {
+    if (!holding_registers.add_callback_region(start, count, on_read, on_write)) {
+        return false;
+    }
+    holding_registers_enabled = true;
+    return true;
+}
+
+bool ModbusSlaveUnit::add_holding_register_snapshot(uint16_t start, uint32_t count) {
+    if (!holding_registers.add_snapshot_region(start, count, process_image)) {
+        return false;
+    }
+    holding_registers_enabled = true;
+    return true;
+}
+
+bool ModbusSlaveUnit::add_input_register_region(uint16_t start, uint32_t count) {
+    if (!input_registers.add_ram_region(start, count)) {
+        return false;
+    }
+    input_registers_enabled = true;
+    return true;
+}
+
+bool ModbusSlaveUnit::add_input_register_callback(uint16_t start, uint32_t count,
+                                              const register_read_callback_t& on_read) {
+    // Input registers are never written by the master
+    if (!input_registers.add_callback_region(start, count, on_read)) {
+        return false;
+    }
+    input_registers_enabled = true;
+    return true;
+}
+
+void ModbusSlaveUnit::enable_coils(const std::map<uint16_t, bool>& initial_coils, bool auto_gpio) {
+    coils.init(initial_coils);
+    coils_enabled = true;
+    clear_coil_gpio_map();
+    
+    // Default mapping: coil number == GPIO number
+    if (auto_gpio) {
+        for (const auto& pair : initial_coils) {
+            map_coil_to_gpio(pair.first, pair.first);
+        }
+    }
+}
+
+void ModbusSlaveUnit::enable_coils(uint16_t count, bool auto_gpio) {
+    coils.init(count);
+    coils_enabled = true;
+    clear_coil_gpio_map();
+    
+    if (auto_gpio) {
+        for (uint16_t coil = 0; coil < count && coil < MAX_COIL_GPIO; coil++) {
+            map_coil_to_gpio(coil, coil);
+        }
+    }
+}
+
+bool ModbusSlaveUnit::map_coil_to_gpio(uint16_t coil_addr, uint gpio) {
+    // Outputs are driven through the 32-bit SIO registers of bank 0
+    if (!coils_enabled || !coils.exists(coil_addr) || gpio >= MAX_COIL_GPIO) {
+        return false;
+    }
+    
+    uint32_t pin_mask = 1u << gpio;
+    if (coil_gpio_mask & pin_mask) {
+        return false;  // Pin already driven by another coil
+    }
+    
+    gpio_init(gpio);
+    gpio_put(gpio, coils.get(coil_addr));
+    gpio_set_dir(gpio, GPIO_OUT);
+    
+    auto it = coil_gpio_map.begin();
+    while (it != coil_gpio_map.end() && it->coil <= coil_addr) {
+        ++it;
+    }
+    coil_gpio_map.insert(it, {coil_addr, (uint8_t)gpio});
+    coil_gpio_mask |= pin_mask;
+    auto_sync_gpio = true;
+    return true;
+}
+
+void ModbusSlaveUnit::clear_coil_gpio_map() {
+    coil_gpio_map.clear();
+    coil_gpio_mask = 0;
+    gpio_dirty_mask = 0;
+    auto_sync_gpio = false;
+}
+
+void ModbusSlaveUnit::mark_coils_dirty(uint16_t start_addr, uint16_t count) {
+    uint32_t end = (uint32_t)start_addr + count;
+    for (const auto& mapping : coil_gpio_map) {
+        if (mapping.coil >= end) break;
+        if (mapping.coil >= start_addr) {
+            gpio_dirty_mask |= 1u << mapping.gpio;
+        }
+    }
+}
+
+void ModbusSlaveUnit::sync_gpio_outputs() {
+    if (!auto_sync_gpio || !coils_enabled || gpio_dirty_mask == 0) return;
+    
+    uint32_t values = 0;
+    for (const auto& mapping : coil_gpio_map) {
+        if ((gpio_dirty_mask >> mapping.gpio) & 1u) {
+            values |= (uint32_t)coils.get(mapping.coil) << mapping.gpio;
+        }
+    }
+    
+    // All changed outputs switch in the same SIO write
+    gpio_put_masked(gpio_dirty_mask, values);
+    gpio_dirty_mask = 0;
+}
+
+void ModbusSlaveUnit::update_gpio_outputs() {
+    gpio_dirty_mask = coil_gpio_mask;
+    sync_gpio_outputs();
+}
+
+void ModbusSlaveUnit::enable_discrete_inputs(const std::map<uint16_t, bool>& initial_inputs) {
+    discrete_inputs.init(initial_inputs);
+    discrete_inputs_enabled = true;
+}
+
+void ModbusSlaveUnit::enable_discrete_inputs(uint16_t count) {
+    discrete_inputs.init(count);
+    discrete_inputs_enabled = true;
+}
+
+bool ModbusSlaveUnit::add_input_register_snapshot(uint16_t start, uint32_t count) {
+    if (!input_registers.add_snapshot_region(start, count, process_image)) {
+        return false;
+    }
+    input_registers_enabled = true;
+    return true;
+}
+
+void ModbusSlaveUnit::commit_process_image() {
+    process_image.commit();
+}
+
+// Holding register access
+bool ModbusSlaveUnit::check_hregister_exist(uint16_t address, uint16_t count) {
+    return holding_registers.contains(address, count);
+}
+
+bool ModbusSlaveUnit::set_holding_register(uint16_t address, uint16_t value) {
+    if (!holding_registers_enabled) {
+        return false;
+    }
+    // RAM and snapshot registers are written in place (snapshot: until the next commit)
+    uint16_t* reg = holding_registers.ram_pointer(address);
+    if (reg != nullptr) {
+        *reg = value;
+        mark_persistent_dirty(address, 1);
+        return true;
+    }
+    return holding_registers.write(address, 1, &value);
+}
+
+void ModbusSlaveUnit::mark_persistent_dirty(uint16_t start_addr, uint16_t count) {
+    if (persistent_store != nullptr) {
+        persistent_store->mark_dirty(unit_address, start_addr, count, time_us_64());
+    }
+}
+
+bool ModbusSlaveUnit::get_holding_register(uint16_t address, uint16_t& value) const {
+    if (!holding_registers_enabled) {
+        return false;
+    }
+    return holding_registers.read(address, 1, &value);
+}
+
+// Input register access
+bool ModbusSlaveUnit::check_iregister_exist(uint16_t address, uint16_t count) {
+    return input_registers.contains(address, count);
+}
+
+bool ModbusSlaveUnit::set_input_register(uint16_t address, uint16_t value) {
+    // Only RAM and snapshot input registers can be updated by the application
+    uint16_t* reg = input_registers.ram_pointer(address);
+    if (reg == nullptr) {
+        return false;
+    }
+    *reg = value;
+    return true;
+}
+
+bool ModbusSlaveUnit::get_input_register(uint16_t address, uint16_t& value) const {
+    if (!input_registers_enabled) {
+        return false;
+    }
+    return input_registers.read(address, 1, &value);
+}
+
+// Coil access
+bool ModbusSlaveUnit::check_coils_exist(uint16_t starting_address, uint16_t count) const {
+    return coils.exists_range(starting_address, count);
+}
+
+bool ModbusSlaveUnit::set_coil(uint16_t address, bool value) {
+    if (!coils_enabled || !coils.exists(address)) {
+        return false;
+    }
+    coils.set(address, value);
+    mark_coils_dirty(address, 1);
+    return true;
+}
+
+bool ModbusSlaveUnit::get_coil(uint16_t address, bool& value) const {
+    if (!coils_enabled || !coils.exists(address)) {
+        return false;
+    }
+    value = coils.get(address);
+    return true;
+}
+
+// Discrete input access
+bool ModbusSlaveUnit::check_discrete_exist(uint16_t address, uint16_t count) {
+    return discrete_inputs.exists_range(address, count);
+}
+
+bool ModbusSlaveUnit::set_discrete_input(uint16_t address, bool value) {
+    if (!discrete_inputs.exists(address)) {
+        return false;
+    }
+    discrete_inputs.set(address, value);
+    return true;
+}
+
+bool ModbusSlaveUnit::get_discrete_input(uint16_t address, bool& value) const {
+    if (!discrete_inputs_enabled || !discrete_inputs.exists(address)) {
+        return false;
+    }
+    value = discrete_inputs.get(address);
+    return true;
+}
@@ -0,0 +1,155 @@
+#ifndef PICO_PLC_SLAVE_UNIT_H
+#define PICO_PLC_SLAVE_UNIT_H
+
+#include "common/md_bitstore.h"
+#include "common/md_regmap.h"
+#include "common/md_persist.h"
+#include <atomic>
+#include <memory>
+#include <map>
+#include <vector>
+
+class ModbusSlave;
+
+// Per-unit slave counters (bus-level counters stay in ModbusBase)
+struct unit_counters_t {
+    std::atomic<uint32_t> SLAVE_MESSAGE_COUNT{0};
+    std::atomic<uint32_t> SLAVE_EXCEPTION_ERROR_COUNT{0};
+    std::atomic<uint32_t> SLAVE_NO_RESPONSE_COUNT{0};
+    
+    void clear() {
+        SLAVE_MESSAGE_COUNT = 0;
+        SLAVE_EXCEPTION_ERROR_COUNT = 0;
+        SLAVE_NO_RESPONSE_COUNT = 0;
+    }
+};
+
+// One logical Modbus device: a unit ID with its own register maps.
+// ModbusSlave is itself a unit (its primary address) and can host more.
+class ModbusSlaveUnit {
+    friend class ModbusSlave;
+
+private:
+    static constexpr uint MAX_COIL_GPIO = 30;  // Valid GPIO range for RP2040/RP2350A
+    
+    uint8_t unit_address;
+    unit_counters_t unit_counters;
+    
+    // Register type enable flags
+    bool coils_enabled;
+    bool discrete_inputs_enabled;
+    bool input_registers_enabled;
+    bool holding_registers_enabled;
+    
+    // Auto-sync GPIO for coils (when enabled)
+    bool auto_sync_gpio;
+    
+    // Coil -> GPIO output mapping, sorted by coil address
+    struct coil_gpio_t {
+        uint16_t coil;
+        uint8_t gpio;
+    };
+    std::vector<coil_gpio_t> coil_gpio_map;
+    uint32_t coil_gpio_mask;   // All mapped pins
+    uint32_t gpio_dirty_mask;  // Mapped pins whose coil changed since the last sync
+    
+    // Holding Registers (R/W, 16-bit) - RAM or callback backed regions
+    ModbusRegisterMap holding_registers;
+    
+    // Input Registers (R, 16-bit) - RAM or callback backed regions
+    ModbusRegisterMap input_registers;
+    
+    // Backing store of all snapshot regions (holding and input)
+    ModbusProcessImage process_image;
+    
+    // Coils (R/W, 1-bit) - packed bitset, optionally sparse
+    ModbusBitStore coils;
+    
+    // Discrete Inputs (R, 1-bit) - packed bitset, optionally sparse
+    ModbusBitStore discrete_inputs;
+    
+    // Flash store of the owning slave (nullptr = no persistence)
+    ModbusPersistentStore* persistent_store;
+    
+    // Schedule persistent holding registers in the range for writing to flash
+    void mark_persistent_dirty(uint16_t start_addr, uint16_t count);
+    
+    // Record coil changes and apply all changed outputs in one masked write
+    void mark_coils_dirty(uint16_t start_addr, uint16_t count);
+    void sync_gpio_outputs();
+
+public:
+    explicit ModbusSlaveUnit(uint8_t address);
+    virtual ~ModbusSlaveUnit() = default;
+    
+    // Enable register types
+    // Single RAM block at address 0 (replaces any existing regions)
+    void enable_holding_registers(uint16_t size);
+    void enable_input_registers(uint16_t size);
+    
+    // Additional register regions anywhere in the address space
+    bool add_holding_register_region(uint16_t start, uint32_t count);
+    bool add_holding_register_callback(uint16_t start, uint32_t count,
+                                       const register_read_callback_t& on_read,
+                                       const register_write_callback_t& on_write = nullptr);
+    bool add_input_register_region(uint16_t start, uint32_t count);
+    
+    // Snapshot regions: the application writes them with set_*_register() and
+    // publishes all of them at once with commit_process_image(); Modbus always
+    // reads a complete committed scan. Holding snapshots are read-only for the master.
+    bool add_holding_register_snapshot(uint16_t start, uint32_t count);
+    bool add_input_register_snapshot(uint16_t start, uint32_t count);
+    void commit_process_image();
+
+    bool add_input_register_callback(uint16_t start, uint32_t count,
+                                     const register_read_callback_t& on_read);
+    void enable_coils(const std::map<uint16_t, bool>& initial_coils, bool auto_gpio = true);
+    void enable_coils(uint16_t count, bool auto_gpio = false);  // Dense, addresses 0..count-1
+    void enable_discrete_inputs(const std::map<uint16_t, bool>& initial_inputs);
+    void enable_discrete_inputs(uint16_t count);  // Dense, addresses 0..count-1
+
+    // Drive a GPIO from a coil (replaces the default coil number == GPIO number)
+    bool map_coil_to_gpio(uint16_t coil_addr, uint gpio);
+    void clear_coil_gpio_map();
+    
+    // Re-apply all mapped coils to their pins
+    void update_gpio_outputs();
+
+    // RAM storage of the region at address 0 (nullptr if none)
+    uint16_t* get_holding_registers() { return holding_registers.ram_pointer(0); }
+    uint16_t* get_input_registers() { return input_registers.ram_pointer(0); }
+    ModbusRegisterMap* get_holding_register_map() { return &holding_registers; }
+    ModbusRegisterMap* get_input_register_map() { return &input_registers; }
+    ModbusBitStore* get_coils() { return &coils; }
+    ModbusBitStore* get_discrete_inputs() { return &discrete_inputs; }
+
+    bool is_holding_registers_enabled() const { return holding_registers_enabled; }
+    bool is_input_registers_enabled() const { return input_registers_enabled; }
+    bool is_coils_enabled() const { return coils_enabled; }
+    bool is_discrete_inputs_enabled() const { return discrete_inputs_enabled; }
+    
+    // Holding register access (R/W by Modbus)
+    bool check_hregister_exist(uint16_t address, uint16_t count);
+    bool set_holding_register(uint16_t address, uint16_t value);
+    bool get_holding_register(uint16_t address, uint16_t& value) const;
+    
+    // Input register access (R by Modbus, W by application)
+    bool check_iregister_exist(uint16_t address, uint16_t count);
+    bool set_input_register(uint16_t address, uint16_t value);  // Application updates
+    bool get_input_register(uint16_t address, uint16_t& value) const;
+    
+    // Coil access (R/W by Modbus)
+    bool check_coils_exist(uint16_t starting_address, uint16_t count) const;
+    bool set_coil(uint16_t address, bool value);
+    bool get_coil(uint16_t address, bool& value) const;
+    
+    // Discrete input access (R by Modbus, W by application)
+    bool check_discrete_exist(uint16_t address, uint16_t count);
+    bool set_discrete_input(uint16_t address, bool value);  // Application updates
+    bool get_discrete_input(uint16_t address, bool& value) const;
+    
+    uint8_t get_address() const { return unit_address; }
+    const unit_counters_t& get_unit_counters() const { return unit_counters; }
+};
+
+#endif //PICO_PLC_SLAVE_UNIT_H
@@ -0,0 +1,254 @@
+#include "md_tcp_server.h"
+#include "pico/cyw43_arch.h"
+#include "common/md_common.h"
+
+// Every client may fill its whole send buffer with copied replies (see send())
+static_assert(MEM_SIZE >= MODBUS_TCP_MAX_CLIENTS * TCP_SND_BUF, "MEM_SIZE too small for the send buffers of all clients");
+
+ModbusTcpListener::ModbusTcpListener(ModbusTcpServer& server)
+    : server(server), listen_pcb(nullptr), connections{}, receiving(false) {
+    for (int i = 0; i < MODBUS_TCP_MAX_CLIENTS; i++) {
+        connections[i].owner = this;
+        connections[i].client = i;
+    }
+    server.set_transport(
+        [this](int client) { return this->send_space(client); },
+        [this](int client, const uint8_t* data, uint16_t length) { return this->send(client, data, length); },
+        [this](int client) { this->drop(client); });
+}
+
+ModbusTcpListener::~ModbusTcpListener() {
+    stop();
+    server.set_transport(nullptr, nullptr);
+}
+
+bool ModbusTcpListener::start(uint16_t port) {
+    if (listen_pcb != nullptr) {
+        return false;
+    }
+
+    cyw43_arch_lwip_begin();
+    struct tcp_pcb* pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+    if (pcb == nullptr) {
+        cyw43_arch_lwip_end();
+        return false;
+    }
+    if (tcp_bind(pcb, IP_ANY_TYPE, port) != ERR_OK) {
+        tcp_close(pcb);
+        cyw43_arch_lwip_end();
+        return false;
+    }
+
+    listen_pcb = tcp_listen_with_backlog(pcb, MODBUS_TCP_MAX_CLIENTS);
+    if (listen_pcb == nullptr) {
+        tcp_close(pcb);
+        cyw43_arch_lwip_end();
+        return false;
+    }
+    tcp_arg(listen_pcb, this);
+    tcp_accept(listen_pcb, accept_callback);
+    cyw43_arch_lwip_end();
+
+    MODBUS_DEBUG_PRINT("[TCP] Listening on port %u\n", port);
+    return true;
+}
+
+void ModbusTcpListener::stop() {
+    cyw43_arch_lwip_begin();
+    for (connection_t& conn : connections) {
+        if (conn.pcb != nullptr) {
+            close(conn, false);
+        }
+    }
+    if (listen_pcb != nullptr) {
+        tcp_close(listen_pcb);
+        listen_pcb = nullptr;
+    }
+    cyw43_arch_lwip_end();
+}
+
+void ModbusTcpListener::process() {
+    cyw43_arch_lwip_begin();
+    for (connection_t& conn : connections) {
+        if (conn.pcb == nullptr) {
+            continue;
+        }
+        if (conn.dropped) {
+            close(conn, true);
+            continue;
+        }
+        if (server.resume(conn.client) && conn.pending != nullptr) {
+            consume(conn);
+        }
+    }
+    cyw43_arch_lwip_end();
+}
+
+uint8_t ModbusTcpListener::get_connection_count() const {
+    uint8_t count = 0;
+    for (const connection_t& conn : connections) {
+        if (conn.pcb != nullptr) {
+            count++;
+        }
+    }
+    return count;
+}
+
+err_t ModbusTcpListener::accept_callback(void* arg, struct tcp_pcb* pcb, err_t err) {
+    ModbusTcpListener* self = static_cast<ModbusTcpListener*>(arg);
+    if (err != ERR_OK || pcb == nullptr) {
+        return ERR_VAL;
+    }
+
+    int client = self->server.open_client();
+    if (client < 0) {
+        MODBUS_DEBUG_PRINT("[TCP] Connection refused, all %d clients in use\n", MODBUS_TCP_MAX_CLIENTS);
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+
+    connection_t& conn = self->connections[client];
+    conn.pcb = pcb;
+    conn.pending = nullptr;
+    conn.pending_offset = 0;
+    conn.dropped = false;
+
+    tcp_arg(pcb, &conn);
+    tcp_recv(pcb, recv_callback);
+    tcp_sent(pcb, sent_callback);
+    tcp_err(pcb, error_callback);
+    tcp_nagle_disable(pcb);  // Replies are small and latency bound
+    return ERR_OK;
+}
+
+err_t ModbusTcpListener::recv_callback(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err) {
+    connection_t& conn = *static_cast<connection_t*>(arg);
+    ModbusTcpListener* self = conn.owner;
+
+    if (p == nullptr) {
+        // Closed by the client; a failed close ends in tcp_abort(), which lwIP must hear of
+        return self->close(conn, false) ? ERR_ABRT : ERR_OK;
+    }
+    if (err != ERR_OK) {
+        pbuf_free(p);
+        return err;
+    }
+
+    if (conn.pending == nullptr) {
+        conn.pending = p;
+        conn.pending_offset = 0;
+    } else {
+        pbuf_cat(conn.pending, p);
+    }
+    return self->consume(conn) ? ERR_OK : ERR_ABRT;
+}
+
+err_t ModbusTcpListener::sent_callback(void* arg, struct tcp_pcb* pcb, u16_t length) {
+    connection_t& conn = *static_cast<connection_t*>(arg);
+    ModbusTcpListener* self = conn.owner;
+
+    // Send space freed: pick up requests held back for it
+    if (!self->server.resume(conn.client)) {
+        return ERR_OK;
+    }
+    return self->consume(conn) ? ERR_OK : ERR_ABRT;
+}
+
+void ModbusTcpListener::error_callback(void* arg, err_t err) {
+    connection_t& conn = *static_cast<connection_t*>(arg);
+    MODBUS_DEBUG_PRINT("[TCP] Client %d error %d\n", conn.client, err);
+
+    // lwIP has already freed the pcb
+    conn.pcb = nullptr;
+    if (conn.pending != nullptr) {
+        pbuf_free(conn.pending);
+        conn.pending = nullptr;
+    }
+    conn.owner->server.close_client(conn.client);
+}
+
+bool ModbusTcpListener::consume(connection_t& conn) {
+    receiving = true;
+    while (conn.pending != nullptr) {
+        struct pbuf* p = conn.pending;
+        uint16_t available = p->len - conn.pending_offset;
+
+        // Each pbuf segment is parsed in place, whole ADUs are never copied
+        int used = server.receive(conn.client, static_cast<const uint8_t*>(p->payload) + conn.pending_offset, available);
+        if (used < 0 || conn.dropped) {
+            receiving = false;
+            close(conn, true);
+            return false;
+        }
+        if (used > 0) {
+            tcp_recved(conn.pcb, used);  // Window reopens only as requests are answered
+        }
+        conn.pending_offset += used;
+        if (used < available) {
+            break;  // Send buffer full, continued from sent_callback
+        }
+
+        // Segment done, release it but keep the rest of the chain
+        struct pbuf* next = p->next;
+        if (next != nullptr) {
+            pbuf_ref(next);
+        }
+        pbuf_free(p);
+        conn.pending = next;
+        conn.pending_offset = 0;
+    }
+    receiving = false;
+
+    tcp_output(conn.pcb);
+    return true;
+}
+
+bool ModbusTcpListener::close(connection_t& conn, bool abort) {
+    if (conn.pending != nullptr) {
+        pbuf_free(conn.pending);
+        conn.pending = nullptr;
+    }
+    server.close_client(conn.client);
+
+    struct tcp_pcb* pcb = conn.pcb;
+    conn.pcb = nullptr;
+    if (pcb == nullptr) {
+        return false;
+    }
+    tcp_arg(pcb, nullptr);
+    tcp_recv(pcb, nullptr);
+    tcp_sent(pcb, nullptr);
+    tcp_err(pcb, nullptr);
+    if (abort || tcp_close(pcb) != ERR_OK) {
+        tcp_abort(pcb);
+        return true;
+    }
+    return false;
+}
+
+uint16_t ModbusTcpListener::send_space(int client) {
+    struct tcp_pcb* pcb = connections[client].pcb;
+    if (pcb == nullptr || tcp_sndqueuelen(pcb) >= TCP_SND_QUEUELEN - 1) {
+        return 0;
+    }
+    return tcp_sndbuf(pcb);
+}
+
+void ModbusTcpListener::drop(int client) {
+    // May run inside this connection's own lwIP callback: only flag it here
+    if (connections[client].pcb != nullptr) {
+        connections[client].dropped = true;
+    }
+}
+
+bool ModbusTcpListener::send(int client, const uint8_t* data, uint16_t length) {
+    struct tcp_pcb* pcb = connections[client].pcb;
+    if (pcb == nullptr || tcp_write(pcb, data, length, TCP_WRITE_FLAG_COPY) != ERR_OK) {
+        return false;
+    }
+    // Replies outside a receive (answered later) go out at once
+    if (!receiving) {
+        tcp_output(pcb);
+    }
+    return true;
+}
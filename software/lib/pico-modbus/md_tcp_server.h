@@ -0,0 +1,56 @@
+#ifndef PICO_PLC_TCP_SERVER_H
+#define PICO_PLC_TCP_SERVER_H
+
+#include "common/md_tcp.h"
+#include "lwip/tcp.h"
+
+// lwIP raw-API front-end for a ModbusTcpServer, e.g.
+//     ModbusTcpServer tcp(slave);
+//     ModbusTcpListener listener(tcp);
+//     listener.start();
+// Link pico_modbus_tcp and a cyw43 lwIP arch. With pico_cyw43_arch_lwip_poll the
+// callbacks run from cyw43_arch_poll() in the main loop, next to process_tx_queue().
+class ModbusTcpListener {
+private:
+    struct connection_t {
+        ModbusTcpListener* owner;
+        struct tcp_pcb* pcb;
+        struct pbuf* pending;       // Received, not yet consumed (send buffer was full)
+        uint16_t pending_offset;
+        int client;
+        bool dropped;               // Server gave up on it, closed outside its callbacks
+    };
+
+    ModbusTcpServer& server;
+    struct tcp_pcb* listen_pcb;
+    connection_t connections[MODBUS_TCP_MAX_CLIENTS];
+    bool receiving;  // Inside recv_callback: one tcp_output() for all pipelined replies
+
+    static err_t accept_callback(void* arg, struct tcp_pcb* pcb, err_t err);
+    static err_t recv_callback(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err);
+    static err_t sent_callback(void* arg, struct tcp_pcb* pcb, u16_t length);
+    static void error_callback(void* arg, err_t err);
+
+    // Feed pending data to the server; false if the connection had to be aborted
+    bool consume(connection_t& conn);
+    // True if the pcb was aborted: a callback must then return ERR_ABRT
+    bool close(connection_t& conn, bool abort);
+
+    uint16_t send_space(int client);
+    bool send(int client, const uint8_t* data, uint16_t length);
+    void drop(int client);
+
+public:
+    explicit ModbusTcpListener(ModbusTcpServer& server);
+    ~ModbusTcpListener();
+
+    bool start(uint16_t port = MODBUS_TCP_PORT);
+    void stop();
+    // Retry requests held back by the server (e.g. a busy gateway) and close dropped
+    // connections; call from the main loop
+    void process();
+    bool is_listening() const { return listen_pcb != nullptr; }
+    uint8_t get_connection_count() const;
+};
+
+#endif //PICO_PLC_TCP_SERVER_H
@@ -0,0 +1,21 @@
+#ifndef PICO_PLC_FLASH_LAYOUT_H
+#define PICO_PLC_FLASH_LAYOUT_H
+
+#include "hardware/flash.h"
+
+// Flash areas of the runtime, one per module, stacked down from the end of the chip:
+//   ModbusPersistentStore   last FLASH_PERSIST_SECTORS sectors
+//   LogicProgramStore       FLASH_LOGIC_SECTORS below it
+//   AdcCalibration          FLASH_CAL_SECTORS below that
+// Pass the *_OFFSET of a module to its init() / enable_persistence(). The program
+// image must end below FLASH_LAYOUT_START.
+#define FLASH_PERSIST_SECTORS 4
+#define FLASH_LOGIC_SECTORS 2
+#define FLASH_CAL_SECTORS 1
+
+#define FLASH_PERSIST_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_PERSIST_SECTORS * FLASH_SECTOR_SIZE)
+#define FLASH_LOGIC_OFFSET (FLASH_PERSIST_OFFSET - FLASH_LOGIC_SECTORS * FLASH_SECTOR_SIZE)
+#define FLASH_CAL_OFFSET (FLASH_LOGIC_OFFSET - FLASH_CAL_SECTORS * FLASH_SECTOR_SIZE)
+#define FLASH_LAYOUT_START FLASH_CAL_OFFSET
+
+#endif //PICO_PLC_FLASH_LAYOUT_H
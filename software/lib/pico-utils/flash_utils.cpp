@@ -0,0 +1,27 @@
+#include "flash_utils.h"
+#include "pico/flash.h"
+
+// One flash operation, run by flash_safe_execute() with XIP disabled
+struct flash_op_t {
+    uint32_t offset;
+    const uint8_t* data;  // nullptr = erase the sector at offset
+};
+
+static void __not_in_flash_func(run_flash_op)(void* param) {
+    const flash_op_t* op = static_cast<const flash_op_t*>(param);
+    if (op->data == nullptr) {
+        flash_range_erase(op->offset, FLASH_SECTOR_SIZE);
+    } else {
+        flash_range_program(op->offset, op->data, FLASH_PAGE_SIZE);
+    }
+}
+
+bool flash_safe_erase_sector(uint32_t offset, uint32_t timeout_ms) {
+    flash_op_t op = { offset, nullptr };
+    return flash_safe_execute(run_flash_op, &op, timeout_ms) == PICO_OK;
+}
+
+bool flash_safe_program_page(uint32_t offset, const uint8_t* data, uint32_t timeout_ms) {
+    flash_op_t op = { offset, data };
+    return flash_safe_execute(run_flash_op, &op, timeout_ms) == PICO_OK;
+}
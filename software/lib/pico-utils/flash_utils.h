@@ -0,0 +1,14 @@
+#ifndef PICO_PLC_FLASH_UTILS_H
+#define PICO_PLC_FLASH_UTILS_H
+
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+
+// Erase one sector / program one page at a flash offset, through flash_safe_execute():
+// XIP off, this core's interrupts off and the other core locked out, so that core
+// must be set up for it (multicore_lockout_victim_init() or flash_safe_execute_core_init()).
+// False if the other core did not reach a safe state within timeout_ms.
+bool flash_safe_erase_sector(uint32_t offset, uint32_t timeout_ms);
+bool flash_safe_program_page(uint32_t offset, const uint8_t* data, uint32_t timeout_ms);
+
+#endif //PICO_PLC_FLASH_UTILS_H
@@ -0,0 +1,326 @@
+#include "adc_calibration.h"
+#include "adc_sampler.h"
+#include "hardware/sync.h"
+#include "pico-modbus/md_slave_unit.h"
+#include "pico-modbus/common/md_common.h"
+#include "pico-utils/analog_utils.h"
+#include "pico-utils/flash_utils.h"
+#include <cstring>
+
+AdcCalibration::AdcCalibration()
+    : channels{}, source_bits(12), selected(0), reference(0), status(CalStatus::OK),
+      pending(CalCommand::NONE), flash_offset(0), flash_enabled(false) {
+    for (uint8_t i = 0; i < CAL_CHANNELS; i++) {
+        set_table(i, default_table(CalUnit::RAW));
+    }
+}
+
+cal_table_t AdcCalibration::default_table(CalUnit unit) {
+    // Raw codes scaled to 16 bits, as table points are
+    cal_table_t table = {};
+    table.unit = unit;
+    table.count = 2;
+    switch (unit) {
+        case CalUnit::MILLIVOLT:
+            table.points[0] = {0, 0};
+            table.points[1] = {(uint16_t)(ADC_VAL_3V0 << 4), 10000};
+            break;
+        case CalUnit::MICROAMP:
+            table.points[0] = {(uint16_t)(ADC_VAL_0V6 << 4), 4000};
+            table.points[1] = {(uint16_t)(ADC_VAL_3V0 << 4), 20000};
+            break;
+        case CalUnit::PERCENT:
+            table.points[0] = {0, 0};
+            table.points[1] = {(uint16_t)(ADC_VAL_3V0 << 4), 10000};
+            break;
+        default:
+            table.unit = CalUnit::RAW;
+            table.points[0] = {0, 0};
+            table.points[1] = {4095 << 4, 4095};
+            break;
+    }
+    return table;
+}
+
+bool AdcCalibration::build(const cal_table_t& table, segment_t* segments) {
+    if (table.count < 2 || table.count > CAL_MAX_POINTS) {
+        return false;
+    }
+    for (uint16_t i = 0; i + 1 < table.count; i++) {
+        const cal_point_t& a = table.points[i];
+        const cal_point_t& b = table.points[i + 1];
+        if (b.raw <= a.raw) {
+            return false;
+        }
+        segments[i].raw = a.raw;
+        segments[i].value = a.value;
+        segments[i].slope = (int64_t)(b.value - a.value) * (1 << 24) / (b.raw - a.raw);
+    }
+    return true;
+}
+
+bool AdcCalibration::set_table(uint8_t channel, const cal_table_t& table) {
+    segment_t segments[CAL_MAX_POINTS - 1];
+    if (channel >= CAL_CHANNELS || !build(table, segments)) {
+        return false;
+    }
+
+    uint32_t irq = save_and_disable_interrupts();
+    channels[channel].table = table;
+    memcpy(channels[channel].segments, segments, sizeof(segments));
+    channels[channel].segment_count = table.count - 1;
+    restore_interrupts(irq);
+    return true;
+}
+
+int16_t __not_in_flash("adc_calibration") AdcCalibration::convert(uint8_t channel, uint16_t raw, uint8_t bits) const {
+    if (channel >= CAL_CHANNELS || bits == 0 || bits > 16) {
+        return 0;
+    }
+    const channel_t& ch = channels[channel];
+    uint16_t raw16 = raw << (16 - bits);
+
+    // Last segment starting at or below raw16; the first one below all of them
+    uint8_t i = ch.segment_count - 1;
+    while (i > 0 && raw16 < ch.segments[i].raw) {
+        i--;
+    }
+    const segment_t& segment = ch.segments[i];
+    int64_t value = segment.value +
+        ((((int64_t)raw16 - segment.raw) * segment.slope + (1 << 23)) >> 24);
+    if (value > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (value < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)value;
+}
+
+void AdcCalibration::set_source(const raw_source_t& source, uint8_t bits) {
+    this->source = source;
+    source_bits = bits;
+}
+
+bool AdcCalibration::attach(AdcSampler& sampler, uint8_t channel_mask, ModbusSlaveUnit* unit, uint16_t input_base) {
+    if (channel_mask == 0 || channel_mask >= (1u << CAL_CHANNELS)) {
+        return false;
+    }
+    if (unit != nullptr) {
+        uint16_t n = 0;
+        for (uint8_t i = 0; i < CAL_CHANNELS; i++) {
+            if ((channel_mask & (1u << i)) && !unit->set_input_register(input_base + n++, 0)) {
+                return false;  // Missing, or a callback region the interrupt could not write
+            }
+        }
+    }
+
+    bool added = sampler.add_block_listener([this, &sampler, channel_mask, unit, input_base]() {
+        uint8_t bits = sampler.get_resolution_bits();
+        uint16_t n = 0;
+        for (uint8_t i = 0; i < CAL_CHANNELS; i++) {
+            if (channel_mask & (1u << i)) {
+                int16_t value = convert(i, sampler.get_latest(i), bits);
+                if (unit != nullptr) {
+                    unit->set_input_register(input_base + n, (uint16_t)value);
+                }
+                n++;
+            }
+        }
+    });
+    if (!added) {
+        return false;
+    }
+    set_source([&sampler](uint8_t channel) { return sampler.get_latest(channel); },
+               sampler.get_resolution_bits());
+    return true;
+}
+
+uint16_t AdcCalibration::read_raw16(uint8_t channel) const {
+    return source ? (uint16_t)(source(channel) << (16 - source_bits)) : 0;
+}
+
+CalStatus AdcCalibration::capture(CalCommand command) {
+    if (!source) {
+        return CalStatus::NO_SOURCE;
+    }
+    cal_table_t table = channels[selected].table;
+    cal_point_t point = {read_raw16(selected), reference};
+
+    if (command == CalCommand::CAPTURE_ZERO) {
+        table.points[0] = point;
+    } else if (command == CalCommand::CAPTURE_SPAN) {
+        table.points[table.count - 1] = point;
+    } else {
+        // Same reference again moves that point, a new one is inserted by raw code
+        uint16_t i = 0;
+        while (i < table.count && table.points[i].value != reference) {
+            i++;
+        }
+        if (i < table.count) {
+            memmove(&table.points[i], &table.points[i + 1], (table.count - i - 1) * sizeof(cal_point_t));
+            table.count--;
+        } else if (table.count >= CAL_MAX_POINTS) {
+            return CalStatus::TABLE_FULL;
+        }
+        i = table.count;
+        while (i > 0 && table.points[i - 1].raw > point.raw) {
+            table.points[i] = table.points[i - 1];
+            i--;
+        }
+        table.points[i] = point;
+        table.count++;
+    }
+    return set_table(selected, table) ? CalStatus::OK : CalStatus::NOT_MONOTONIC;
+}
+
+CalStatus AdcCalibration::run_command(uint16_t command) {
+    switch ((CalCommand)command) {
+        case CalCommand::NONE:
+            return status;
+        case CalCommand::CAPTURE_ZERO:
+        case CalCommand::CAPTURE_SPAN:
+        case CalCommand::CAPTURE_POINT:
+            return capture((CalCommand)command);
+        case CalCommand::RESET:
+            set_table(selected, default_table(channels[selected].table.unit));
+            return CalStatus::OK;
+        case CalCommand::SAVE:
+        case CalCommand::LOAD:
+            if (!flash_enabled) {
+                return CalStatus::FLASH_ERROR;
+            }
+            pending = (CalCommand)command;
+            return CalStatus::PENDING;
+        default:
+            return CalStatus::BAD_COMMAND;
+    }
+}
+
+bool AdcCalibration::bind_registers(ModbusSlaveUnit& unit, uint16_t holding_base) {
+    return unit.add_holding_register_callback(holding_base, CAL_REGISTERS,
+        [this, holding_base](uint16_t start, uint16_t count, uint16_t* values) {
+            return read_registers(start - holding_base, count, values);
+        },
+        [this, holding_base](uint16_t start, uint16_t count, const uint16_t* values) {
+            return write_registers(start - holding_base, count, values);
+        });
+}
+
+bool AdcCalibration::read_registers(uint16_t offset, uint16_t count, uint16_t* values) {
+    for (uint16_t i = 0; i < count; i++) {
+        switch (offset + i) {
+            case 0: values[i] = selected; break;
+            case 1: values[i] = (uint16_t)reference; break;
+            case 2: values[i] = 0; break;
+            case 3: values[i] = enum_value(status); break;
+            case 4: values[i] = enum_value(channels[selected].table.unit); break;
+            case 5: values[i] = read_raw16(selected); break;
+            case 6: values[i] = (uint16_t)convert(selected, read_raw16(selected), 16); break;
+            default: return false;
+        }
+    }
+    return true;
+}
+
+bool AdcCalibration::write_registers(uint16_t offset, uint16_t count, const uint16_t* values) {
+    // Check the whole write first, so a bad word changes nothing
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t reg = offset + i;
+        if ((reg == 0 && values[i] >= CAL_CHANNELS) || reg == 3 || reg >= 5 ||
+            (reg == 2 && pending != CalCommand::NONE) ||  // SAVE or LOAD still running
+            (reg == 4 && values[i] > enum_value(CalUnit::PERCENT))) {
+            return false;
+        }
+    }
+    // In register order: channel and reference are set before a command in the same write
+    for (uint16_t i = 0; i < count; i++) {
+        switch (offset + i) {
+            case 0:
+                selected = values[i];
+                break;
+            case 1:
+                reference = (int16_t)values[i];
+                break;
+            case 2:
+                status = run_command(values[i]);
+                break;
+            case 4:
+                set_table(selected, default_table((CalUnit)values[i]));
+                status = CalStatus::OK;
+                break;
+        }
+    }
+    return true;
+}
+
+uint16_t AdcCalibration::image_crc(const flash_image_t& image) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(image.tables);
+    uint16_t crc = 0xFFFF;
+    for (uint32_t i = 0; i < sizeof(image.tables); i++) {
+        crc = crc_update(crc, bytes[i]);
+    }
+    return crc;
+}
+
+bool AdcCalibration::init(uint32_t offset) {
+    if (offset % FLASH_SECTOR_SIZE != 0 || offset + FLASH_SECTOR_SIZE > PICO_FLASH_SIZE_BYTES) {
+        return false;
+    }
+    flash_offset = offset;
+    flash_enabled = true;
+    return true;
+}
+
+bool AdcCalibration::load() {
+    if (!flash_enabled) {
+        return false;
+    }
+    flash_image_t image;
+    memcpy(&image, reinterpret_cast<const void*>(XIP_BASE + flash_offset), sizeof(image));
+    if (image.magic != MAGIC || image.size != sizeof(image) || image_crc(image) != image.crc) {
+        return false;
+    }
+
+    // All or nothing: check every table before replacing any
+    segment_t segments[CAL_MAX_POINTS - 1];
+    for (uint8_t i = 0; i < CAL_CHANNELS; i++) {
+        if (!build(image.tables[i], segments)) {
+            return false;
+        }
+    }
+    for (uint8_t i = 0; i < CAL_CHANNELS; i++) {
+        set_table(i, image.tables[i]);
+    }
+    return true;
+}
+
+bool AdcCalibration::save() {
+    static_assert(sizeof(flash_image_t) <= FLASH_PAGE_SIZE, "Calibration tables must fit one flash page");
+    if (!flash_enabled) {
+        return false;
+    }
+
+    uint8_t page[FLASH_PAGE_SIZE];
+    memset(page, 0xFF, sizeof(page));
+    flash_image_t image = {};
+    image.magic = MAGIC;
+    image.size = sizeof(image);
+    for (uint8_t i = 0; i < CAL_CHANNELS; i++) {
+        image.tables[i] = channels[i].table;
+    }
+    image.crc = image_crc(image);
+    memcpy(page, &image, sizeof(image));
+
+    return flash_safe_erase_sector(flash_offset, CAL_FLASH_TIMEOUT_MS) &&
+           flash_safe_program_page(flash_offset, page, CAL_FLASH_TIMEOUT_MS);
+}
+
+void AdcCalibration::service() {
+    if (pending == CalCommand::SAVE) {
+        status = save() ? CalStatus::OK : CalStatus::FLASH_ERROR;
+    } else if (pending == CalCommand::LOAD) {
+        status = load() ? CalStatus::OK : CalStatus::EMPTY;
+    }
+    pending = CalCommand::NONE;
+}
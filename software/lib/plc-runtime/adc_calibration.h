@@ -0,0 +1,156 @@
+#ifndef PICO_PLC_ADC_CALIBRATION_H
+#define PICO_PLC_ADC_CALIBRATION_H
+
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include <functional>
+
+class AdcSampler;
+class ModbusSlaveUnit;
+
+// Raw ADC codes to engineering units through a piecewise-linear table per channel,
+// integer only, so convert() can run in the AdcSampler block interrupt. Table points
+// are raw codes scaled to 16 bits (any ADC resolution fits) and signed 16-bit values;
+// segment slopes are precomputed in Q24 when a table is set. Beyond the end points
+// the first and last segments extrapolate (a broken 4-20 mA loop reads below 4000 uA),
+// saturated to int16.
+//
+// Defaults come from the front-end constants in analog_utils.h. Calibrated tables are
+// kept in one flash sector, written from service() with the other core locked out.
+//
+// Calibration registers after bind_registers() (holding, at base):
+//   +0 channel          0-3, selects the channel for the registers below
+//   +1 reference        applied value, in the channel's unit (signed)
+//   +2 command          CalCommand, acts on write (reads 0)
+//   +3 status           CalStatus of the last command (read only)
+//   +4 unit             CalUnit; writing one resets the table to its default
+//   +5 raw              current raw code, 16-bit scaled (read only)
+//   +6 value            current converted value (read only)
+// Zero/span: apply the low reference, write channel, reference and CAPTURE_ZERO in
+// one request; the same with the high reference and CAPTURE_SPAN; then SAVE.
+#define CAL_CHANNELS 4
+#define CAL_MAX_POINTS 8
+#define CAL_REGISTERS 7
+#define CAL_FLASH_TIMEOUT_MS 100
+
+enum class CalUnit : uint16_t {
+    RAW = 0,            // 12-bit code
+    MILLIVOLT,          // 0-10 V input
+    MICROAMP,           // 4-20 mA input
+    PERCENT             // 0.01 % steps, 0-10000
+};
+
+enum class CalCommand : uint16_t {
+    NONE = 0,
+    CAPTURE_ZERO,       // First point := current raw, reference
+    CAPTURE_SPAN,       // Last point := current raw, reference
+    CAPTURE_POINT,      // Insert (or move the point with the same reference)
+    RESET,              // Default table of the channel's unit
+    SAVE,               // All channels to flash, in service()
+    LOAD                // All channels from flash, in service()
+};
+
+enum class CalStatus : uint16_t {
+    OK = 0,
+    PENDING,            // SAVE or LOAD waiting for service()
+    BAD_COMMAND,
+    NO_SOURCE,          // Nothing to capture from (attach() or set_source())
+    TABLE_FULL,
+    NOT_MONOTONIC,      // Raw codes would not increase from point to point
+    FLASH_ERROR,
+    EMPTY               // LOAD found no valid tables in flash
+};
+
+struct cal_point_t {
+    uint16_t raw;       // Raw code scaled to 16 bits
+    int16_t value;
+};
+
+struct cal_table_t {
+    CalUnit unit;
+    uint16_t count;     // 2 to CAL_MAX_POINTS
+    cal_point_t points[CAL_MAX_POINTS];
+};
+
+class AdcCalibration {
+public:
+    // Raw code of a channel, at source_bits resolution
+    typedef std::function<uint16_t(uint8_t channel)> raw_source_t;
+
+private:
+    struct segment_t {
+        uint16_t raw;
+        int32_t value;
+        int64_t slope;          // Value per 16-bit raw step, Q24
+    };
+
+    struct channel_t {
+        cal_table_t table;
+        segment_t segments[CAL_MAX_POINTS - 1];
+        uint8_t segment_count;
+    };
+
+    struct flash_image_t {
+        uint32_t magic;
+        uint16_t size;
+        uint16_t crc;           // Modbus CRC of the tables
+        cal_table_t tables[CAL_CHANNELS];
+    };
+
+    static constexpr uint32_t MAGIC = 0x4C414341;  // "ACAL"
+
+    channel_t channels[CAL_CHANNELS];
+
+    raw_source_t source;
+    uint8_t source_bits;
+
+    // Register interface
+    uint16_t selected;
+    int16_t reference;
+    CalStatus status;
+    CalCommand pending;         // SAVE or LOAD for service()
+
+    uint32_t flash_offset;
+    bool flash_enabled;
+
+    static bool build(const cal_table_t& table, segment_t* segments);
+    uint16_t read_raw16(uint8_t channel) const;
+    CalStatus capture(CalCommand command);
+    CalStatus run_command(uint16_t command);
+    bool read_registers(uint16_t offset, uint16_t count, uint16_t* values);
+    bool write_registers(uint16_t offset, uint16_t count, const uint16_t* values);
+    static uint16_t image_crc(const flash_image_t& image);
+
+public:
+    AdcCalibration();
+
+    static cal_table_t default_table(CalUnit unit);
+
+    // Tables are checked (2+ points, raw strictly increasing) and swapped in with
+    // interrupts off; call from the core running the sampler interrupt
+    bool set_table(uint8_t channel, const cal_table_t& table);
+    const cal_table_t& get_table(uint8_t channel) const { return channels[channel % CAL_CHANNELS].table; }
+
+    // Engineering value of a raw code of "bits" resolution (12 for adc_read_raw())
+    int16_t convert(uint8_t channel, uint16_t raw, uint8_t bits = 12) const;
+
+    // Where captures read the current raw code from
+    void set_source(const raw_source_t& source, uint8_t bits);
+    // Source = the sampler; after each block, converted values of the channels in
+    // channel_mask go to input_base + n (n-th channel in the mask), from the interrupt.
+    // Adds a block listener, so call while the sampler is stopped.
+    bool attach(AdcSampler& sampler, uint8_t channel_mask, ModbusSlaveUnit* unit = nullptr, uint16_t input_base = 0);
+
+    bool bind_registers(ModbusSlaveUnit& unit, uint16_t holding_base);
+
+    // Flash sector at "offset" (FLASH_CAL_OFFSET of pico-utils/flash_layout.h)
+    bool init(uint32_t offset);
+    bool load();                // At boot; false (defaults kept) if flash holds no tables
+    bool save();
+    // Pending SAVE/LOAD from the registers; call from the main loop
+    void service();
+
+    CalStatus get_status() const { return status; }
+};
+
+#endif //PICO_PLC_ADC_CALIBRATION_H
@@ -0,0 +1,277 @@
+#include "adc_sampler.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "pico-modbus/md_slave_unit.h"
+#include "pico-utils/analog_utils.h"
+
+#define SAMPLER_BUFFER_RING_BITS 11     // log2 of one buffer in bytes, DMA write wrap
+
+static_assert((1u << SAMPLER_BUFFER_RING_BITS) == SAMPLER_BLOCK_SAMPLES * sizeof(uint16_t),
+              "DMA write ring must be exactly one buffer");
+static_assert((SAMPLER_HISTORY & (SAMPLER_HISTORY - 1)) == 0, "SAMPLER_HISTORY must be a power of 2");
+
+AdcSampler* AdcSampler::instance = nullptr;
+
+AdcSampler::AdcSampler()
+    : channels{}, channel_mask(0), channel_count(0), order{},
+      rate_hz(SAMPLER_DEFAULT_RATE_HZ), oversampling(0),
+      block_samples(0), outputs_per_block(0), dma_channels{-1, -1},
+      unit(nullptr), input_base(0), listener_count(0), blocks(0), overruns(0), started(false) {
+}
+
+AdcSampler::~AdcSampler() {
+    stop();
+}
+
+bool AdcSampler::add_channel(uint8_t adc_channel) {
+    if (started || adc_channel >= SAMPLER_ADC_CHANNELS || (channel_mask & (1u << adc_channel))) {
+        return false;
+    }
+    if (channel_mask == 0) {
+        adc_init_system();
+    }
+    adc_init_pin(adc_channel);
+    channel_mask |= 1u << adc_channel;
+
+    // Round robin converts in ascending channel order
+    channel_count = 0;
+    for (uint8_t i = 0; i < SAMPLER_ADC_CHANNELS; i++) {
+        if (channel_mask & (1u << i)) {
+            order[channel_count++] = i;
+        }
+    }
+    return true;
+}
+
+bool AdcSampler::set_rate_hz(uint32_t rate_hz) {
+    if (started || rate_hz == 0 || rate_hz > SAMPLER_MAX_CONVERSION_RATE) {
+        return false;
+    }
+    this->rate_hz = rate_hz;
+    return true;
+}
+
+bool AdcSampler::set_oversampling(uint8_t k) {
+    if (started || k > SAMPLER_MAX_OVERSAMPLING) {
+        return false;
+    }
+    oversampling = k;
+    return true;
+}
+
+bool AdcSampler::bind_registers(ModbusSlaveUnit& unit, uint16_t input_base) {
+    if (started || channel_count == 0) {
+        return false;
+    }
+    for (uint8_t i = 0; i < channel_count; i++) {
+        if (!unit.set_input_register(input_base + i, 0)) {
+            return false;  // Missing, or a callback region the interrupt could not write
+        }
+    }
+    this->unit = &unit;
+    this->input_base = input_base;
+    return true;
+}
+
+bool AdcSampler::add_block_listener(const block_callback_t& listener) {
+    if (started || !listener || listener_count >= SAMPLER_MAX_LISTENERS) {
+        return false;
+    }
+    listeners[listener_count++] = listener;
+    return true;
+}
+
+bool AdcSampler::start() {
+    if (started || channel_count == 0 || (instance != nullptr && instance != this)) {
+        return false;
+    }
+
+    // One conversion takes (1 + div) ADC clocks; div has a 16-bit integer part
+    uint32_t conversion_rate = rate_hz * channel_count;
+    if (conversion_rate > SAMPLER_MAX_CONVERSION_RATE || SAMPLER_ADC_CLOCK_HZ / conversion_rate > 65536) {
+        return false;
+    }
+    uint32_t round = (uint32_t)channel_count << (2 * oversampling);
+    uint32_t output_rate = get_output_rate_hz();
+    if (round > SAMPLER_BLOCK_SAMPLES || output_rate == 0) {
+        return false;
+    }
+
+    outputs_per_block = output_rate / SAMPLER_BLOCK_RATE_HZ;
+    if (outputs_per_block == 0) {
+        outputs_per_block = 1;
+    }
+    if (outputs_per_block > SAMPLER_BLOCK_SAMPLES / round) {
+        outputs_per_block = SAMPLER_BLOCK_SAMPLES / round;
+    }
+    block_samples = round * outputs_per_block;
+
+    dma_channels[0] = dma_claim_unused_channel(false);
+    dma_channels[1] = dma_claim_unused_channel(false);
+    if (dma_channels[0] < 0 || dma_channels[1] < 0) {
+        for (int& channel : dma_channels) {
+            if (channel >= 0) {
+                dma_channel_unclaim(channel);
+                channel = -1;
+            }
+        }
+        return false;
+    }
+    instance = this;
+
+    adc_set_round_robin(channel_mask);
+    adc_set_clkdiv((float)SAMPLER_ADC_CLOCK_HZ / (float)conversion_rate - 1.0f);
+    adc_fifo_setup(true, true, 1, false, false);  // DREQ on every sample
+
+    irq_add_shared_handler(DMA_IRQ_0, dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    dma_channel_set_irq0_enabled(dma_channels[0], true);
+    dma_channel_set_irq0_enabled(dma_channels[1], true);
+    irq_set_enabled(DMA_IRQ_0, true);
+
+    started = true;
+    restart_stream();
+    return true;
+}
+
+void AdcSampler::stop() {
+    if (!started) {
+        return;
+    }
+    adc_run(false);
+    for (int& channel : dma_channels) {
+        dma_channel_set_irq0_enabled(channel, false);
+        dma_channel_abort(channel);
+        dma_channel_acknowledge_irq0(channel);
+        dma_channel_unclaim(channel);
+        channel = -1;
+    }
+    irq_remove_handler(DMA_IRQ_0, dma_irq_handler);
+    adc_fifo_drain();
+    adc_fifo_setup(false, false, 0, false, false);
+    adc_set_round_robin(0);
+    instance = nullptr;
+    started = false;
+}
+
+void AdcSampler::configure_dma(uint8_t buffer) {
+    dma_channel_config config = dma_channel_get_default_config(dma_channels[buffer]);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    // A late interrupt then overwrites its own buffer, never memory after it
+    channel_config_set_ring(&config, true, SAMPLER_BUFFER_RING_BITS);
+    channel_config_set_dreq(&config, DREQ_ADC);
+    channel_config_set_chain_to(&config, dma_channels[buffer ^ 1]);
+    dma_channel_configure(dma_channels[buffer], &config, buffers[buffer], &adc_hw->fifo, block_samples, false);
+}
+
+void AdcSampler::restart_stream() {
+    adc_run(false);
+    for (int channel : dma_channels) {
+        dma_channel_abort(channel);
+    }
+    adc_fifo_drain();
+    hw_set_bits(&adc_hw->fcs, ADC_FCS_OVER_BITS | ADC_FCS_UNDER_BITS);  // Write-1-to-clear
+
+    configure_dma(0);
+    configure_dma(1);
+    for (int channel : dma_channels) {
+        dma_channel_acknowledge_irq0(channel);
+    }
+    adc_select_input(order[0]);
+    dma_channel_start(dma_channels[0]);
+    adc_run(true);
+}
+
+void AdcSampler::dma_irq_handler() {
+    AdcSampler* self = instance;
+    if (self == nullptr) {
+        return;
+    }
+    bool done[2] = {dma_channel_get_irq0_status(self->dma_channels[0]),
+                    dma_channel_get_irq0_status(self->dma_channels[1])};
+    if (!done[0] && !done[1]) {
+        return;  // Another DMA channel on the shared interrupt
+    }
+
+    // Both blocks done: the stream has already wrapped into the older one.
+    // A FIFO overflow dropped a sample and shifted the channel order.
+    if ((done[0] && done[1]) || (adc_hw->fcs & ADC_FCS_OVER_BITS)) {
+        self->overruns++;
+        self->restart_stream();
+        return;
+    }
+
+    uint8_t buffer = done[0] ? 0 : 1;
+    dma_channel_acknowledge_irq0(self->dma_channels[buffer]);
+    // Ready for its next turn, which starts when the other block completes
+    dma_channel_set_write_addr(self->dma_channels[buffer], self->buffers[buffer], false);
+    self->handle_block(buffer);
+}
+
+void AdcSampler::handle_block(uint8_t buffer) {
+    const uint16_t* samples = buffers[buffer];
+    uint32_t round = (uint32_t)channel_count << (2 * oversampling);
+
+    // Decimate into one run of values per channel
+    for (uint32_t output = 0; output < outputs_per_block; output++) {
+        uint32_t sums[SAMPLER_ADC_CHANNELS] = {};
+        const uint16_t* round_samples = samples + output * round;
+        for (uint32_t i = 0; i < round; i += channel_count) {
+            for (uint8_t c = 0; c < channel_count; c++) {
+                sums[c] += round_samples[i + c];
+            }
+        }
+        for (uint8_t c = 0; c < channel_count; c++) {
+            decimated[c * outputs_per_block + output] = (uint16_t)(sums[c] >> oversampling);
+        }
+    }
+
+    for (uint8_t c = 0; c < channel_count; c++) {
+        uint16_t* values = &decimated[c * outputs_per_block];
+        if (filter) {
+            filter(order[c], values, outputs_per_block);
+        }
+
+        channel_t& channel = channels[order[c]];
+        uint32_t head = channel.head;
+        for (uint32_t output = 0; output < outputs_per_block; output++) {
+            channel.history[(head + output) & (SAMPLER_HISTORY - 1)] = values[output];
+        }
+        channel.head = head + outputs_per_block;
+        channel.latest = values[outputs_per_block - 1];
+    }
+
+    if (unit != nullptr) {
+        for (uint8_t c = 0; c < channel_count; c++) {
+            unit->set_input_register(input_base + c, channels[order[c]].latest);
+        }
+    }
+    blocks++;
+    for (uint8_t i = 0; i < listener_count; i++) {
+        listeners[i]();
+    }
+}
+
+uint32_t AdcSampler::read_history(uint8_t adc_channel, uint16_t* values, uint32_t count) const {
+    if (adc_channel >= SAMPLER_ADC_CHANNELS) {
+        return 0;
+    }
+    const channel_t& channel = channels[adc_channel];
+    if (count > SAMPLER_HISTORY) {
+        count = SAMPLER_HISTORY;
+    }
+
+    // Copy, then check that the interrupt did not reach the copied entries meanwhile
+    while (true) {
+        uint32_t head = channel.head;
+        uint32_t copied = count < head ? count : head;
+        for (uint32_t i = 0; i < copied; i++) {
+            values[i] = channel.history[(head - copied + i) & (SAMPLER_HISTORY - 1)];
+        }
+        if (channel.head - head <= SAMPLER_HISTORY - copied) {
+            return copied;
+        }
+    }
+}
@@ -0,0 +1,118 @@
+#ifndef PICO_PLC_ADC_SAMPLER_H
+#define PICO_PLC_ADC_SAMPLER_H
+
+#include "pico/stdlib.h"
+#include <functional>
+
+class ModbusSlaveUnit;
+
+// Free-running ADC acquisition with no CPU time per conversion. The ADC converts the
+// enabled channels round robin at a fixed rate and two chained DMA channels move the
+// FIFO into two blocks, ping-pong. Each finished block raises one DMA interrupt,
+// which oversamples and decimates it: 4^k raw samples per channel summed and shifted
+// right by k give one value of 12 + k bits. Values pass an optional block filter and
+// go to a per-channel history ring
+// and to the channel's latest value, a single halfword that readers load without
+// locks from any core or interrupt.
+//
+// Blocks are sized for about SAMPLER_BLOCK_RATE_HZ interrupts per second. A block
+// holds whole rounds, so sample i of every block is always the same channel; an ADC
+// FIFO overflow restarts the stream to keep it that way.
+//
+// It is the one ADC path of the runtime: IoMap inputs, ScanEngine::bind_adc() and
+// ControlInput::ADC read get_latest_raw() of a bound sampler, so do not call
+// adc_read_raw() while it runs.
+#define SAMPLER_ADC_CHANNELS 4          // ADC0-3 (GPIO 26-29)
+#define SAMPLER_ADC_CLOCK_HZ 48000000
+#define SAMPLER_MAX_CONVERSION_RATE 500000  // All channels together
+#define SAMPLER_DEFAULT_RATE_HZ 10000   // Raw samples per channel
+#define SAMPLER_MAX_OVERSAMPLING 4      // k: 4^4 = 256 samples for 16 bits
+#define SAMPLER_BLOCK_SAMPLES 1024      // Per DMA block
+#define SAMPLER_BLOCK_RATE_HZ 1000      // Target interrupt rate
+#define SAMPLER_HISTORY 64              // Decimated values kept per channel, power of 2
+#define SAMPLER_MAX_LISTENERS 4         // Block callbacks (IoMap, AdcCalibration, application)
+
+class AdcSampler {
+public:
+    // Called in the DMA interrupt after each block, with the latest values updated
+    typedef std::function<void()> block_callback_t;
+    // Called in the DMA interrupt with each channel's decimated values of a block,
+    // oldest first, before they reach the history and latest value; filters in place
+    typedef std::function<void(uint8_t adc_channel, uint16_t* values, uint32_t count)> block_filter_t;
+
+private:
+    struct channel_t {
+        volatile uint16_t latest;
+        uint16_t history[SAMPLER_HISTORY];
+        volatile uint32_t head;         // Values written so far, history index = head % size
+    };
+
+    channel_t channels[SAMPLER_ADC_CHANNELS];
+    uint8_t channel_mask;
+    uint8_t channel_count;
+    uint8_t order[SAMPLER_ADC_CHANNELS];  // ADC channels in conversion order
+    uint32_t rate_hz;
+    uint8_t oversampling;               // k
+
+    // Two DMA blocks of rounds; outputs_per_block decimated values per channel each
+    alignas(SAMPLER_BLOCK_SAMPLES * sizeof(uint16_t)) uint16_t buffers[2][SAMPLER_BLOCK_SAMPLES];
+    uint32_t block_samples;
+    uint32_t outputs_per_block;
+    int dma_channels[2];
+    uint16_t decimated[SAMPLER_BLOCK_SAMPLES];  // Per channel, outputs_per_block each
+
+    block_filter_t filter;
+
+    ModbusSlaveUnit* unit;
+    uint16_t input_base;
+    block_callback_t listeners[SAMPLER_MAX_LISTENERS];
+    uint8_t listener_count;
+
+    volatile uint32_t blocks;
+    volatile uint32_t overruns;         // Late interrupts and FIFO overflows
+    bool started;
+
+    static AdcSampler* instance;        // For the DMA interrupt
+    static void dma_irq_handler();
+    void handle_block(uint8_t buffer);
+    void restart_stream();
+    void configure_dma(uint8_t buffer);
+
+public:
+    AdcSampler();
+    ~AdcSampler();
+
+    // Setup, while stopped
+    bool add_channel(uint8_t adc_channel);
+    bool has_channel(uint8_t adc_channel) const {
+        return adc_channel < SAMPLER_ADC_CHANNELS && (channel_mask & (1u << adc_channel));
+    }
+    bool set_rate_hz(uint32_t rate_hz);             // Raw samples per second per channel
+    bool set_oversampling(uint8_t k);               // 0 to SAMPLER_MAX_OVERSAMPLING
+    // Latest value of the n-th enabled channel (in channel order) to input_base + n,
+    // from the interrupt; the registers must be RAM regions
+    bool bind_registers(ModbusSlaveUnit& unit, uint16_t input_base);
+    // Called in order after each block; false when all SAMPLER_MAX_LISTENERS are taken
+    bool add_block_listener(const block_callback_t& listener);
+    void set_block_filter(const block_filter_t& filter) { this->filter = filter; }
+
+    bool start();
+    void stop();
+    bool is_running() const { return started; }
+
+    // Lock-free reads, any core or context
+    uint16_t get_latest(uint8_t adc_channel) const {
+        return adc_channel < SAMPLER_ADC_CHANNELS ? channels[adc_channel].latest : 0;
+    }
+    // Latest value as a 12-bit code, for scales written in adc_read_raw() codes (ADC_VAL_*)
+    uint16_t get_latest_raw(uint8_t adc_channel) const { return get_latest(adc_channel) >> oversampling; }
+    // Newest count values, oldest first; returns how many were copied
+    uint32_t read_history(uint8_t adc_channel, uint16_t* values, uint32_t count) const;
+
+    uint8_t get_resolution_bits() const { return 12 + oversampling; }
+    uint32_t get_output_rate_hz() const { return rate_hz >> (2 * oversampling); }
+    uint32_t get_blocks() const { return blocks; }
+    uint32_t get_overruns() const { return overruns; }
+};
+
+#endif //PICO_PLC_ADC_SAMPLER_H
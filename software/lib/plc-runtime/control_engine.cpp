@@ -0,0 +1,343 @@
+#include "control_engine.h"
+#include "adc_sampler.h"
+#include "pico/multicore.h"
+#include "hardware/sync.h"
+#include "dac7562-driver/dac7562.h"
+#include "pico-modbus/md_slave_unit.h"
+#include "pico-utils/custom_dac.h"
+#include <cstdio>
+#include <cstring>
+
+#define CONTROL_CODE_BITS 12        // DAC7562 and PWM output resolution
+#define CONTROL_STOP_TIMEOUT_MS 100
+
+ControlEngine::ControlEngine(uint32_t rate_hz)
+    : rate_hz(CONTROL_DEFAULT_RATE_HZ), period_us(1000000 / CONTROL_DEFAULT_RATE_HZ),
+      loop_count(0), dac(nullptr), sampler(nullptr),
+      unit(nullptr), holding_base(0), input_base(0), stats{},
+      stats_lock(spin_lock_instance(spin_lock_claim_unused(true))),
+      pool(nullptr), due_us(0), running(false), core1_stopped(true) {
+    set_rate_hz(rate_hz);
+}
+
+ControlEngine::~ControlEngine() {
+    stop();
+}
+
+bool ControlEngine::set_rate_hz(uint32_t rate_hz) {
+    if (running || rate_hz == 0 || rate_hz > CONTROL_MAX_RATE_HZ || 1000000 % rate_hz != 0) {
+        return false;  // Whole microsecond periods only, so the grid does not drift
+    }
+    for (uint8_t i = 0; i < loop_count; i++) {
+        loops[i].pid.set_rate(rate_hz);
+    }
+    this->rate_hz = rate_hz;
+    period_us = 1000000 / rate_hz;
+    return true;
+}
+
+void ControlEngine::bind_dac(DAC7562* dac) {
+    this->dac = dac;
+}
+
+void ControlEngine::bind_sampler(AdcSampler* sampler) {
+    this->sampler = sampler;
+}
+
+int ControlEngine::add_loop(const control_loop_io_t& io) {
+    if (running || loop_count >= CONTROL_MAX_LOOPS) {
+        return -1;
+    }
+    if (io.input == ControlInput::ADC &&
+        (sampler == nullptr || io.adc_channel >= CONTROL_ADC_CHANNELS || io.adc_high <= io.adc_low)) {
+        return -1;
+    }
+    if ((io.input == ControlInput::CALLBACK && !io.read_pv) || (io.output == ControlOutput::CALLBACK && !io.write_cv)) {
+        return -1;
+    }
+
+    if (io.input == ControlInput::ADC && !sampler->has_channel(io.adc_channel) &&
+        !sampler->add_channel(io.adc_channel)) {
+        return -1;  // Sampler already running
+    }
+    if (io.output == ControlOutput::PWM) {
+        setup_pwm_dac(io.pwm_gpio, CONTROL_CODE_BITS);
+    }
+
+    loop_t& loop = loops[loop_count];
+    loop.io = io;
+    loop.pid = PidController();
+    loop.pid.set_rate(rate_hz);
+    loop.applied = {};
+    loop.written_valid = false;
+    parameters.allocate(PID_PARAMETER_WORDS);
+    status.allocate(CONTROL_INPUT_STRIDE);
+    return loop_count++;
+}
+
+bool ControlEngine::set_output_limits(uint8_t loop, q15_t min, q15_t max) {
+    if (running || loop >= loop_count) {
+        return false;
+    }
+    return loops[loop].pid.set_output_limits(min, max);
+}
+
+bool ControlEngine::bind_registers(ModbusSlaveUnit& unit, uint16_t holding_base, uint16_t input_base) {
+    if (loop_count == 0 ||
+        !unit.check_hregister_exist(holding_base, loop_count * CONTROL_HOLDING_STRIDE) ||
+        !unit.check_iregister_exist(input_base, loop_count * CONTROL_INPUT_STRIDE)) {
+        return false;
+    }
+    this->unit = &unit;
+    this->holding_base = holding_base;
+    this->input_base = input_base;
+    return true;
+}
+
+void ControlEngine::sync() {
+    if (unit == nullptr) {
+        return;
+    }
+
+    uint16_t* words = parameters.write_view();
+    for (uint16_t i = 0; i < loop_count * CONTROL_HOLDING_STRIDE; i++) {
+        unit->get_holding_register(holding_base + i, words[i]);
+    }
+    parameters.commit();
+
+    status.acquire();
+    const uint16_t* values = status.read_view();
+    for (uint16_t i = 0; i < loop_count * CONTROL_INPUT_STRIDE; i++) {
+        unit->set_input_register(input_base + i, values[i]);
+    }
+}
+
+bool ControlEngine::set_parameters(uint8_t loop, const pid_parameters_t& parameters) {
+    if (loop >= loop_count) {
+        return false;
+    }
+    const uint16_t* words = reinterpret_cast<const uint16_t*>(&parameters);
+    if (unit != nullptr) {
+        for (uint16_t i = 0; i < CONTROL_HOLDING_STRIDE; i++) {
+            unit->set_holding_register(holding_base + loop * CONTROL_HOLDING_STRIDE + i, words[i]);
+        }
+    }
+    memcpy(this->parameters.write_view() + loop * PID_PARAMETER_WORDS, words, sizeof(pid_parameters_t));
+    this->parameters.commit();
+    return true;
+}
+
+bool ControlEngine::get_status(uint8_t loop, control_status_t& status) {
+    if (loop >= loop_count) {
+        return false;
+    }
+    this->status.acquire();
+    const uint16_t* values = this->status.read_view() + loop * CONTROL_INPUT_STRIDE;
+    status.pv = (q15_t)values[0];
+    status.cv = (q15_t)values[1];
+    status.error = (q15_t)values[2];
+    status.flags = values[3];
+    return true;
+}
+
+bool ControlEngine::start() {
+    if (running || loop_count == 0) {
+        return false;
+    }
+
+    multicore_reset_core1();
+    core1_stopped = false;
+    multicore_launch_core1(core1_entry);
+    multicore_fifo_push_blocking((uintptr_t)this);
+    if (multicore_fifo_pop_blocking() == 0) {
+        multicore_reset_core1();
+        core1_stopped = true;
+        return false;
+    }
+    return true;
+}
+
+void ControlEngine::stop() {
+    if (core1_stopped) {
+        return;
+    }
+    running = false;
+
+    // Core 1 leaves its wait loop at the next alarm; reset it anyway if it does not
+    absolute_time_t deadline = make_timeout_time_ms(CONTROL_STOP_TIMEOUT_MS);
+    while (!core1_stopped && !time_reached(deadline)) {
+        tight_loop_contents();
+    }
+    multicore_reset_core1();
+    core1_stopped = true;
+}
+
+void ControlEngine::core1_entry() {
+    ControlEngine* engine = reinterpret_cast<ControlEngine*>((uintptr_t)multicore_fifo_pop_blocking());
+
+    // Flash writes from core 0 (flash_safe_execute) park this core instead of failing
+    multicore_lockout_victim_init();
+
+    bool started = engine->start_on_core1();
+    multicore_fifo_push_blocking(started ? 1 : 0);
+    if (!started) {
+        engine->core1_stopped = true;
+        return;
+    }
+
+    while (engine->running) {
+        __wfi();
+    }
+    alarm_pool_destroy(engine->pool);
+    engine->pool = nullptr;
+    engine->core1_stopped = true;
+}
+
+bool ControlEngine::start_on_core1() {
+    // Pool created here, so the alarm interrupt is taken on core 1
+    pool = alarm_pool_create_with_unused_hardware_alarm(1);
+    if (pool == nullptr) {
+        return false;
+    }
+    for (uint8_t i = 0; i < loop_count; i++) {
+        loops[i].written_valid = false;
+    }
+
+    due_us = time_us_64() + period_us;
+    running = true;
+    if (alarm_pool_add_alarm_at(pool, from_us_since_boot(due_us), alarm_callback, this, true) < 0) {
+        running = false;
+        alarm_pool_destroy(pool);
+        pool = nullptr;
+        return false;
+    }
+    return true;
+}
+
+int64_t ControlEngine::alarm_callback(alarm_id_t id, void* user_data) {
+    return static_cast<ControlEngine*>(user_data)->cycle();
+}
+
+q15_t ControlEngine::read_pv(loop_t& loop) {
+    if (loop.io.input == ControlInput::CALLBACK) {
+        return loop.io.read_pv();
+    }
+    int32_t raw = sampler->get_latest_raw(loop.io.adc_channel);
+    int32_t span = loop.io.adc_high - loop.io.adc_low;
+    int32_t value = ((raw - loop.io.adc_low) * (int32_t)Q15_ONE) / span;
+    return value < 0 ? 0 : q15_sat(value);
+}
+
+void ControlEngine::write_cv(loop_t& loop, q15_t cv) {
+    if (loop.io.output == ControlOutput::CALLBACK) {
+        loop.io.write_cv(cv);
+        return;
+    }
+
+    // SPI and PWM writes only when the code changes
+    uint16_t code = (uint16_t)q15_to_code(cv, CONTROL_CODE_BITS);
+    if (loop.written_valid && code == loop.written) {
+        return;
+    }
+    switch (loop.io.output) {
+        case ControlOutput::DAC_A:
+            if (dac != nullptr) {
+                dac->setCodeA(code);
+            }
+            break;
+        case ControlOutput::DAC_B:
+            if (dac != nullptr) {
+                dac->setCodeB(code);
+            }
+            break;
+        case ControlOutput::PWM:
+            set_dac_value(loop.io.pwm_gpio, code);
+            break;
+        default:
+            break;
+    }
+    loop.written = code;
+    loop.written_valid = true;
+}
+
+int64_t __not_in_flash("control_engine") ControlEngine::cycle() {
+    if (!running) {
+        return 0;
+    }
+
+    uint64_t start_us = time_us_64();
+    uint32_t jitter_us = (uint32_t)(start_us - due_us);
+
+    // Latest tunings from core 0; coefficients are recomputed only when they change
+    parameters.acquire();
+    const uint16_t* words = parameters.read_view();
+    uint16_t* values = status.write_view();
+
+    for (uint8_t i = 0; i < loop_count; i++) {
+        loop_t& loop = loops[i];
+        const uint16_t* tuning = &words[i * PID_PARAMETER_WORDS];
+        if (memcmp(&loop.applied, tuning, sizeof(pid_parameters_t)) != 0) {
+            memcpy(&loop.applied, tuning, sizeof(pid_parameters_t));
+            loop.pid.configure(loop.applied);
+        }
+
+        q15_t pv = read_pv(loop);
+        q15_t cv = loop.pid.update(pv);
+        write_cv(loop, cv);
+
+        uint16_t* out = &values[i * CONTROL_INPUT_STRIDE];
+        out[0] = (uint16_t)pv;
+        out[1] = (uint16_t)cv;
+        out[2] = (uint16_t)loop.pid.get_error();
+        out[3] = loop.pid.get_flags();
+    }
+    status.commit();
+
+    uint64_t end_us = time_us_64();
+    uint64_t next_us = due_us + period_us;
+    uint32_t missed = 0;
+    if (end_us >= next_us) {
+        missed = (uint32_t)((end_us - next_us) / period_us) + 1;
+        next_us += (uint64_t)missed * period_us;
+    }
+
+    uint32_t irq = spin_lock_blocking(stats_lock);
+    stats.cycles++;
+    stats.jitter.add(jitter_us);
+    stats.exec.add((uint32_t)(end_us - start_us));
+    if (missed > 0) {
+        stats.overruns++;
+        stats.skipped += missed;
+    }
+    spin_unlock(stats_lock, irq);
+
+    int64_t delay_us = (int64_t)(next_us - due_us);
+    due_us = next_us;
+    return -delay_us;  // Negative: counted from when this cycle was due
+}
+
+control_stats_t ControlEngine::get_stats() const {
+    uint32_t irq = spin_lock_blocking(stats_lock);
+    control_stats_t copy = stats;
+    spin_unlock(stats_lock, irq);
+    return copy;
+}
+
+void ControlEngine::reset_stats() {
+    uint32_t irq = spin_lock_blocking(stats_lock);
+    stats.cycles = 0;
+    stats.overruns = 0;
+    stats.skipped = 0;
+    stats.exec.clear();
+    stats.jitter.clear();
+    spin_unlock(stats_lock, irq);
+}
+
+void ControlEngine::dump_stats() const {
+    control_stats_t copy = get_stats();
+    printf("=== Control engine, %u loops at %lu Hz ===\n", loop_count, (unsigned long)rate_hz);
+    printf("Cycles: %lu, overruns: %lu, skipped: %lu\n",
+           (unsigned long)copy.cycles, (unsigned long)copy.overruns, (unsigned long)copy.skipped);
+    copy.exec.print("exec");
+    copy.jitter.print("jitter");
+}
@@ -0,0 +1,154 @@
+#ifndef PICO_PLC_CONTROL_ENGINE_H
+#define PICO_PLC_CONTROL_ENGINE_H
+
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include "pico/sync.h"
+#include "pico-modbus/common/md_histogram.h"
+#include "pico-modbus/common/md_image.h"
+#include "pid_controller.h"
+#include <functional>
+
+class AdcSampler;
+class DAC7562;
+class ModbusSlaveUnit;
+
+// PID loops on core 1, sampled together from that core's own hardware alarm at a
+// fixed rate: read PV (ADC or callback), PidController::update(), write CV (DAC7562,
+// PWM or callback). Core 0 and Modbus never touch the loop data directly: tunings go
+// to core 1 and PV/CV/error come back through two ModbusProcessImage buffers, which
+// sync() exchanges with the registers from the core 0 main loop. Bus traffic and
+// core 0 load therefore add no loop jitter.
+//
+// Per loop n, holding registers at holding_base + n * CONTROL_HOLDING_STRIDE
+// (pid_parameters_t order):
+//   +0 setpoint Q1.15  +1 Kp Q8.8  +2 Ki Q8.8 /s  +3 Kd Q8.8 s  +4 feed-forward Q1.15
+//   +5 rate limit Q8.8 full scale/s (0 = none)  +6 mode (0 off, 1 auto, 2 manual)
+//   +7 manual output Q1.15
+// and input registers at input_base + n * CONTROL_INPUT_STRIDE:
+//   +0 PV Q1.15  +1 CV Q1.15  +2 error Q1.15 (signed)  +3 PID_FLAG_* flags
+//
+// ADC inputs read the latest value of an AdcSampler, lock-free from core 1, so the
+// sampler can also feed a ScanEngine or IoMap. While running, core 1 owns the
+// DAC7562 and the PWM slices of the loops: do not bind them in a ScanEngine too.
+// Flash writes (persistence, logic downloads) pause core 1, and with it the loops,
+// for their duration.
+#define CONTROL_MAX_LOOPS 4
+#define CONTROL_DEFAULT_RATE_HZ 1000
+#define CONTROL_MAX_RATE_HZ 20000
+#define CONTROL_HOLDING_STRIDE PID_PARAMETER_WORDS
+#define CONTROL_INPUT_STRIDE 4
+#define CONTROL_ADC_CHANNELS 4      // ADC0-3 (GPIO 26-29)
+
+enum class ControlInput : uint8_t {
+    ADC = 0,        // 12-bit code from bind_sampler(), scaled from adc_low..adc_high to 0.0..1.0
+    CALLBACK        // read_pv
+};
+
+enum class ControlOutput : uint8_t {
+    DAC_A = 0,      // DAC7562 from bind_dac(), 12-bit code
+    DAC_B,
+    PWM,            // 12-bit PWM level on pwm_gpio
+    CALLBACK        // write_cv
+};
+
+struct control_loop_io_t {
+    ControlInput input;
+    uint8_t adc_channel;
+    uint16_t adc_low;                       // Raw code at 0 % (e.g. ADC_VAL_0V6 for 4-20 mA)
+    uint16_t adc_high;                      // Raw code at 100 %
+    std::function<q15_t()> read_pv;         // Called on core 1 in the loop interrupt
+    ControlOutput output;
+    uint pwm_gpio;
+    std::function<void(q15_t cv)> write_cv; // Called on core 1 in the loop interrupt
+};
+
+struct control_stats_t {
+    uint32_t cycles;
+    uint32_t overruns;            // Cycles still running when the next one was due
+    uint32_t skipped;             // Periods dropped after overruns
+    latency_histogram_t exec;     // All loops, read to write
+    latency_histogram_t jitter;   // Cycle start after its due time
+};
+
+struct control_status_t {
+    q15_t pv;
+    q15_t cv;
+    q15_t error;
+    uint16_t flags;
+};
+
+class ControlEngine {
+private:
+    struct loop_t {
+        control_loop_io_t io;
+        PidController pid;
+        pid_parameters_t applied;   // Tuning the controller runs with
+        uint16_t written;           // Last DAC/PWM code
+        bool written_valid;
+    };
+
+    uint32_t rate_hz;
+    uint32_t period_us;
+    loop_t loops[CONTROL_MAX_LOOPS];
+    uint8_t loop_count;
+    DAC7562* dac;
+    AdcSampler* sampler;
+
+    // Core 0 -> core 1: pid_parameters_t per loop; core 1 -> core 0: status per loop
+    ModbusProcessImage parameters;
+    ModbusProcessImage status;
+
+    // Register binding for sync()
+    ModbusSlaveUnit* unit;
+    uint16_t holding_base;
+    uint16_t input_base;
+
+    control_stats_t stats;
+    spin_lock_t* stats_lock;
+
+    alarm_pool_t* pool;
+    uint64_t due_us;
+    volatile bool running;
+    volatile bool core1_stopped;
+
+    static void core1_entry();
+    static int64_t alarm_callback(alarm_id_t id, void* user_data);
+    bool start_on_core1();
+    int64_t cycle();
+    q15_t read_pv(loop_t& loop);
+    void write_cv(loop_t& loop, q15_t cv);
+
+public:
+    explicit ControlEngine(uint32_t rate_hz = CONTROL_DEFAULT_RATE_HZ);
+    ~ControlEngine();
+
+    // Setup, while stopped
+    bool set_rate_hz(uint32_t rate_hz);
+    void bind_dac(DAC7562* dac);                            // Already begin()-ed
+    void bind_sampler(AdcSampler* sampler);                 // Before ADC loops, while it is stopped
+    int add_loop(const control_loop_io_t& io);              // Loop index, or -1
+    bool set_output_limits(uint8_t loop, q15_t min, q15_t max);
+
+    // Tunings and status in the unit's registers, laid out as above. The input block
+    // may be a snapshot region: commit_process_image() after sync() then.
+    bool bind_registers(ModbusSlaveUnit& unit, uint16_t holding_base, uint16_t input_base);
+    // Registers -> core 1 and core 1 -> registers; call from the core 0 main loop
+    void sync();
+
+    // Without registers (or to override them: bound holding registers are updated too)
+    bool set_parameters(uint8_t loop, const pid_parameters_t& parameters);
+    bool get_status(uint8_t loop, control_status_t& status);
+
+    // Launches core 1, which must be free; stop() resets it
+    bool start();
+    void stop();
+    bool is_running() const { return running; }
+    uint32_t get_rate_hz() const { return rate_hz; }
+
+    control_stats_t get_stats() const;
+    void reset_stats();
+    void dump_stats() const;
+};
+
+#endif //PICO_PLC_CONTROL_ENGINE_H
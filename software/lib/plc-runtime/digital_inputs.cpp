@@ -0,0 +1,287 @@
+#include "digital_inputs.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "pico-modbus/md_slave_unit.h"
+
+#define DI_EDGES (GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL)
+
+DigitalInputs* DigitalInputs::instance = nullptr;
+
+DigitalInputs::DigitalInputs()
+    : channels{}, channel_count(0), gpio_mask(0), state(0), rising(0), falling(0),
+      unit(nullptr), discrete_base(0), config_base(0), latch_base(0), started(false) {
+}
+
+DigitalInputs::~DigitalInputs() {
+    stop();
+}
+
+int DigitalInputs::add_channel(uint gpio, bool pull_up, uint16_t debounce_us, uint16_t mode) {
+    if (started || channel_count >= DI_MAX_CHANNELS || gpio >= 32 || (gpio_mask & (1u << gpio))) {
+        return -1;
+    }
+
+    gpio_init(gpio);
+    gpio_set_dir(gpio, GPIO_IN);
+    if (pull_up) {
+        gpio_pull_up(gpio);
+    } else {
+        gpio_disable_pulls(gpio);
+    }
+
+    channel_t& channel = channels[channel_count];
+    channel.gpio = gpio;
+    channel.debounce_us = debounce_us;
+    channel.mode = mode & DI_MODE_MASK;
+    channel.alarm = 0;
+    gpio_mask |= 1u << gpio;
+    return channel_count++;
+}
+
+bool DigitalInputs::bind(ModbusSlaveUnit& unit, uint16_t discrete_base, uint16_t config_base, uint16_t latch_base) {
+    if (started || channel_count == 0 || !unit.check_discrete_exist(discrete_base, channel_count)) {
+        return false;
+    }
+
+    bool added = unit.add_holding_register_callback(config_base, channel_count * DI_CONFIG_WORDS,
+        [this](uint16_t start, uint16_t count, uint16_t* values) {
+            return read_config(start, count, values);
+        },
+        [this](uint16_t start, uint16_t count, const uint16_t* values) {
+            return write_config(start, count, values);
+        });
+    if (!added || !unit.add_input_register_callback(latch_base, DI_LATCH_WORDS,
+            [this](uint16_t start, uint16_t count, uint16_t* values) {
+                return read_latches(start, count, values);
+            })) {
+        return false;
+    }
+
+    this->unit = &unit;
+    this->discrete_base = discrete_base;
+    this->config_base = config_base;
+    this->latch_base = latch_base;
+    return true;
+}
+
+bool DigitalInputs::start() {
+    if (started || channel_count == 0 || (instance != nullptr && instance != this)) {
+        return false;
+    }
+    instance = this;
+
+    // Current levels as the initial state, no edges latched for them
+    for (uint8_t i = 0; i < channel_count; i++) {
+        bool level = read_level(i);
+        state = level ? (state | (1u << i)) : (state & ~(1u << i));
+        publish(i, level);
+    }
+
+    gpio_add_raw_irq_handler_masked(gpio_mask, gpio_irq_handler);
+    for (uint8_t i = 0; i < channel_count; i++) {
+        gpio_acknowledge_irq(channels[i].gpio, DI_EDGES);
+        set_irq_enabled(i, true);
+    }
+    irq_set_enabled(IO_IRQ_BANK0, true);
+    started = true;
+    return true;
+}
+
+void DigitalInputs::stop() {
+    if (!started) {
+        return;
+    }
+    for (uint8_t i = 0; i < channel_count; i++) {
+        set_irq_enabled(i, false);
+        if (channels[i].alarm > 0) {
+            cancel_alarm(channels[i].alarm);
+            channels[i].alarm = 0;
+        }
+    }
+    gpio_remove_raw_irq_handler_masked(gpio_mask, gpio_irq_handler);
+    instance = nullptr;
+    started = false;
+}
+
+bool DigitalInputs::read_level(uint8_t channel) const {
+    return gpio_get(channels[channel].gpio) != ((channels[channel].mode & DI_MODE_INVERT) != 0);
+}
+
+void DigitalInputs::set_irq_enabled(uint8_t channel, bool enabled) {
+    gpio_set_irq_enabled(channels[channel].gpio, DI_EDGES, enabled);
+}
+
+void DigitalInputs::gpio_irq_handler() {
+    if (instance != nullptr) {
+        instance->handle_edges();
+    }
+}
+
+void DigitalInputs::handle_edges() {
+    for (uint8_t i = 0; i < channel_count; i++) {
+        channel_t& channel = channels[i];
+        uint32_t events = gpio_get_irq_event_mask(channel.gpio) & DI_EDGES;
+        if (events == 0) {
+            continue;
+        }
+        gpio_acknowledge_irq(channel.gpio, events);
+
+        if (channel.debounce_us > 0) {
+            // Quiet until the alarm samples the pin
+            set_irq_enabled(i, false);
+            channel.alarm = add_alarm_in_us(channel.debounce_us, debounce_callback, &channel, true);
+            if (channel.alarm <= 0) {
+                channel.alarm = 0;
+                debounce_done(i);  // No alarm free: take the level as it is
+            }
+            continue;
+        }
+
+        bool level = read_level(i);
+        bool current = (state >> i) & 1;
+        if (level != current) {
+            accept(i, level);
+        } else if (events == DI_EDGES) {
+            // Both edges since the last interrupt: a pulse too short to see the level of
+            accept(i, !level);
+            accept(i, level);
+        }
+    }
+}
+
+int64_t DigitalInputs::debounce_callback(alarm_id_t id, void* user_data) {
+    DigitalInputs* self = instance;
+    if (self != nullptr) {
+        channel_t* channel = static_cast<channel_t*>(user_data);
+        channel->alarm = 0;
+        self->debounce_done((uint8_t)(channel - self->channels));
+    }
+    return 0;
+}
+
+void DigitalInputs::debounce_done(uint8_t channel) {
+    bool level = read_level(channel);
+    if (level != (bool)((state >> channel) & 1)) {
+        accept(channel, level);
+    }
+
+    // Edges seen while paused are covered by the sample just taken
+    gpio_acknowledge_irq(channels[channel].gpio, DI_EDGES);
+    set_irq_enabled(channel, true);
+
+    // A change between the sample and re-enabling would otherwise go unnoticed
+    if (read_level(channel) != (bool)((state >> channel) & 1)) {
+        set_irq_enabled(channel, false);
+        channels[channel].alarm = add_alarm_in_us(channels[channel].debounce_us, debounce_callback,
+                                                  &channels[channel], true);
+        if (channels[channel].alarm <= 0) {
+            channels[channel].alarm = 0;
+            set_irq_enabled(channel, true);
+        }
+    }
+}
+
+void DigitalInputs::accept(uint8_t channel, bool level) {
+    uint32_t bit = 1u << channel;
+    uint16_t mode = channels[channel].mode;
+    if (level) {
+        state |= bit;
+        if (mode & DI_MODE_LATCH_RISING) {
+            rising |= bit;
+        }
+    } else {
+        state &= ~bit;
+        if (mode & DI_MODE_LATCH_FALLING) {
+            falling |= bit;
+        }
+    }
+    publish(channel, level);
+    if (on_change) {
+        on_change(channel, level);
+    }
+}
+
+void DigitalInputs::publish(uint8_t channel, bool level) {
+    if (unit != nullptr) {
+        unit->get_discrete_inputs()->set(discrete_base + channel, level);
+    }
+}
+
+bool DigitalInputs::set_debounce_us(uint8_t channel, uint16_t debounce_us) {
+    if (channel >= channel_count) {
+        return false;
+    }
+    channels[channel].debounce_us = debounce_us;  // From the next edge on
+    return true;
+}
+
+bool DigitalInputs::set_mode(uint8_t channel, uint16_t mode) {
+    if (channel >= channel_count || (mode & ~DI_MODE_MASK) != 0) {
+        return false;
+    }
+
+    uint32_t irq = save_and_disable_interrupts();
+    bool inverted = ((channels[channel].mode ^ mode) & DI_MODE_INVERT) != 0;
+    channels[channel].mode = mode;
+    if (inverted) {
+        // Same pin level, opposite meaning: restate without latching an edge
+        bool level = read_level(channel);
+        state = level ? (state | (1u << channel)) : (state & ~(1u << channel));
+        publish(channel, level);
+    }
+    restore_interrupts(irq);
+    return true;
+}
+
+uint32_t DigitalInputs::take_rising() {
+    uint32_t irq = save_and_disable_interrupts();
+    uint32_t edges = rising;
+    rising = 0;
+    restore_interrupts(irq);
+    return edges;
+}
+
+uint32_t DigitalInputs::take_falling() {
+    uint32_t irq = save_and_disable_interrupts();
+    uint32_t edges = falling;
+    falling = 0;
+    restore_interrupts(irq);
+    return edges;
+}
+
+bool DigitalInputs::read_config(uint16_t start, uint16_t count, uint16_t* values) {
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t offset = start + i - config_base;
+        const channel_t& channel = channels[offset / DI_CONFIG_WORDS];
+        values[i] = (offset % DI_CONFIG_WORDS == 0) ? channel.debounce_us : channel.mode;
+    }
+    return true;
+}
+
+bool DigitalInputs::write_config(uint16_t start, uint16_t count, const uint16_t* values) {
+    // Check the whole write first, so a bad mode word changes nothing
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t offset = start + i - config_base;
+        if (offset % DI_CONFIG_WORDS == 1 && (values[i] & ~DI_MODE_MASK) != 0) {
+            return false;
+        }
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t offset = start + i - config_base;
+        uint8_t channel = offset / DI_CONFIG_WORDS;
+        if (offset % DI_CONFIG_WORDS == 0) {
+            set_debounce_us(channel, values[i]);
+        } else {
+            set_mode(channel, values[i]);
+        }
+    }
+    return true;
+}
+
+bool DigitalInputs::read_latches(uint16_t start, uint16_t count, uint16_t* values) {
+    for (uint16_t i = 0; i < count; i++) {
+        values[i] = (start + i == latch_base) ? (uint16_t)take_rising() : (uint16_t)take_falling();
+    }
+    return true;
+}
@@ -0,0 +1,110 @@
+#ifndef PICO_PLC_DIGITAL_INPUTS_H
+#define PICO_PLC_DIGITAL_INPUTS_H
+
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include <functional>
+
+class ModbusSlaveUnit;
+
+// GPIO inputs driven by edge interrupts instead of polling. An edge pauses the pin's
+// interrupt and arms a one-shot hardware alarm for the debounce time; the level found
+// when it fires is the new state if it differs (pulses shorter than the debounce are
+// dropped). With debounce 0 an edge is taken at once, and a pulse whose both edges
+// arrive before the interrupt runs is still latched.
+//
+// Each accepted change updates the unit's discrete input straight from the interrupt
+// and sets the channel's rising/falling latch, held until read.
+//
+// Registers after bind():
+//   holding  config_base + 2n      debounce, us (0-65535)
+//            config_base + 2n + 1  DI_MODE_* flags
+//   input    latch_base            rising edge latches, bit n = channel n
+//            latch_base + 1        falling edge latches
+// Reading a latch register clears the bits it returned. The application must not
+// write discrete inputs in the 32-address words used here from another context.
+#define DI_MAX_CHANNELS 16
+#define DI_DEFAULT_DEBOUNCE_US 5000
+#define DI_CONFIG_WORDS 2           // Holding registers per channel
+#define DI_LATCH_WORDS 2
+
+// Mode flags
+#define DI_MODE_INVERT 0x0001           // Active low input
+#define DI_MODE_LATCH_RISING 0x0002     // After inversion
+#define DI_MODE_LATCH_FALLING 0x0004
+#define DI_MODE_MASK 0x0007
+#define DI_MODE_DEFAULT (DI_MODE_LATCH_RISING | DI_MODE_LATCH_FALLING)
+
+class DigitalInputs {
+public:
+    typedef std::function<void(uint8_t channel, bool state)> change_callback_t;
+
+private:
+    struct channel_t {
+        uint8_t gpio;
+        uint16_t debounce_us;
+        uint16_t mode;
+        alarm_id_t alarm;       // Debounce pending while > 0
+    };
+
+    channel_t channels[DI_MAX_CHANNELS];
+    uint8_t channel_count;
+    uint32_t gpio_mask;
+
+    // Channel bit masks, written from the interrupt
+    volatile uint32_t state;
+    volatile uint32_t rising;
+    volatile uint32_t falling;
+
+    ModbusSlaveUnit* unit;
+    uint16_t discrete_base;
+    uint16_t config_base;
+    uint16_t latch_base;
+    change_callback_t on_change;
+    bool started;
+
+    static DigitalInputs* instance;     // For the raw GPIO handler
+    static void gpio_irq_handler();
+    static int64_t debounce_callback(alarm_id_t id, void* user_data);
+
+    bool read_level(uint8_t channel) const;
+    void handle_edges();
+    void debounce_done(uint8_t channel);
+    void accept(uint8_t channel, bool level);
+    void publish(uint8_t channel, bool level);
+    void set_irq_enabled(uint8_t channel, bool enabled);
+
+    bool read_config(uint16_t start, uint16_t count, uint16_t* values);
+    bool write_config(uint16_t start, uint16_t count, const uint16_t* values);
+    bool read_latches(uint16_t start, uint16_t count, uint16_t* values);
+
+public:
+    DigitalInputs();
+    ~DigitalInputs();
+
+    // Setup, before start()
+    int add_channel(uint gpio, bool pull_up = false, uint16_t debounce_us = DI_DEFAULT_DEBOUNCE_US,
+                    uint16_t mode = DI_MODE_DEFAULT);
+    // Channel n is discrete input discrete_base + n (must exist); config and latch
+    // registers are added to the unit as callback regions
+    bool bind(ModbusSlaveUnit& unit, uint16_t discrete_base, uint16_t config_base, uint16_t latch_base);
+    // Called from the interrupt after each accepted change
+    void on_state_change(const change_callback_t& callback) { on_change = callback; }
+
+    // Takes the GPIO bank interrupt (raw handler, other pins unaffected); one instance
+    bool start();
+    void stop();
+
+    // Also what the config registers do
+    bool set_debounce_us(uint8_t channel, uint16_t debounce_us);
+    bool set_mode(uint8_t channel, uint16_t mode);
+
+    bool get(uint8_t channel) const { return (state >> channel) & 1; }
+    uint32_t get_all() const { return state; }
+    // Latched edges since the last take (or register read), cleared by the call
+    uint32_t take_rising();
+    uint32_t take_falling();
+    uint8_t get_channel_count() const { return channel_count; }
+};
+
+#endif //PICO_PLC_DIGITAL_INPUTS_H
@@ -0,0 +1,259 @@
+#include "dsp_filter.h"
+#include "plc_in_ram.h"
+#include <cstring>
+
+// Two int16 lanes per word: lane 0 in the low half
+#if defined(__ARM_FEATURE_SIMD32) && __ARM_FEATURE_SIMD32
+static inline uint32_t lane_max(uint32_t a, uint32_t b) {
+    uint32_t result;
+    // SSUB16 sets GE per lane where a >= b, SEL picks from a there
+    __asm__("ssub16 %0, %1, %2\n\tsel %0, %1, %2" : "=&r"(result) : "r"(a), "r"(b) : "cc");
+    return result;
+}
+
+static inline uint32_t lane_min(uint32_t a, uint32_t b) {
+    uint32_t result;
+    __asm__("ssub16 %0, %1, %2\n\tsel %0, %2, %1" : "=&r"(result) : "r"(a), "r"(b) : "cc");
+    return result;
+}
+
+static inline int32_t saturate16(int32_t value) {
+    int32_t result;
+    __asm__("ssat %0, #16, %1" : "=r"(result) : "r"(value));
+    return result;
+}
+#else
+static inline uint32_t lane_max(uint32_t a, uint32_t b) {
+    int16_t a0 = (int16_t)a, a1 = (int16_t)(a >> 16);
+    int16_t b0 = (int16_t)b, b1 = (int16_t)(b >> 16);
+    return (uint16_t)(a0 >= b0 ? a0 : b0) | ((uint32_t)(uint16_t)(a1 >= b1 ? a1 : b1) << 16);
+}
+
+static inline uint32_t lane_min(uint32_t a, uint32_t b) {
+    int16_t a0 = (int16_t)a, a1 = (int16_t)(a >> 16);
+    int16_t b0 = (int16_t)b, b1 = (int16_t)(b >> 16);
+    return (uint16_t)(a0 >= b0 ? b0 : a0) | ((uint32_t)(uint16_t)(a1 >= b1 ? b1 : a1) << 16);
+}
+
+static inline int32_t saturate16(int32_t value) {
+    return value > INT16_MAX ? INT16_MAX : (value < INT16_MIN ? INT16_MIN : value);
+}
+#endif
+
+static inline void lane_sort(uint32_t& a, uint32_t& b) {
+    uint32_t low = lane_min(a, b);
+    b = lane_max(a, b);
+    a = low;
+}
+
+static inline uint32_t load_pair(const int16_t* p) {
+    uint32_t pair;
+    memcpy(&pair, p, sizeof(pair));     // Unaligned LDR on the M33
+    return pair;
+}
+
+FilterChain::FilterChain() : stages{}, stage_count(0) {
+}
+
+bool FilterChain::is_valid(const filter_stage_config_t& config) {
+    switch (config.type) {
+        case FilterType::NONE:
+            return true;
+        case FilterType::MOVING_AVERAGE:
+            return config.param >= 1 && config.param <= FILTER_MAX_WINDOW;
+        case FilterType::IIR:
+            return config.param >= 1 && config.param <= INT16_MAX;
+        case FilterType::MEDIAN:
+            return config.param == 3 || config.param == 5;
+        case FilterType::DEADBAND:
+            return config.param <= INT16_MAX;
+        default:
+            return false;
+    }
+}
+
+bool FilterChain::configure(const filter_stage_config_t* configs, uint8_t count) {
+    if (count > FILTER_MAX_STAGES) {
+        return false;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        if (!is_valid(configs[i])) {
+            return false;
+        }
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        stage_t& stage = stages[i];
+        stage.type = configs[i].type;
+        stage.param = configs[i].param;
+        if (stage.type == FilterType::MOVING_AVERAGE) {
+            stage.reciprocal = ((1u << 24) + stage.param / 2) / stage.param;
+        }
+    }
+    stage_count = count;
+    reset();
+    return true;
+}
+
+filter_stage_config_t FilterChain::get_stage(uint8_t index) const {
+    if (index >= stage_count) {
+        return {FilterType::NONE, 0};
+    }
+    return {stages[index].type, stages[index].param};
+}
+
+void FilterChain::reset() {
+    for (uint8_t i = 0; i < stage_count; i++) {
+        stages[i].primed = false;
+    }
+}
+
+void PLC_IN_RAM("dsp_filter") FilterChain::run_average(stage_t& stage, int16_t* samples, uint32_t count) {
+    uint8_t window = (uint8_t)stage.param;
+    if (!stage.primed) {
+        for (uint8_t i = 0; i < window; i++) {
+            stage.history[i] = samples[0];
+        }
+        stage.sum = (int32_t)samples[0] * window;
+        stage.pos = 0;
+        stage.primed = true;
+    }
+
+    int32_t sum = stage.sum;
+    uint8_t pos = stage.pos;
+    for (uint32_t i = 0; i < count; i++) {
+        int16_t x = samples[i];
+        sum += x - stage.history[pos];
+        stage.history[pos] = x;
+        if (++pos == window) {
+            pos = 0;
+        }
+        // Divide by the window as a multiply: |sum| < 2^21, so the Q24 reciprocal is exact to 1/16 LSB
+        samples[i] = (int16_t)(((int64_t)sum * stage.reciprocal + (1 << 23)) >> 24);
+    }
+    stage.sum = sum;
+    stage.pos = pos;
+}
+
+void PLC_IN_RAM("dsp_filter") FilterChain::run_iir(stage_t& stage, int16_t* samples, uint32_t count) {
+    if (!stage.primed) {
+        stage.state = (int32_t)samples[0] * 65536;
+        stage.primed = true;
+    }
+
+    // Output kept in Q16 so small alphas still settle on the input
+    int32_t y = stage.state;
+    int32_t alpha = stage.param;
+    for (uint32_t i = 0; i < count; i++) {
+        int64_t error = (int64_t)samples[i] * 65536 - y;
+        y += (int32_t)((error * alpha + (1 << 14)) >> 15);
+        samples[i] = (int16_t)saturate16((y + 0x8000) >> 16);
+    }
+    stage.state = y;
+}
+
+void PLC_IN_RAM("dsp_filter") FilterChain::run_median(stage_t& stage, int16_t* samples, uint32_t count) {
+    uint8_t taps = (uint8_t)stage.param;
+    uint8_t kept = taps - 1;
+    if (!stage.primed) {
+        for (uint8_t i = 0; i < kept; i++) {
+            stage.history[i] = samples[0];
+        }
+        stage.primed = true;
+    }
+
+    // Previous inputs, then this block, plus a pad for the second lane of an odd end
+    int16_t window[FILTER_BLOCK + 5];
+    memcpy(window, stage.history, kept * sizeof(int16_t));
+    memcpy(window + kept, samples, count * sizeof(int16_t));
+    window[kept + count] = window[kept + count - 1];
+
+    // Outputs i and i + 1 side by side: pair j holds window[i + j] and window[i + j + 1]
+    for (uint32_t i = 0; i < count; i += 2) {
+        const int16_t* w = window + i;
+        uint32_t median;
+        if (taps == 3) {
+            uint32_t p0 = load_pair(w), p1 = load_pair(w + 1), p2 = load_pair(w + 2);
+            lane_sort(p0, p1);
+            lane_sort(p1, p2);
+            lane_sort(p0, p1);
+            median = p1;
+        } else {
+            uint32_t p0 = load_pair(w), p1 = load_pair(w + 1), p2 = load_pair(w + 2);
+            uint32_t p3 = load_pair(w + 3), p4 = load_pair(w + 4);
+            lane_sort(p0, p1);
+            lane_sort(p3, p4);
+            lane_sort(p0, p3);
+            lane_sort(p1, p4);
+            lane_sort(p1, p2);
+            lane_sort(p2, p3);
+            lane_sort(p1, p2);
+            median = p2;
+        }
+        samples[i] = (int16_t)median;
+        if (i + 1 < count) {
+            samples[i + 1] = (int16_t)(median >> 16);
+        }
+    }
+    memcpy(stage.history, window + count, kept * sizeof(int16_t));
+}
+
+void PLC_IN_RAM("dsp_filter") FilterChain::run_deadband(stage_t& stage, int16_t* samples, uint32_t count) {
+    if (!stage.primed) {
+        stage.state = samples[0];
+        stage.primed = true;
+    }
+
+    int32_t held = stage.state;
+    int32_t band = stage.param;
+    for (uint32_t i = 0; i < count; i++) {
+        int32_t x = samples[i];
+        if (x - held > band || held - x > band) {
+            held = x;
+        }
+        samples[i] = (int16_t)held;
+    }
+    stage.state = held;
+}
+
+void PLC_IN_RAM("dsp_filter") FilterChain::process(uint16_t* samples, uint32_t count) {
+    int16_t block[FILTER_BLOCK];
+    while (count > 0) {
+        uint32_t n = count < FILTER_BLOCK ? count : FILTER_BLOCK;
+
+        // Unsigned codes to int16 around mid-scale; every stage is offset invariant
+        for (uint32_t i = 0; i < n; i++) {
+            block[i] = (int16_t)(samples[i] ^ 0x8000);
+        }
+        for (uint8_t s = 0; s < stage_count; s++) {
+            stage_t& stage = stages[s];
+            switch (stage.type) {
+                case FilterType::MOVING_AVERAGE:
+                    run_average(stage, block, n);
+                    break;
+                case FilterType::IIR:
+                    run_iir(stage, block, n);
+                    break;
+                case FilterType::MEDIAN:
+                    run_median(stage, block, n);
+                    break;
+                case FilterType::DEADBAND:
+                    run_deadband(stage, block, n);
+                    break;
+                default:
+                    break;
+            }
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            samples[i] = (uint16_t)block[i] ^ 0x8000;
+        }
+
+        samples += n;
+        count -= n;
+    }
+}
+
+uint16_t FilterChain::process(uint16_t sample) {
+    process(&sample, 1);
+    return sample;
+}
@@ -0,0 +1,76 @@
+#ifndef PICO_PLC_DSP_FILTER_H
+#define PICO_PLC_DSP_FILTER_H
+
+#include <cstdint>
+
+// Filter chain for one analog channel, in integer arithmetic and free of Pico SDK
+// headers. Samples are unsigned codes of up to 16 bits (raw or oversampled ADC
+// values); internally they are offset to int16 so the median can work on two per
+// register. Blocks are filtered in place, stage after stage:
+//
+//   MOVING_AVERAGE  param = window, 1 to FILTER_MAX_WINDOW samples
+//   IIR             param = alpha, Q0.15 (1 to 32767): y += alpha * (x - y)
+//   MEDIAN          param = 3 or 5, spike rejection
+//   DEADBAND        param = band in codes: the output holds until the input moves
+//                   more than band away from it
+//
+// Only the median uses the Cortex-M33 DSP extension: two outputs per step on SSUB16/SEL
+// packed min/max. The recursive stages (average, IIR, deadband) depend on the previous
+// output and are plain C, with int64 intermediates; the IIR output is clamped with
+// SSAT. Without the DSP extension (host builds) plain C gives bit-identical results.
+//
+// A stage starts from the first sample it sees (no ramp from zero) and again after
+// reset() or a reconfiguration.
+#define FILTER_MAX_STAGES 4
+#define FILTER_MAX_WINDOW 64
+#define FILTER_BLOCK 64             // Samples per internal pass, any count can be given
+
+enum class FilterType : uint16_t {
+    NONE = 0,
+    MOVING_AVERAGE,
+    IIR,
+    MEDIAN,
+    DEADBAND
+};
+
+struct filter_stage_config_t {
+    FilterType type;
+    uint16_t param;
+};
+
+class FilterChain {
+private:
+    struct stage_t {
+        FilterType type;
+        uint16_t param;
+        bool primed;
+        uint8_t pos;                // Moving average ring position
+        int32_t sum;                // Moving average window sum
+        int32_t state;              // IIR output Q16, deadband output
+        uint32_t reciprocal;        // Moving average 2^24 / window
+        int16_t history[FILTER_MAX_WINDOW];  // Average window, last median inputs
+    };
+
+    stage_t stages[FILTER_MAX_STAGES];
+    uint8_t stage_count;
+
+    static void run_average(stage_t& stage, int16_t* samples, uint32_t count);
+    static void run_iir(stage_t& stage, int16_t* samples, uint32_t count);
+    static void run_median(stage_t& stage, int16_t* samples, uint32_t count);
+    static void run_deadband(stage_t& stage, int16_t* samples, uint32_t count);
+
+public:
+    FilterChain();
+
+    static bool is_valid(const filter_stage_config_t& config);
+
+    // Stages in order; NONE stages are skipped. False (chain unchanged) if any is invalid.
+    bool configure(const filter_stage_config_t* configs, uint8_t count);
+    filter_stage_config_t get_stage(uint8_t index) const;
+    void reset();
+
+    void process(uint16_t* samples, uint32_t count);
+    uint16_t process(uint16_t sample);
+};
+
+#endif //PICO_PLC_DSP_FILTER_H
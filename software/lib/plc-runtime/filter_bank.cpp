@@ -0,0 +1,92 @@
+#include "filter_bank.h"
+#include "adc_sampler.h"
+#include "hardware/sync.h"
+#include "pico-modbus/md_slave_unit.h"
+#include "pico-modbus/common/md_common.h"
+#include <cstring>
+
+FilterBank::FilterBank() : chains{}, configs{}, holding_base(0) {
+}
+
+bool FilterBank::configure(uint8_t channel, const filter_stage_config_t* stages, uint8_t count) {
+    if (channel >= FILTER_CHANNELS || count > FILTER_MAX_STAGES) {
+        return false;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        if (!FilterChain::is_valid(stages[i])) {
+            return false;
+        }
+    }
+
+    filter_stage_config_t padded[FILTER_MAX_STAGES] = {};
+    memcpy(padded, stages, count * sizeof(filter_stage_config_t));
+
+    uint32_t irq = save_and_disable_interrupts();
+    chains[channel].configure(padded, FILTER_MAX_STAGES);
+    memcpy(configs[channel], padded, sizeof(padded));
+    restore_interrupts(irq);
+    return true;
+}
+
+bool FilterBank::bind_registers(ModbusSlaveUnit& unit, uint16_t holding_base) {
+    this->holding_base = holding_base;
+    return unit.add_holding_register_callback(holding_base, FILTER_CHANNELS * FILTER_CONFIG_WORDS,
+        [this](uint16_t start, uint16_t count, uint16_t* values) {
+            return read_config(start, count, values);
+        },
+        [this](uint16_t start, uint16_t count, const uint16_t* values) {
+            return write_config(start, count, values);
+        });
+}
+
+void FilterBank::attach(AdcSampler& sampler) {
+    sampler.set_block_filter([this](uint8_t adc_channel, uint16_t* values, uint32_t count) {
+        chains[adc_channel].process(values, count);
+    });
+}
+
+void FilterBank::process(uint8_t channel, uint16_t* samples, uint32_t count) {
+    if (channel < FILTER_CHANNELS) {
+        chains[channel].process(samples, count);
+    }
+}
+
+bool FilterBank::read_config(uint16_t start, uint16_t count, uint16_t* values) {
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t offset = start + i - holding_base;
+        const filter_stage_config_t& stage = configs[offset / FILTER_CONFIG_WORDS][(offset % FILTER_CONFIG_WORDS) / 2];
+        values[i] = (offset % 2 == 0) ? enum_value(stage.type) : stage.param;
+    }
+    return true;
+}
+
+bool FilterBank::write_config(uint16_t start, uint16_t count, const uint16_t* values) {
+    // Apply the write to copies, check every touched channel, then swap them all in
+    filter_stage_config_t updated[FILTER_CHANNELS][FILTER_MAX_STAGES];
+    memcpy(updated, configs, sizeof(updated));
+    uint8_t touched = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t offset = start + i - holding_base;
+        uint8_t channel = offset / FILTER_CONFIG_WORDS;
+        filter_stage_config_t& stage = updated[channel][(offset % FILTER_CONFIG_WORDS) / 2];
+        if (offset % 2 == 0) {
+            stage.type = (FilterType)values[i];
+        } else {
+            stage.param = values[i];
+        }
+        touched |= 1u << channel;
+    }
+    for (uint8_t channel = 0; channel < FILTER_CHANNELS; channel++) {
+        for (uint8_t s = 0; (touched & (1u << channel)) && s < FILTER_MAX_STAGES; s++) {
+            if (!FilterChain::is_valid(updated[channel][s])) {
+                return false;
+            }
+        }
+    }
+    for (uint8_t channel = 0; channel < FILTER_CHANNELS; channel++) {
+        if (touched & (1u << channel)) {
+            configure(channel, updated[channel], FILTER_MAX_STAGES);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef PICO_PLC_FILTER_BANK_H
+#define PICO_PLC_FILTER_BANK_H
+
+#include "pico/stdlib.h"
+#include "dsp_filter.h"
+
+class AdcSampler;
+class ModbusSlaveUnit;
+
+// One FilterChain per ADC channel, configured from holding registers and run on the
+// AdcSampler's decimated blocks in its DMA interrupt (attach()), so the history,
+// latest values and everything reading them (registers, calibration, PID callbacks)
+// see filtered data.
+//
+// Holding registers after bind_registers(), per channel n at
+// holding_base + n * FILTER_CONFIG_WORDS:
+//   +2s  stage s FilterType (0 none, 1 moving average, 2 IIR, 3 median, 4 deadband)
+//   +2s+1 stage s parameter (see dsp_filter.h)
+// A write is checked against the whole resulting chain and rejected if any stage is
+// invalid; an accepted write restarts that channel's chain from the next sample.
+#define FILTER_CHANNELS 4                               // ADC0-3
+#define FILTER_CONFIG_WORDS (FILTER_MAX_STAGES * 2)     // Holding registers per channel
+
+class FilterBank {
+private:
+    FilterChain chains[FILTER_CHANNELS];
+    filter_stage_config_t configs[FILTER_CHANNELS][FILTER_MAX_STAGES];
+    uint16_t holding_base;
+
+    bool read_config(uint16_t start, uint16_t count, uint16_t* values);
+    bool write_config(uint16_t start, uint16_t count, const uint16_t* values);
+
+public:
+    FilterBank();
+
+    // Swapped in with interrupts off; call from the core running the sampler interrupt
+    bool configure(uint8_t channel, const filter_stage_config_t* stages, uint8_t count);
+    bool bind_registers(ModbusSlaveUnit& unit, uint16_t holding_base);
+    // Takes the sampler's block filter
+    void attach(AdcSampler& sampler);
+
+    // For samples from elsewhere (adc_read_raw(), a scan); not while attached
+    void process(uint8_t channel, uint16_t* samples, uint32_t count);
+};
+
+#endif //PICO_PLC_FILTER_BANK_H
@@ -0,0 +1,96 @@
+#ifndef PICO_PLC_FIXED_POINT_H
+#define PICO_PLC_FIXED_POINT_H
+
+#include <cstdint>
+
+// Fixed-point formats for scan-time math, no FPU or float conversions needed:
+//   q16_t  Q16.16  engineering values (-32768.0 to 32767.99998, step 1/65536)
+//   q15_t  Q1.15   normalized signals (-1.0 to 0.99997, step 1/32768), e.g. ADC/DAC
+// Arithmetic saturates instead of wrapping. Float conversions are for constants and
+// setup; constexpr, so Q16_FROM_FLOAT(2.5f) costs nothing at run time.
+
+typedef int32_t q16_t;
+typedef int16_t q15_t;
+
+#define Q16_ONE ((q16_t)0x10000)
+#define Q16_MAX ((q16_t)INT32_MAX)
+#define Q16_MIN ((q16_t)INT32_MIN)
+#define Q15_ONE ((q15_t)0x7FFF)     // Largest value, 1.0 itself does not fit
+#define Q15_MIN ((q15_t)INT16_MIN)
+
+#define Q16_FROM_FLOAT(x) ((q16_t)((x) * 65536.0f + ((x) >= 0 ? 0.5f : -0.5f)))
+#define Q15_FROM_FLOAT(x) ((q15_t)((x) >= 1.0f ? 0x7FFF : (x) * 32768.0f + ((x) >= 0 ? 0.5f : -0.5f)))
+
+constexpr q16_t q16_sat(int64_t value) {
+    return value > INT32_MAX ? Q16_MAX : value < INT32_MIN ? Q16_MIN : (q16_t)value;
+}
+
+constexpr q15_t q15_sat(int32_t value) {
+    return value > INT16_MAX ? Q15_ONE : value < INT16_MIN ? Q15_MIN : (q15_t)value;
+}
+
+constexpr q16_t q16_from_int(int32_t value) {
+    return q16_sat((int64_t)value * Q16_ONE);
+}
+
+// Rounded to nearest
+constexpr int32_t q16_to_int(q16_t value) {
+    return (int32_t)(((int64_t)value + 0x8000) >> 16);
+}
+
+constexpr float q16_to_float(q16_t value) {
+    return (float)value / 65536.0f;
+}
+
+constexpr float q15_to_float(q15_t value) {
+    return (float)value / 32768.0f;
+}
+
+constexpr q16_t q16_add(q16_t a, q16_t b) {
+    return q16_sat((int64_t)a + b);
+}
+
+constexpr q16_t q16_sub(q16_t a, q16_t b) {
+    return q16_sat((int64_t)a - b);
+}
+
+constexpr q16_t q16_mul(q16_t a, q16_t b) {
+    return q16_sat(((int64_t)a * b + 0x8000) >> 16);
+}
+
+// Division by zero saturates toward the sign of a
+constexpr q16_t q16_div(q16_t a, q16_t b) {
+    return b == 0 ? (a >= 0 ? Q16_MAX : Q16_MIN) : q16_sat(((int64_t)a * Q16_ONE) / b);
+}
+
+constexpr q15_t q15_add(q15_t a, q15_t b) {
+    return q15_sat((int32_t)a + b);
+}
+
+constexpr q15_t q15_sub(q15_t a, q15_t b) {
+    return q15_sat((int32_t)a - b);
+}
+
+constexpr q15_t q15_mul(q15_t a, q15_t b) {
+    return q15_sat(((int32_t)a * b + 0x4000) >> 15);
+}
+
+// Q1.15 <-> Q16.16: the same value, clipped to -1.0..0.99997 toward Q1.15
+constexpr q15_t q15_from_q16(q16_t value) {
+    return q15_sat((int32_t)(((int64_t)value + 1) >> 1));  // 64 bits: no overflow at Q16_MAX
+}
+
+constexpr q16_t q16_from_q15(q15_t value) {
+    return (q16_t)value * 2;
+}
+
+// Unsigned converter codes (ADC, DAC7562, PWM levels) <-> Q1.15 0.0..1.0
+constexpr q15_t q15_from_code(uint32_t code, uint8_t bits) {
+    return q15_sat((int32_t)((code << 15) / ((1u << bits) - 1)));
+}
+
+constexpr uint32_t q15_to_code(q15_t value, uint8_t bits) {
+    return value <= 0 ? 0 : ((uint32_t)value * ((1u << bits) - 1) + 0x4000) >> 15;
+}
+
+#endif //PICO_PLC_FIXED_POINT_H
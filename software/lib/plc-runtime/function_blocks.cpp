@@ -0,0 +1,348 @@
+#include "function_blocks.h"
+#include <cmath>
+
+// Ramp positions and rates carry this many fraction bits below Q16.16
+static constexpr int RAMP_EXTRA_BITS = 24;
+static constexpr int64_t RAMP_SCALE = (int64_t)1 << RAMP_EXTRA_BITS;
+
+// Valid instance bits of word "w" in a bank of "count"
+static inline uint32_t word_mask(uint16_t count, uint16_t w) {
+    uint16_t left = count - w * 32;
+    return left >= 32 ? 0xFFFFFFFFu : (1u << left) - 1;
+}
+
+static inline void put_bit(uint32_t* words, uint16_t index, bool value) {
+    if (value) {
+        words[index / 32] |= 1u << (index % 32);
+    } else {
+        words[index / 32] &= ~(1u << (index % 32));
+    }
+}
+
+// elapsed + dt, stopped at preset
+static inline uint32_t advance(uint32_t elapsed, uint32_t dt, uint32_t preset) {
+    return dt >= preset - elapsed ? preset : elapsed + dt;
+}
+
+static uint32_t preset_to_us(uint32_t preset_ms) {
+    return (preset_ms > FB_MAX_PRESET_MS ? FB_MAX_PRESET_MS : preset_ms) * 1000;
+}
+
+// TimerBank
+
+TimerBank::TimerBank(TimerMode mode)
+    : mode(mode), count(0), preset_us{}, elapsed_us{}, in{}, last_in{}, q{} {
+}
+
+int TimerBank::add(uint32_t preset_ms) {
+    if (count >= FB_MAX_TIMERS) {
+        return -1;
+    }
+    uint16_t index = count++;
+    preset_us[index] = preset_to_us(preset_ms);
+    // An off-delay timer starts expired, not as if in had just gone off
+    elapsed_us[index] = mode == TimerMode::OFF_DELAY ? preset_us[index] : 0;
+    return index;
+}
+
+bool TimerBank::set_preset_ms(uint16_t index, uint32_t preset_ms) {
+    if (index >= count) {
+        return false;
+    }
+    preset_us[index] = preset_to_us(preset_ms);
+    if (elapsed_us[index] > preset_us[index]) {
+        elapsed_us[index] = preset_us[index];
+    }
+    return true;
+}
+
+void TimerBank::set_input(uint16_t index, bool value) {
+    if (index < count) {
+        put_bit(in, index, value);
+    }
+}
+
+void TimerBank::update(uint32_t dt_us) {
+    if (dt_us > FB_MAX_DT_US) {
+        dt_us = FB_MAX_DT_US;
+    }
+
+    for (uint16_t w = 0; w < FB_WORDS(count); w++) {
+        uint32_t mask = word_mask(count, w);
+        uint32_t on = in[w] & mask;
+        uint32_t was_on = last_in[w];
+        uint32_t outputs = q[w];
+        last_in[w] = on;
+
+        // Whole word idle: nothing to time, nothing to reset
+        if ((on | was_on | (mode == TimerMode::ON_DELAY ? 0 : outputs)) == 0) {
+            q[w] = 0;
+            continue;
+        }
+
+        uint32_t* elapsed = &elapsed_us[w * 32];
+        const uint32_t* preset = &preset_us[w * 32];
+        uint32_t result = 0;
+        uint8_t bits = w * 32 + 32 <= count ? 32 : count - w * 32;
+        switch (mode) {
+            case TimerMode::ON_DELAY: {
+                // Times from the first scan that saw in on
+                uint32_t timing = on & was_on;
+                for (uint8_t b = 0; b < bits; b++) {
+                    uint32_t e = ((timing >> b) & 1) ? advance(elapsed[b], dt_us, preset[b]) : 0;
+                    elapsed[b] = e;
+                    // A zero preset passes in through in the same scan, like IEC TON with PT = 0
+                    bool done = preset[b] == 0 || (((timing >> b) & 1) && e >= preset[b]);
+                    result |= (uint32_t)done << b;
+                }
+                result &= on;
+                break;
+            }
+
+            case TimerMode::OFF_DELAY:
+                for (uint8_t b = 0; b < bits; b++) {
+                    uint32_t bit = 1u << b;
+                    if (on & bit) {
+                        elapsed[b] = 0;
+                    } else if (!(was_on & bit)) {
+                        elapsed[b] = advance(elapsed[b], dt_us, preset[b]);
+                    }
+                    if ((on & bit) || elapsed[b] < preset[b]) {
+                        result |= bit;
+                    }
+                }
+                break;
+
+            case TimerMode::PULSE:
+                for (uint8_t b = 0; b < bits; b++) {
+                    uint32_t bit = 1u << b;
+                    if (outputs & bit) {
+                        elapsed[b] = advance(elapsed[b], dt_us, preset[b]);
+                        if (elapsed[b] < preset[b]) {
+                            result |= bit;
+                        } else if (!(on & bit)) {
+                            elapsed[b] = 0;
+                        }
+                    } else if ((on & ~was_on & bit) && preset[b] > 0) {
+                        elapsed[b] = 0;
+                        result |= bit;
+                    } else if (!(on & bit)) {
+                        elapsed[b] = 0;
+                    }
+                }
+                break;
+        }
+        q[w] = result;
+    }
+}
+
+// CounterBank
+
+CounterBank::CounterBank()
+    : count(0), value{}, preset{}, cu{}, last_cu{}, reset{}, q{} {
+}
+
+int CounterBank::add(uint32_t preset) {
+    if (count >= FB_MAX_COUNTERS) {
+        return -1;
+    }
+    uint16_t index = count++;
+    this->preset[index] = preset;
+    value[index] = 0;
+    put_bit(q, index, preset == 0);
+    return index;
+}
+
+bool CounterBank::set_preset(uint16_t index, uint32_t preset) {
+    if (index >= count) {
+        return false;
+    }
+    this->preset[index] = preset;
+    put_bit(q, index, value[index] >= preset);
+    return true;
+}
+
+void CounterBank::set_input(uint16_t index, bool value) {
+    if (index < count) {
+        put_bit(cu, index, value);
+    }
+}
+
+void CounterBank::set_reset(uint16_t index, bool value) {
+    if (index < count) {
+        put_bit(reset, index, value);
+    }
+}
+
+void CounterBank::update() {
+    for (uint16_t w = 0; w < FB_WORDS(count); w++) {
+        uint32_t mask = word_mask(count, w);
+        uint32_t rising = cu[w] & ~last_cu[w] & mask;
+        uint32_t resets = reset[w] & mask;
+        last_cu[w] = cu[w];
+
+        // Only instances with an edge or a reset change; q of the others is current
+        uint32_t changed = rising | resets;
+        uint32_t result = q[w];
+        while (changed != 0) {
+            uint32_t b = __builtin_ctz(changed);
+            uint32_t bit = 1u << b;
+            changed &= ~bit;
+
+            uint16_t i = w * 32 + b;
+            if (resets & bit) {
+                value[i] = 0;
+            } else if (value[i] != UINT32_MAX) {
+                value[i]++;
+            }
+            result = value[i] >= preset[i] ? result | bit : result & ~bit;
+        }
+        q[w] = result;
+    }
+}
+
+// LatchBank
+
+LatchBank::LatchBank()
+    : count(0), set_dominant{}, s{}, r{}, q{} {
+}
+
+int LatchBank::add(LatchMode mode) {
+    if (count >= FB_MAX_LATCHES) {
+        return -1;
+    }
+    uint16_t index = count++;
+    put_bit(set_dominant, index, mode == LatchMode::SR);
+    return index;
+}
+
+void LatchBank::set_inputs(uint16_t index, bool set, bool reset) {
+    if (index < count) {
+        put_bit(s, index, set);
+        put_bit(r, index, reset);
+    }
+}
+
+void LatchBank::update() {
+    // 32 latches per step: RS q = !r & (s | q), SR q = s | (!r & q)
+    for (uint16_t w = 0; w < FB_WORDS(count); w++) {
+        uint32_t sd = set_dominant[w];
+        uint32_t held = ~r[w] & q[w];
+        q[w] = ((sd & (s[w] | held)) | (~sd & ~r[w] & (s[w] | q[w]))) & word_mask(count, w);
+    }
+}
+
+// ScaleBank
+
+ScaleBank::ScaleBank()
+    : count(0), in{}, out{}, in_low{}, out_low{}, out_min{}, out_max{}, gain{}, gain_shift{} {
+}
+
+int ScaleBank::add(q16_t in_low, q16_t in_high, q16_t out_low, q16_t out_high) {
+    if (count >= FB_MAX_SCALES || in_low == in_high) {
+        return -1;
+    }
+    uint16_t index = count++;
+    set_range(index, in_low, in_high, out_low, out_high);
+    in[index] = in_low;
+    out[index] = out_low;
+    return index;
+}
+
+bool ScaleBank::set_range(uint16_t index, q16_t in_low, q16_t in_high, q16_t out_low, q16_t out_high) {
+    if (index >= count || in_low == in_high) {
+        return false;
+    }
+
+    // Gain as mantissa * 2^-shift with the mantissa below 2^30, so (in - in_low) * gain
+    // fits 64 bits for any input. Setup only, so double is fine here.
+    double ratio = (double)((int64_t)out_high - out_low) / (double)((int64_t)in_high - in_low);
+    int exponent = 0;
+    double mantissa = std::frexp(ratio, &exponent);
+    int shift = 30 - exponent;
+    if (shift < 0) {
+        // Gain above 2^30, an input range of a few LSBs: capped
+        shift = 0;
+        mantissa = ratio >= 0 ? (double)(1 << 30) : -(double)(1 << 30);
+    } else if (shift > 62) {
+        shift = 0;
+        mantissa = 0;
+    } else {
+        mantissa = std::ldexp(mantissa, 30);
+    }
+
+    this->in_low[index] = in_low;
+    this->out_low[index] = out_low;
+    out_min[index] = out_low < out_high ? out_low : out_high;
+    out_max[index] = out_low < out_high ? out_high : out_low;
+    gain[index] = (int32_t)std::llround(mantissa);
+    gain_shift[index] = (uint8_t)shift;
+    return true;
+}
+
+void ScaleBank::update() {
+    for (uint16_t i = 0; i < count; i++) {
+        int64_t offset = (int64_t)in[i] - in_low[i];
+        uint8_t shift = gain_shift[i];
+        int64_t round = shift > 0 ? (int64_t)1 << (shift - 1) : 0;
+        int64_t value = out_low[i] + ((offset * gain[i] + round) >> shift);
+        out[i] = value < out_min[i] ? out_min[i] : value > out_max[i] ? out_max[i] : (q16_t)value;
+    }
+}
+
+// RampBank
+
+RampBank::RampBank()
+    : count(0), target{}, out{}, position{}, rate_up{}, rate_down{} {
+}
+
+int RampBank::add(q16_t rate_up, q16_t rate_down, q16_t initial) {
+    if (count >= FB_MAX_RAMPS || rate_up <= 0 || rate_down <= 0) {
+        return -1;
+    }
+    uint16_t index = count++;
+    set_rates(index, rate_up, rate_down);
+    jump_to(index, initial);
+    return index;
+}
+
+bool RampBank::set_rates(uint16_t index, q16_t rate_up, q16_t rate_down) {
+    if (index >= count || rate_up <= 0 || rate_down <= 0) {
+        return false;
+    }
+    // Per second -> per microsecond, rounded; the extra fraction bits keep it exact enough
+    this->rate_up[index] = ((int64_t)rate_up * RAMP_SCALE + 500000) / 1000000;
+    this->rate_down[index] = ((int64_t)rate_down * RAMP_SCALE + 500000) / 1000000;
+    return true;
+}
+
+void RampBank::jump_to(uint16_t index, q16_t value) {
+    if (index < count) {
+        target[index] = value;
+        out[index] = value;
+        position[index] = (int64_t)value * RAMP_SCALE;
+    }
+}
+
+void RampBank::update(uint32_t dt_us) {
+    if (dt_us > FB_MAX_DT_US) {
+        dt_us = FB_MAX_DT_US;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        int64_t goal = (int64_t)target[i] * RAMP_SCALE;
+        int64_t p = position[i];
+        if (p < goal) {
+            p += rate_up[i] * dt_us;
+            if (p > goal) {
+                p = goal;
+            }
+        } else if (p > goal) {
+            p -= rate_down[i] * dt_us;
+            if (p < goal) {
+                p = goal;
+            }
+        }
+        position[i] = p;
+        out[i] = (q16_t)(p >> RAMP_EXTRA_BITS);
+    }
+}
@@ -0,0 +1,179 @@
+#ifndef PICO_PLC_FUNCTION_BLOCKS_H
+#define PICO_PLC_FUNCTION_BLOCKS_H
+
+#include "fixed_point.h"
+
+// IEC 61131-style function blocks for scan programs, in banks of instances stored as
+// structure-of-arrays: one update() per bank and scan sweeps all instances over
+// packed arrays, 32 boolean inputs/outputs per word. Timing comes from the scan's
+// dt_us, so nothing reads the clock. Free of Pico SDK headers (host benchmark in
+// tools/fb-bench).
+//
+//   TimerBank    TON / TOF / TP, preset in ms
+//   CounterBank  CTU with reset, count saturates
+//   LatchBank    RS (reset dominant) / SR (set dominant)
+//   ScaleBank    linear SCALE with clamping, Q16.16
+//   RampBank     RAMP toward a target at separate up/down rates, Q16.16 per second
+//
+// Typical use from ScanEngine::set_program():
+//   TimerBank delays(TimerMode::ON_DELAY);
+//   int pump_delay = delays.add(500);
+//   ...
+//   delays.set_input(pump_delay, image.gpio_in & (1u << 2));
+//   delays.update(image.dt_us);
+//   if (delays.get_output(pump_delay)) { image.gpio_out |= 1u << 6; }
+#define FB_MAX_TIMERS 256           // Per bank
+#define FB_MAX_COUNTERS 256
+#define FB_MAX_LATCHES 256
+#define FB_MAX_SCALES 64
+#define FB_MAX_RAMPS 64
+#define FB_MAX_DT_US 1000000        // Longer scan gaps count as this
+#define FB_MAX_PRESET_MS 4294967    // About 71 minutes
+
+#define FB_WORDS(count) (((count) + 31) / 32)
+
+enum class TimerMode : uint8_t {
+    ON_DELAY = 0,   // TON: q after in has been on for the preset
+    OFF_DELAY,      // TOF: q on with in, off the preset after in goes off
+    PULSE           // TP:  q for the preset from a rising edge of in, not retriggered
+};
+
+enum class LatchMode : uint8_t {
+    RS = 0,         // Reset dominant
+    SR              // Set dominant
+};
+
+class TimerBank {
+private:
+    TimerMode mode;
+    uint16_t count;
+    uint32_t preset_us[FB_MAX_TIMERS];
+    uint32_t elapsed_us[FB_MAX_TIMERS];
+    uint32_t in[FB_WORDS(FB_MAX_TIMERS)];
+    uint32_t last_in[FB_WORDS(FB_MAX_TIMERS)];
+    uint32_t q[FB_WORDS(FB_MAX_TIMERS)];
+
+public:
+    explicit TimerBank(TimerMode mode);
+
+    int add(uint32_t preset_ms);                    // Instance index, or -1 if full
+    bool set_preset_ms(uint16_t index, uint32_t preset_ms);
+    void update(uint32_t dt_us);
+
+    void set_input(uint16_t index, bool value);
+    bool get_output(uint16_t index) const { return (q[index / 32] >> (index % 32)) & 1; }
+    uint32_t get_elapsed_ms(uint16_t index) const { return elapsed_us[index] / 1000; }
+    uint16_t size() const { return count; }
+
+    // Bit words for bulk access, instance i in bit i % 32 of word i / 32
+    uint32_t* get_inputs() { return in; }
+    const uint32_t* get_outputs() const { return q; }
+};
+
+class CounterBank {
+private:
+    uint16_t count;
+    uint32_t value[FB_MAX_COUNTERS];
+    uint32_t preset[FB_MAX_COUNTERS];
+    uint32_t cu[FB_WORDS(FB_MAX_COUNTERS)];
+    uint32_t last_cu[FB_WORDS(FB_MAX_COUNTERS)];
+    uint32_t reset[FB_WORDS(FB_MAX_COUNTERS)];
+    uint32_t q[FB_WORDS(FB_MAX_COUNTERS)];
+
+public:
+    CounterBank();
+
+    int add(uint32_t preset);                       // Instance index, or -1 if full
+    bool set_preset(uint16_t index, uint32_t preset);
+    void update();
+
+    void set_input(uint16_t index, bool value);     // Counts rising edges
+    void set_reset(uint16_t index, bool value);     // Holds the count at 0
+    bool get_output(uint16_t index) const { return (q[index / 32] >> (index % 32)) & 1; }
+    uint32_t get_count(uint16_t index) const { return value[index]; }
+    uint16_t size() const { return count; }
+
+    uint32_t* get_inputs() { return cu; }
+    uint32_t* get_resets() { return reset; }
+    const uint32_t* get_outputs() const { return q; }
+};
+
+class LatchBank {
+private:
+    uint16_t count;
+    uint32_t set_dominant[FB_WORDS(FB_MAX_LATCHES)];
+    uint32_t s[FB_WORDS(FB_MAX_LATCHES)];
+    uint32_t r[FB_WORDS(FB_MAX_LATCHES)];
+    uint32_t q[FB_WORDS(FB_MAX_LATCHES)];
+
+public:
+    LatchBank();
+
+    int add(LatchMode mode = LatchMode::RS);        // Instance index, or -1 if full
+    void update();
+
+    void set_inputs(uint16_t index, bool set, bool reset);
+    bool get_output(uint16_t index) const { return (q[index / 32] >> (index % 32)) & 1; }
+    uint16_t size() const { return count; }
+
+    uint32_t* get_sets() { return s; }
+    uint32_t* get_resets() { return r; }
+    const uint32_t* get_outputs() const { return q; }
+};
+
+class ScaleBank {
+private:
+    uint16_t count;
+    q16_t in[FB_MAX_SCALES];
+    q16_t out[FB_MAX_SCALES];
+    q16_t in_low[FB_MAX_SCALES];
+    q16_t out_low[FB_MAX_SCALES];
+    q16_t out_min[FB_MAX_SCALES];
+    q16_t out_max[FB_MAX_SCALES];
+    int32_t gain[FB_MAX_SCALES];        // Mantissa, 31 significant bits...
+    uint8_t gain_shift[FB_MAX_SCALES];  // ...times 2^-gain_shift
+
+public:
+    ScaleBank();
+
+    // in_low..in_high maps to out_low..out_high, clamped to that output range
+    int add(q16_t in_low, q16_t in_high, q16_t out_low, q16_t out_high);
+    bool set_range(uint16_t index, q16_t in_low, q16_t in_high, q16_t out_low, q16_t out_high);
+    void update();
+
+    void set_input(uint16_t index, q16_t value) { in[index] = value; }
+    q16_t get_output(uint16_t index) const { return out[index]; }
+    uint16_t size() const { return count; }
+
+    q16_t* get_inputs() { return in; }
+    const q16_t* get_outputs() const { return out; }
+};
+
+class RampBank {
+private:
+    uint16_t count;
+    q16_t target[FB_MAX_RAMPS];
+    q16_t out[FB_MAX_RAMPS];
+    int64_t position[FB_MAX_RAMPS];     // Output with 24 more fraction bits, no drift
+    int64_t rate_up[FB_MAX_RAMPS];      // Per us, same scale as position
+    int64_t rate_down[FB_MAX_RAMPS];
+
+public:
+    RampBank();
+
+    // Rates in units per second, > 0; starts at "initial" with the target there too
+    int add(q16_t rate_up, q16_t rate_down, q16_t initial = 0);
+    bool set_rates(uint16_t index, q16_t rate_up, q16_t rate_down);
+    void update(uint32_t dt_us);
+
+    void set_target(uint16_t index, q16_t value) { target[index] = value; }
+    void jump_to(uint16_t index, q16_t value);      // Output and target, no ramp
+    q16_t get_output(uint16_t index) const { return out[index]; }
+    bool at_target(uint16_t index) const { return out[index] == target[index]; }
+    uint16_t size() const { return count; }
+
+    q16_t* get_targets() { return target; }
+    const q16_t* get_outputs() const { return out; }
+};
+
+#endif //PICO_PLC_FUNCTION_BLOCKS_H
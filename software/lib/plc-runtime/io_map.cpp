@@ -0,0 +1,161 @@
+#include "io_map.h"
+#include "adc_sampler.h"
+#include "dac7562-driver/dac7562.h"
+#include "pico-modbus/md_slave_unit.h"
+#include "pico-utils/custom_dac.h"
+
+IoMap::IoMap()
+    : inputs{}, input_count(0), sampler(nullptr),
+      outputs{}, output_count(0), dac(nullptr), started(false) {
+}
+
+IoMap::~IoMap() {
+    stop();
+}
+
+void IoMap::bind_dac(DAC7562* dac) {
+    this->dac = dac;
+}
+
+bool IoMap::bind_sampler(AdcSampler* sampler) {
+    if (started || this->sampler != nullptr || sampler == nullptr) {
+        return false;
+    }
+    // Listens for good: stopping the map only stops the stores
+    if (!sampler->add_block_listener([this]() { store_inputs(); })) {
+        return false;
+    }
+    this->sampler = sampler;
+    return true;
+}
+
+int IoMap::add_input(ModbusSlaveUnit& unit, const analog_input_map_t& map) {
+    if (started || sampler == nullptr || input_count >= IO_MAP_ADC_CHANNELS ||
+        map.adc_channel >= IO_MAP_ADC_CHANNELS) {
+        return -1;
+    }
+    if (map.scale == AnalogScale::SCALED && map.raw_high <= map.raw_low) {
+        return -1;
+    }
+    for (uint8_t i = 0; i < input_count; i++) {
+        if (inputs[i].map.adc_channel == map.adc_channel) {
+            return -1;
+        }
+    }
+    // Fails for callback regions, which the interrupt could not write
+    if (!unit.set_input_register(map.input_register, 0)) {
+        return -1;
+    }
+    if (!sampler->has_channel(map.adc_channel) && !sampler->add_channel(map.adc_channel)) {
+        return -1;  // Sampler already running
+    }
+
+    input_t& input = inputs[input_count];
+    input.map = map;
+    input.unit = &unit;
+    input.raw = 0;
+    return input_count++;
+}
+
+int IoMap::add_output(ModbusSlaveUnit& unit, const analog_output_map_t& map) {
+    if (output_count >= IO_MAP_MAX_OUTPUTS) {
+        return -1;
+    }
+    if (map.output == AnalogOutput::PWM && (map.pwm_bits == 0 || map.pwm_bits > 16)) {
+        return -1;
+    }
+    if (map.output != AnalogOutput::PWM && dac == nullptr) {
+        return -1;
+    }
+
+    uint8_t index = output_count;
+    output_t& output = outputs[index];
+    output.map = map;
+    output.code = 0;
+    if (map.initial > max_code(output)) {
+        return -1;
+    }
+
+    bool added = unit.add_holding_register_callback(map.holding_register, 1,
+        [this, index](uint16_t start, uint16_t count, uint16_t* values) {
+            values[0] = outputs[index].code;
+            return true;
+        },
+        [this, index](uint16_t start, uint16_t count, const uint16_t* values) {
+            return write_output(index, values[0]);
+        });
+    if (!added) {
+        return -1;
+    }
+
+    if (map.output == AnalogOutput::PWM) {
+        setup_pwm_dac(map.pwm_gpio, map.pwm_bits);
+    }
+    output_count++;
+    write_output(index, map.initial);
+    return index;
+}
+
+uint16_t IoMap::max_code(const output_t& output) const {
+    uint8_t bits = output.map.output == AnalogOutput::PWM ? output.map.pwm_bits : IO_MAP_DAC_BITS;
+    return (uint16_t)((1u << bits) - 1);
+}
+
+bool IoMap::write_output(uint8_t index, uint16_t code) {
+    if (index >= output_count || code > max_code(outputs[index])) {
+        return false;
+    }
+
+    output_t& output = outputs[index];
+    switch (output.map.output) {
+        case AnalogOutput::DAC_A:
+            dac->setCodeA(code);
+            break;
+        case AnalogOutput::DAC_B:
+            dac->setCodeB(code);
+            break;
+        case AnalogOutput::PWM:
+            set_dac_value(output.map.pwm_gpio, code);
+            break;
+    }
+    output.code = code;
+    return true;
+}
+
+bool IoMap::start() {
+    if (started || input_count == 0) {
+        return false;
+    }
+    started = true;
+    return true;
+}
+
+void IoMap::stop() {
+    started = false;
+}
+
+void IoMap::store_inputs() {
+    if (!started) {
+        return;
+    }
+    for (uint8_t i = 0; i < input_count; i++) {
+        store(inputs[i], sampler->get_latest_raw(inputs[i].map.adc_channel));
+    }
+}
+
+void IoMap::store(input_t& input, uint16_t raw) {
+    input.raw = raw;
+
+    uint16_t value = raw;
+    if (input.map.scale == AnalogScale::SCALED) {
+        const analog_input_map_t& map = input.map;
+        if (raw <= map.raw_low) {
+            value = 0;
+        } else if (raw >= map.raw_high) {
+            value = map.scaled_max;
+        } else {
+            value = (uint16_t)(((uint32_t)(raw - map.raw_low) * map.scaled_max) / (map.raw_high - map.raw_low));
+        }
+    }
+    input.unit->set_input_register(input.map.input_register, value);
+}
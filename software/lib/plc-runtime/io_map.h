@@ -0,0 +1,107 @@
+#ifndef PICO_PLC_IO_MAP_H
+#define PICO_PLC_IO_MAP_H
+
+#include "pico/stdlib.h"
+
+class AdcSampler;
+class DAC7562;
+class ModbusSlaveUnit;
+
+// Declarative binding of analog I/O to Modbus registers, with no application code
+// in the main loop:
+//   - Inputs come from an AdcSampler: after each of its blocks, the latest value of
+//     every input channel is stored in its input register from the DMA interrupt,
+//     raw (12-bit) or scaled. The sampler sets the rate and oversampling.
+//   - Each output is a one-register callback region: a master write goes straight
+//     to the DAC7562 (SPI) or the PWM slice from the write hook, before the
+//     response is sent. Reads return the code last written.
+#define IO_MAP_ADC_CHANNELS 4               // ADC0-3 (GPIO 26-29)
+#define IO_MAP_MAX_OUTPUTS 8
+#define IO_MAP_DAC_BITS 12
+
+enum class AnalogScale : uint8_t {
+    RAW = 0,        // 12-bit code (oversampled values shifted back to 12 bits)
+    SCALED          // raw_low..raw_high -> 0..scaled_max, clamped
+};
+
+enum class AnalogOutput : uint8_t {
+    DAC_A = 0,      // DAC7562 from bind_dac(), 12-bit code
+    DAC_B,
+    PWM             // Level on pwm_gpio, pwm_bits resolution
+};
+
+struct analog_input_map_t {
+    uint8_t adc_channel;
+    uint16_t input_register;
+    AnalogScale scale;
+    uint16_t raw_low;           // Raw code at 0 (e.g. ADC_VAL_0V6 for 4-20 mA)
+    uint16_t raw_high;          // Raw code at scaled_max
+    uint16_t scaled_max;        // E.g. 10000 for 0.01 % steps
+};
+
+struct analog_output_map_t {
+    uint16_t holding_register;
+    AnalogOutput output;
+    uint pwm_gpio;
+    uint8_t pwm_bits;
+    uint16_t initial;           // Code written at add time
+};
+
+class IoMap {
+private:
+    struct input_t {
+        analog_input_map_t map;
+        ModbusSlaveUnit* unit;
+        volatile uint16_t raw;
+    };
+
+    struct output_t {
+        analog_output_map_t map;
+        uint16_t code;
+    };
+
+    input_t inputs[IO_MAP_ADC_CHANNELS];
+    uint8_t input_count;
+    AdcSampler* sampler;
+
+    output_t outputs[IO_MAP_MAX_OUTPUTS];
+    uint8_t output_count;
+    DAC7562* dac;
+
+    bool started;
+
+    void store_inputs();
+    void store(input_t& input, uint16_t raw);
+
+    bool write_output(uint8_t index, uint16_t code);
+    uint16_t max_code(const output_t& output) const;
+
+public:
+    IoMap();
+    ~IoMap();
+
+    // Setup, before start(); registers are added to the unit right away
+    void bind_dac(DAC7562* dac);                            // Already begin()-ed
+    // Source of the inputs, while it is stopped; adds a block listener, so the map
+    // must outlive the sampler's runs
+    bool bind_sampler(AdcSampler* sampler);
+    // Adds the channel to the sampler unless it has it. Input register must be
+    // writable by the application (RAM region). Index, or -1.
+    int add_input(ModbusSlaveUnit& unit, const analog_input_map_t& map);
+    // Adds the holding register as a callback region. Index, or -1.
+    int add_output(ModbusSlaveUnit& unit, const analog_output_map_t& map);
+
+    // Starts storing inputs; the sampler is started by its owner (outputs work from
+    // add_output() on)
+    bool start();
+    void stop();
+    bool is_running() const { return started; }
+
+    // Also what a register write does; false if the code is out of range
+    bool set_output(uint8_t index, uint16_t code) { return write_output(index, code); }
+    uint16_t get_output(uint8_t index) const { return index < output_count ? outputs[index].code : 0; }
+    // Latest 12-bit value of an input, as last stored
+    uint16_t get_raw(uint8_t index) const { return index < input_count ? inputs[index].raw : 0; }
+};
+
+#endif //PICO_PLC_IO_MAP_H
@@ -0,0 +1,361 @@
+#include "logic_asm.h"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+enum class OperandKind : uint8_t {
+    NONE,
+    LOAD,           // Bit, word or immediate
+    LOAD_NOT,       // Bit
+    LOAD_SIGNED,    // Word
+    STORE,          // Bit or word
+    STORE_NOT,      // Bit
+    SET,            // Bit
+    RESET,          // Bit
+    INDEX,          // Timer or edge number in A
+    LABEL           // Jump target in B
+};
+
+struct mnemonic_t {
+    const char* name;
+    LogicOp op;
+    OperandKind kind;
+};
+
+static const mnemonic_t mnemonics[] = {
+    {"LD", LogicOp::LDB, OperandKind::LOAD},
+    {"LDN", LogicOp::LDNB, OperandKind::LOAD_NOT},
+    {"LDS", LogicOp::LDWS, OperandKind::LOAD_SIGNED},
+    {"ST", LogicOp::STB, OperandKind::STORE},
+    {"STN", LogicOp::STNB, OperandKind::STORE_NOT},
+    {"S", LogicOp::SETB, OperandKind::SET},
+    {"R", LogicOp::RSTB, OperandKind::RESET},
+    {"NOP", LogicOp::NOP, OperandKind::NONE},
+    {"END", LogicOp::END, OperandKind::NONE},
+    {"AND", LogicOp::AND, OperandKind::NONE},
+    {"OR", LogicOp::OR, OperandKind::NONE},
+    {"XOR", LogicOp::XOR, OperandKind::NONE},
+    {"NOT", LogicOp::NOT, OperandKind::NONE},
+    {"ADD", LogicOp::ADD, OperandKind::NONE},
+    {"SUB", LogicOp::SUB, OperandKind::NONE},
+    {"MUL", LogicOp::MUL, OperandKind::NONE},
+    {"DIV", LogicOp::DIV, OperandKind::NONE},
+    {"MOD", LogicOp::MOD, OperandKind::NONE},
+    {"NEG", LogicOp::NEG, OperandKind::NONE},
+    {"ABS", LogicOp::ABS, OperandKind::NONE},
+    {"MIN", LogicOp::MIN, OperandKind::NONE},
+    {"MAX", LogicOp::MAX, OperandKind::NONE},
+    {"EQ", LogicOp::EQ, OperandKind::NONE},
+    {"NE", LogicOp::NE, OperandKind::NONE},
+    {"LT", LogicOp::LT, OperandKind::NONE},
+    {"LE", LogicOp::LE, OperandKind::NONE},
+    {"GT", LogicOp::GT, OperandKind::NONE},
+    {"GE", LogicOp::GE, OperandKind::NONE},
+    {"SEL", LogicOp::SEL, OperandKind::NONE},
+    {"DUP", LogicOp::DUP, OperandKind::NONE},
+    {"DROP", LogicOp::DROP, OperandKind::NONE},
+    {"SWAP", LogicOp::SWAP, OperandKind::NONE},
+    {"R_TRIG", LogicOp::RTRIG, OperandKind::INDEX},
+    {"F_TRIG", LogicOp::FTRIG, OperandKind::INDEX},
+    {"TON", LogicOp::TON, OperandKind::INDEX},
+    {"TOF", LogicOp::TOF, OperandKind::INDEX},
+    {"TP", LogicOp::TP, OperandKind::INDEX},
+    {"ET", LogicOp::LDET, OperandKind::INDEX},
+    {"JMP", LogicOp::JMP, OperandKind::LABEL},
+    {"JMPC", LogicOp::JMPC, OperandKind::LABEL},
+    {"JMPCN", LogicOp::JMPCN, OperandKind::LABEL},
+};
+
+// Area prefixes, longest first
+struct area_prefix_t {
+    const char* prefix;
+    LogicArea area;
+    bool bit;
+};
+
+static const area_prefix_t area_prefixes[] = {
+    {"%HR", LogicArea::HOLDING, false},
+    {"%IR", LogicArea::INPUT, false},
+    {"%MW", LogicArea::WORD, false},
+    {"%Q", LogicArea::COIL, true},
+    {"%I", LogicArea::DISCRETE, true},
+    {"%M", LogicArea::MARKER, true},
+};
+
+struct operand_t {
+    bool is_address;
+    bool bit;
+    LogicArea area;
+    long value;         // Address or immediate
+};
+
+struct label_t {
+    char name[LOGIC_ASM_MAX_LABEL_LENGTH + 1];
+    uint16_t index;
+};
+
+struct assembler_t {
+    label_t labels[LOGIC_ASM_MAX_LABELS];
+    uint16_t label_count;
+    uint16_t count;
+    bool final_pass;
+    const char* error;
+};
+
+static bool parse_number(const char* text, long& value) {
+    if (*text == '\0') {
+        return false;
+    }
+    char* end;
+    value = strtol(text, &end, 0);
+    return *end == '\0';
+}
+
+static bool equals_upper(const char* text, const char* upper) {
+    while (*text != '\0' && *upper != '\0') {
+        if (toupper((unsigned char)*text) != *upper) {
+            return false;
+        }
+        text++;
+        upper++;
+    }
+    return *text == *upper;
+}
+
+static bool parse_operand(const char* text, operand_t& operand) {
+    for (const area_prefix_t& prefix : area_prefixes) {
+        size_t length = strlen(prefix.prefix);
+        bool match = true;
+        for (size_t i = 0; i < length; i++) {
+            if (toupper((unsigned char)text[i]) != prefix.prefix[i]) {
+                match = false;
+                break;
+            }
+        }
+        if (!match) {
+            continue;
+        }
+        operand.is_address = true;
+        operand.bit = prefix.bit;
+        operand.area = prefix.area;
+        return parse_number(text + length, operand.value) && operand.value >= 0 && operand.value <= 0xFFFF;
+    }
+    operand.is_address = false;
+    return parse_number(text, operand.value) && operand.value >= -32768 && operand.value <= 0xFFFF;
+}
+
+static const label_t* find_label(const assembler_t& as, const char* name) {
+    for (uint16_t i = 0; i < as.label_count; i++) {
+        if (strcmp(as.labels[i].name, name) == 0) {
+            return &as.labels[i];
+        }
+    }
+    return nullptr;
+}
+
+static bool add_label(assembler_t& as, const char* name) {
+    if (as.final_pass) {
+        return true;  // Collected by the first pass
+    }
+    if (*name == '\0' || strlen(name) > LOGIC_ASM_MAX_LABEL_LENGTH) {
+        as.error = "bad label name";
+        return false;
+    }
+    if (find_label(as, name) != nullptr) {
+        as.error = "duplicate label";
+        return false;
+    }
+    if (as.label_count >= LOGIC_ASM_MAX_LABELS) {
+        as.error = "too many labels";
+        return false;
+    }
+    label_t& label = as.labels[as.label_count++];
+    strcpy(label.name, name);
+    label.index = as.count;
+    return true;
+}
+
+static bool encode(assembler_t& as, const mnemonic_t& mnemonic, const char* text, uint32_t& word) {
+    LogicOp op = mnemonic.op;
+    uint8_t a = 0;
+    uint16_t b = 0;
+
+    if (mnemonic.kind == OperandKind::NONE) {
+        if (text != nullptr) {
+            as.error = "unexpected operand";
+            return false;
+        }
+        word = logic_encode(op);
+        return true;
+    }
+    if (text == nullptr) {
+        as.error = "missing operand";
+        return false;
+    }
+
+    if (mnemonic.kind == OperandKind::LABEL) {
+        const label_t* label = find_label(as, text);
+        if (label == nullptr && as.final_pass) {
+            as.error = "unknown label";
+            return false;
+        }
+        word = logic_encode(op, 0, label != nullptr ? label->index : 0);
+        return true;
+    }
+
+    operand_t operand = {};
+    if (!parse_operand(text, operand)) {
+        as.error = "bad operand";
+        return false;
+    }
+
+    switch (mnemonic.kind) {
+        case OperandKind::LOAD:
+            if (!operand.is_address) {
+                op = operand.value <= 0x7FFF ? LogicOp::LDI : LogicOp::LDU;
+                word = logic_encode(op, 0, (uint16_t)operand.value);
+                return true;
+            }
+            op = operand.bit ? LogicOp::LDB : LogicOp::LDW;
+            break;
+        case OperandKind::STORE:
+            if (!operand.is_address) {
+                as.error = "store needs an address";
+                return false;
+            }
+            op = operand.bit ? LogicOp::STB : LogicOp::STW;
+            break;
+        case OperandKind::LOAD_SIGNED:
+            if (!operand.is_address || operand.bit) {
+                as.error = "word address expected";
+                return false;
+            }
+            break;
+        case OperandKind::LOAD_NOT:
+        case OperandKind::STORE_NOT:
+        case OperandKind::SET:
+        case OperandKind::RESET:
+            if (!operand.is_address || !operand.bit) {
+                as.error = "bit address expected";
+                return false;
+            }
+            break;
+        case OperandKind::INDEX:
+            if (operand.is_address || operand.value < 0 || operand.value > 0xFF) {
+                as.error = "number 0-255 expected";
+                return false;
+            }
+            word = logic_encode(op, (uint8_t)operand.value);
+            return true;
+        default:
+            break;
+    }
+
+    a = static_cast<uint8_t>(operand.area);
+    b = (uint16_t)operand.value;
+    word = logic_encode(op, a, b);
+    return true;
+}
+
+// One source line, modified in place
+static bool assemble_line(assembler_t& as, char* line, uint32_t* code, uint16_t max_count) {
+    char* comment = strchr(line, ';');
+    if (comment != nullptr) {
+        *comment = '\0';
+    }
+
+    char* tokens[4];
+    uint8_t token_count = 0;
+    for (char* token = strtok(line, " \t\r"); token != nullptr; token = strtok(nullptr, " \t\r")) {
+        if (token_count == 4) {
+            as.error = "unexpected text";
+            return false;
+        }
+        tokens[token_count++] = token;
+    }
+
+    uint8_t next = 0;
+    if (token_count > 0) {
+        size_t length = strlen(tokens[0]);
+        if (tokens[0][length - 1] == ':') {
+            tokens[0][length - 1] = '\0';
+            if (!add_label(as, tokens[0])) {
+                return false;
+            }
+            next = 1;
+        }
+    }
+    if (next == token_count) {
+        return true;  // Blank, comment or label only
+    }
+    if (token_count - next > 2) {
+        as.error = "unexpected text";
+        return false;
+    }
+
+    const mnemonic_t* mnemonic = nullptr;
+    for (const mnemonic_t& m : mnemonics) {
+        if (equals_upper(tokens[next], m.name)) {
+            mnemonic = &m;
+            break;
+        }
+    }
+    if (mnemonic == nullptr) {
+        as.error = "unknown instruction";
+        return false;
+    }
+    if (as.count >= max_count) {
+        as.error = "program too long";
+        return false;
+    }
+
+    uint32_t word;
+    if (!encode(as, *mnemonic, token_count - next == 2 ? tokens[next + 1] : nullptr, word)) {
+        return false;
+    }
+    if (as.final_pass) {
+        code[as.count] = word;
+    }
+    as.count++;
+    return true;
+}
+
+bool logic_assemble(const char* source, uint32_t* code, uint16_t max_count, logic_asm_result_t& result) {
+    static assembler_t as;  // Label table kept off the stack
+    as.label_count = 0;
+    result = {};
+
+    // First pass collects labels, the second one encodes
+    for (int pass = 0; pass < 2; pass++) {
+        as.final_pass = pass == 1;
+        as.count = 0;
+        as.error = nullptr;
+
+        const char* p = source;
+        uint32_t line_number = 0;
+        while (*p != '\0') {
+            const char* end = strchr(p, '\n');
+            size_t length = end != nullptr ? (size_t)(end - p) : strlen(p);
+            line_number++;
+
+            char line[LOGIC_ASM_MAX_LINE_LENGTH + 1];
+            if (length > LOGIC_ASM_MAX_LINE_LENGTH) {
+                as.error = "line too long";
+            } else {
+                memcpy(line, p, length);
+                line[length] = '\0';
+                assemble_line(as, line, code, max_count);
+            }
+            if (as.error != nullptr) {
+                result.error_line = line_number;
+                result.error = as.error;
+                result.count = as.count;
+                return false;
+            }
+            p = end != nullptr ? end + 1 : p + length;
+        }
+    }
+
+    result.count = as.count;
+    return true;
+}
@@ -0,0 +1,34 @@
+#ifndef PICO_PLC_LOGIC_ASM_H
+#define PICO_PLC_LOGIC_ASM_H
+
+#include "logic_vm.h"
+
+// Text assembler for LogicVm programs, IL style: one instruction per line,
+// optional "label:" in front, ";" starts a comment. Mnemonics are case-insensitive.
+//
+//   LD / LDN / LDS  x     push operand (LDN: negated bit, LDS: signed word)
+//   ST / STN x            pop into operand (STN: negated bit)
+//   S / R x               pop, set / reset the bit if the value is non-zero
+//   AND OR XOR NOT ADD SUB MUL DIV MOD NEG ABS MIN MAX
+//   EQ NE LT LE GT GE SEL DUP DROP SWAP NOP END
+//   R_TRIG n / F_TRIG n   edge memory n
+//   TON n / TOF n / TP n  timer n, [in pt_ms] -> [q]; ET n pushes its elapsed ms
+//   JMP / JMPC / JMPCN label   forward only
+//
+// Operands: bits %Q (coil), %I (discrete input), %M (marker); words %HR, %IR, %MW;
+// immediates -32768..65535, decimal or 0x hex. Example: "LD %I0", "ST %HR12", "LD 500".
+
+#define LOGIC_ASM_MAX_LABELS 128
+#define LOGIC_ASM_MAX_LABEL_LENGTH 31
+#define LOGIC_ASM_MAX_LINE_LENGTH 127
+
+struct logic_asm_result_t {
+    uint16_t count;         // Instructions assembled
+    uint32_t error_line;    // 1-based, 0 = no error
+    const char* error;      // nullptr = no error
+};
+
+// Assemble "source" into at most "max_count" words; false with the line and message on error
+bool logic_assemble(const char* source, uint32_t* code, uint16_t max_count, logic_asm_result_t& result);
+
+#endif //PICO_PLC_LOGIC_ASM_H
@@ -0,0 +1,212 @@
+#include "logic_store.h"
+#include "pico-modbus/md_slave.h"
+#include "pico-modbus/common/md_common.h"
+#include "pico-utils/flash_utils.h"
+#include <cstring>
+
+static uint16_t get_u16(const uint8_t* p) {
+    return (p[0] << 8) | p[1];
+}
+
+static void put_u16(uint8_t* p, uint16_t value) {
+    p[0] = value >> 8;
+    p[1] = value & 0xFF;
+}
+
+LogicProgramStore::LogicProgramStore(LogicVm& vm)
+    : vm(vm), flash_offset(0), enabled(false), staging{}, staging_count(0),
+      state(LogicStoreState::EMPTY), error(LogicVmError::NONE), error_index(0), active_crc(0), pending_crc(0) {
+}
+
+bool LogicProgramStore::init(uint32_t offset) {
+    if (offset % FLASH_SECTOR_SIZE != 0 ||
+        offset + LOGIC_STORE_SECTORS * FLASH_SECTOR_SIZE > PICO_FLASH_SIZE_BYTES) {
+        return false;
+    }
+    flash_offset = offset;
+    enabled = true;
+    return true;
+}
+
+const uint8_t* LogicProgramStore::slot_data() const {
+    return reinterpret_cast<const uint8_t*>(XIP_BASE + flash_offset);
+}
+
+uint16_t LogicProgramStore::program_crc(const uint32_t* code, uint16_t count) {
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < count; i++) {
+        crc = crc_update(crc, code[i] >> 24);
+        crc = crc_update(crc, (code[i] >> 16) & 0xFF);
+        crc = crc_update(crc, (code[i] >> 8) & 0xFF);
+        crc = crc_update(crc, code[i] & 0xFF);
+    }
+    return crc;
+}
+
+LogicVmError LogicProgramStore::load() {
+    slot_header_t header;
+    if (enabled) {
+        memcpy(&header, slot_data(), sizeof(header));
+    }
+    const uint32_t* code = reinterpret_cast<const uint32_t*>(slot_data() + sizeof(slot_header_t));
+    if (!enabled || header.magic != MAGIC || header.count == 0 || header.count > LOGIC_VM_MAX_INSTRUCTIONS ||
+        program_crc(code, header.count) != header.crc) {
+        state = LogicStoreState::EMPTY;
+        return LogicVmError::EMPTY;
+    }
+
+    error = vm.load(code, header.count, &error_index);
+    if (error != LogicVmError::NONE) {
+        state = LogicStoreState::FAILED;
+        return error;
+    }
+    state = LogicStoreState::ACTIVE;
+    active_crc = header.crc;
+    return LogicVmError::NONE;
+}
+
+bool LogicProgramStore::write_slot(uint16_t crc) {
+    for (uint8_t sector = 0; sector < LOGIC_STORE_SECTORS; sector++) {
+        if (!flash_safe_erase_sector(flash_offset + sector * FLASH_SECTOR_SIZE, LOGIC_STORE_FLASH_TIMEOUT_MS)) {
+            return false;
+        }
+    }
+
+    // Header and code as one byte stream; the page with the header goes last, so an
+    // interrupted write leaves an empty slot rather than a partial program
+    slot_header_t header = { MAGIC, staging_count, crc };
+    const uint8_t* code = reinterpret_cast<const uint8_t*>(staging);
+    uint32_t total = sizeof(header) + staging_count * sizeof(uint32_t);
+    uint32_t pages = (total + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE;
+
+    uint8_t page[FLASH_PAGE_SIZE];
+    for (uint32_t i = 1; i <= pages; i++) {
+        uint32_t index = i % pages;
+        uint32_t start = index * FLASH_PAGE_SIZE;
+        uint32_t end = (start + FLASH_PAGE_SIZE < total) ? start + FLASH_PAGE_SIZE : total;
+
+        memset(page, 0xFF, sizeof(page));
+        if (start == 0) {
+            memcpy(page, &header, sizeof(header));
+            memcpy(page + sizeof(header), code, end - sizeof(header));
+        } else {
+            memcpy(page, code + start - sizeof(header), end - start);
+        }
+
+        if (!flash_safe_program_page(flash_offset + start, page, LOGIC_STORE_FLASH_TIMEOUT_MS)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LogicProgramStore::attach(ModbusSlave& slave, uint8_t function_code) {
+    return slave.register_function(function_code,
+        [this](ModbusSlaveUnit& unit, const uint8_t* request, uint8_t length, uint8_t* response,
+               uint8_t capacity) {
+            return this->handle_request(request, length, response, capacity);
+        });
+}
+
+int LogicProgramStore::handle_request(const uint8_t* request, uint8_t length, uint8_t* response,
+                                      uint8_t capacity) {
+    const int illegal_value = -enum_value(ModbusExceptionCode::ILLEGAL_DATA_VALUE);
+    if (!enabled || capacity < MAX_RESPONSE) {
+        return -enum_value(ModbusExceptionCode::SLAVE_DEVICE_FAILURE);
+    }
+    if (length < 1) {
+        return illegal_value;
+    }
+
+    uint8_t function = request[0];
+    if (state == LogicStoreState::WRITING && function != STATUS) {
+        return -enum_value(ModbusExceptionCode::SLAVE_DEVICE_BUSY);
+    }
+
+    switch (function) {
+        case BEGIN: {
+            if (length != 3) {
+                return illegal_value;
+            }
+            uint16_t count = get_u16(&request[1]);
+            if (count == 0 || count > LOGIC_VM_MAX_INSTRUCTIONS) {
+                return illegal_value;
+            }
+            staging_count = count;
+            state = LogicStoreState::RECEIVING;
+            error = LogicVmError::NONE;
+            error_index = 0;
+            memcpy(response, request, 3);
+            return 3;
+        }
+
+        case WRITE: {
+            if (length < 4 || state != LogicStoreState::RECEIVING) {
+                return illegal_value;
+            }
+            uint16_t offset = get_u16(&request[1]);
+            uint8_t count = request[3];
+            if (count == 0 || count > LOGIC_STORE_WRITE_MAX_WORDS || length != 4 + count * 4 ||
+                offset + count > staging_count) {
+                return illegal_value;
+            }
+            const uint8_t* p = &request[4];
+            for (uint8_t i = 0; i < count; i++, p += 4) {
+                staging[offset + i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+            }
+            memcpy(response, request, 4);
+            return 4;
+        }
+
+        case COMMIT: {
+            if (length != 3 || state != LogicStoreState::RECEIVING) {
+                return illegal_value;
+            }
+            uint16_t crc = get_u16(&request[1]);
+            if (program_crc(staging, staging_count) != crc) {
+                return illegal_value;  // Lost or corrupted WRITE, the host resends
+            }
+            uint16_t cost = 0;
+            error = vm.verify(staging, staging_count, &error_index, &cost);
+            if (error == LogicVmError::NONE) {
+                state = LogicStoreState::WRITING;  // staging is kept until service() has written it
+                pending_crc = crc;
+            } else {
+                state = LogicStoreState::FAILED;
+            }
+            response[0] = COMMIT;
+            response[1] = enum_value(error);
+            put_u16(&response[2], error_index);
+            put_u16(&response[4], cost);
+            return 6;
+        }
+
+        case STATUS:
+            if (length != 1) {
+                return illegal_value;
+            }
+            response[0] = STATUS;
+            response[1] = enum_value(state);
+            response[2] = enum_value(error);
+            put_u16(&response[3], error_index);
+            put_u16(&response[5], vm.get_instruction_count());
+            put_u16(&response[7], vm.get_program_cost());
+            put_u16(&response[9], active_crc);
+            return 11;
+
+        default:
+            return illegal_value;
+    }
+}
+
+void LogicProgramStore::service() {
+    if (state != LogicStoreState::WRITING) {
+        return;
+    }
+    if (!write_slot(pending_crc)) {
+        // Flash write failed: error stays NONE, the previous program keeps running
+        state = LogicStoreState::FAILED;
+        return;
+    }
+    load();
+}
@@ -0,0 +1,95 @@
+#ifndef PICO_PLC_LOGIC_STORE_H
+#define PICO_PLC_LOGIC_STORE_H
+
+#include "pico/stdlib.h"
+#include "pico-utils/flash_layout.h"
+#include "logic_vm.h"
+
+class ModbusSlave;
+
+// Flash slot for the LogicVm program, filled over Modbus with a user function code.
+// Request payloads after the function code (big-endian fields):
+//
+//   0x01 BEGIN   count                     start a download of "count" instructions
+//   0x02 WRITE   offset, n, n x u32         instructions offset..offset+n-1 (n <= 60)
+//   0x03 COMMIT  crc                       CRC-16 (Modbus) of all words, big-endian bytes
+//   0x04 STATUS
+//
+// BEGIN and WRITE echo their header. COMMIT verifies the download and answers with
+// error, error index and worst-case cost (LogicVmError::NONE = accepted); the flash
+// write and the switch to the new program follow in service(). STATUS answers
+// state, error, error index, instruction count, cost and CRC of the active program.
+//
+// The slot is written with the other core locked out and this core's interrupts off;
+// each sector erase stalls scans for tens of ms, so keep the scan watchdog above that.
+#define LOGIC_STORE_FUNCTION_CODE 0x41          // First user-defined code (65)
+#define LOGIC_STORE_SECTORS FLASH_LOGIC_SECTORS     // At FLASH_LOGIC_OFFSET
+#define LOGIC_STORE_WRITE_MAX_WORDS 60
+#define LOGIC_STORE_FLASH_TIMEOUT_MS 100
+
+enum class LogicStoreState : uint8_t {
+    EMPTY = 0,      // No program in flash
+    ACTIVE,         // Program from flash loaded
+    RECEIVING,      // Download in progress, the active program keeps running
+    WRITING,        // Committed, waiting for service()
+    FAILED          // Last commit or flash write failed, see the error
+};
+
+class LogicProgramStore {
+private:
+    struct slot_header_t {
+        uint32_t magic;
+        uint16_t count;
+        uint16_t crc;
+    };
+
+    static constexpr uint32_t MAGIC = 0x4D56474C;  // "LGVM"
+    static constexpr uint8_t BEGIN = 0x01;
+    static constexpr uint8_t WRITE = 0x02;
+    static constexpr uint8_t COMMIT = 0x03;
+    static constexpr uint8_t STATUS = 0x04;
+    static constexpr uint8_t MAX_RESPONSE = 11;     // STATUS reply
+
+    LogicVm& vm;
+    uint32_t flash_offset;
+    bool enabled;
+
+    // Download buffer
+    uint32_t staging[LOGIC_VM_MAX_INSTRUCTIONS];
+    uint16_t staging_count;
+
+    LogicStoreState state;
+    LogicVmError error;
+    uint16_t error_index;
+    uint16_t active_crc;
+    uint16_t pending_crc;    // Committed download, not yet in flash
+
+    const uint8_t* slot_data() const;
+    bool write_slot(uint16_t crc);
+
+public:
+    explicit LogicProgramStore(LogicVm& vm);
+
+    // Use LOGIC_STORE_SECTORS sectors at "offset" (sector aligned, outside the program image)
+    bool init(uint32_t offset);
+
+    // Load the program in flash into the VM (at boot, after LogicVm::set_image())
+    LogicVmError load();
+
+    // Serve downloads on "function_code" of all units of the slave
+    bool attach(ModbusSlave& slave, uint8_t function_code = LOGIC_STORE_FUNCTION_CODE);
+    // "capacity": room in "response"; replies are at most MAX_RESPONSE bytes
+    int handle_request(const uint8_t* request, uint8_t length, uint8_t* response, uint8_t capacity);
+
+    // Flash write and program switch after a commit; call from the main loop
+    void service();
+
+    LogicStoreState get_state() const { return state; }
+    LogicVmError get_error() const { return error; }
+    uint16_t get_error_index() const { return error_index; }
+
+    // CRC-16 of a program as COMMIT expects it
+    static uint16_t program_crc(const uint32_t* code, uint16_t count);
+};
+
+#endif //PICO_PLC_LOGIC_STORE_H
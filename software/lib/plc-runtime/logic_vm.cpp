@@ -0,0 +1,565 @@
+#include "logic_vm.h"
+#include "plc_in_ram.h"
+#include <cstring>
+
+static constexpr uint8_t OP_COUNT = static_cast<uint8_t>(LogicOp::COUNT);
+
+struct op_info_t {
+    uint8_t pops;
+    uint8_t pushes;
+    uint8_t cost;
+};
+
+// Stack effect and cost, indexed by LogicOp
+static constexpr op_info_t op_info[] = {
+    {0, 0, 1},                                          // END
+    {0, 0, 1},                                          // NOP
+    {0, 1, 1}, {0, 1, 1},                               // LDB LDNB
+    {1, 0, 1}, {1, 0, 1}, {1, 0, 1}, {1, 0, 1},         // STB STNB SETB RSTB
+    {0, 1, 1}, {0, 1, 1}, {1, 0, 1},                    // LDW LDWS STW
+    {0, 1, 1}, {0, 1, 1},                               // LDI LDU
+    {2, 1, 1}, {2, 1, 1}, {2, 1, 1}, {1, 1, 1},         // AND OR XOR NOT
+    {2, 1, 1}, {2, 1, 1}, {2, 1, 1}, {2, 1, 2},         // ADD SUB MUL DIV
+    {2, 1, 2}, {1, 1, 1}, {1, 1, 1}, {2, 1, 1},         // MOD NEG ABS MIN
+    {2, 1, 1},                                          // MAX
+    {2, 1, 1}, {2, 1, 1}, {2, 1, 1}, {2, 1, 1},         // EQ NE LT LE
+    {2, 1, 1}, {2, 1, 1},                               // GT GE
+    {3, 1, 1},                                          // SEL
+    {1, 2, 1}, {1, 0, 1}, {2, 2, 1},                    // DUP DROP SWAP
+    {1, 1, 1}, {1, 1, 1},                               // RTRIG FTRIG
+    {2, 1, 3}, {2, 1, 3}, {2, 1, 3}, {0, 1, 1},         // TON TOF TP LDET
+    {0, 0, 1}, {1, 0, 1}, {1, 0, 1},                    // JMP JMPC JMPCN
+};
+static_assert(sizeof(op_info) / sizeof(op_info[0]) == OP_COUNT, "op_info out of step with LogicOp");
+
+LogicVm::LogicVm()
+    : image{}, budget(LOGIC_VM_DEFAULT_BUDGET), cell_count(0), program_cost(0),
+      ready(false), in_run(false), stats{} {
+    reset_memory();
+}
+
+static bool is_bit_op(LogicOp op) {
+    return op >= LogicOp::LDB && op <= LogicOp::RSTB;
+}
+
+static bool is_word_op(LogicOp op) {
+    return op >= LogicOp::LDW && op <= LogicOp::STW;
+}
+
+static bool is_store(LogicOp op) {
+    return (op >= LogicOp::STB && op <= LogicOp::RSTB) || op == LogicOp::STW;
+}
+
+static bool is_jump(LogicOp op) {
+    return op >= LogicOp::JMP && op <= LogicOp::JMPCN;
+}
+
+bool LogicVm::operand_valid(LogicOp op, uint8_t a, uint16_t b) const {
+    LogicArea area = static_cast<LogicArea>(a);
+    if (is_bit_op(op) || is_word_op(op)) {
+        // Inputs are read-only for the program
+        if (is_store(op) && (area == LogicArea::DISCRETE || area == LogicArea::INPUT)) {
+            return false;
+        }
+    }
+    if (is_bit_op(op)) {
+        switch (area) {
+            case LogicArea::COIL:     return b < image.coil_count;
+            case LogicArea::DISCRETE: return b < image.discrete_input_count;
+            case LogicArea::MARKER:   return b < LOGIC_VM_MARKERS;
+            default:                  return false;
+        }
+    }
+    if (is_word_op(op)) {
+        switch (area) {
+            case LogicArea::HOLDING:  return b < image.holding_register_count;
+            case LogicArea::INPUT:    return b < image.input_register_count;
+            case LogicArea::WORD:     return b < LOGIC_VM_WORDS;
+            default:                  return false;
+        }
+    }
+    if (op == LogicOp::RTRIG || op == LogicOp::FTRIG) {
+        return a < LOGIC_VM_EDGES;
+    }
+    if (op >= LogicOp::TON && op <= LogicOp::LDET) {
+        return a < LOGIC_VM_TIMERS;
+    }
+    return true;
+}
+
+LogicVmError LogicVm::verify(const uint32_t* code, uint16_t count, uint16_t* error_index, uint16_t* cost) {
+    auto fail = [error_index](LogicVmError error, uint16_t index) {
+        if (error_index != nullptr) {
+            *error_index = index;
+        }
+        return error;
+    };
+
+    if (count == 0) {
+        return fail(LogicVmError::EMPTY, 0);
+    }
+    if (count > LOGIC_VM_MAX_INSTRUCTIONS) {
+        return fail(LogicVmError::TOO_LONG, LOGIC_VM_MAX_INSTRUCTIONS);
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        flow[i] = { -1, 0 };
+    }
+    flow[0] = { 0, 0 };
+
+    // Jumps only go forward, so every path into an instruction is known when it is reached
+    uint16_t worst = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        uint8_t opcode = code[i] >> 24;
+        uint8_t a = (code[i] >> 16) & 0xFF;
+        uint16_t b = code[i] & 0xFFFF;
+        if (opcode >= OP_COUNT) {
+            return fail(LogicVmError::BAD_OPCODE, i);
+        }
+        LogicOp op = static_cast<LogicOp>(opcode);
+        if (!operand_valid(op, a, b)) {
+            return fail(LogicVmError::BAD_OPERAND, i);
+        }
+        if (is_jump(op) && (b <= i || b >= count)) {
+            return fail(LogicVmError::BAD_JUMP, i);
+        }
+        if (flow[i].depth < 0) {
+            continue;  // Unreachable: checked, never run
+        }
+
+        const op_info_t& info = op_info[opcode];
+        if (flow[i].depth < info.pops) {
+            return fail(LogicVmError::STACK_UNDERFLOW, i);
+        }
+        int8_t depth = flow[i].depth - info.pops + info.pushes;
+        if (depth > LOGIC_VM_STACK_DEPTH) {
+            return fail(LogicVmError::STACK_OVERFLOW, i);
+        }
+        uint32_t reach = flow[i].cost + info.cost;
+        uint16_t next_cost = reach > 0xFFFF ? 0xFFFF : reach;
+
+        if (op == LogicOp::END) {
+            if (next_cost > worst) {
+                worst = next_cost;
+            }
+            continue;
+        }
+
+        uint16_t successors[2];
+        uint8_t successor_count = 0;
+        if (is_jump(op)) {
+            successors[successor_count++] = b;
+        }
+        if (op != LogicOp::JMP) {
+            if (i + 1 >= count) {
+                return fail(LogicVmError::NO_END, i);
+            }
+            successors[successor_count++] = i + 1;
+        }
+        for (uint8_t s = 0; s < successor_count; s++) {
+            flow_t& next = flow[successors[s]];
+            if (next.depth < 0) {
+                next = { depth, next_cost };
+            } else if (next.depth != depth) {
+                return fail(LogicVmError::STACK_MISMATCH, i);
+            } else if (next_cost > next.cost) {
+                next.cost = next_cost;
+            }
+        }
+    }
+
+    if (cost != nullptr) {
+        *cost = worst;
+    }
+    if (worst > budget) {
+        return fail(LogicVmError::OVER_BUDGET, 0);
+    }
+    return LogicVmError::NONE;
+}
+
+bool LogicVm::resolve_bit(uint8_t area, uint16_t address, cell_t& cell) {
+    uint32_t* base;
+    switch (static_cast<LogicArea>(area)) {
+        case LogicArea::COIL:     base = image.coils; break;
+        case LogicArea::DISCRETE: base = image.discrete_inputs; break;
+        case LogicArea::MARKER:   base = markers; break;
+        default:                  return false;
+    }
+    cell.bits = base + (address >> 5);
+    cell.mask = 1u << (address & 31);
+    return true;
+}
+
+void LogicVm::translate(const uint32_t* code, uint16_t count) {
+    const void* const* handlers;
+    execute(nullptr, 0, &handlers);
+
+    for (uint16_t i = 0; i < count; i++) {
+        uint8_t opcode = code[i] >> 24;
+        uint8_t a = (code[i] >> 16) & 0xFF;
+        uint16_t b = code[i] & 0xFFFF;
+        LogicOp op = static_cast<LogicOp>(opcode);
+        cell_t& cell = cells[i];
+
+        cell.handler = handlers[opcode];
+        cell.value = 0;
+        cell.mask = 0;
+        if (is_bit_op(op)) {
+            resolve_bit(a, b, cell);
+        } else if (is_word_op(op)) {
+            switch (static_cast<LogicArea>(a)) {
+                case LogicArea::HOLDING: cell.word = image.holding_registers + b; break;
+                case LogicArea::INPUT:   cell.word = image.input_registers + b; break;
+                default:                 cell.word = words + b; break;
+            }
+        } else if (op == LogicOp::LDI) {
+            cell.value = (int16_t)b;
+        } else if (op == LogicOp::LDU) {
+            cell.value = b;
+        } else if (op == LogicOp::RTRIG || op == LogicOp::FTRIG) {
+            cell.bits = edges + (a >> 5);
+            cell.mask = 1u << (a & 31);
+        } else if (op >= LogicOp::TON && op <= LogicOp::LDET) {
+            cell.timer = &timers[a];
+        } else if (is_jump(op)) {
+            cell.target = &cells[b];
+            cell.mask = b - i - 1;
+        }
+    }
+}
+
+void LogicVm::reset_memory() {
+    memset(markers, 0, sizeof(markers));
+    memset(words, 0, sizeof(words));
+    memset(edges, 0, sizeof(edges));
+    memset(timers, 0, sizeof(timers));
+}
+
+LogicVmError LogicVm::load(const uint32_t* code, uint16_t count, uint16_t* error_index) {
+    uint16_t cost = 0;
+    LogicVmError error = verify(code, count, error_index, &cost);
+    if (error != LogicVmError::NONE) {
+        return error;
+    }
+
+    // A run already going on the other core finishes first; new ones are skipped
+    ready = false;
+    while (in_run) {
+    }
+    translate(code, count);
+    reset_memory();
+    cell_count = count;
+    program_cost = cost;
+    ready = true;
+    return LogicVmError::NONE;
+}
+
+void LogicVm::unload() {
+    ready = false;
+    while (in_run) {
+    }
+    cell_count = 0;
+    program_cost = 0;
+}
+
+void LogicVm::run(uint32_t now_ms) {
+    in_run = true;
+    if (!ready) {
+        in_run = false;
+        stats.skipped_runs++;
+        return;
+    }
+    stats.last_instructions = execute(cells, now_ms, nullptr);
+    stats.runs++;
+    in_run = false;
+}
+
+logic_vm_benchmark_t LogicVm::benchmark(const clock_function_t& clock, uint32_t runs) {
+    logic_vm_benchmark_t result = {};
+    if (!ready) {
+        return result;
+    }
+    uint64_t start_us = clock();
+    for (uint32_t i = 0; i < runs; i++) {
+        result.instructions += execute(cells, (uint32_t)(start_us / 1000), nullptr);
+    }
+    result.elapsed_us = clock() - start_us;
+    result.runs = runs;
+    return result;
+}
+
+bool LogicVm::logic_timer_t::on_delay(bool in, uint32_t preset_ms, uint32_t now_ms) {
+    if (!in) {
+        running = false;
+        q = false;
+        elapsed_ms = 0;
+        return false;
+    }
+    if (!running) {
+        running = true;
+        start_ms = now_ms;
+    }
+    uint32_t elapsed = now_ms - start_ms;
+    if (elapsed >= preset_ms) {
+        elapsed = preset_ms;
+        q = true;  // Stays set even if the millisecond counter wraps
+    }
+    elapsed_ms = elapsed;
+    return q;
+}
+
+bool LogicVm::logic_timer_t::off_delay(bool in, uint32_t preset_ms, uint32_t now_ms) {
+    if (in) {
+        running = false;
+        q = true;
+        elapsed_ms = 0;
+        return true;
+    }
+    if (q) {
+        if (!running) {
+            running = true;
+            start_ms = now_ms;
+        }
+        uint32_t elapsed = now_ms - start_ms;
+        if (elapsed >= preset_ms) {
+            elapsed = preset_ms;
+            running = false;
+            q = false;
+        }
+        elapsed_ms = elapsed;
+    }
+    return q;
+}
+
+bool LogicVm::logic_timer_t::pulse(bool in, uint32_t preset_ms, uint32_t now_ms) {
+    if (in && !last_in && !q) {
+        q = true;
+        start_ms = now_ms;
+    }
+    if (q) {
+        uint32_t elapsed = now_ms - start_ms;
+        if (elapsed >= preset_ms) {
+            elapsed = preset_ms;
+            q = false;
+        }
+        elapsed_ms = elapsed;
+    } else if (!in) {
+        elapsed_ms = 0;
+    }
+    last_in = in;
+    return q;
+}
+
+static inline uint32_t preset(int32_t value) {
+    return value < 0 ? 0 : (uint32_t)value;
+}
+
+// Wrapping int32 arithmetic (overflow is defined, as on the PLC)
+static inline int32_t wrap(uint32_t value) {
+    return (int32_t)value;
+}
+
+uint32_t PLC_IN_RAM("logic_vm") LogicVm::execute(const cell_t* program, uint32_t now_ms, const void* const** handlers) {
+    static const void* const table[] = {
+        &&op_end, &&op_nop,
+        &&op_ldb, &&op_ldnb, &&op_stb, &&op_stnb, &&op_setb, &&op_rstb,
+        &&op_ldw, &&op_ldws, &&op_stw,
+        &&op_ldi, &&op_ldi,  // LDU differs only in translation
+        &&op_and, &&op_or, &&op_xor, &&op_not,
+        &&op_add, &&op_sub, &&op_mul, &&op_div, &&op_mod, &&op_neg, &&op_abs, &&op_min, &&op_max,
+        &&op_eq, &&op_ne, &&op_lt, &&op_le, &&op_gt, &&op_ge,
+        &&op_sel,
+        &&op_dup, &&op_drop, &&op_swap,
+        &&op_rtrig, &&op_ftrig,
+        &&op_ton, &&op_tof, &&op_tp, &&op_ldet,
+        &&op_jmp, &&op_jmpc, &&op_jmpcn,
+    };
+    static_assert(sizeof(table) / sizeof(table[0]) == OP_COUNT, "handler table out of step with LogicOp");
+
+    if (program == nullptr) {
+        *handlers = table;
+        return 0;
+    }
+
+    int32_t stack[LOGIC_VM_STACK_DEPTH + 1];
+    int32_t* sp = stack;  // Top of stack; stack[0] is never used
+    const cell_t* ip = program;
+    uint32_t skipped = 0;
+
+#define DISPATCH() goto *ip->handler
+#define NEXT() do { ++ip; DISPATCH(); } while (0)
+
+    DISPATCH();
+
+op_nop:
+    NEXT();
+op_ldb:
+    *++sp = (*ip->bits & ip->mask) != 0;
+    NEXT();
+op_ldnb:
+    *++sp = (*ip->bits & ip->mask) == 0;
+    NEXT();
+op_stb:
+    if (*sp--) *ip->bits |= ip->mask; else *ip->bits &= ~ip->mask;
+    NEXT();
+op_stnb:
+    if (*sp--) *ip->bits &= ~ip->mask; else *ip->bits |= ip->mask;
+    NEXT();
+op_setb:
+    if (*sp--) *ip->bits |= ip->mask;
+    NEXT();
+op_rstb:
+    if (*sp--) *ip->bits &= ~ip->mask;
+    NEXT();
+op_ldw:
+    *++sp = *ip->word;
+    NEXT();
+op_ldws:
+    *++sp = (int16_t)*ip->word;
+    NEXT();
+op_stw:
+    *ip->word = (uint16_t)*sp--;
+    NEXT();
+op_ldi:
+    *++sp = ip->value;
+    NEXT();
+op_and:
+    sp[-1] &= sp[0]; sp--;
+    NEXT();
+op_or:
+    sp[-1] |= sp[0]; sp--;
+    NEXT();
+op_xor:
+    sp[-1] ^= sp[0]; sp--;
+    NEXT();
+op_not:
+    *sp = !*sp;
+    NEXT();
+op_add:
+    sp[-1] = wrap((uint32_t)sp[-1] + (uint32_t)sp[0]); sp--;
+    NEXT();
+op_sub:
+    sp[-1] = wrap((uint32_t)sp[-1] - (uint32_t)sp[0]); sp--;
+    NEXT();
+op_mul:
+    sp[-1] = wrap((uint32_t)sp[-1] * (uint32_t)sp[0]); sp--;
+    NEXT();
+op_div:
+    if (sp[0] == 0) {
+        stats.arithmetic_faults++;
+        sp[-1] = 0;
+    } else if (sp[0] != -1) {
+        sp[-1] /= sp[0];
+    } else {
+        sp[-1] = wrap(0u - (uint32_t)sp[-1]);
+    }
+    sp--;
+    NEXT();
+op_mod:
+    if (sp[0] == 0) {
+        stats.arithmetic_faults++;
+        sp[-1] = 0;
+    } else if (sp[0] != -1) {
+        sp[-1] %= sp[0];
+    } else {
+        sp[-1] = 0;
+    }
+    sp--;
+    NEXT();
+op_neg:
+    *sp = wrap(0u - (uint32_t)*sp);
+    NEXT();
+op_abs:
+    if (*sp < 0) *sp = wrap(0u - (uint32_t)*sp);
+    NEXT();
+op_min:
+    if (sp[0] < sp[-1]) sp[-1] = sp[0];
+    sp--;
+    NEXT();
+op_max:
+    if (sp[0] > sp[-1]) sp[-1] = sp[0];
+    sp--;
+    NEXT();
+op_eq:
+    sp[-1] = sp[-1] == sp[0]; sp--;
+    NEXT();
+op_ne:
+    sp[-1] = sp[-1] != sp[0]; sp--;
+    NEXT();
+op_lt:
+    sp[-1] = sp[-1] < sp[0]; sp--;
+    NEXT();
+op_le:
+    sp[-1] = sp[-1] <= sp[0]; sp--;
+    NEXT();
+op_gt:
+    sp[-1] = sp[-1] > sp[0]; sp--;
+    NEXT();
+op_ge:
+    sp[-1] = sp[-1] >= sp[0]; sp--;
+    NEXT();
+op_sel:
+    sp[-2] = sp[-2] ? sp[0] : sp[-1]; sp -= 2;
+    NEXT();
+op_dup:
+    sp[1] = sp[0]; sp++;
+    NEXT();
+op_drop:
+    sp--;
+    NEXT();
+op_swap: {
+    int32_t top = sp[0];
+    sp[0] = sp[-1];
+    sp[-1] = top;
+    NEXT();
+}
+op_rtrig: {
+    bool in = *sp != 0;
+    bool last = (*ip->bits & ip->mask) != 0;
+    if (in) *ip->bits |= ip->mask; else *ip->bits &= ~ip->mask;
+    *sp = in && !last;
+    NEXT();
+}
+op_ftrig: {
+    bool in = *sp != 0;
+    bool last = (*ip->bits & ip->mask) != 0;
+    if (in) *ip->bits |= ip->mask; else *ip->bits &= ~ip->mask;
+    *sp = !in && last;
+    NEXT();
+}
+op_ton:
+    sp[-1] = ip->timer->on_delay(sp[-1] != 0, preset(sp[0]), now_ms); sp--;
+    NEXT();
+op_tof:
+    sp[-1] = ip->timer->off_delay(sp[-1] != 0, preset(sp[0]), now_ms); sp--;
+    NEXT();
+op_tp:
+    sp[-1] = ip->timer->pulse(sp[-1] != 0, preset(sp[0]), now_ms); sp--;
+    NEXT();
+op_ldet:
+    *++sp = (int32_t)ip->timer->elapsed_ms;
+    NEXT();
+op_jmp:
+    skipped += ip->mask;
+    ip = ip->target;
+    DISPATCH();
+op_jmpc:
+    if (*sp--) {
+        skipped += ip->mask;
+        ip = ip->target;
+        DISPATCH();
+    }
+    NEXT();
+op_jmpcn:
+    if (!*sp--) {
+        skipped += ip->mask;
+        ip = ip->target;
+        DISPATCH();
+    }
+    NEXT();
+op_end:
+    return (uint32_t)(ip - program) + 1 - skipped;
+
+#undef NEXT
+#undef DISPATCH
+}
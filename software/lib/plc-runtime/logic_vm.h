@@ -0,0 +1,207 @@
+#ifndef PICO_PLC_LOGIC_VM_H
+#define PICO_PLC_LOGIC_VM_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+// Bytecode interpreter for downloadable IEC 61131-style logic: boolean networks,
+// integer arithmetic, comparisons, edges and timers on the register/coil image.
+// Free of Pico SDK headers, so the assembler tool runs the same VM on a host.
+//
+// Instructions are 32-bit words: opcode (bits 31-24), A (23-16), B (15-0). A selects
+// the data area or timer/edge, B is the address, immediate or jump target (absolute
+// index, forward only). Values are int32 on a stack checked by the verifier, so
+// nothing is checked or allocated while a program runs. load() translates the words
+// into direct-threaded code: each instruction holds its handler address (GCC labels
+// as values) and resolved operand pointers.
+//
+// Programs have no loops, so the verifier knows the worst-case path through them and
+// rejects programs whose cost exceeds the budget. One cost unit is about one simple
+// instruction; benchmark() gives the instructions/us rate to convert a scan budget.
+
+#define LOGIC_VM_MAX_INSTRUCTIONS 1024
+#define LOGIC_VM_STACK_DEPTH 16
+#define LOGIC_VM_MARKERS 256        // %M bits
+#define LOGIC_VM_WORDS 64           // %MW words
+#define LOGIC_VM_TIMERS 32
+#define LOGIC_VM_EDGES 64           // R_TRIG / F_TRIG memories
+#define LOGIC_VM_DEFAULT_BUDGET 4000
+
+enum class LogicOp : uint8_t {
+    END = 0x00,
+    NOP,
+    // Bit areas: [ ] -> [x]        [x] -> [ ]
+    LDB, LDNB, STB, STNB, SETB, RSTB,
+    // Word areas: LDW unsigned, LDWS signed; STW keeps the low 16 bits
+    LDW, LDWS, STW,
+    // Immediates: B sign-extended, or as is
+    LDI, LDU,
+    // [a b] -> [a op b]; NOT is logical
+    AND, OR, XOR, NOT,
+    ADD, SUB, MUL, DIV, MOD, NEG, ABS, MIN, MAX,
+    EQ, NE, LT, LE, GT, GE,
+    SEL,                    // [g in0 in1] -> [g ? in1 : in0]
+    DUP, DROP, SWAP,
+    // A = edge memory: [x] -> [edge]
+    RTRIG, FTRIG,
+    // A = timer: [in pt_ms] -> [q]; LDET pushes the timer's elapsed ms
+    TON, TOF, TP, LDET,
+    // B = target index; JMPC / JMPCN pop the condition
+    JMP, JMPC, JMPCN,
+    COUNT
+};
+
+enum class LogicArea : uint8_t {
+    COIL = 0,       // %Q bits
+    DISCRETE,       // %I bits
+    MARKER,         // %M bits, VM memory
+    HOLDING,        // %HR words
+    INPUT,          // %IR words
+    WORD,           // %MW words, VM memory
+    COUNT
+};
+
+enum class LogicVmError : uint8_t {
+    NONE = 0,
+    EMPTY,
+    TOO_LONG,
+    BAD_OPCODE,
+    BAD_OPERAND,        // Area, address, timer or edge out of range
+    BAD_JUMP,           // Not forward, or past the end
+    STACK_UNDERFLOW,
+    STACK_OVERFLOW,
+    STACK_MISMATCH,     // Paths join with different stack depths
+    NO_END,             // Execution can run past the last instruction
+    OVER_BUDGET
+};
+
+constexpr uint32_t logic_encode(LogicOp op, uint8_t a = 0, uint16_t b = 0) {
+    return ((uint32_t)op << 24) | ((uint32_t)a << 16) | b;
+}
+
+// Process image the program works on; bit areas are packed 32 per word
+// (bit n of word w = address w * 32 + n, as in ModbusBitStore)
+struct logic_image_t {
+    uint32_t* coils;
+    uint16_t coil_count;
+    uint32_t* discrete_inputs;
+    uint16_t discrete_input_count;
+    uint16_t* holding_registers;
+    uint16_t holding_register_count;
+    uint16_t* input_registers;
+    uint16_t input_register_count;
+};
+
+struct logic_vm_stats_t {
+    uint32_t runs;
+    uint32_t skipped_runs;        // No program, or a load in progress
+    uint32_t arithmetic_faults;   // Division by zero (result 0)
+    uint32_t last_instructions;   // Executed by the last run
+};
+
+struct logic_vm_benchmark_t {
+    uint32_t runs;
+    uint64_t instructions;
+    uint64_t elapsed_us;
+    float instructions_per_us() const { return elapsed_us ? (float)instructions / (float)elapsed_us : 0.0f; }
+};
+
+class LogicVm {
+public:
+    typedef std::function<uint64_t()> clock_function_t;  // Microseconds
+
+private:
+    struct logic_timer_t {
+        uint32_t start_ms;
+        uint32_t elapsed_ms;
+        bool running;
+        bool q;
+        bool last_in;
+
+        // IEC TON / TOF / TP for one scan; returns Q
+        bool on_delay(bool in, uint32_t preset_ms, uint32_t now_ms);
+        bool off_delay(bool in, uint32_t preset_ms, uint32_t now_ms);
+        bool pulse(bool in, uint32_t preset_ms, uint32_t now_ms);
+    };
+
+    // One translated instruction
+    struct cell_t {
+        const void* handler;
+        union {
+            uint32_t* bits;
+            uint16_t* word;
+            int32_t value;
+            logic_timer_t* timer;
+            const cell_t* target;
+        };
+        uint32_t mask;      // Bit operands; jumps: instructions skipped
+    };
+
+    // Verifier state per instruction
+    struct flow_t {
+        int8_t depth;       // Stack depth on entry, -1 = not reached
+        uint16_t cost;      // Worst-case cost to reach it
+    };
+
+    logic_image_t image;
+    uint32_t budget;
+
+    cell_t cells[LOGIC_VM_MAX_INSTRUCTIONS];
+    flow_t flow[LOGIC_VM_MAX_INSTRUCTIONS];
+    uint16_t cell_count;
+    uint16_t program_cost;
+
+    uint32_t markers[LOGIC_VM_MARKERS / 32];
+    uint16_t words[LOGIC_VM_WORDS];
+    uint32_t edges[LOGIC_VM_EDGES / 32];
+    logic_timer_t timers[LOGIC_VM_TIMERS];
+
+    // run() / load() handshake, safe across cores and from an interrupt
+    std::atomic<bool> ready;
+    std::atomic<bool> in_run;
+
+    logic_vm_stats_t stats;
+
+    // Runs "cells" from the start; with program == nullptr only fills "handlers"
+    uint32_t execute(const cell_t* program, uint32_t now_ms, const void* const** handlers);
+    bool operand_valid(LogicOp op, uint8_t a, uint16_t b) const;
+    bool resolve_bit(uint8_t area, uint16_t address, cell_t& cell);
+    void translate(const uint32_t* code, uint16_t count);
+    void reset_memory();
+
+public:
+    LogicVm();
+
+    // Set before load(): addresses are checked against it and resolved into the code
+    void set_image(const logic_image_t& image) { this->image = image; }
+    void set_budget(uint32_t max_cost) { budget = max_cost; }
+    uint32_t get_budget() const { return budget; }
+
+    // Check a program without touching the loaded one. "error_index" receives the
+    // offending instruction, "cost" the worst-case path cost.
+    LogicVmError verify(const uint32_t* code, uint16_t count, uint16_t* error_index = nullptr, uint16_t* cost = nullptr);
+
+    // Verify, then replace the running program; VM memory and timers start cleared.
+    // Runs that start meanwhile are skipped.
+    LogicVmError load(const uint32_t* code, uint16_t count, uint16_t* error_index = nullptr);
+    void unload();
+    bool is_loaded() const { return ready; }
+    uint16_t get_instruction_count() const { return cell_count; }
+    uint16_t get_program_cost() const { return program_cost; }
+
+    // One pass of the program, e.g. from a ScanEngine program; "now_ms" drives timers
+    void run(uint32_t now_ms);
+
+    // Run the loaded program "runs" times back to back
+    logic_vm_benchmark_t benchmark(const clock_function_t& clock, uint32_t runs);
+
+    // VM memory, e.g. to publish markers over Modbus
+    uint32_t* get_markers() { return markers; }
+    uint16_t* get_words() { return words; }
+
+    const logic_vm_stats_t& get_stats() const { return stats; }
+    void reset_stats() { stats = {}; }
+};
+
+#endif //PICO_PLC_LOGIC_VM_H
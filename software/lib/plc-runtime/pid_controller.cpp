@@ -0,0 +1,128 @@
+#include "pid_controller.h"
+#include "plc_in_ram.h"
+
+static constexpr int64_t Q32_PER_Q15 = (int64_t)1 << 17;
+
+static inline int64_t q32_from_q15(q15_t value) {
+    return (int64_t)value * Q32_PER_Q15;
+}
+
+static inline int64_t clamp(int64_t value, int64_t low, int64_t high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+PidController::PidController()
+    : rate_hz(1000), out_min(0), out_max(q32_from_q15(Q15_ONE)), parameters{},
+      mode(PidMode::OFF), setpoint(0), kp(0), ki_per_sample(0), kd_per_sample(0),
+      feed_forward(0), manual_output(0), max_step(0),
+      integral(0), output(0), last_pv(0), primed(false), error(0), flags(0) {
+}
+
+bool PidController::set_rate(uint32_t rate_hz) {
+    if (rate_hz < PID_MIN_RATE_HZ || rate_hz > PID_MAX_RATE_HZ) {
+        return false;
+    }
+    this->rate_hz = rate_hz;
+    configure(parameters);  // Per-sample coefficients depend on the rate
+    return true;
+}
+
+bool PidController::set_output_limits(q15_t min, q15_t max) {
+    if (min >= max) {
+        return false;
+    }
+    out_min = q32_from_q15(min);
+    out_max = q32_from_q15(max);
+    output = clamp(output, out_min, out_max);
+    integral = clamp(integral, out_min, out_max);
+    manual_output = clamp(manual_output, out_min, out_max);
+    return true;
+}
+
+void PidController::configure(const pid_parameters_t& parameters) {
+    this->parameters = parameters;
+    mode = parameters.mode <= static_cast<uint16_t>(PidMode::MANUAL) ? static_cast<PidMode>(parameters.mode)
+                                                                       : PidMode::OFF;
+    setpoint = q16_from_q15((q15_t)parameters.setpoint);
+
+    // Q8.8 gains to Q16.16 / Q32.32, the time base folded in once here
+    kp = (q16_t)parameters.kp << 8;
+    ki_per_sample = ((int64_t)parameters.ki << 24) / rate_hz;
+    kd_per_sample = q16_sat(((int64_t)parameters.kd << 8) * rate_hz);
+    feed_forward = q32_from_q15((q15_t)parameters.feed_forward);
+    manual_output = clamp(q32_from_q15((q15_t)parameters.manual_output), out_min, out_max);
+
+    max_step = 0;
+    if (parameters.rate_limit != 0) {
+        max_step = ((int64_t)parameters.rate_limit << 24) / rate_hz;
+        if (max_step == 0) {
+            max_step = 1;  // Slowest possible, not "no limit"
+        }
+    }
+}
+
+void PidController::reset(q15_t value) {
+    output = clamp(q32_from_q15(value), out_min, out_max);
+    integral = output;
+    primed = false;
+}
+
+q15_t PLC_IN_RAM("pid") PidController::update(q15_t pv) {
+    q16_t pv16 = q16_from_q15(pv);
+    error = setpoint - pv16;  // Both within +-1.0, no overflow
+
+    int64_t p = (int64_t)kp * error;
+    int64_t d = primed ? -(int64_t)kd_per_sample * (pv16 - last_pv) : 0;
+    last_pv = pv16;
+    primed = true;
+
+    int64_t previous = integral;
+    int64_t target;
+    flags = 0;
+
+    if (mode == PidMode::AUTO) {
+        flags |= PID_FLAG_AUTO;
+        integral = clamp(integral + ((ki_per_sample * error) >> 16), out_min, out_max);
+        target = p + integral + d + feed_forward;
+        // Clamped in the direction the error pushes: integrating further only winds up
+        if ((target > out_max && error > 0) || (target < out_min && error < 0)) {
+            integral = previous;
+            target = p + integral + d + feed_forward;
+        }
+    } else if (mode == PidMode::MANUAL) {
+        flags |= PID_FLAG_MANUAL;
+        target = manual_output;
+    } else {
+        target = out_min;
+    }
+
+    if (target > out_max) {
+        target = out_max;
+        flags |= PID_FLAG_HIGH;
+    } else if (target < out_min) {
+        target = out_min;
+        flags |= PID_FLAG_LOW;
+    }
+
+    if (max_step > 0) {
+        int64_t step = target - output;
+        if (step > max_step || step < -max_step) {
+            target = output + (step > 0 ? max_step : -max_step);
+            flags |= PID_FLAG_RATE;
+            if (mode == PidMode::AUTO && error != 0 && (step > 0) == (error > 0)) {
+                integral = previous;
+            }
+        }
+    }
+    output = target;
+
+    // Bumpless transfer: the integral holds what AUTO would need for this output
+    if (mode != PidMode::AUTO) {
+        integral = clamp(output - p - d - feed_forward, out_min, out_max);
+    }
+    return get_output();
+}
+
+q15_t PidController::get_output() const {
+    return q15_sat((int32_t)((output + (Q32_PER_Q15 / 2)) >> 17));
+}
@@ -0,0 +1,92 @@
+#ifndef PICO_PLC_PID_CONTROLLER_H
+#define PICO_PLC_PID_CONTROLLER_H
+
+#include "fixed_point.h"
+
+// Fixed-rate PID in fixed point, free of Pico SDK headers. PV, setpoint and output
+// are Q1.15 fractions of full scale; integral and output are kept as Q32.32, so slow
+// integral gains at kHz rates neither round to zero nor drift.
+//
+//   out = Kp*e + integral(Ki*e) - Kd*d(pv)/dt + feed_forward, e = sp - pv
+//
+// The derivative acts on the measurement (no kick on setpoint steps). Anti-windup:
+// the integral stops while the output is clamped or rate limited in the direction
+// the error pushes, and never leaves the output limits. In OFF and MANUAL the
+// integral tracks the output, so switching to AUTO is bumpless.
+#define PID_MIN_RATE_HZ 1
+#define PID_MAX_RATE_HZ 100000
+
+// Status flags
+#define PID_FLAG_HIGH 0x0001        // Output clamped at the upper limit
+#define PID_FLAG_LOW 0x0002         // Output clamped at the lower limit
+#define PID_FLAG_RATE 0x0004        // Output change rate limited
+#define PID_FLAG_AUTO 0x0008
+#define PID_FLAG_MANUAL 0x0010
+
+enum class PidMode : uint16_t {
+    OFF = 0,        // Output at the lower limit
+    AUTO = 1,
+    MANUAL = 2      // Output follows manual_output (rate limited)
+};
+
+// Tuning as 16-bit words, in Modbus register order
+struct pid_parameters_t {
+    uint16_t setpoint;          // Q1.15
+    uint16_t kp;                // Q8.8
+    uint16_t ki;                // Q8.8, per second
+    uint16_t kd;                // Q8.8, seconds
+    uint16_t feed_forward;      // Q1.15, signed, added to the output
+    uint16_t rate_limit;        // Q8.8 full scale per second, 0 = no limit
+    uint16_t mode;              // PidMode
+    uint16_t manual_output;     // Q1.15
+};
+
+#define PID_PARAMETER_WORDS (sizeof(pid_parameters_t) / sizeof(uint16_t))
+
+class PidController {
+private:
+    uint32_t rate_hz;
+    int64_t out_min;            // Q32.32
+    int64_t out_max;
+
+    // From configure()
+    pid_parameters_t parameters;
+    PidMode mode;
+    q16_t setpoint;
+    q16_t kp;
+    int64_t ki_per_sample;      // Q32.32
+    q16_t kd_per_sample;        // Kd * rate
+    int64_t feed_forward;       // Q32.32
+    int64_t manual_output;
+    int64_t max_step;           // Q32.32 per sample, 0 = no limit
+
+    // State
+    int64_t integral;
+    int64_t output;
+    q16_t last_pv;
+    bool primed;                // last_pv valid
+    q16_t error;
+    uint16_t flags;
+
+public:
+    PidController();
+
+    // Setup: sample rate and output range (default 0.0 to 1.0); call configure() after
+    bool set_rate(uint32_t rate_hz);
+    bool set_output_limits(q15_t min, q15_t max);
+
+    // New tuning or mode; the output continues from where it is
+    void configure(const pid_parameters_t& parameters);
+    // Output and integral to "value", e.g. before the first update()
+    void reset(q15_t value);
+
+    // One sample
+    q15_t update(q15_t pv);
+
+    q15_t get_output() const;
+    q15_t get_error() const { return q15_from_q16(error); }
+    uint16_t get_flags() const { return flags; }
+    PidMode get_mode() const { return mode; }
+};
+
+#endif //PICO_PLC_PID_CONTROLLER_H
@@ -0,0 +1,13 @@
+#ifndef PICO_PLC_PLC_IN_RAM_H
+#define PICO_PLC_PLC_IN_RAM_H
+
+// Hot paths (interrupt handlers, the logic interpreter loop) run from RAM on the target,
+// so they never stall on an XIP cache miss. Host builds (tools/) compile them as usual.
+#if PICO_ON_DEVICE
+#include "pico/platform.h"
+#define PLC_IN_RAM(section) __not_in_flash(section)
+#else
+#define PLC_IN_RAM(section)
+#endif
+
+#endif //PICO_PLC_PLC_IN_RAM_H
@@ -0,0 +1,237 @@
+#include "scan_engine.h"
+#include "adc_sampler.h"
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "hardware/watchdog.h"
+#include "dac7562-driver/dac7562.h"
+#include "pico-utils/custom_dac.h"
+#include <cstdio>
+
+ScanEngine::ScanEngine(uint32_t period_us)
+    : period_us(period_us < SCAN_MIN_PERIOD_US ? SCAN_MIN_PERIOD_US : period_us),
+      input_stage_count(0), output_stage_count(0),
+      gpio_output_mask(0), adc_channel_mask(0), sampler(nullptr), dac(nullptr), dac_written{}, dac_valid(false),
+      pwm_pins{}, pwm_count(0), image{}, stats{}, watchdog_ms(0),
+      pool(nullptr), due_us(0), last_start_us(0), running(false) {
+}
+
+ScanEngine::~ScanEngine() {
+    stop();
+}
+
+bool ScanEngine::set_period_us(uint32_t period_us) {
+    if (running || period_us < SCAN_MIN_PERIOD_US) {
+        return false;
+    }
+    if (watchdog_ms > 0 && (uint64_t)watchdog_ms * 1000 <= period_us) {
+        return false;
+    }
+    this->period_us = period_us;
+    return true;
+}
+
+bool ScanEngine::add_input_stage(const scan_function_t& stage) {
+    if (running || input_stage_count >= SCAN_MAX_STAGES) {
+        return false;
+    }
+    input_stages[input_stage_count++] = stage;
+    return true;
+}
+
+bool ScanEngine::add_output_stage(const scan_function_t& stage) {
+    if (running || output_stage_count >= SCAN_MAX_STAGES) {
+        return false;
+    }
+    output_stages[output_stage_count++] = stage;
+    return true;
+}
+
+void ScanEngine::bind_gpio_outputs(uint32_t mask) {
+    gpio_init_mask(mask);
+    gpio_set_dir_out_masked(mask);
+    gpio_clr_mask(mask);
+    gpio_output_mask |= mask;
+}
+
+void ScanEngine::bind_sampler(AdcSampler* sampler) {
+    this->sampler = sampler;
+}
+
+bool ScanEngine::bind_adc(uint8_t channel) {
+    if (running || sampler == nullptr || channel >= SCAN_ADC_CHANNELS) {
+        return false;
+    }
+    if (!sampler->has_channel(channel) && !sampler->add_channel(channel)) {
+        return false;  // Sampler already running
+    }
+    adc_channel_mask |= 1 << channel;
+    return true;
+}
+
+void ScanEngine::bind_dac(DAC7562* dac) {
+    this->dac = dac;
+    dac_valid = false;
+}
+
+int ScanEngine::bind_pwm(uint gpio, uint resolution_bits) {
+    if (running || pwm_count >= SCAN_MAX_PWM_OUTPUTS) {
+        return -1;
+    }
+    setup_pwm_dac(gpio, resolution_bits);
+    pwm_pins[pwm_count] = gpio;
+    return pwm_count++;
+}
+
+bool ScanEngine::enable_watchdog(uint32_t timeout_ms) {
+    if (running || timeout_ms == 0 || (uint64_t)timeout_ms * 1000 <= period_us) {
+        return false;
+    }
+    watchdog_ms = timeout_ms;
+    return true;
+}
+
+bool ScanEngine::was_watchdog_reset() {
+    return watchdog_enable_caused_reboot();
+}
+
+bool ScanEngine::start() {
+    if (running || !program) {
+        return false;
+    }
+
+    // Own alarm and interrupt: scans are not queued behind other alarms (e.g. Modbus frame timers)
+    pool = alarm_pool_create_with_unused_hardware_alarm(1);
+    if (pool == nullptr) {
+        return false;
+    }
+
+    image.cycle = 0;
+    dac_valid = false;
+    last_start_us = time_us_64();
+    due_us = last_start_us + period_us;
+    if (watchdog_ms > 0) {
+        watchdog_enable(watchdog_ms, true);  // Paused while a debugger halts the core
+    }
+
+    running = true;
+    if (alarm_pool_add_alarm_at(pool, from_us_since_boot(due_us), alarm_callback, this, true) < 0) {
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void ScanEngine::stop() {
+    running = false;
+    if (pool != nullptr) {
+        alarm_pool_destroy(pool);
+        pool = nullptr;
+    }
+    if (watchdog_ms > 0) {
+        watchdog_disable();
+    }
+}
+
+int64_t ScanEngine::alarm_callback(alarm_id_t id, void* user_data) {
+    return static_cast<ScanEngine*>(user_data)->scan();
+}
+
+int64_t ScanEngine::scan() {
+    if (!running) {
+        return 0;
+    }
+
+    uint64_t start_us = time_us_64();
+    stats.jitter.add((uint32_t)(start_us - due_us));
+    image.dt_us = (uint32_t)(start_us - last_start_us);
+    last_start_us = start_us;
+
+    latch_inputs();
+    program(image);
+    write_outputs();
+    image.cycle++;
+
+    uint64_t end_us = time_us_64();
+    stats.exec.add((uint32_t)(end_us - start_us));
+    stats.cycles++;
+    if (watchdog_ms > 0) {
+        watchdog_update();
+    }
+
+    // Next slot on the grid; slots already gone are dropped, not run back to back
+    uint64_t next_us = due_us + period_us;
+    if (end_us >= next_us) {
+        uint32_t missed = (uint32_t)((end_us - next_us) / period_us) + 1;
+        stats.overruns++;
+        stats.skipped += missed;
+        next_us += (uint64_t)missed * period_us;
+    }
+
+    int64_t delay_us = (int64_t)(next_us - due_us);
+    due_us = next_us;
+    return -delay_us;  // Negative: counted from when this scan was due, not from now
+}
+
+void ScanEngine::latch_inputs() {
+    image.gpio_in = gpio_get_all();
+    for (uint8_t channel = 0; channel < SCAN_ADC_CHANNELS; channel++) {
+        if (adc_channel_mask & (1 << channel)) {
+            image.adc[channel] = sampler->get_latest_raw(channel);
+        }
+    }
+    for (uint8_t i = 0; i < input_stage_count; i++) {
+        input_stages[i](image);
+    }
+}
+
+void ScanEngine::write_outputs() {
+    if (gpio_output_mask != 0) {
+        gpio_put_masked(gpio_output_mask, image.gpio_out);
+    }
+
+    // SPI writes only for codes that changed
+    if (dac != nullptr) {
+        if (!dac_valid || image.dac[0] != dac_written[0]) {
+            dac->setCodeA(image.dac[0]);
+            dac_written[0] = image.dac[0];
+        }
+        if (!dac_valid || image.dac[1] != dac_written[1]) {
+            dac->setCodeB(image.dac[1]);
+            dac_written[1] = image.dac[1];
+        }
+        dac_valid = true;
+    }
+
+    for (uint8_t i = 0; i < pwm_count; i++) {
+        set_dac_value(pwm_pins[i], image.pwm[i]);
+    }
+    for (uint8_t i = 0; i < output_stage_count; i++) {
+        output_stages[i](image);
+    }
+}
+
+scan_stats_t ScanEngine::get_stats() const {
+    uint32_t irq = save_and_disable_interrupts();
+    scan_stats_t copy = stats;
+    restore_interrupts(irq);
+    return copy;
+}
+
+void ScanEngine::reset_stats() {
+    uint32_t irq = save_and_disable_interrupts();
+    stats.cycles = 0;
+    stats.overruns = 0;
+    stats.skipped = 0;
+    stats.exec.clear();
+    stats.jitter.clear();
+    restore_interrupts(irq);
+}
+
+void ScanEngine::dump_stats() const {
+    scan_stats_t copy = get_stats();
+    printf("=== Scan engine, %lu us period ===\n", (unsigned long)period_us);
+    printf("Cycles: %lu, overruns: %lu, skipped: %lu\n",
+           (unsigned long)copy.cycles, (unsigned long)copy.overruns, (unsigned long)copy.skipped);
+    copy.exec.print("exec");
+    copy.jitter.print("jitter");
+}
@@ -0,0 +1,114 @@
+#ifndef PICO_PLC_SCAN_ENGINE_H
+#define PICO_PLC_SCAN_ENGINE_H
+
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include "pico-modbus/common/md_histogram.h"
+#include <functional>
+
+class AdcSampler;
+class DAC7562;
+
+// Fixed-period PLC scan: every period, on a dedicated hardware alarm,
+//   1. latch inputs  (GPIO, bound ADC channels, then input stages, e.g. Modbus registers)
+//   2. run the program on the latched image
+//   3. write outputs (bound GPIO, DAC7562, PWM, then output stages, e.g. commit_process_image())
+// Scans start on a fixed time grid: a late scan does not shift the ones after it.
+// Everything runs in the alarm interrupt, so the program and stages must not block.
+#define SCAN_DEFAULT_PERIOD_US 10000
+#define SCAN_MIN_PERIOD_US 100
+#define SCAN_ADC_CHANNELS 4        // ADC0-3 (GPIO 26-29)
+#define SCAN_MAX_PWM_OUTPUTS 8
+#define SCAN_MAX_STAGES 4          // Extra input and output stages, each
+
+// Process image of one scan: inputs are latched before the program runs, outputs
+// are written after it returns
+struct scan_image_t {
+    uint32_t gpio_in;                    // All GPIO levels
+    uint16_t adc[SCAN_ADC_CHANNELS];     // 12-bit codes from the sampler, bound channels only
+    uint32_t gpio_out;                   // Levels for the bound output pins
+    uint16_t dac[2];                     // DAC7562 codes A and B (0-4095), written on change
+    uint16_t pwm[SCAN_MAX_PWM_OUTPUTS];  // PWM levels, in order of bind_pwm()
+    uint32_t cycle;                      // Scan number, from 0
+    uint32_t dt_us;                      // Since the previous scan started
+};
+
+struct scan_stats_t {
+    uint32_t cycles;
+    uint32_t overruns;            // Scans still running when the next one was due
+    uint32_t skipped;             // Periods dropped after overruns to get back on the grid
+    latency_histogram_t exec;     // Latch + program + write time
+    latency_histogram_t jitter;   // Scan start after its due time
+};
+
+class ScanEngine {
+public:
+    typedef std::function<void(scan_image_t& image)> scan_function_t;
+
+private:
+    uint32_t period_us;
+    scan_function_t program;
+    scan_function_t input_stages[SCAN_MAX_STAGES];
+    scan_function_t output_stages[SCAN_MAX_STAGES];
+    uint8_t input_stage_count;
+    uint8_t output_stage_count;
+
+    // I/O bindings
+    uint32_t gpio_output_mask;
+    uint8_t adc_channel_mask;
+    AdcSampler* sampler;
+    DAC7562* dac;
+    uint16_t dac_written[2];
+    bool dac_valid;                      // dac_written matches the chip
+    uint pwm_pins[SCAN_MAX_PWM_OUTPUTS];
+    uint8_t pwm_count;
+
+    scan_image_t image;
+    scan_stats_t stats;
+    uint32_t watchdog_ms;                // 0 = watchdog off
+
+    alarm_pool_t* pool;
+    uint64_t due_us;                     // When the running scan was due
+    uint64_t last_start_us;
+    volatile bool running;
+
+    static int64_t alarm_callback(alarm_id_t id, void* user_data);
+    int64_t scan();
+    void latch_inputs();
+    void write_outputs();
+
+public:
+    explicit ScanEngine(uint32_t period_us = SCAN_DEFAULT_PERIOD_US);
+    ~ScanEngine();
+
+    // Setup, while stopped
+    bool set_period_us(uint32_t period_us);
+    void set_program(const scan_function_t& program) { this->program = program; }
+    bool add_input_stage(const scan_function_t& stage);
+    bool add_output_stage(const scan_function_t& stage);
+
+    void bind_gpio_outputs(uint32_t mask);                  // Pins are set to outputs, low
+    // Bound ADC channels latch the sampler's latest values; bind_adc() adds the channel
+    // to the sampler, so bind before the sampler starts
+    void bind_sampler(AdcSampler* sampler);
+    bool bind_adc(uint8_t channel);                          // 0 to SCAN_ADC_CHANNELS - 1
+    void bind_dac(DAC7562* dac);                             // Already begin()-ed
+    int bind_pwm(uint gpio, uint resolution_bits = 12);      // Image index, or -1 if full
+
+    // Hardware watchdog, kicked by every scan: the chip resets if scans stop for
+    // timeout_ms (stuck program, interrupts off). Must be longer than the period.
+    bool enable_watchdog(uint32_t timeout_ms);
+    static bool was_watchdog_reset();
+
+    bool start();
+    void stop();
+    bool is_running() const { return running; }
+    uint32_t get_period_us() const { return period_us; }
+
+    // Copy taken with interrupts off: call from the core that started the engine
+    scan_stats_t get_stats() const;
+    void reset_stats();
+    void dump_stats() const;
+};
+
+#endif //PICO_PLC_SCAN_ENGINE_H
@@ -0,0 +1,252 @@
+#include "waveform_output.h"
+#include "pico-modbus/md_slave_unit.h"
+#include "pico-modbus/common/md_common.h"
+#include <cstring>
+
+static uint8_t codes_per_sample(DacStreamChannels channels) {
+    return channels == DacStreamChannels::BOTH ? 2 : 1;
+}
+
+static bool is_channels(uint16_t value) {
+    return value >= enum_value(DacStreamChannels::A) && value <= enum_value(DacStreamChannels::BOTH);
+}
+
+// Step k of "steps" from "from" to "to", rounded to nearest
+static uint16_t ramp(int32_t from, int32_t to, uint32_t k, uint32_t steps) {
+    int32_t scaled = (to - from) * (int32_t)k;
+    int32_t half = (int32_t)steps / 2;
+    return (uint16_t)(from + (scaled >= 0 ? scaled + half : scaled - half) / (int32_t)steps);
+}
+
+WaveformOutput::WaveformOutput(DAC7562Stream& stream)
+    : stream(stream), points{}, segments{}, channels(DacStreamChannels::A), rate_hz(1000),
+      point_count(0), segment_count(0), status(WaveStatus::OK) {
+}
+
+bool WaveformOutput::set_output(DacStreamChannels channels, uint16_t rate_hz) {
+    if (!is_channels(enum_value(channels)) || rate_hz == 0) {
+        return false;
+    }
+    this->channels = channels;
+    this->rate_hz = rate_hz;
+    return true;
+}
+
+bool WaveformOutput::set_points(const uint16_t* codes, uint16_t samples) {
+    uint32_t count = (uint32_t)samples * codes_per_sample(channels);
+    if (count > WAVE_MAX_POINTS) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (codes[i] > 4095) {
+            return false;
+        }
+    }
+    memcpy(points, codes, count * sizeof(uint16_t));
+    point_count = samples;
+    return true;
+}
+
+bool WaveformOutput::set_profile(const wave_segment_t* segments, uint16_t count) {
+    if (count > WAVE_MAX_SEGMENTS) {
+        return false;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        if (segments[i].code_a > 4095 || segments[i].code_b > 4095) {
+            return false;
+        }
+    }
+    memcpy(this->segments, segments, count * sizeof(wave_segment_t));
+    segment_count = count;
+    return true;
+}
+
+WaveStatus WaveformOutput::render() {
+    if (rate_hz < WAVE_MIN_RATE_HZ) {
+        return WaveStatus::BAD_RATE;
+    }
+    uint8_t per_sample = codes_per_sample(channels);
+    uint32_t capacity = WAVE_MAX_POINTS / per_sample;
+
+    // Checked in full first: a profile that does not fit leaves the point table alone
+    uint32_t total = 0;
+    for (uint16_t i = 0; i < segment_count; i++) {
+        total += (uint32_t)((uint64_t)segments[i].time_ms * rate_hz / 1000);
+        if (total > capacity) {
+            return WaveStatus::TOO_LONG;
+        }
+    }
+    if (total == 0) {
+        return WaveStatus::BAD_POINTS;
+    }
+
+    int32_t from[2] = {segments[0].code_a, segments[0].code_b};
+    uint32_t sample = 0;
+    for (uint16_t i = 0; i < segment_count; i++) {
+        const wave_segment_t& segment = segments[i];
+        int32_t to[2] = {segment.code_a, segment.code_b};
+        uint32_t steps = (uint32_t)((uint64_t)segment.time_ms * rate_hz / 1000);
+        for (uint32_t k = 1; k <= steps; k++, sample++) {
+            uint16_t a = ramp(from[0], to[0], k, steps);
+            uint16_t b = ramp(from[1], to[1], k, steps);
+            if (channels == DacStreamChannels::BOTH) {
+                points[2 * sample] = a;
+                points[2 * sample + 1] = b;
+            } else {
+                points[sample] = channels == DacStreamChannels::A ? a : b;
+            }
+        }
+        from[0] = to[0];
+        from[1] = to[1];
+    }
+    point_count = (uint16_t)total;
+    return WaveStatus::OK;
+}
+
+WaveStatus WaveformOutput::start(bool loop) {
+    uint8_t per_sample = codes_per_sample(channels);
+    if (point_count == 0 || point_count > WAVE_MAX_POINTS / per_sample) {
+        return WaveStatus::BAD_POINTS;
+    }
+    if (rate_hz < WAVE_MIN_RATE_HZ || rate_hz > DAC_STREAM_MAX_FRAME_RATE / per_sample) {
+        return WaveStatus::BAD_RATE;
+    }
+    // START while playing restarts with the current table
+    stream.stop();
+    if (!stream.load(points, point_count, channels)) {
+        return WaveStatus::BAD_POINTS;
+    }
+    return stream.start(rate_hz, loop) ? WaveStatus::OK : WaveStatus::NO_RESOURCES;
+}
+
+WaveStatus WaveformOutput::run_command(uint16_t command) {
+    switch ((WaveCommand)command) {
+        case WaveCommand::NONE:
+            return status;
+        case WaveCommand::START:
+            return start(true);
+        case WaveCommand::START_ONCE:
+            return start(false);
+        case WaveCommand::STOP:
+            stream.stop();
+            return WaveStatus::OK;
+        case WaveCommand::RENDER:
+            return render();
+        default:
+            return WaveStatus::BAD_COMMAND;
+    }
+}
+
+WaveStatus WaveformOutput::execute(WaveCommand command) {
+    status = run_command(enum_value(command));
+    return status;
+}
+
+WaveState WaveformOutput::get_state() const {
+    if (!stream.is_started()) {
+        return WaveState::IDLE;
+    }
+    return stream.is_running() ? WaveState::RUNNING : WaveState::DONE;
+}
+
+bool WaveformOutput::bind_registers(ModbusSlaveUnit& unit, uint16_t control_base, uint16_t points_base,
+                                    uint16_t profile_base) {
+    bool bound = unit.add_holding_register_callback(control_base, WAVE_CONTROL_REGISTERS,
+        [this, control_base](uint16_t start, uint16_t count, uint16_t* values) {
+            return read_control(start - control_base, count, values);
+        },
+        [this, control_base](uint16_t start, uint16_t count, const uint16_t* values) {
+            return write_control(start - control_base, count, values);
+        });
+    bound = bound && unit.add_holding_register_callback(points_base, WAVE_MAX_POINTS,
+        [this, points_base](uint16_t start, uint16_t count, uint16_t* values) {
+            memcpy(values, &points[start - points_base], count * sizeof(uint16_t));
+            return true;
+        },
+        [this, points_base](uint16_t start, uint16_t count, const uint16_t* values) {
+            for (uint16_t i = 0; i < count; i++) {
+                if (values[i] > 4095) {
+                    return false;
+                }
+            }
+            memcpy(&points[start - points_base], values, count * sizeof(uint16_t));
+            return true;
+        });
+    return bound && unit.add_holding_register_callback(profile_base, WAVE_MAX_SEGMENTS * WAVE_PROFILE_WORDS,
+        [this, profile_base](uint16_t start, uint16_t count, uint16_t* values) {
+            for (uint16_t i = 0; i < count; i++) {
+                uint16_t offset = start + i - profile_base;
+                const wave_segment_t& segment = segments[offset / WAVE_PROFILE_WORDS];
+                switch (offset % WAVE_PROFILE_WORDS) {
+                    case 0: values[i] = segment.code_a; break;
+                    case 1: values[i] = segment.code_b; break;
+                    default: values[i] = segment.time_ms; break;
+                }
+            }
+            return true;
+        },
+        [this, profile_base](uint16_t start, uint16_t count, const uint16_t* values) {
+            return write_profile(start - profile_base, count, values);
+        });
+}
+
+bool WaveformOutput::read_control(uint16_t offset, uint16_t count, uint16_t* values) {
+    for (uint16_t i = 0; i < count; i++) {
+        switch (offset + i) {
+            case 0: values[i] = 0; break;
+            case 1: values[i] = enum_value(status); break;
+            case 2: values[i] = enum_value(get_state()); break;
+            case 3: values[i] = enum_value(channels); break;
+            case 4: values[i] = rate_hz; break;
+            case 5: values[i] = point_count; break;
+            case 6: values[i] = segment_count; break;
+            case 7: values[i] = (uint16_t)stream.get_position(); break;
+            default: return false;
+        }
+    }
+    return true;
+}
+
+bool WaveformOutput::write_control(uint16_t offset, uint16_t count, const uint16_t* values) {
+    // Check the whole write first, so a bad word changes nothing
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t reg = offset + i;
+        if (reg == 1 || reg == 2 || reg >= 7 ||
+            (reg == 3 && !is_channels(values[i])) ||
+            (reg == 4 && values[i] == 0) ||
+            (reg == 5 && values[i] > WAVE_MAX_POINTS) ||
+            (reg == 6 && values[i] > WAVE_MAX_SEGMENTS)) {
+            return false;
+        }
+    }
+    // The command runs last, with the settings written alongside it
+    for (uint16_t i = 0; i < count; i++) {
+        switch (offset + i) {
+            case 3: channels = (DacStreamChannels)values[i]; break;
+            case 4: rate_hz = values[i]; break;
+            case 5: point_count = values[i]; break;
+            case 6: segment_count = values[i]; break;
+        }
+    }
+    if (offset == 0 && count > 0) {
+        status = run_command(values[0]);
+    }
+    return true;
+}
+
+bool WaveformOutput::write_profile(uint16_t offset, uint16_t count, const uint16_t* values) {
+    for (uint16_t i = 0; i < count; i++) {
+        if ((offset + i) % WAVE_PROFILE_WORDS != 2 && values[i] > 4095) {
+            return false;
+        }
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        wave_segment_t& segment = segments[(offset + i) / WAVE_PROFILE_WORDS];
+        switch ((offset + i) % WAVE_PROFILE_WORDS) {
+            case 0: segment.code_a = values[i]; break;
+            case 1: segment.code_b = values[i]; break;
+            default: segment.time_ms = values[i]; break;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,99 @@
+#ifndef PICO_PLC_WAVEFORM_OUTPUT_H
+#define PICO_PLC_WAVEFORM_OUTPUT_H
+
+#include "pico/stdlib.h"
+#include "dac7562-driver/dac7562_stream.h"
+
+class ModbusSlaveUnit;
+
+// Waveforms and ramp/soak setpoint profiles on the DAC7562, uploaded over Modbus and
+// played by a DAC7562Stream (DMA, no CPU per sample). Points and profile segments are
+// edited in holding registers while anything plays; START formats them into frames,
+// so edits take effect on the next START.
+//
+// Control registers after bind_registers() (holding, at control_base):
+//   +0 command      WaveCommand, acts on write (reads 0)
+//   +1 status       WaveStatus of the last command (read only)
+//   +2 state        WaveState (read only)
+//   +3 channels     DacStreamChannels: 1 A, 2 B, 3 A and B updated together
+//   +4 rate         Samples per second
+//   +5 points       Samples in the point table
+//   +6 segments     Profile segments in use
+//   +7 position     Sample being output (read only)
+// Point table (at points_base, WAVE_MAX_POINTS registers): 12-bit codes, one per
+// sample, or A, B pairs with channels 3 (points counts the pairs).
+// Profile (at profile_base, WAVE_PROFILE_WORDS per segment): +0 code A, +1 code B,
+// +2 time in ms. Each segment ramps linearly from where the previous one ended to its
+// codes over its time, so repeating the codes soaks; the first one starts from its own
+// codes. RENDER expands the profile into the point table at the current rate.
+// A write is checked whole and rejected (nothing changes) on a bad word.
+#define WAVE_CONTROL_REGISTERS 8
+#define WAVE_MAX_POINTS DAC_STREAM_MAX_FRAMES   // Holding registers of the point table
+#define WAVE_MAX_SEGMENTS 32
+#define WAVE_PROFILE_WORDS 3                    // Holding registers per segment
+#define WAVE_MIN_RATE_HZ 10                     // Slowest PWM pacing, 255 * 65536 clocks
+
+enum class WaveCommand : uint16_t {
+    NONE = 0,
+    START,              // Loop the point table
+    START_ONCE,         // One pass, then hold the last sample
+    STOP,               // Hand the DAC back to its setters
+    RENDER              // Profile -> point table
+};
+
+enum class WaveStatus : uint16_t {
+    OK = 0,
+    BAD_COMMAND,
+    BAD_POINTS,         // None, or more than fit the stream with these channels
+    BAD_RATE,           // Outside what the stream can pace for these channels
+    TOO_LONG,           // The rendered profile would not fit the point table
+    NO_RESOURCES        // No free DMA channels or PIO state machine
+};
+
+enum class WaveState : uint16_t {
+    IDLE = 0,
+    RUNNING,
+    DONE                // One pass sent, last sample held until STOP or START
+};
+
+struct wave_segment_t {
+    uint16_t code_a;
+    uint16_t code_b;
+    uint16_t time_ms;
+};
+
+class WaveformOutput {
+private:
+    DAC7562Stream& stream;
+
+    uint16_t points[WAVE_MAX_POINTS];
+    wave_segment_t segments[WAVE_MAX_SEGMENTS];
+    DacStreamChannels channels;
+    uint16_t rate_hz;
+    uint16_t point_count;
+    uint16_t segment_count;
+    WaveStatus status;
+
+    WaveStatus start(bool loop);
+    WaveStatus run_command(uint16_t command);
+    bool read_control(uint16_t offset, uint16_t count, uint16_t* values);
+    bool write_control(uint16_t offset, uint16_t count, const uint16_t* values);
+    bool write_profile(uint16_t offset, uint16_t count, const uint16_t* values);
+
+public:
+    explicit WaveformOutput(DAC7562Stream& stream);
+
+    bool bind_registers(ModbusSlaveUnit& unit, uint16_t control_base, uint16_t points_base, uint16_t profile_base);
+
+    // The same operations without registers; points in the layout of the channels set
+    bool set_output(DacStreamChannels channels, uint16_t rate_hz);
+    bool set_points(const uint16_t* codes, uint16_t samples);
+    bool set_profile(const wave_segment_t* segments, uint16_t count);
+    WaveStatus render();
+    WaveStatus execute(WaveCommand command);
+
+    WaveState get_state() const;
+    WaveStatus get_status() const { return status; }
+};
+
+#endif //PICO_PLC_WAVEFORM_OUTPUT_H
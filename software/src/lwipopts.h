@@ -0,0 +1,48 @@
+#ifndef PICO_PLC_LWIPOPTS_H
+#define PICO_PLC_LWIPOPTS_H
+
+// lwIP options for tcp_slave_plc (pico_cyw43_arch_lwip_poll): no OS, callbacks run
+// from cyw43_arch_poll() in the main loop. Sized for MODBUS_TCP_MAX_CLIENTS
+// connections with pipelined requests, a few KB of send buffer each.
+//
+// Replies are copied into the lwIP heap (TCP_WRITE_FLAG_COPY) and the server answers
+// as long as the send buffer has room, so MEM_SIZE holds a full TCP_SND_BUF, and the
+// segments carrying it, for every client at once: tcp_write() never fails on ERR_MEM.
+
+#define NO_SYS                      1
+#define LWIP_SOCKET                 0
+#define LWIP_NETCONN                0
+#define MEM_LIBC_MALLOC             0
+#define MEM_ALIGNMENT               4
+#define PLC_TCP_CLIENTS             4       // MODBUS_TCP_MAX_CLIENTS
+#define PLC_TCP_SEGMENT_OVERHEAD    128     // pbuf + TCP/IP/link headers per queued segment
+#define MEM_SIZE                    (PLC_TCP_CLIENTS * (TCP_SND_BUF + TCP_SND_QUEUELEN * PLC_TCP_SEGMENT_OVERHEAD) + 4096)
+#define MEMP_NUM_TCP_SEG            (PLC_TCP_CLIENTS * TCP_SND_QUEUELEN)
+#define MEMP_NUM_TCP_PCB            (PLC_TCP_CLIENTS + 2)   // Spare for closing pcbs
+#define MEMP_NUM_ARP_QUEUE          10
+#define PBUF_POOL_SIZE              24
+#define LWIP_ARP                    1
+#define LWIP_ETHERNET               1
+#define LWIP_ICMP                   1
+#define LWIP_RAW                    1
+#define LWIP_IPV4                   1
+#define LWIP_TCP                    1
+#define LWIP_UDP                    1
+#define LWIP_DNS                    0
+#define LWIP_DHCP                   1
+#define LWIP_TCP_KEEPALIVE          1
+#define LWIP_NETIF_STATUS_CALLBACK  1
+#define LWIP_NETIF_LINK_CALLBACK    1
+#define LWIP_NETIF_HOSTNAME         1
+#define LWIP_NETIF_TX_SINGLE_PBUF   1
+#define DHCP_DOES_ARP_CHECK         0
+#define LWIP_DHCP_DOES_ACD_CHECK    0
+#define TCP_MSS                     1460
+#define TCP_WND                     (8 * TCP_MSS)
+#define TCP_SND_BUF                 (4 * TCP_MSS)
+#define TCP_SND_QUEUELEN            ((4 * (TCP_SND_BUF) + (TCP_MSS - 1)) / (TCP_MSS))
+#define LWIP_CHKSUM_ALGORITHM       3
+#define LWIP_STATS                  0
+#define LWIP_STATS_DISPLAY          0
+
+#endif //PICO_PLC_LWIPOPTS_H
@@ -1,6 +1,9 @@
-﻿#include "pico/stdlib.h"
+﻿#include <cstdio>
+#include "pico/stdlib.h"
 #include "pico/cyw43_arch.h"
 #include "dac7562-driver/dac7562.h"
+#include "plc-runtime/adc_sampler.h"
+#include "plc-runtime/scan_engine.h"
 
 #include "pico-utils/analog_utils.h"
 
@@ -10,10 +13,18 @@
 #define DAC_CLR_PIN  20
 #define DAC_LDAC_PIN 21
 
+#define SCAN_PERIOD_US   1000
+#define SCAN_WATCHDOG_MS 100
+
 
 int main() {
+    stdio_init_all();
     cyw43_arch_init();
 
+    if (ScanEngine::was_watchdog_reset()) {
+        printf("Restarted by the scan watchdog\n");
+    }
+
     DAC7562 dac(spi0,
                 DAC_CS_PIN,
                 DAC_SCK_PIN,
@@ -22,8 +33,25 @@ int main() {
                 DAC_LDAC_PIN);
 
     dac.begin();
-    dac.setA(2.5);
 
-    cyw43_arch_deinit();
-    return 0;
+    static AdcSampler sampler;  // DMA buffers, too big for the main stack
+
+    ScanEngine scan(SCAN_PERIOD_US);
+    scan.bind_sampler(&sampler);
+    scan.bind_adc(0);
+    scan.bind_dac(&dac);
+    scan.enable_watchdog(SCAN_WATCHDOG_MS);
+
+    // 0-10 V input on ADC0 follows to DAC output A
+    scan.set_program([](scan_image_t& image) {
+        uint32_t raw = image.adc[0] > ADC_VAL_3V0 ? ADC_VAL_3V0 : image.adc[0];
+        image.dac[0] = (uint16_t)(raw * 4095 / ADC_VAL_3V0);
+    });
+    sampler.start();
+    scan.start();
+
+    while (true) {
+        sleep_ms(5000);
+        scan.dump_stats();
+    }
 }
\ No newline at end of file
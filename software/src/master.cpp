@@ -61,13 +61,18 @@ int main() {
             sleep_ms(1); // 1ms polling interval
         }
         
-        printf("  Master Stats - Messages: %u, Timeouts: %u, CRC Errors: %u\n\n",
-               master.get_bus_message_count(),
-               master.get_slave_no_response_count(),
-               master.get_bus_communication_error_count());
+        printf("  Master Stats - Messages: %lu, Timeouts: %lu, CRC Errors: %lu\n\n",
+               (unsigned long)master.get_bus_message_count(),
+               (unsigned long)master.get_slave_no_response_count(),
+               (unsigned long)master.get_bus_communication_error_count());
         
         // Move to next request type
         request_type = (request_type + 1) % 3;
+        
+        // Full latency/bus-utilization report once per request cycle
+        if (request_type == 0) {
+            master.dump_telemetry();
+        }
 
         for (int i = 0; i < 3000; i++) {
             master.process_tx_queue();
@@ -0,0 +1,19 @@
+﻿#include "pico/stdlib.h"
+
+#include "defines.h"
+#include "pico-modbus/md_passthrough.h"
+
+// USB CDC <-> RS-485 passthrough for PC tools (see md_passthrough.h for the record format).
+// stdio is the data channel here: nothing else may print.
+int main() {
+    stdio_init_all();
+
+    gpio_set_function(16, GPIO_FUNC_UART); // TX
+    gpio_set_function(17, GPIO_FUNC_UART); // RX
+
+    ModbusPassthrough passthrough(MD_UART, MD_BAUDRATE, RS485_DE_PIN, RS485_RE_PIN, parity);
+
+    while (true) {
+        passthrough.process();
+    }
+}
\ No newline at end of file
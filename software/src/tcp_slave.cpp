@@ -0,0 +1,68 @@
+#include <cstdio>
+#include "pico/stdlib.h"
+#include "pico/cyw43_arch.h"
+#include "lwip/netif.h"
+
+#include "defines.h"
+#include "pico-modbus/md_slave.h"
+#include "pico-modbus/md_tcp_server.h"
+
+// WIFI_SSID / WIFI_PASSWORD come from the environment at configure time
+#ifndef WIFI_SSID
+#define WIFI_SSID ""
+#define WIFI_PASSWORD ""
+#endif
+
+#define WIFI_CONNECT_TIMEOUT_MS 30000
+
+int main() {
+    stdio_init_all();
+    sleep_ms(2000); // Wait for USB serial
+
+    if (cyw43_arch_init() != 0) {
+        printf("WiFi init failed\n");
+        return 1;
+    }
+    cyw43_arch_enable_sta_mode();
+
+    gpio_set_function(16, GPIO_FUNC_UART); // TX
+    gpio_set_function(17, GPIO_FUNC_UART); // RX
+
+    // The same registers answer on RS-485 and on Modbus TCP port 502
+    ModbusSlave slave(SLAVE_ADDRESS, MD_UART, MD_BAUDRATE, RS485_DE_PIN, RS485_RE_PIN, parity);
+    slave.enable_holding_registers(16);
+    slave.enable_coils(16);
+
+    ModbusTcpServer tcp(slave);
+    ModbusTcpListener listener(tcp);
+
+    while (cyw43_arch_wifi_connect_timeout_ms(WIFI_SSID, WIFI_PASSWORD, CYW43_AUTH_WPA2_AES_PSK,
+                                              WIFI_CONNECT_TIMEOUT_MS) != 0) {
+        printf("WiFi connect to \"%s\" failed, retrying\n", WIFI_SSID);
+    }
+    printf("Connected, address %s\n", ip4addr_ntoa(netif_ip4_addr(netif_list)));
+
+    if (!listener.start()) {
+        printf("Modbus TCP listen failed\n");
+        return 1;
+    }
+
+    uint32_t loop_count = 0;
+    uint16_t counter = 0;
+
+    while (true) {
+        cyw43_arch_poll();      // lwIP callbacks, and with them the TCP requests
+        listener.process();
+        slave.process_tx_queue();
+
+        if (++loop_count >= 1000) {
+            loop_count = 0;
+            counter++;
+            slave.set_holding_register(0, counter);
+            printf("TCP clients: %u, requests: %lu\n", listener.get_connection_count(),
+                   (unsigned long)tcp.get_stats().requests);
+        }
+
+        sleep_ms(1);
+    }
+}
@@ -0,0 +1,332 @@
+// Host benchmark for the fixed-point function blocks (lib/plc-runtime/function_blocks.h)
+// against the usual float, one-struct-per-instance implementation. Builds with any
+// host C++17 compiler, no Pico SDK needed:
+//
+//   cd software/tools/fb-bench
+//   g++ -std=c++17 -O2 -I../../lib -o fb_bench fb_bench.cpp ../../lib/plc-runtime/function_blocks.cpp
+//
+//   fb_bench [instances] [scans]       defaults 256 and 20000
+//
+// Both sides get the same inputs every scan and their outputs are compared, so the
+// run doubles as a check of the fixed-point math. Times are host times: the ratio,
+// not the absolute numbers, is what carries over to the RP2350 (single-precision FPU,
+// no SIMD, a few KB of data per bank either way).
+//
+// Measured float/fixed ratios (x86 host, -O2, three runs each at 256 and 64 instances):
+//   CTU 5.2-12.5x, RS 4.0-7.1x, SCALE 2.6-3.5x, RAMP 1.2-2.1x, TON 1.0-1.5x
+// The gain is in the bit-packed counters and latches; RAMP gains little and TON only
+// breaks even, and on some hosts RAMP stays at 1.2-1.5x. The fixed-point case for those
+// two is the drift (max error 0.00002 fixed against 0.01 float), not speed.
+#include "plc-runtime/function_blocks.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#define SCAN_DT_US 1000
+
+// Float reference, as projects write it today
+
+struct float_timer_t {
+    bool in;
+    bool last_in;
+    bool q;
+    float preset_s;
+    float elapsed_s;
+};
+
+struct float_counter_t {
+    bool cu;
+    bool last_cu;
+    bool reset;
+    bool q;
+    uint32_t value;
+    uint32_t preset;
+};
+
+struct float_scale_t {
+    float in;
+    float out;
+    float in_low, in_high, out_low, out_high;
+};
+
+struct float_ramp_t {
+    float target;
+    float out;
+    float rate_up, rate_down;
+};
+
+static void float_ton(std::vector<float_timer_t>& timers, float dt) {
+    for (float_timer_t& t : timers) {
+        t.elapsed_s = (t.in && t.last_in) ? std::fmin(t.elapsed_s + dt, t.preset_s) : 0.0f;
+        t.q = t.in && t.elapsed_s >= t.preset_s;
+        t.last_in = t.in;
+    }
+}
+
+static void float_ctu(std::vector<float_counter_t>& counters) {
+    for (float_counter_t& c : counters) {
+        if (c.reset) {
+            c.value = 0;
+        } else if (c.cu && !c.last_cu) {
+            c.value++;
+        }
+        c.last_cu = c.cu;
+        c.q = c.value >= c.preset;
+    }
+}
+
+static void float_rs(std::vector<uint8_t>& s, std::vector<uint8_t>& r, std::vector<uint8_t>& q) {
+    for (size_t i = 0; i < q.size(); i++) {
+        q[i] = !r[i] && (s[i] || q[i]);
+    }
+}
+
+static void float_scale(std::vector<float_scale_t>& scales) {
+    for (float_scale_t& s : scales) {
+        float y = s.out_low + (s.in - s.in_low) * (s.out_high - s.out_low) / (s.in_high - s.in_low);
+        s.out = std::fmin(std::fmax(y, std::fmin(s.out_low, s.out_high)), std::fmax(s.out_low, s.out_high));
+    }
+}
+
+static void float_ramp(std::vector<float_ramp_t>& ramps, float dt) {
+    for (float_ramp_t& r : ramps) {
+        if (r.out < r.target) {
+            r.out = std::fmin(r.out + r.rate_up * dt, r.target);
+        } else if (r.out > r.target) {
+            r.out = std::fmax(r.out - r.rate_down * dt, r.target);
+        }
+    }
+}
+
+// Timing
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct timing_t {
+    double fixed_ns;
+    double float_ns;
+};
+
+static void add_time(double& total, bench_clock::time_point start) {
+    total += std::chrono::duration<double, std::nano>(bench_clock::now() - start).count();
+}
+
+static void report(const char* name, const timing_t& timing, uint32_t instances, uint32_t scans, uint32_t mismatches) {
+    double updates = (double)instances * scans;
+    printf("%-6s %8.2f ns fixed %8.2f ns float  x%.2f  %s\n", name,
+           timing.fixed_ns / updates, timing.float_ns / updates, timing.float_ns / timing.fixed_ns,
+           mismatches == 0 ? "outputs match" : "OUTPUTS DIFFER");
+    if (mismatches != 0) {
+        printf("       %u mismatches\n", mismatches);
+    }
+}
+
+// Pseudo-random inputs, identical for both sides
+static uint32_t next_random(uint32_t& state) {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
+
+int main(int argc, char** argv) {
+    uint32_t instances = argc > 1 ? (uint32_t)atoi(argv[1]) : 256;
+    uint32_t scans = argc > 2 ? (uint32_t)atoi(argv[2]) : 20000;
+    if (instances == 0 || instances > FB_MAX_TIMERS || scans == 0) {
+        fprintf(stderr, "usage: %s [instances 1-%d] [scans]\n", argv[0], FB_MAX_TIMERS);
+        return 2;
+    }
+    uint32_t analog_instances = instances < FB_MAX_SCALES ? instances : FB_MAX_SCALES;
+    const float dt = SCAN_DT_US / 1e6f;
+    uint32_t failures = 0;
+    printf("%u instances (%u analog), %u scans of %u us, per instance update:\n",
+           instances, analog_instances, scans, SCAN_DT_US);
+
+    // TON: inputs toggle rarely, as real plant signals do; every 8th has PT = 0
+    {
+        std::unique_ptr<TimerBank> bank(new TimerBank(TimerMode::ON_DELAY));
+        std::vector<float_timer_t> timers(instances);
+        for (uint32_t i = 0; i < instances; i++) {
+            uint32_t preset_ms = i % 8 == 0 ? 0 : 5 + i % 50;
+            bank->add(preset_ms);
+            timers[i] = { false, false, false, preset_ms / 1000.0f, 0.0f };
+        }
+        timing_t timing = {};
+        uint32_t mismatches = 0, seed = 1;
+        for (uint32_t scan = 0; scan < scans; scan++) {
+            for (uint32_t i = 0; i < instances; i++) {
+                if (next_random(seed) % 64 == 0) {
+                    bool value = !timers[i].in;
+                    timers[i].in = value;
+                    bank->set_input(i, value);
+                }
+            }
+            auto start = bench_clock::now();
+            bank->update(SCAN_DT_US);
+            add_time(timing.fixed_ns, start);
+            start = bench_clock::now();
+            float_ton(timers, dt);
+            add_time(timing.float_ns, start);
+            for (uint32_t i = 0; i < instances; i++) {
+                // Float accumulation may land a scan late; count only outright disagreements.
+                // PT = 0 follows in within the same scan on both sides.
+                if (bank->get_output(i) != timers[i].q &&
+                    (timers[i].preset_s == 0 || timers[i].elapsed_s < timers[i].preset_s - 2 * dt)) {
+                    mismatches++;
+                }
+            }
+        }
+        report("TON", timing, instances, scans, mismatches);
+        failures += mismatches;
+    }
+
+    // CTU
+    {
+        std::unique_ptr<CounterBank> bank(new CounterBank());
+        std::vector<float_counter_t> counters(instances);
+        for (uint32_t i = 0; i < instances; i++) {
+            bank->add(10 + i % 20);
+            counters[i] = { false, false, false, false, 0, 10 + i % 20 };
+        }
+        timing_t timing = {};
+        uint32_t mismatches = 0, seed = 2;
+        for (uint32_t scan = 0; scan < scans; scan++) {
+            for (uint32_t i = 0; i < instances; i++) {
+                uint32_t r = next_random(seed) % 256;
+                if (r < 8) {
+                    counters[i].cu = !counters[i].cu;
+                    bank->set_input(i, counters[i].cu);
+                }
+                counters[i].reset = r == 255;
+                bank->set_reset(i, r == 255);
+            }
+            auto start = bench_clock::now();
+            bank->update();
+            add_time(timing.fixed_ns, start);
+            start = bench_clock::now();
+            float_ctu(counters);
+            add_time(timing.float_ns, start);
+            for (uint32_t i = 0; i < instances; i++) {
+                if (bank->get_output(i) != counters[i].q || bank->get_count(i) != counters[i].value) {
+                    mismatches++;
+                }
+            }
+        }
+        report("CTU", timing, instances, scans, mismatches);
+        failures += mismatches;
+    }
+
+    // RS
+    {
+        std::unique_ptr<LatchBank> bank(new LatchBank());
+        std::vector<uint8_t> s(instances), r(instances), q(instances);
+        for (uint32_t i = 0; i < instances; i++) {
+            bank->add(LatchMode::RS);
+        }
+        timing_t timing = {};
+        uint32_t mismatches = 0, seed = 3;
+        for (uint32_t scan = 0; scan < scans; scan++) {
+            for (uint32_t i = 0; i < instances; i++) {
+                uint32_t value = next_random(seed) % 32;
+                s[i] = value == 0 || value == 1;
+                r[i] = value == 1 || value == 2;
+                bank->set_inputs(i, s[i], r[i]);
+            }
+            auto start = bench_clock::now();
+            bank->update();
+            add_time(timing.fixed_ns, start);
+            start = bench_clock::now();
+            float_rs(s, r, q);
+            add_time(timing.float_ns, start);
+            for (uint32_t i = 0; i < instances; i++) {
+                if (bank->get_output(i) != (q[i] != 0)) {
+                    mismatches++;
+                }
+            }
+        }
+        report("RS", timing, instances, scans, mismatches);
+        failures += mismatches;
+    }
+
+    // SCALE: 12-bit ADC codes to 0-10 bar, 4-20 mA style offset on half of them
+    {
+        std::unique_ptr<ScaleBank> bank(new ScaleBank());
+        std::vector<float_scale_t> scales(analog_instances);
+        for (uint32_t i = 0; i < analog_instances; i++) {
+            float in_low = (i % 2) ? 745.0f : 0.0f;
+            bank->add(Q16_FROM_FLOAT(in_low), q16_from_int(3723), 0, q16_from_int(10));
+            scales[i] = { 0.0f, 0.0f, in_low, 3723.0f, 0.0f, 10.0f };
+        }
+        timing_t timing = {};
+        uint32_t mismatches = 0, seed = 4;
+        for (uint32_t scan = 0; scan < scans; scan++) {
+            for (uint32_t i = 0; i < analog_instances; i++) {
+                uint32_t code = next_random(seed) % 4096;
+                bank->set_input(i, q16_from_int(code));
+                scales[i].in = (float)code;
+            }
+            auto start = bench_clock::now();
+            bank->update();
+            add_time(timing.fixed_ns, start);
+            start = bench_clock::now();
+            float_scale(scales);
+            add_time(timing.float_ns, start);
+            for (uint32_t i = 0; i < analog_instances; i++) {
+                if (std::fabs(q16_to_float(bank->get_output(i)) - scales[i].out) > 1e-4f) {
+                    mismatches++;
+                }
+            }
+        }
+        report("SCALE", timing, analog_instances, scans, mismatches);
+        failures += mismatches;
+    }
+
+    // RAMP: new targets now and then, output compared at the end of each scan
+    {
+        std::unique_ptr<RampBank> bank(new RampBank());
+        std::vector<float_ramp_t> ramps(analog_instances);
+        std::vector<double> exact(analog_instances, 0.0);   // Reference for both sides
+        for (uint32_t i = 0; i < analog_instances; i++) {
+            float up = 1.0f + i % 7, down = 2.0f + i % 5;
+            bank->add(Q16_FROM_FLOAT(up), Q16_FROM_FLOAT(down));
+            ramps[i] = { 0.0f, 0.0f, up, down };
+        }
+        timing_t timing = {};
+        uint32_t mismatches = 0, seed = 5;
+        double fixed_error = 0, float_error = 0;
+        for (uint32_t scan = 0; scan < scans; scan++) {
+            for (uint32_t i = 0; i < analog_instances; i++) {
+                if (next_random(seed) % 2000 == 0) {
+                    float target = (float)(next_random(seed) % 200) - 100.0f;
+                    bank->set_target(i, q16_from_int((int32_t)target));
+                    ramps[i].target = target;
+                }
+            }
+            auto start = bench_clock::now();
+            bank->update(SCAN_DT_US);
+            add_time(timing.fixed_ns, start);
+            start = bench_clock::now();
+            float_ramp(ramps, dt);
+            add_time(timing.float_ns, start);
+            for (uint32_t i = 0; i < analog_instances; i++) {
+                const float_ramp_t& r = ramps[i];
+                double step = (exact[i] < r.target ? r.rate_up : r.rate_down) * (SCAN_DT_US / 1e6);
+                exact[i] = exact[i] < r.target ? std::fmin(exact[i] + step, r.target)
+                                               : std::fmax(exact[i] - step, r.target);
+                double error = std::fabs(q16_to_float(bank->get_output(i)) - exact[i]);
+                fixed_error = std::fmax(fixed_error, error);
+                float_error = std::fmax(float_error, std::fabs(r.out - exact[i]));
+                // One Q16.16 step of rounding per scan at most, no accumulated drift
+                if (error > 1e-3) {
+                    mismatches++;
+                }
+            }
+        }
+        report("RAMP", timing, analog_instances, scans, mismatches);
+        printf("       max error against double: %.6f fixed, %.6f float\n", fixed_error, float_error);
+        failures += mismatches;
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,355 @@
+// Host benchmark and accuracy check for the analog filter chain (lib/plc-runtime/dsp_filter.h)
+// against per-sample float filters as application code writes them. Builds with any host
+// C++17 compiler, no Pico SDK needed:
+//
+//   cd software/tools/filter-bench
+//   g++ -std=c++17 -O2 -I../../lib -o filter_bench filter_bench.cpp ../../lib/plc-runtime/dsp_filter.cpp
+//
+//   filter_bench [samples] [block]     defaults 200000 and 32
+//
+// Every stage is checked against a double-precision reference on the same input (noise,
+// spikes and full-scale steps over the 16-bit range):
+//   moving average  within 0.57 codes of the exact mean (rounding + reciprocal)
+//   IIR             within 1 code of the exact recursion
+//   median          equal to the sorted-window median
+//   deadband        equal
+// and block processing must give the same output as one sample at a time. The host
+// build runs the plain C lane operations; they are bit-identical to the SSUB16/SEL and
+// SSAT paths the target uses. Times are host times: compare ratios, not absolutes.
+#include "plc-runtime/dsp_filter.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Insertion sort, for median windows of a few samples
+template <typename T>
+static void sort_small(T* values, uint32_t count) {
+    for (uint32_t i = 1; i < count; i++) {
+        T value = values[i];
+        uint32_t j = i;
+        for (; j > 0 && values[j - 1] > value; j--) {
+            values[j] = values[j - 1];
+        }
+        values[j] = value;
+    }
+}
+
+// Float reference, as projects write it today: one sample at a time
+
+struct float_average_t {
+    std::vector<float> window;
+    uint32_t pos;
+    float sum;
+    bool primed;
+
+    float run(float x) {
+        if (!primed) {
+            std::fill(window.begin(), window.end(), x);
+            sum = x * window.size();
+            primed = true;
+        }
+        sum += x - window[pos];
+        window[pos] = x;
+        pos = (pos + 1) % window.size();
+        return sum / window.size();
+    }
+};
+
+struct float_iir_t {
+    float alpha;
+    float y;
+    bool primed;
+
+    float run(float x) {
+        if (!primed) {
+            y = x;
+            primed = true;
+        }
+        y += alpha * (x - y);
+        return y;
+    }
+};
+
+struct float_median_t {
+    std::vector<float> window;
+    bool primed;
+
+    float run(float x) {
+        if (!primed) {
+            std::fill(window.begin(), window.end(), x);
+            primed = true;
+        }
+        std::rotate(window.begin(), window.begin() + 1, window.end());
+        window.back() = x;
+        float sorted[5];
+        std::copy(window.begin(), window.end(), sorted);
+        sort_small(sorted, window.size());
+        return sorted[window.size() / 2];
+    }
+};
+
+struct float_deadband_t {
+    float band;
+    float held;
+    bool primed;
+
+    float run(float x) {
+        if (!primed) {
+            held = x;
+            primed = true;
+        }
+        if (std::fabs(x - held) > band) {
+            held = x;
+        }
+        return held;
+    }
+};
+
+// Test signal
+
+static uint32_t next_random(uint32_t& state) {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
+
+static std::vector<uint16_t> make_signal(uint32_t count) {
+    std::vector<uint16_t> signal(count);
+    uint32_t random = 12345;
+    int32_t level = 20000;
+    for (uint32_t i = 0; i < count; i++) {
+        if (i % 5000 == 0) {
+            level = (i / 5000) % 3 == 2 ? 65535 : (int32_t)(next_random(random) % 65536);
+        }
+        int32_t value = level + (int32_t)(next_random(random) % 401) - 200;
+        if (next_random(random) % 100 == 0) {
+            value += (next_random(random) & 1) ? 9000 : -9000;     // Spike
+        }
+        signal[i] = (uint16_t)std::min(65535, std::max(0, value));
+    }
+    return signal;
+}
+
+// Timing
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsed_ns(bench_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count();
+}
+
+static std::vector<uint16_t> run_fixed(const filter_stage_config_t* stages, uint8_t count,
+                                       const std::vector<uint16_t>& input, uint32_t block, double& ns) {
+    FilterChain chain;
+    chain.configure(stages, count);
+    std::vector<uint16_t> output = input;
+    auto start = bench_clock::now();
+    for (uint32_t i = 0; i < output.size(); i += block) {
+        chain.process(&output[i], std::min<uint32_t>(block, output.size() - i));
+    }
+    ns = elapsed_ns(start);
+    return output;
+}
+
+static uint32_t check_blocks(const filter_stage_config_t* stages, uint8_t count,
+                             const std::vector<uint16_t>& input, const std::vector<uint16_t>& blocked) {
+    FilterChain chain;
+    chain.configure(stages, count);
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < input.size(); i++) {
+        if (chain.process(input[i]) != blocked[i]) {
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+static void report(const char* name, uint32_t samples, double fixed_ns, double float_ns,
+                   double max_error, uint32_t mismatches, uint32_t block_mismatches) {
+    printf("%-8s %7.2f ns fixed %7.2f ns float  x%.2f  max error %.3f  %s\n", name,
+           fixed_ns / samples, float_ns / samples, float_ns / fixed_ns, max_error,
+           mismatches + block_mismatches == 0 ? "ok" : "FAILED");
+    if (mismatches != 0) {
+        printf("         %u samples outside the reference tolerance\n", mismatches);
+    }
+    if (block_mismatches != 0) {
+        printf("         %u samples differ between block and single-sample runs\n", block_mismatches);
+    }
+}
+
+int main(int argc, char** argv) {
+    uint32_t samples = argc > 1 ? (uint32_t)atoi(argv[1]) : 200000;
+    uint32_t block = argc > 2 ? (uint32_t)atoi(argv[2]) : 32;
+    if (samples == 0 || block == 0) {
+        fprintf(stderr, "usage: %s [samples] [block]\n", argv[0]);
+        return 2;
+    }
+    std::vector<uint16_t> input = make_signal(samples);
+    printf("%u samples, blocks of %u, per sample:\n", samples, block);
+    uint32_t failures = 0;
+
+    // Moving average
+    {
+        const uint16_t window = 16;
+        filter_stage_config_t stage = {FilterType::MOVING_AVERAGE, window};
+        double fixed_ns;
+        std::vector<uint16_t> output = run_fixed(&stage, 1, input, block, fixed_ns);
+
+        float_average_t reference = {std::vector<float>(window), 0, 0.0f, false};
+        std::vector<float> float_output(samples);
+        auto start = bench_clock::now();
+        for (uint32_t i = 0; i < samples; i++) {
+            float_output[i] = reference.run(input[i]);
+        }
+        double float_ns = elapsed_ns(start);
+
+        double max_error = 0;
+        uint32_t mismatches = 0;
+        for (uint32_t i = 0; i < samples; i++) {
+            double sum = 0;
+            for (uint32_t k = 0; k < window; k++) {
+                sum += input[i >= k ? i - k : 0];
+            }
+            double error = std::fabs(output[i] - sum / window);
+            max_error = std::max(max_error, error);
+            if (error > 0.57) {
+                mismatches++;
+            }
+        }
+        uint32_t block_mismatches = check_blocks(&stage, 1, input, output);
+        report("AVG16", samples, fixed_ns, float_ns, max_error, mismatches, block_mismatches);
+        failures += mismatches + block_mismatches;
+    }
+
+    // First-order IIR
+    {
+        const uint16_t alpha = 655;     // 0.02
+        filter_stage_config_t stage = {FilterType::IIR, alpha};
+        double fixed_ns;
+        std::vector<uint16_t> output = run_fixed(&stage, 1, input, block, fixed_ns);
+
+        float_iir_t reference = {alpha / 32768.0f, 0.0f, false};
+        std::vector<float> float_output(samples);
+        auto start = bench_clock::now();
+        for (uint32_t i = 0; i < samples; i++) {
+            float_output[i] = reference.run(input[i]);
+        }
+        double float_ns = elapsed_ns(start);
+
+        double max_error = 0, float_error = 0;
+        uint32_t mismatches = 0;
+        double y = input[0];
+        for (uint32_t i = 0; i < samples; i++) {
+            y += (alpha / 32768.0) * (input[i] - y);
+            double error = std::fabs(output[i] - y);
+            max_error = std::max(max_error, error);
+            float_error = std::max(float_error, std::fabs(float_output[i] - y));
+            if (error > 1.0) {
+                mismatches++;
+            }
+        }
+        uint32_t block_mismatches = check_blocks(&stage, 1, input, output);
+        report("IIR", samples, fixed_ns, float_ns, max_error, mismatches, block_mismatches);
+        printf("         float max error %.3f\n", float_error);
+        failures += mismatches + block_mismatches;
+    }
+
+    // Median of 3 and 5
+    for (uint16_t taps : {3, 5}) {
+        filter_stage_config_t stage = {FilterType::MEDIAN, taps};
+        double fixed_ns;
+        std::vector<uint16_t> output = run_fixed(&stage, 1, input, block, fixed_ns);
+
+        float_median_t reference = {std::vector<float>(taps), false};
+        std::vector<float> float_output(samples);
+        auto start = bench_clock::now();
+        for (uint32_t i = 0; i < samples; i++) {
+            float_output[i] = reference.run(input[i]);
+        }
+        double float_ns = elapsed_ns(start);
+
+        uint32_t mismatches = 0;
+        for (uint32_t i = 0; i < samples; i++) {
+            uint16_t window[5];
+            for (uint32_t k = 0; k < taps; k++) {
+                window[k] = input[i >= k ? i - k : 0];
+            }
+            sort_small(window, taps);
+            if (output[i] != window[taps / 2]) {
+                mismatches++;
+            }
+        }
+        uint32_t block_mismatches = check_blocks(&stage, 1, input, output);
+        report(taps == 3 ? "MEDIAN3" : "MEDIAN5", samples, fixed_ns, float_ns, 0, mismatches, block_mismatches);
+        failures += mismatches + block_mismatches;
+    }
+
+    // Deadband
+    {
+        const uint16_t band = 150;
+        filter_stage_config_t stage = {FilterType::DEADBAND, band};
+        double fixed_ns;
+        std::vector<uint16_t> output = run_fixed(&stage, 1, input, block, fixed_ns);
+
+        float_deadband_t reference = {(float)band, 0.0f, false};
+        std::vector<float> float_output(samples);
+        auto start = bench_clock::now();
+        for (uint32_t i = 0; i < samples; i++) {
+            float_output[i] = reference.run(input[i]);
+        }
+        double float_ns = elapsed_ns(start);
+
+        uint32_t mismatches = 0;
+        int32_t held = input[0];
+        for (uint32_t i = 0; i < samples; i++) {
+            if (std::abs(input[i] - held) > band) {
+                held = input[i];
+            }
+            if (output[i] != held) {
+                mismatches++;
+            }
+        }
+        uint32_t block_mismatches = check_blocks(&stage, 1, input, output);
+        report("DEADBAND", samples, fixed_ns, float_ns, 0, mismatches, block_mismatches);
+        failures += mismatches + block_mismatches;
+    }
+
+    // Typical front-end chain: spike rejection, smoothing, display deadband
+    {
+        filter_stage_config_t stages[] = {
+            {FilterType::MEDIAN, 5}, {FilterType::MOVING_AVERAGE, 8},
+            {FilterType::IIR, 3277}, {FilterType::DEADBAND, 4}
+        };
+        double fixed_ns;
+        std::vector<uint16_t> output = run_fixed(stages, 4, input, block, fixed_ns);
+
+        float_median_t median = {std::vector<float>(5), false};
+        float_average_t average = {std::vector<float>(8), 0, 0.0f, false};
+        float_iir_t iir = {3277 / 32768.0f, 0.0f, false};
+        float_deadband_t deadband = {4.0f, 0.0f, false};
+        std::vector<float> float_output(samples);
+        auto start = bench_clock::now();
+        for (uint32_t i = 0; i < samples; i++) {
+            float_output[i] = deadband.run(iir.run(average.run(median.run(input[i]))));
+        }
+        double float_ns = elapsed_ns(start);
+
+        // Rounding between stages is the only difference, held within the deadband
+        double max_error = 0;
+        uint32_t mismatches = 0;
+        for (uint32_t i = 0; i < samples; i++) {
+            double error = std::fabs(output[i] - float_output[i]);
+            max_error = std::max(max_error, error);
+            if (error > 4.0 + 2.0) {
+                mismatches++;
+            }
+        }
+        uint32_t block_mismatches = check_blocks(stages, 4, input, output);
+        report("CHAIN", samples, fixed_ns, float_ns, max_error, mismatches, block_mismatches);
+        failures += mismatches + block_mismatches;
+    }
+
+    return failures == 0 ? 0 : 1;
+}
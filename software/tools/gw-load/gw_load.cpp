@@ -0,0 +1,392 @@
+// Host load test for the Modbus TCP -> RTU gateway (lib/pico-modbus/common/md_gateway.h):
+// localhost socket clients against a ModbusTcpGateway whose downstream bus is simulated
+// with RTU timing. Builds on Linux with any C++17 compiler, no Pico SDK needed:
+//
+//   cd software/tools/gw-load
+//   g++ -std=c++17 -O2 -pthread -I../../lib/pico-modbus -o gw_load gw_load.cpp
+//       ../../lib/pico-modbus/common/md_gateway.cpp ../../lib/pico-modbus/common/md_tcp.cpp
+//       ../../lib/pico-modbus/common/md_histogram.cpp     (one command line)
+//
+//   gw_load [--shared | --writes] [--depth N] [--seconds S] [--baud B] [--port P]
+//
+// Every client pipelines "depth" FC03 reads of 8 registers and waits for the replies
+// before sending the next batch. By default each client reads its own unit and register
+// block, so every request is a bus transaction and the per-client rates show the
+// round-robin fairness; --shared makes all clients read the same block, which measures
+// read coalescing instead. --writes is --shared where every other batch starts with an
+// FC06 write of a new value to the client's own register in that block: the reads behind
+// it must return that value, so a read coalesced across the client's own write shows as
+// an error. Replies are checked against the simulated slave's data.
+// "client share" is the slowest client's answered requests over the fastest one's.
+#include "common/md_gateway.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define READ_REGISTERS 8
+#define SLAVE_TURNAROUND_US 1000        // Request end -> reply start at the RTU slave
+#define MAX_DEPTH 4                     // Within MODBUS_GATEWAY_CLIENT_SHARE
+#define WRITE_REPLY_SIZE 12             // FC06 echo
+
+enum class Scenario {
+    PER_CLIENT,
+    SHARED,
+    WRITES
+};
+
+static uint64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Simulated slave register: depends on address and register, so misrouted replies show
+static uint16_t register_value(uint8_t address, uint16_t reg) {
+    return (uint16_t)(address * 1000 + reg);
+}
+
+// RTU bus at "baud", 8E1: T3.5 before each frame, request, slave turnaround, reply
+class SimulatedBus : public ModbusGatewayLink {
+private:
+    ModbusTcpGateway* gateway;
+    double char_us;
+    uint32_t gap_us;
+    bool busy;
+    uint32_t tag;
+    uint8_t address;
+    uint8_t function;
+    uint16_t start;
+    uint16_t count;             // Register count (FC03) or value (FC06)
+    uint64_t done_us;
+    std::map<uint32_t, uint16_t> written;   // (address << 16 | register) -> FC06 value
+
+    uint16_t read_register(uint8_t a, uint16_t reg) const {
+        auto it = written.find((uint32_t)a << 16 | reg);
+        return it != written.end() ? it->second : register_value(a, reg);
+    }
+
+public:
+    uint32_t transactions;
+
+    explicit SimulatedBus(uint32_t baud)
+        : gateway(nullptr), char_us(11e6 / baud), gap_us(baud > 19200 ? 1750 : (uint32_t)(3.5 * 11e6 / baud)),
+          busy(false), tag(0), address(0), function(0), start(0), count(0), done_us(0), transactions(0) {
+    }
+
+    void attach(ModbusTcpGateway& gw) { gateway = &gw; }
+
+    bool forward(uint32_t t, uint8_t a, const uint8_t* pdu, uint16_t length, uint32_t) override {
+        if (busy || length != 5 || (pdu[0] != 0x03 && pdu[0] != 0x06)) {
+            return false;
+        }
+        busy = true;
+        tag = t;
+        address = a;
+        function = pdu[0];
+        start = (pdu[1] << 8) | pdu[2];
+        count = (pdu[3] << 8) | pdu[4];
+        uint32_t request_chars = 1 + length + 2;
+        uint32_t reply_chars = function == 0x06 ? request_chars : 1 + 2 + 2 * count + 2;
+        done_us = now_us() + 2 * gap_us + SLAVE_TURNAROUND_US + (uint64_t)((request_chars + reply_chars) * char_us);
+        transactions++;
+        return true;
+    }
+
+    void poll() {
+        if (!busy || now_us() < done_us) {
+            return;
+        }
+        busy = false;
+        if (function == 0x06) {
+            written[(uint32_t)address << 16 | start] = count;
+            uint8_t echo[5] = { 0x06, (uint8_t)(start >> 8), (uint8_t)start, (uint8_t)(count >> 8), (uint8_t)count };
+            gateway->complete(tag, echo, sizeof(echo));
+            return;
+        }
+        uint8_t reply[2 + 2 * 125];
+        reply[0] = 0x03;
+        reply[1] = (uint8_t)(2 * count);
+        for (uint16_t i = 0; i < count; i++) {
+            uint16_t value = read_register(address, start + i);
+            reply[2 + 2 * i] = value >> 8;
+            reply[3 + 2 * i] = value & 0xFF;
+        }
+        gateway->complete(tag, reply, 2 + 2 * count);
+    }
+};
+
+struct client_result_t {
+    std::vector<uint32_t> latencies_us;     // Per batch
+    uint32_t requests;
+    uint32_t errors;
+};
+
+// One socket client: batches of "depth" pipelined reads of its own (or the shared) block,
+// with --writes every other batch led by a write of its own register
+static void run_client(int index, Scenario scenario, int depth, uint16_t port, std::atomic<bool>& stop,
+                       client_result_t& result) {
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(s, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        result.errors++;
+        close(s);
+        return;
+    }
+
+    bool shared = scenario != Scenario::PER_CLIENT;
+    uint8_t unit = shared ? 1 : (uint8_t)(1 + index);
+    uint16_t own_register = (uint16_t)index;          // --writes: within the shared block
+    uint16_t own_value = register_value(unit, own_register);
+    uint16_t transaction_id = 0;
+    uint32_t batch = 0;
+    const int reply_size = 9 + 2 * READ_REGISTERS;
+    while (!stop) {
+        uint8_t requests[(MAX_DEPTH + 1) * 12];
+        uint16_t starts[MAX_DEPTH];
+        int requests_length = 0;
+        int expected_length = depth * reply_size;
+        bool write = scenario == Scenario::WRITES && batch++ % (2 + index) == 0;
+        if (write) {
+            transaction_id++;
+            own_value = (uint16_t)(0x8000 | transaction_id);
+            uint8_t request[12] = { (uint8_t)(transaction_id >> 8), (uint8_t)transaction_id, 0, 0, 0, 6, unit,
+                                    0x06, (uint8_t)(own_register >> 8), (uint8_t)own_register,
+                                    (uint8_t)(own_value >> 8), (uint8_t)own_value };
+            memcpy(requests, request, 12);
+            requests_length = 12;
+            expected_length += WRITE_REPLY_SIZE;
+        }
+        for (int k = 0; k < depth; k++) {
+            transaction_id++;
+            starts[k] = shared ? 0 : (uint16_t)(index * 100 + (transaction_id % 4) * READ_REGISTERS);
+            uint8_t request[12] = { (uint8_t)(transaction_id >> 8), (uint8_t)transaction_id, 0, 0, 0, 6, unit,
+                                    0x03, (uint8_t)(starts[k] >> 8), (uint8_t)starts[k], 0, READ_REGISTERS };
+            memcpy(&requests[requests_length], request, 12);
+            requests_length += 12;
+        }
+        uint64_t sent_us = now_us();
+        if (send(s, requests, requests_length, 0) != requests_length) {
+            result.errors++;
+            break;
+        }
+
+        uint8_t replies[WRITE_REPLY_SIZE + MAX_DEPTH * reply_size];
+        int received = 0;
+        while (received < expected_length) {
+            ssize_t n = recv(s, replies + received, sizeof(replies) - received, 0);
+            if (n <= 0) {
+                result.errors++;
+                close(s);
+                return;
+            }
+            received += n;
+        }
+        result.latencies_us.push_back((uint32_t)(now_us() - sent_us));
+
+        // In order, each with its own transaction ID and the data of its block
+        const uint8_t* reply = replies;
+        if (write) {
+            uint16_t expected_id = (uint16_t)(transaction_id - depth);
+            if (((reply[0] << 8) | reply[1]) == expected_id && reply[7] == 0x06 && memcmp(&reply[8], &requests[8], 4) == 0) {
+                result.requests++;
+            } else {
+                result.errors++;
+            }
+            reply += WRITE_REPLY_SIZE;
+        }
+        for (int k = 0; k < depth; k++, reply += reply_size) {
+            uint16_t expected_id = (uint16_t)(transaction_id - depth + 1 + k);
+            bool ok = ((reply[0] << 8) | reply[1]) == expected_id && reply[6] == unit && reply[7] == 0x03;
+            for (int i = 0; ok && i < READ_REGISTERS; i++) {
+                uint16_t value = (reply[9 + 2 * i] << 8) | reply[10 + 2 * i];
+                if (scenario == Scenario::WRITES) {
+                    // The other clients' registers change under us, ours must show our write
+                    ok = starts[k] + i != own_register || value == own_value;
+                } else {
+                    ok = value == register_value(unit, starts[k] + i);
+                }
+            }
+            if (ok) {
+                result.requests++;
+            } else {
+                result.errors++;
+            }
+        }
+    }
+    close(s);
+}
+
+// Gateway side: non-blocking sockets polled in one loop with the bus, like the main loop
+static void run_level(int clients, Scenario scenario, int depth, double seconds, uint32_t baud, uint16_t port, int listener) {
+    SimulatedBus bus(baud);
+    ModbusTcpGateway gateway(bus, now_us);
+    bus.attach(gateway);
+
+    int fds[MODBUS_TCP_MAX_CLIENTS];
+    std::vector<uint8_t> held[MODBUS_TCP_MAX_CLIENTS];    // Bytes the gateway held back
+    gateway.set_transport(
+        [](int) { return (uint16_t)8192; },
+        [&](int client, const uint8_t* data, uint16_t length) {
+            return send(fds[client], data, length, MSG_NOSIGNAL) == length;
+        },
+        [&](int client) {
+            gateway.close_client(client);
+            close(fds[client]);
+        });
+
+    std::atomic<bool> stop(false);
+    std::vector<client_result_t> results(clients);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; i++) {
+        threads.emplace_back(run_client, i, scenario, depth, port, std::ref(stop), std::ref(results[i]));
+    }
+
+    auto feed = [&](int client, const uint8_t* data, size_t length) {
+        held[client].insert(held[client].end(), data, data + length);
+        int used = gateway.receive(client, held[client].data(), (uint16_t)held[client].size());
+        if (used < 0) {
+            gateway.close_client(client);
+            close(fds[client]);
+            return;
+        }
+        held[client].erase(held[client].begin(), held[client].begin() + used);
+    };
+
+    uint64_t start_us = now_us();
+    uint64_t end_us = start_us + (uint64_t)(seconds * 1e6);
+    uint32_t start_transactions = bus.transactions;
+    uint64_t drain_until = 0;
+    while (true) {
+        uint64_t now = now_us();
+        if (!stop && now >= end_us) {
+            stop = true;
+            drain_until = now + 200000;   // Let the last batches finish
+        }
+        if (stop && now >= drain_until) {
+            break;
+        }
+
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd >= 0) {
+            int client = gateway.open_client();
+            if (client < 0) {
+                close(fd);
+            } else {
+                int one = 1;
+                fcntl(fd, F_SETFL, O_NONBLOCK);
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                fds[client] = fd;
+                held[client].clear();
+            }
+        }
+        for (int client = 0; client < MODBUS_TCP_MAX_CLIENTS; client++) {
+            if (!gateway.is_client_open(client)) {
+                continue;
+            }
+            uint8_t buffer[1024];
+            ssize_t n = recv(fds[client], buffer, sizeof(buffer), 0);
+            if (n == 0) {
+                gateway.close_client(client);
+                close(fds[client]);
+            } else if (n > 0) {
+                feed(client, buffer, n);
+            } else if (!held[client].empty()) {
+                feed(client, nullptr, 0);   // Offer the held bytes again
+            }
+        }
+        bus.poll();
+        gateway.process();
+    }
+    double elapsed = (now_us() - start_us) / 1e6;
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    for (int client = 0; client < MODBUS_TCP_MAX_CLIENTS; client++) {
+        if (gateway.is_client_open(client)) {
+            gateway.close_client(client);
+            close(fds[client]);
+        }
+    }
+
+    std::vector<uint32_t> latencies;
+    uint32_t requests = 0, errors = 0, slowest = UINT32_MAX, fastest = 0;
+    for (const client_result_t& r : results) {
+        latencies.insert(latencies.end(), r.latencies_us.begin(), r.latencies_us.end());
+        requests += r.requests;
+        errors += r.errors;
+        slowest = std::min(slowest, r.requests);
+        fastest = std::max(fastest, r.requests);
+    }
+    std::sort(latencies.begin(), latencies.end());
+    uint32_t p50 = latencies.empty() ? 0 : latencies[latencies.size() / 2];
+    uint32_t p99 = latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100];
+    const modbus_gateway_stats_t& stats = gateway.get_gateway_stats();
+    printf("%d client%s  %6.0f req/s  bus %5.0f txn/s  batch p50 %5.1f ms  p99 %5.1f ms  "
+           "client share %.2f  coalesced %u  errors %u\n",
+           clients, clients == 1 ? " " : "s", requests / elapsed, (bus.transactions - start_transactions) / elapsed,
+           p50 / 1000.0, p99 / 1000.0, fastest ? (double)slowest / fastest : 0.0, stats.deduplicated, errors);
+}
+
+int main(int argc, char** argv) {
+    Scenario scenario = Scenario::PER_CLIENT;
+    int depth = 2;
+    double seconds = 2.0;
+    uint32_t baud = 115200;
+    uint16_t port = 15020;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--shared") == 0) {
+            scenario = Scenario::SHARED;
+        } else if (strcmp(argv[i], "--writes") == 0) {
+            scenario = Scenario::WRITES;
+        } else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+            depth = std::max(1, std::min(MAX_DEPTH, atoi(argv[++i])));
+        } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--baud") == 0 && i + 1 < argc) {
+            baud = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = (uint16_t)atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--shared | --writes] [--depth N] [--seconds S] [--baud B] [--port P]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, MODBUS_TCP_MAX_CLIENTS) != 0) {
+        perror("listen");
+        return 1;
+    }
+    fcntl(listener, F_SETFL, O_NONBLOCK);
+
+    const char* names[] = { "per-client blocks", "shared block", "shared block with writes" };
+    printf("%s, %d pipelined reads of %d registers per client, %u baud, %.1f s per level\n",
+           names[(int)scenario], depth, READ_REGISTERS, baud, seconds);
+    for (int clients = 1; clients <= MODBUS_TCP_MAX_CLIENTS; clients *= 2) {
+        run_level(clients, scenario, depth, seconds, baud, port, listener);
+    }
+    close(listener);
+    return 0;
+}
@@ -0,0 +1,137 @@
+// Host assembler for LogicVm programs (lib/plc-runtime/logic_asm.h for the syntax).
+// Builds with any host C++17 compiler, no Pico SDK needed:
+//
+//   cd software/tools/plc-asm
+//   g++ -std=c++17 -O2 -I../../lib -o plc_asm plc_asm.cpp ../../lib/plc-runtime/logic_vm.cpp ../../lib/plc-runtime/logic_asm.cpp
+//
+//   plc_asm program.il [program.bin]   assemble, verify, write the words (big-endian,
+//                                      as sent with the download function code)
+//   plc_asm -b program.il              also run the program on this host and report
+//                                      instructions per microsecond
+//
+// The verifier here sees a full 65536-entry image: addresses are checked against
+// the real image again when the program is committed on the device.
+#include "plc-runtime/logic_asm.h"
+#include "plc-runtime/logic_vm.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+static const char* error_name(LogicVmError error) {
+    switch (error) {
+        case LogicVmError::NONE:            return "none";
+        case LogicVmError::EMPTY:           return "empty program";
+        case LogicVmError::TOO_LONG:        return "too long";
+        case LogicVmError::BAD_OPCODE:      return "bad opcode";
+        case LogicVmError::BAD_OPERAND:     return "operand out of range";
+        case LogicVmError::BAD_JUMP:        return "jump not forward or past the end";
+        case LogicVmError::STACK_UNDERFLOW: return "stack underflow";
+        case LogicVmError::STACK_OVERFLOW:  return "stack overflow";
+        case LogicVmError::STACK_MISMATCH:  return "paths join with different stack depths";
+        case LogicVmError::NO_END:          return "runs past the last instruction";
+        case LogicVmError::OVER_BUDGET:     return "over the scan budget";
+        default:                            return "?";
+    }
+}
+
+// Same CRC as LogicProgramStore::program_crc()
+static uint16_t program_crc(const uint32_t* code, uint16_t count) {
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < count; i++) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            crc ^= (code[i] >> shift) & 0xFF;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+            }
+        }
+    }
+    return crc;
+}
+
+static bool read_file(const char* path, std::string& text) {
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    char buffer[4096];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        text.append(buffer, length);
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    bool bench = argc > 1 && strcmp(argv[1], "-b") == 0;
+    int first = bench ? 2 : 1;
+    if (argc - first < 1 || argc - first > 2) {
+        fprintf(stderr, "usage: %s [-b] program.il [program.bin]\n", argv[0]);
+        return 2;
+    }
+
+    std::string source;
+    if (!read_file(argv[first], source)) {
+        fprintf(stderr, "%s: cannot read\n", argv[first]);
+        return 1;
+    }
+
+    uint32_t code[LOGIC_VM_MAX_INSTRUCTIONS];
+    logic_asm_result_t result;
+    if (!logic_assemble(source.c_str(), code, LOGIC_VM_MAX_INSTRUCTIONS, result)) {
+        fprintf(stderr, "%s:%u: %s\n", argv[first], (unsigned)result.error_line, result.error);
+        return 1;
+    }
+
+    // Full-size image, so only the program structure is checked
+    static uint32_t coils[65536 / 32], discrete_inputs[65536 / 32];
+    static uint16_t holding_registers[65536], input_registers[65536];
+    logic_image_t image = { coils, 0xFFFF, discrete_inputs, 0xFFFF,
+                            holding_registers, 0xFFFF, input_registers, 0xFFFF };
+
+    std::unique_ptr<LogicVm> vm(new LogicVm());
+    vm->set_image(image);
+    vm->set_budget(0xFFFF);
+    uint16_t index = 0;
+    LogicVmError error = vm->load(code, result.count, &index);
+    if (error != LogicVmError::NONE) {
+        fprintf(stderr, "%s: instruction %u: %s\n", argv[first], index, error_name(error));
+        return 1;
+    }
+    printf("%u instructions, worst-case cost %u, CRC 0x%04X\n",
+           result.count, vm->get_program_cost(), program_crc(code, result.count));
+
+    if (argc - first == 2) {
+        FILE* file = fopen(argv[first + 1], "wb");
+        if (file == nullptr) {
+            fprintf(stderr, "%s: cannot write\n", argv[first + 1]);
+            return 1;
+        }
+        for (uint16_t i = 0; i < result.count; i++) {
+            uint8_t bytes[4] = { (uint8_t)(code[i] >> 24), (uint8_t)(code[i] >> 16),
+                                 (uint8_t)(code[i] >> 8), (uint8_t)code[i] };
+            fwrite(bytes, 1, sizeof(bytes), file);
+        }
+        fclose(file);
+    }
+
+    if (bench) {
+        auto clock = []() {
+            return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        };
+        uint32_t runs = 1000;
+        logic_vm_benchmark_t benchmark = vm->benchmark(clock, runs);
+        while (benchmark.elapsed_us < 200000 && runs < (1u << 30)) {
+            runs *= 4;
+            benchmark = vm->benchmark(clock, runs);
+        }
+        printf("%u runs, %llu instructions in %llu us: %.1f instructions/us, %.3f us per run\n",
+               benchmark.runs, (unsigned long long)benchmark.instructions,
+               (unsigned long long)benchmark.elapsed_us, benchmark.instructions_per_us(),
+               (double)benchmark.elapsed_us / benchmark.runs);
+    }
+    return 0;
+}
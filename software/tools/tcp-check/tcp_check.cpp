@@ -0,0 +1,283 @@
+// Host check of the Modbus TCP (MBAP) core (lib/pico-modbus/common/md_tcp.h): drives a
+// ModbusTcpServer through request/response pairs the way the lwIP listener does, with
+// whole, split and pipelined ADUs, send buffer backpressure and bad headers. Builds with
+// any host C++17 compiler, no Pico SDK needed:
+//
+//   cd software/tools/tcp-check
+//   g++ -std=c++17 -O2 -I../../lib/pico-modbus -o tcp_check tcp_check.cpp ../../lib/pico-modbus/common/md_tcp.cpp
+//
+//   tcp_check                          prints each case, exit code 1 on a failure
+#include "common/md_tcp.h"
+#include <cstdio>
+#include <vector>
+
+#define REGISTER_COUNT 16
+#define FC_NO_REPLY 0x41                // Answered with nothing, like a broadcast
+
+// FC03 over REGISTER_COUNT registers holding 0x1000 + address
+class RegisterHandler : public ModbusPduHandler {
+public:
+    uint32_t executed = 0;
+
+    uint16_t process_pdu(uint8_t unit_id, const uint8_t* pdu, uint16_t length, uint8_t* reply) override {
+        executed++;
+        reply[0] = unit_id;
+        if (pdu[0] == FC_NO_REPLY) {
+            return 0;
+        }
+        uint16_t start = (pdu[1] << 8) | pdu[2];
+        uint16_t count = (pdu[3] << 8) | pdu[4];
+        if (pdu[0] != 0x03 || length != 5) {
+            reply[1] = pdu[0] | 0x80;
+            reply[2] = 0x01;            // Illegal function
+            return 3;
+        }
+        if (count == 0 || start + count > REGISTER_COUNT) {
+            reply[1] = 0x83;
+            reply[2] = 0x02;            // Illegal data address
+            return 3;
+        }
+        reply[1] = 0x03;
+        reply[2] = (uint8_t)(2 * count);
+        for (uint16_t i = 0; i < count; i++) {
+            reply[3 + 2 * i] = 0x10;
+            reply[4 + 2 * i] = (uint8_t)(start + i);
+        }
+        return 3 + 2 * count;
+    }
+};
+
+// The transport side: collects replies, with a send buffer that fills up and sends
+// that can fail outright (lwIP ERR_MEM)
+struct Transport {
+    std::vector<std::vector<uint8_t>> replies;
+    uint32_t space = 4096;
+    bool fail = false;
+    int dropped = -1;
+
+    void attach(ModbusTcpServer& server) {
+        server.set_transport(
+            [this](int) { return (uint16_t)space; },
+            [this](int, const uint8_t* data, uint16_t length) {
+                if (fail || length > space) {
+                    return false;
+                }
+                space -= length;
+                replies.emplace_back(data, data + length);
+                return true;
+            },
+            [this](int client) { dropped = client; });
+    }
+};
+
+static int failures = 0;
+
+static void check(bool ok, const char* name) {
+    printf("%-48s %s\n", name, ok ? "ok" : "FAIL");
+    if (!ok) {
+        failures++;
+    }
+}
+
+static std::vector<uint8_t> read_request(uint16_t transaction_id, uint8_t unit, uint16_t start, uint16_t count) {
+    return { (uint8_t)(transaction_id >> 8), (uint8_t)transaction_id, 0, 0, 0, 6, unit,
+             0x03, (uint8_t)(start >> 8), (uint8_t)start, (uint8_t)(count >> 8), (uint8_t)count };
+}
+
+// The exact ADU the server must send for read_request()
+static std::vector<uint8_t> read_reply(uint16_t transaction_id, uint8_t unit, uint16_t start, uint16_t count) {
+    uint16_t length = 3 + 2 * count;
+    std::vector<uint8_t> adu = { (uint8_t)(transaction_id >> 8), (uint8_t)transaction_id, 0, 0,
+                                 (uint8_t)(length >> 8), (uint8_t)length, unit, 0x03, (uint8_t)(2 * count) };
+    for (uint16_t i = 0; i < count; i++) {
+        adu.push_back(0x10);
+        adu.push_back((uint8_t)(start + i));
+    }
+    return adu;
+}
+
+static std::vector<uint8_t> join(std::initializer_list<std::vector<uint8_t>> parts) {
+    std::vector<uint8_t> all;
+    for (const std::vector<uint8_t>& part : parts) {
+        all.insert(all.end(), part.begin(), part.end());
+    }
+    return all;
+}
+
+// Feed "data" in segments of the given sizes (the last one takes the rest);
+// true if every byte was consumed
+static bool feed(ModbusTcpServer& server, int client, const std::vector<uint8_t>& data,
+                 std::initializer_list<uint16_t> sizes) {
+    uint16_t offset = 0;
+    for (uint16_t size : sizes) {
+        if (server.receive(client, &data[offset], size) != size) {
+            return false;
+        }
+        offset += size;
+    }
+    return server.receive(client, &data[offset], data.size() - offset) == (int)(data.size() - offset);
+}
+
+int main() {
+    RegisterHandler handler;
+
+    {
+        ModbusTcpServer server(handler);
+        Transport transport;
+        transport.attach(server);
+        int client = server.open_client();
+        std::vector<uint8_t> request = read_request(0x1234, 7, 2, 3);
+        bool ok = server.receive(client, request.data(), request.size()) == (int)request.size();
+        check(ok && transport.replies.size() == 1 && transport.replies[0] == read_reply(0x1234, 7, 2, 3),
+              "whole ADU: reply with transaction and unit ID");
+
+        request = read_request(0x1235, 7, 14, 4);
+        server.receive(client, request.data(), request.size());
+        std::vector<uint8_t> exception = { 0x12, 0x35, 0, 0, 0, 3, 7, 0x83, 0x02 };
+        check(transport.replies.size() == 2 && transport.replies[1] == exception, "exception reply");
+    }
+
+    {
+        ModbusTcpServer server(handler);
+        Transport transport;
+        transport.attach(server);
+        int client = server.open_client();
+        std::vector<uint8_t> request = read_request(1, 1, 0, 2);
+        bool ok = true;
+        for (size_t i = 0; i < request.size(); i++) {
+            ok = ok && server.receive(client, &request[i], 1) == 1;
+            ok = ok && transport.replies.size() == (i + 1 == request.size() ? 1u : 0u);
+        }
+        check(ok && transport.replies[0] == read_reply(1, 1, 0, 2), "split: one byte per segment");
+
+        request = read_request(2, 1, 4, 1);
+        ok = feed(server, client, request, {3});
+        request = read_request(3, 1, 5, 1);
+        ok = ok && feed(server, client, request, {9});
+        check(ok && transport.replies.size() == 3 && transport.replies[1] == read_reply(2, 1, 4, 1) &&
+              transport.replies[2] == read_reply(3, 1, 5, 1), "split: inside the header, inside the PDU");
+    }
+
+    {
+        ModbusTcpServer server(handler);
+        Transport transport;
+        transport.attach(server);
+        int client = server.open_client();
+        std::vector<uint8_t> batch = join({read_request(10, 1, 0, 1), read_request(11, 2, 1, 2),
+                                           read_request(12, 3, 2, 3)});
+        bool ok = server.receive(client, batch.data(), batch.size()) == (int)batch.size();
+        check(ok && transport.replies.size() == 3 && transport.replies[0] == read_reply(10, 1, 0, 1) &&
+              transport.replies[1] == read_reply(11, 2, 1, 2) && transport.replies[2] == read_reply(12, 3, 2, 3) &&
+              server.get_stats().max_pipelined == 3, "pipelined: three ADUs in one segment, in order");
+
+        // 2.5 ADUs, then the rest of the third together with a fourth
+        batch = join({read_request(20, 1, 0, 1), read_request(21, 1, 1, 1), read_request(22, 1, 2, 1),
+                      read_request(23, 1, 3, 1)});
+        ok = feed(server, client, batch, {30});
+        check(ok && transport.replies.size() == 7 && transport.replies[5] == read_reply(22, 1, 2, 1) &&
+              transport.replies[6] == read_reply(23, 1, 3, 1), "pipelined: ADU split across segments");
+    }
+
+    {
+        ModbusTcpServer server(handler);
+        Transport transport;
+        transport.attach(server);
+        int client = server.open_client();
+        std::vector<uint8_t> batch = join({read_request(30, 1, 0, 1), read_request(31, 1, 1, 1),
+                                           read_request(32, 1, 2, 1)});
+
+        // Room for one largest reply: the rest stays unconsumed, nothing is executed twice
+        transport.space = MODBUS_TCP_MAX_ADU_SIZE + 10;
+        int used = server.receive(client, batch.data(), batch.size());
+        bool ok = used == 12 && transport.replies.size() == 1;
+        ok = ok && server.receive(client, &batch[used], batch.size() - used) == 0 && transport.replies.size() == 1;
+        transport.space = 4096;
+        ok = ok && server.resume(client);
+        ok = ok && server.receive(client, &batch[used], batch.size() - used) == (int)batch.size() - used;
+        check(ok && transport.replies.size() == 3 && transport.replies[1] == read_reply(31, 1, 1, 1) &&
+              transport.replies[2] == read_reply(32, 1, 2, 1), "backpressure: whole ADUs offered again");
+
+        // A split ADU is consumed into the client buffer and answered by resume()
+        std::vector<uint8_t> request = read_request(33, 1, 3, 1);
+        transport.space = 0;
+        ok = feed(server, client, request, {5}) && transport.replies.size() == 3;
+        ok = ok && !server.resume(client);
+        transport.space = 4096;
+        ok = ok && server.resume(client);
+        check(ok && transport.replies.size() == 4 && transport.replies[3] == read_reply(33, 1, 3, 1),
+              "backpressure: split ADU held until resume()");
+    }
+
+    {
+        // The first request has run but its reply is lost: the client is dropped and the
+        // pipelined rest is not executed, so a resent write cannot run twice
+        ModbusTcpServer server(handler);
+        Transport transport;
+        transport.attach(server);
+        int client = server.open_client();
+        std::vector<uint8_t> batch = join({read_request(40, 1, 0, 1), read_request(41, 1, 1, 1)});
+        transport.fail = true;
+        uint32_t executed = handler.executed;
+        server.receive(client, batch.data(), batch.size());
+        bool ok = handler.executed == executed + 1 && transport.dropped == client &&
+                  server.get_stats().dropped == 1 && server.get_stats().no_reply == 0;
+        transport.fail = false;
+        ok = ok && server.receive(client, batch.data(), batch.size()) == -1;
+        check(ok && transport.replies.empty() && handler.executed == executed + 1,
+              "failed send: client dropped, nothing more run");
+
+        server.close_client(client);    // What the transport does after the drop
+        client = server.open_client();
+        ok = server.receive(client, batch.data(), batch.size()) == (int)batch.size();
+        check(ok && transport.replies.size() == 2, "failed send: slot reusable");
+    }
+
+    {
+        ModbusTcpServer server(handler);
+        Transport transport;
+        transport.attach(server);
+        int client = server.open_client();
+        std::vector<uint8_t> request = { 0, 1, 0, 0, 0, 2, 1, FC_NO_REPLY };
+        std::vector<uint8_t> batch = join({request, read_request(2, 1, 0, 1)});
+        bool ok = server.receive(client, batch.data(), batch.size()) == (int)batch.size();
+        check(ok && transport.replies.size() == 1 && transport.replies[0] == read_reply(2, 1, 0, 1) &&
+              server.get_stats().no_reply == 1 && server.get_stats().requests == 1, "no reply: next ADU still served");
+    }
+
+    {
+        ModbusTcpServer server(handler);
+        Transport transport;
+        transport.attach(server);
+        int client = server.open_client();
+        std::vector<uint8_t> request = read_request(1, 1, 0, 1);
+        request[2] = 0x01;  // Protocol ID
+        bool ok = server.receive(client, request.data(), request.size()) == -1;
+        server.close_client(client);    // What the transport does on -1
+        client = server.open_client();
+        request = read_request(1, 1, 0, 1);
+        request[5] = 1;     // Length without a PDU
+        ok = ok && feed(server, client, request, {4}) == false;
+        server.close_client(client);
+        client = server.open_client();
+        request = read_request(1, 1, 0, 1);
+        request[4] = 0x01;  // Length beyond the largest PDU
+        ok = ok && server.receive(client, request.data(), request.size()) == -1;
+        check(ok && transport.replies.empty() && server.get_stats().protocol_errors == 3,
+              "bad MBAP header: whole and split");
+
+        server.close_client(client);
+        request = read_request(1, 1, 0, 1);
+        check(server.receive(client, request.data(), request.size()) == -1 && !server.resume(client),
+              "closed client");
+
+        int clients[MODBUS_TCP_MAX_CLIENTS];
+        for (int& c : clients) {
+            c = server.open_client();
+        }
+        check(clients[MODBUS_TCP_MAX_CLIENTS - 1] >= 0 && server.open_client() == -1 &&
+              server.get_stats().rejected == 1, "client slots");
+    }
+
+    printf("%s\n", failures == 0 ? "all passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}